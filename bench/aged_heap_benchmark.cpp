@@ -0,0 +1,99 @@
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocator_policies.h"
+#include "heap_state.h"
+#include "memory_metrics.h"
+
+constexpr double AGED_FILL_RATIO = 0.5;
+
+// Heap aged to HeapState{2 * free_blocks, AGED_FILL_RATIO, free_blocks} before timing.
+// range(0) is the buffer size and range(1) the number of free blocks.
+template <typename Policy> class AgedHeapFixture : public benchmark::Fixture {
+public:
+  void SetUp(benchmark::State &state) override {
+    m_buffer_size = static_cast<size_t>(state.range(0));
+    m_target = {static_cast<size_t>(state.range(1)) * 2, AGED_FILL_RATIO,
+                static_cast<size_t>(state.range(1))};
+
+    m_policy.init(m_buffer_size);
+    m_live = age_heap(m_policy, m_buffer_size, m_target);
+    m_memory.sample(m_policy);
+  }
+
+  void TearDown(benchmark::State &state) override {
+    state.counters["live_blocks"] = static_cast<double>(m_live.size());
+    state.counters["free_blocks"] = static_cast<double>(m_target.free_blocks);
+    m_memory.report(state, m_policy, m_buffer_size, aged_block_size(m_buffer_size, m_target));
+
+    for (void *ptr : m_live) {
+      m_policy.free(ptr);
+    }
+    m_live.clear();
+    m_policy.teardown();
+  }
+
+  void *alloc(size_t size) { return m_policy.alloc(size); }
+
+  void free(void *ptr) { m_policy.free(ptr); }
+
+protected:
+  Policy m_policy;
+  size_t m_buffer_size;
+  HeapState m_target;
+  std::vector<void *> m_live;
+  MemorySampler<Policy> m_memory;
+};
+
+// Buffer sizes from 64KiB to 1GiB, with every free block count the buffer can hold.
+static void aged_heap_args(benchmark::internal::Benchmark *b) {
+  b->ArgNames({"buffer", "free_blocks"});
+  for (int64_t buffer_size = 64 << 10; buffer_size <= int64_t{1} << 30; buffer_size *= 4) {
+    for (int64_t free_blocks : {16, 256, 4096}) {
+      HeapState target{static_cast<size_t>(free_blocks) * 2, AGED_FILL_RATIO,
+                       static_cast<size_t>(free_blocks)};
+      if (aged_state_feasible(static_cast<size_t>(buffer_size), target))
+        b->Args({buffer_size, free_blocks});
+    }
+  }
+}
+
+// Allocate a block of the mean aged size and free it again, the heap state is
+// unchanged between iterations.
+BENCHMARK_TEMPLATE_METHOD_F(AgedHeapFixture, AgedAllocFree)(benchmark::State &state) {
+  size_t size = aged_block_size(this->m_buffer_size, this->m_target);
+  for (auto _ : state) {
+    void *ptr = this->alloc(size);
+    benchmark::DoNotOptimize(ptr);
+    if (ptr)
+      this->free(ptr);
+  }
+  state.SetItemsProcessed(state.iterations() * 2);
+}
+ALLOCATOR_BENCHMARK_INSTANTIATE(AgedHeapFixture, AgedAllocFree, ->Apply(aged_heap_args));
+
+// Replace a random live block with a new one of random size, the heap keeps aging
+// around the target state instead of returning to it.
+BENCHMARK_TEMPLATE_METHOD_F(AgedHeapFixture, AgedChurn)(benchmark::State &state) {
+  std::mt19937 rng(7);
+  size_t mean_size = aged_block_size(this->m_buffer_size, this->m_target);
+  std::uniform_int_distribution<size_t> size_dist(mean_size / 2, mean_size + mean_size / 2);
+
+  for (auto _ : state) {
+    if (!this->m_live.empty()) {
+      std::uniform_int_distribution<size_t> idx_dist(0, this->m_live.size() - 1);
+      size_t idx = idx_dist(rng);
+      this->free(this->m_live[idx]);
+      this->m_live[idx] = this->m_live.back();
+      this->m_live.pop_back();
+    }
+
+    void *ptr = this->alloc(size_dist(rng));
+    if (ptr)
+      this->m_live.push_back(ptr);
+  }
+  state.SetItemsProcessed(state.iterations() * 2);
+}
+ALLOCATOR_BENCHMARK_INSTANTIATE(AgedHeapFixture, AgedChurn, ->Apply(aged_heap_args));
@@ -4,12 +4,7 @@
 #include <benchmark/benchmark.h>
 
 #include "allocator_policies.h"
-
-#define ALLOCATOR_BENCHMARK_INSTANTIATE(fixture, test, ...)                                        \
-  BENCHMARK_TEMPLATE_INSTANTIATE_F(fixture, test, DeadpoolPolicy) __VA_ARGS__;                     \
-  BENCHMARK_TEMPLATE_INSTANTIATE_F(fixture, test, MallocPolicy) __VA_ARGS__;                       \
-  BENCHMARK_TEMPLATE_INSTANTIATE_F(fixture, test, MimallocPolicy) __VA_ARGS__;                     \
-  BENCHMARK_TEMPLATE_INSTANTIATE_F(fixture, test, O1HeapPolicy) __VA_ARGS__;
+#include "memory_metrics.h"
 
 constexpr size_t BUFFER_SIZE = 1024 * 1024;
 
@@ -17,26 +12,38 @@ template <typename Policy> class AllocatorFixture : public benchmark::Fixture {
 public:
   void SetUp(benchmark::State &) override { m_policy.init(BUFFER_SIZE); }
 
-  void TearDown(benchmark::State &) override { m_policy.teardown(); }
+  void TearDown(benchmark::State &state) override {
+    m_memory.report(state, m_policy, BUFFER_SIZE, m_probe_size);
+    m_policy.teardown();
+  }
 
   void *alloc(size_t size) { return m_policy.alloc(size); }
 
   void free(void *ptr) { m_policy.free(ptr); }
 
+  void sample_memory() { m_memory.sample(m_policy); }
+
 protected:
   Policy m_policy;
+  MemorySampler<Policy> m_memory;
+  // Allocation size used for the overhead and usable-at-failure counters.
+  size_t m_probe_size = 64;
 };
 
 // Single allocation benchmark
 BENCHMARK_TEMPLATE_METHOD_F(AllocatorFixture, SingleAlloc)(benchmark::State &state) {
   size_t size = static_cast<size_t>(state.range(0));
+  this->m_probe_size = size;
   for (auto _ : state) {
     void *ptr = this->alloc(size);
     benchmark::DoNotOptimize(ptr);
   }
+  this->sample_memory();
 }
 ALLOCATOR_BENCHMARK_INSTANTIATE(AllocatorFixture,
                                 SingleAlloc, ->RangeMultiplier(4)->Range(16, 4096));
+DEADPOOL_VARIANTS_INSTANTIATE(AllocatorFixture,
+                              SingleAlloc, ->RangeMultiplier(4)->Range(16, 4096));
 
 // Batch allocation benchmark - allocate N objects then free all
 BENCHMARK_TEMPLATE_METHOD_F(AllocatorFixture, BatchAllocFree)(benchmark::State &state) {
@@ -56,6 +63,8 @@ BENCHMARK_TEMPLATE_METHOD_F(AllocatorFixture, BatchAllocFree)(benchmark::State &
 }
 ALLOCATOR_BENCHMARK_INSTANTIATE(AllocatorFixture,
                                 BatchAllocFree, ->RangeMultiplier(4)->Range(16, 256));
+DEADPOOL_VARIANTS_INSTANTIATE(AllocatorFixture,
+                              BatchAllocFree, ->RangeMultiplier(4)->Range(16, 256));
 
 // Mixed workload - allocate/free in random order
 BENCHMARK_TEMPLATE_METHOD_F(AllocatorFixture, MixedWorkload)(benchmark::State &state) {
@@ -77,12 +86,14 @@ BENCHMARK_TEMPLATE_METHOD_F(AllocatorFixture, MixedWorkload)(benchmark::State &s
       live_ptrs.pop_back();
     }
   }
+  this->sample_memory();
 
   for (void *p : live_ptrs) {
     this->free(p);
   }
 }
 ALLOCATOR_BENCHMARK_INSTANTIATE(AllocatorFixture, MixedWorkload);
+DEADPOOL_VARIANTS_INSTANTIATE(AllocatorFixture, MixedWorkload);
 
 // LIFO pattern - stack-like allocation
 BENCHMARK_TEMPLATE_METHOD_F(AllocatorFixture, LifoPattern)(benchmark::State &state) {
@@ -101,6 +112,8 @@ BENCHMARK_TEMPLATE_METHOD_F(AllocatorFixture, LifoPattern)(benchmark::State &sta
 }
 ALLOCATOR_BENCHMARK_INSTANTIATE(AllocatorFixture,
                                 LifoPattern, ->RangeMultiplier(2)->Range(512, 4096));
+DEADPOOL_VARIANTS_INSTANTIATE(AllocatorFixture,
+                              LifoPattern, ->RangeMultiplier(2)->Range(512, 4096));
 
 // FIFO pattern - queue-like allocation (first allocated, first freed)
 BENCHMARK_TEMPLATE_METHOD_F(AllocatorFixture, FifoPattern)(benchmark::State &state) {
@@ -119,6 +132,8 @@ BENCHMARK_TEMPLATE_METHOD_F(AllocatorFixture, FifoPattern)(benchmark::State &sta
 }
 ALLOCATOR_BENCHMARK_INSTANTIATE(AllocatorFixture,
                                 FifoPattern, ->RangeMultiplier(2)->Range(512, 4096));
+DEADPOOL_VARIANTS_INSTANTIATE(AllocatorFixture,
+                              FifoPattern, ->RangeMultiplier(2)->Range(512, 4096));
 
 // Fragmentation stress - create holes by freeing every other block, then allocate
 // varying sizes to stress coalescing and best-fit behavior
@@ -140,6 +155,7 @@ BENCHMARK_TEMPLATE_METHOD_F(AllocatorFixture, FragmentationStress)(benchmark::St
       this->free(ptrs[i]);
       ptrs[i] = nullptr;
     }
+    this->sample_memory();
     state.ResumeTiming();
 
     // Try to allocate larger blocks that require finding/coalescing holes
@@ -1,34 +1,271 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdlib>
-#include <vector>
+#include <memory>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#include <sys/resource.h>
+#endif
 
 #include <mimalloc.h>
 #include <o1heap.h>
 
 extern "C" {
 #include "allocator.h"
+#include "bitmap.h"
+#include "tree.h"
 }
 
+#include "deadpool_variant.h"
+#include "heap.hpp"
+
+#define ALLOCATOR_BENCHMARK_INSTANTIATE(fixture, test, ...)                                        \
+  BENCHMARK_TEMPLATE_INSTANTIATE_F(fixture, test, DeadpoolPolicy) __VA_ARGS__;                     \
+  BENCHMARK_TEMPLATE_INSTANTIATE_F(fixture, test, MallocPolicy) __VA_ARGS__;                       \
+  BENCHMARK_TEMPLATE_INSTANTIATE_F(fixture, test, MimallocPolicy) __VA_ARGS__;                     \
+  BENCHMARK_TEMPLATE_INSTANTIATE_F(fixture, test, O1HeapPolicy) __VA_ARGS__;
+
+// Every deadpool variant, see DeadpoolVariantPolicy.
+#define DEADPOOL_VARIANTS_INSTANTIATE(fixture, test, ...)                                          \
+  BENCHMARK_TEMPLATE_INSTANTIATE_F(fixture, test, DeadpoolDefaultVariant) __VA_ARGS__;             \
+  BENCHMARK_TEMPLATE_INSTANTIATE_F(fixture, test, DeadpoolLogVariant) __VA_ARGS__;                 \
+  BENCHMARK_TEMPLATE_INSTANTIATE_F(fixture, test, DeadpoolStatsVariant) __VA_ARGS__;               \
+  BENCHMARK_TEMPLATE_INSTANTIATE_F(fixture, test, DeadpoolFreeValidationVariant) __VA_ARGS__;      \
+  BENCHMARK_TEMPLATE_INSTANTIATE_F(fixture, test, DeadpoolAllVariant) __VA_ARGS__;                 \
+  BENCHMARK_TEMPLATE_INSTANTIATE_F(fixture, test, DeadpoolAlign8Variant) __VA_ARGS__;              \
+  BENCHMARK_TEMPLATE_INSTANTIATE_F(fixture, test, DeadpoolAlign64Variant) __VA_ARGS__;             \
+  BENCHMARK_TEMPLATE_INSTANTIATE_F(fixture, test, DeadpoolFirstFitVariant) __VA_ARGS__;            \
+  BENCHMARK_TEMPLATE_INSTANTIATE_F(fixture, test, DeadpoolProbeLimit16Variant) __VA_ARGS__;        \
+  BENCHMARK_TEMPLATE_INSTANTIATE_F(fixture, test, DeadpoolSplit64Variant) __VA_ARGS__;             \
+  BENCHMARK_TEMPLATE_INSTANTIATE_F(fixture, test, DeadpoolCanaryVariant) __VA_ARGS__;              \
+  BENCHMARK_TEMPLATE_INSTANTIATE_F(fixture, test, DeadpoolCheckSlice4Variant) __VA_ARGS__;         \
+  BENCHMARK_TEMPLATE_INSTANTIATE_F(fixture, test, DeadpoolFreeIndexVariant) __VA_ARGS__;           \
+  BENCHMARK_TEMPLATE_INSTANTIATE_F(fixture, test, DeadpoolOutOfLineVariant) __VA_ARGS__;           \
+  BENCHMARK_TEMPLATE_INSTANTIATE_F(fixture, test, DeadpoolSizeClassesVariant) __VA_ARGS__;         \
+  BENCHMARK_TEMPLATE_INSTANTIATE_F(fixture, test, DeadpoolSizeClassesInlineVariant) __VA_ARGS__;   \
+  BENCHMARK_TEMPLATE_INSTANTIATE_F(fixture, test, DeadpoolWatermarksVariant) __VA_ARGS__;
+
 #if DP_LOG
 static void noop_log(const char *, ...) {}
 static dp_logger null_logger = {noop_log, noop_log, noop_log, noop_log};
 #endif
 
+// Every policy provides init/alloc/free/teardown. Policies that can report their memory
+// usage also provide (see memory_metrics.h):
+//  capacity()  - bytes the policy can hand out in total, 0 when unbounded.
+//  used()      - bytes currently taken out of capacity, including metadata and padding.
+//  peak_used() - high-water mark of used().
+// and optionally footprint(ptr), the bytes a single allocation takes out of capacity, for
+// policies whose used() can't attribute bytes to individual allocations.
+
+// Buffers are left uninitialised so that large (GiB) arenas don't pay for zero-filling
+// on every fixture SetUp.
 struct DeadpoolPolicy {
-  std::vector<uint8_t> buffer;
+  std::unique_ptr<uint8_t[]> buffer;
   dp_alloc allocator{};
+  size_t peak{};
 
   void init(size_t size) {
-    buffer.resize(size);
-    dp_init(&allocator, buffer.data(), size IF_DP_LOG(, null_logger));
+    buffer = std::make_unique_for_overwrite<uint8_t[]>(size);
+    dp_init(&allocator, buffer.get(), size IF_DP_LOG(, null_logger));
+    peak = used();
   }
 
-  void *alloc(size_t size) { return dp_malloc(&allocator, size); }
+  void *alloc(size_t size) {
+    void *ptr = dp_malloc(&allocator, size);
+    peak = std::max(peak, used());
+    return ptr;
+  }
 
   void free(void *ptr) { dp_free(&allocator, ptr); }
 
-  void teardown() { buffer.clear(); }
+  void teardown() { buffer.reset(); }
+
+  size_t capacity() const { return allocator.buffer_size; }
+
+  size_t used() const { return allocator.buffer_size - allocator.available; }
+
+  size_t peak_used() const { return peak; }
+
+#if DP_STATS
+  // Free blocks probed by the last dp_malloc plus those scanned by the last dp_free.
+  size_t probes() const { return allocator.num_iterations + allocator.num_free_iterations; }
+#endif
+};
+
+// Deadpool built with its own configuration, linked next to the configuration the rest of
+// the benchmark uses (see DP_VARIANTS in bench/CMakeLists.txt). Calls go through the
+// variant's function table, compare variants with DeadpoolDefaultVariant, which pays the
+// same indirection, rather than with DeadpoolPolicy. Inline calls the variant's
+// allocator_inline.h entry points instead of dp_malloc and dp_free.
+template <const DeadpoolVariant &Variant, bool Inline = false> struct DeadpoolVariantPolicy {
+  std::unique_ptr<uint8_t[]> buffer;
+  std::unique_ptr<std::max_align_t[]> instance;
+  size_t buffer_size{};
+  size_t peak{};
+
+  void init(size_t size) {
+    buffer = std::make_unique_for_overwrite<uint8_t[]>(size);
+    instance = std::make_unique<std::max_align_t[]>(
+        (Variant.instance_size + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t));
+    buffer_size = size;
+    Variant.init(instance.get(), buffer.get(), size);
+    peak = used();
+  }
+
+  void *alloc(size_t size) {
+    void *ptr = Inline ? Variant.malloc_inline(instance.get(), size)
+                       : Variant.malloc(instance.get(), size);
+    peak = std::max(peak, used());
+    return ptr;
+  }
+
+  void free(void *ptr) {
+    if (Inline)
+      Variant.free_inline(instance.get(), ptr);
+    else
+      Variant.free(instance.get(), ptr);
+  }
+
+  void *realloc(void *ptr, size_t size) {
+    ptr = Variant.realloc(instance.get(), ptr, size);
+    peak = std::max(peak, used());
+    return ptr;
+  }
+
+  void teardown() {
+    instance.reset();
+    buffer.reset();
+  }
+
+  size_t capacity() const { return buffer_size; }
+
+  size_t used() const { return Variant.used(instance.get()); }
+
+  size_t peak_used() const { return peak; }
+};
+
+using DeadpoolDefaultVariant = DeadpoolVariantPolicy<deadpool_default_variant>;
+using DeadpoolLogVariant = DeadpoolVariantPolicy<deadpool_log_variant>;
+using DeadpoolStatsVariant = DeadpoolVariantPolicy<deadpool_stats_variant>;
+using DeadpoolFreeValidationVariant = DeadpoolVariantPolicy<deadpool_free_validation_variant>;
+using DeadpoolAllVariant = DeadpoolVariantPolicy<deadpool_all_variant>;
+using DeadpoolAlign8Variant = DeadpoolVariantPolicy<deadpool_align8_variant>;
+using DeadpoolAlign64Variant = DeadpoolVariantPolicy<deadpool_align64_variant>;
+using DeadpoolFirstFitVariant = DeadpoolVariantPolicy<deadpool_first_fit_variant>;
+using DeadpoolProbeLimit16Variant = DeadpoolVariantPolicy<deadpool_probe_limit16_variant>;
+using DeadpoolSplit64Variant = DeadpoolVariantPolicy<deadpool_split64_variant>;
+using DeadpoolCanaryVariant = DeadpoolVariantPolicy<deadpool_canary_variant>;
+using DeadpoolCheckSlice4Variant = DeadpoolVariantPolicy<deadpool_check_slice4_variant>;
+using DeadpoolFreeIndexVariant = DeadpoolVariantPolicy<deadpool_free_index_variant>;
+using DeadpoolOutOfLineVariant = DeadpoolVariantPolicy<deadpool_out_of_line_variant>;
+using DeadpoolSizeClassesVariant = DeadpoolVariantPolicy<deadpool_size_classes_variant>;
+using DeadpoolSizeClassesInlineVariant =
+    DeadpoolVariantPolicy<deadpool_size_classes_variant, true>;
+// Not in DEADPOOL_VARIANTS_INSTANTIATE, largest_satisfiable would measure mmap rather than
+// the buffer.
+using DeadpoolHugeVariant = DeadpoolVariantPolicy<deadpool_huge_variant>;
+using DeadpoolWatermarksVariant = DeadpoolVariantPolicy<deadpool_watermarks_variant>;
+
+// Deadpool's granule bitmap engine pinned to one SIMD level, check supported() before
+// measuring, the engine stays on dp_simd_best() when the CPU lacks the level.
+template <dp_simd Simd, size_t Granule = 64> struct DeadpoolBitmapPolicy {
+  std::unique_ptr<uint8_t[]> buffer;
+  dp_bitmap bitmap{};
+  size_t peak{};
+
+  void init(size_t size) {
+    buffer = std::make_unique_for_overwrite<uint8_t[]>(size);
+    dp_bitmap_init(&bitmap, buffer.get(), size, Granule IF_DP_LOG(, null_logger));
+    dp_bitmap_set_simd(&bitmap, Simd);
+    peak = used();
+  }
+
+  bool supported() const { return bitmap.simd == Simd; }
+
+  void *alloc(size_t size) {
+    void *ptr = dp_bitmap_malloc(&bitmap, size);
+    peak = std::max(peak, used());
+    return ptr;
+  }
+
+  void free(void *ptr) { dp_bitmap_free(&bitmap, ptr); }
+
+  void teardown() { buffer.reset(); }
+
+  size_t capacity() const { return bitmap.granules * Granule; }
+
+  size_t used() const { return (bitmap.granules - bitmap.available) * Granule; }
+
+  size_t peak_used() const { return peak; }
+
+#if DP_STATS
+  size_t probes() const { return bitmap.num_iterations; }
+#endif
+};
+
+// Deadpool's segment tree first fit engine.
+template <size_t Granule = 64> struct DeadpoolTreePolicy {
+  std::unique_ptr<uint8_t[]> buffer;
+  dp_tree tree{};
+  size_t peak{};
+
+  void init(size_t size) {
+    buffer = std::make_unique_for_overwrite<uint8_t[]>(size);
+    dp_tree_init(&tree, buffer.get(), size, Granule IF_DP_LOG(, null_logger));
+    peak = used();
+  }
+
+  void *alloc(size_t size) {
+    void *ptr = dp_tree_malloc(&tree, size);
+    peak = std::max(peak, used());
+    return ptr;
+  }
+
+  void free(void *ptr) { dp_tree_free(&tree, ptr); }
+
+  void teardown() { buffer.reset(); }
+
+  size_t capacity() const { return tree.granules * Granule; }
+
+  size_t used() const { return (tree.granules - tree.available) * Granule; }
+
+  size_t peak_used() const { return peak; }
+
+#if DP_STATS
+  size_t probes() const { return tree.num_iterations; }
+#endif
+};
+
+// Deadpool's header only C++ heap, specialised at compile time for Config.
+template <typename Config = dp::default_config> struct DeadpoolHeapPolicy {
+  std::unique_ptr<uint8_t[]> buffer;
+  dp::heap<Config> heap;
+  size_t peak{};
+
+  void init(size_t size) {
+    buffer = std::make_unique_for_overwrite<uint8_t[]>(size);
+    heap.init(buffer.get(), size);
+    peak = used();
+  }
+
+  void *alloc(size_t size) {
+    void *ptr = heap.allocate(size);
+    peak = std::max(peak, used());
+    return ptr;
+  }
+
+  void free(void *ptr) { heap.deallocate(ptr); }
+
+  void teardown() { buffer.reset(); }
+
+  size_t capacity() const { return heap.buffer_size(); }
+
+  size_t used() const { return heap.buffer_size() - heap.available(); }
+
+  size_t peak_used() const { return peak; }
 };
 
 struct MallocPolicy {
@@ -39,6 +276,26 @@ struct MallocPolicy {
   void free(void *ptr) { std::free(ptr); }
 
   void teardown() {}
+
+#ifdef __GLIBC__
+  size_t capacity() const { return 0; }
+
+  size_t used() const {
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+  }
+
+  // Freed chunks parked in the tcache still count as used, so measure allocations directly:
+  // the usable size plus the chunk's size field.
+  size_t footprint(void *ptr) const { return malloc_usable_size(ptr) + sizeof(size_t); }
+
+  // glibc doesn't track a heap high-water mark, the process peak RSS is the closest.
+  size_t peak_used() const {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+  }
+#endif
 };
 
 struct MimallocPolicy {
@@ -52,17 +309,23 @@ struct MimallocPolicy {
 };
 
 struct O1HeapPolicy {
-  std::vector<uint8_t> buffer;
+  std::unique_ptr<uint8_t[]> buffer;
   O1HeapInstance *heap{};
 
   void init(size_t size) {
-    buffer.resize(size);
-    heap = o1heapInit(buffer.data(), size);
+    buffer = std::make_unique_for_overwrite<uint8_t[]>(size);
+    heap = o1heapInit(buffer.get(), size);
   }
 
   void *alloc(size_t size) { return o1heapAllocate(heap, size); }
 
   void free(void *ptr) { o1heapFree(heap, ptr); }
 
-  void teardown() { buffer.clear(); }
+  void teardown() { buffer.reset(); }
+
+  size_t capacity() const { return o1heapGetDiagnostics(heap).capacity; }
+
+  size_t used() const { return o1heapGetDiagnostics(heap).allocated; }
+
+  size_t peak_used() const { return o1heapGetDiagnostics(heap).peak_allocated; }
 };
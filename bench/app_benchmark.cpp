@@ -0,0 +1,423 @@
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocator_policies.h"
+#include "memory_metrics.h"
+#include "policy_allocator.h"
+
+// Application-level benchmarks, small programs running every container allocation
+// through the policy via PolicyAllocator.
+//
+// Each iteration runs the whole program end to end, including destroying what it built.
+// Sizes are kept small enough for deadpool's linear free list search to finish in a
+// reasonable time.
+// Besides throughput every benchmark reports peak_requested, the most bytes the program
+// had allocated at once, next to the policy's own peak_used.
+
+constexpr size_t APP_BUFFER_SIZE = 64 * 1024 * 1024;
+
+template <typename Policy> class AppFixture : public benchmark::Fixture {
+public:
+  void SetUp(benchmark::State &) override { m_policy.init(APP_BUFFER_SIZE); }
+
+  void TearDown(benchmark::State &state) override {
+    state.counters["peak_requested"] =
+        benchmark::Counter(static_cast<double>(m_arena.peak_bytes), benchmark::Counter::kDefaults,
+                           benchmark::Counter::kIs1024);
+    m_memory.report(state, m_policy, APP_BUFFER_SIZE, 64);
+    m_policy.teardown();
+  }
+
+  // Runs one iteration of program(arena), skipping the benchmark if the policy runs out of
+  // memory.
+  template <typename Program> bool run(benchmark::State &state, Program &&program) {
+    try {
+      benchmark::DoNotOptimize(program(m_arena));
+      return true;
+    } catch (const std::bad_alloc &) {
+      state.SkipWithError("allocation failed");
+      return false;
+    }
+  }
+
+protected:
+  Policy m_policy;
+  PolicyArena<Policy> m_arena{m_policy};
+  MemorySampler<Policy> m_memory;
+};
+
+// Lowercase word of 2 to 40 letters, most are longer than the small string buffer.
+static void append_word(std::mt19937 &rng, std::string &out) {
+  std::uniform_int_distribution<size_t> length(2, 40);
+  std::uniform_int_distribution<int> letter('a', 'z');
+  for (size_t i = length(rng); i > 0; i--) {
+    out += static_cast<char>(letter(rng));
+  }
+}
+
+// JSON DOM parse and teardown.
+
+static void append_json_value(std::mt19937 &rng, std::string &out, int depth) {
+  std::uniform_int_distribution<int> kind(0, depth >= 4 ? 3 : 5);
+  std::uniform_int_distribution<int> children(1, 8);
+  switch (kind(rng)) {
+  case 0:
+    out += rng() % 2 ? "true" : "null";
+    break;
+  case 1:
+    out += std::to_string(rng() % 100000) + ".25";
+    break;
+  case 2:
+  case 3:
+    out += '"';
+    append_word(rng, out);
+    out += '"';
+    break;
+  case 4:
+    out += '[';
+    for (int i = children(rng); i > 0; i--) {
+      append_json_value(rng, out, depth + 1);
+      out += i > 1 ? ", " : "";
+    }
+    out += ']';
+    break;
+  default:
+    out += '{';
+    for (int i = children(rng); i > 0; i--) {
+      out += '"';
+      append_word(rng, out);
+      out += "\": ";
+      append_json_value(rng, out, depth + 1);
+      out += i > 1 ? ", " : "";
+    }
+    out += '}';
+    break;
+  }
+}
+
+// Array of records of at least `bytes` characters.
+static const std::string &json_document(size_t bytes) {
+  static std::map<size_t, std::string> documents;
+  std::string &doc = documents[bytes];
+  if (doc.empty()) {
+    std::mt19937 rng(42);
+    doc = "[";
+    while (doc.size() < bytes) {
+      doc += "{\"name\": \"";
+      append_word(rng, doc);
+      doc += "\", \"value\": ";
+      append_json_value(rng, doc, 1);
+      doc += "},\n";
+    }
+    doc += "null]";
+  }
+  return doc;
+}
+
+enum class JsonKind : uint8_t { Null, Bool, Number, String, Array, Object };
+
+// Objects keep their members as children with a key.
+template <typename Policy> struct JsonNode {
+  using String = PolicyString<Policy>;
+
+  explicit JsonNode(const PolicyAllocator<char, Policy> &alloc)
+      : key(alloc), text(alloc), children(alloc) {}
+
+  JsonKind kind = JsonKind::Null;
+  double number = 0;
+  String key;
+  String text;
+  std::vector<JsonNode, PolicyAllocator<JsonNode, Policy>> children;
+};
+
+template <typename Policy> class JsonParser {
+public:
+  using Node = JsonNode<Policy>;
+
+  explicit JsonParser(std::string_view text) : m_text(text) {}
+
+  bool parse(Node &node) {
+    skip_space();
+    if (m_pos >= m_text.size())
+      return false;
+
+    switch (m_text[m_pos]) {
+    case '{':
+      node.kind = JsonKind::Object;
+      return parse_container(node, '}', true);
+    case '[':
+      node.kind = JsonKind::Array;
+      return parse_container(node, ']', false);
+    case '"':
+      node.kind = JsonKind::String;
+      return parse_string(node.text);
+    case 't':
+    case 'f':
+      node.kind = JsonKind::Bool;
+      node.number = m_text[m_pos] == 't';
+      return skip_literal(m_text[m_pos] == 't' ? "true" : "false");
+    case 'n':
+      node.kind = JsonKind::Null;
+      return skip_literal("null");
+    default: {
+      node.kind = JsonKind::Number;
+      auto [end, error] =
+          std::from_chars(m_text.data() + m_pos, m_text.data() + m_text.size(), node.number);
+      m_pos = static_cast<size_t>(end - m_text.data());
+      return error == std::errc{};
+    }
+    }
+  }
+
+private:
+  std::string_view m_text;
+  size_t m_pos = 0;
+
+  void skip_space() {
+    while (m_pos < m_text.size() && (m_text[m_pos] == ' ' || m_text[m_pos] == '\n'))
+      m_pos++;
+  }
+
+  bool skip_literal(std::string_view literal) {
+    if (m_text.substr(m_pos, literal.size()) != literal)
+      return false;
+    m_pos += literal.size();
+    return true;
+  }
+
+  bool parse_string(typename Node::String &out) {
+    m_pos++;
+    size_t end = m_text.find('"', m_pos);
+    if (end == std::string_view::npos)
+      return false;
+    out.assign(m_text.substr(m_pos, end - m_pos));
+    m_pos = end + 1;
+    return true;
+  }
+
+  bool parse_container(Node &node, char close, bool keyed) {
+    m_pos++;
+    skip_space();
+    if (m_pos < m_text.size() && m_text[m_pos] == close) {
+      m_pos++;
+      return true;
+    }
+
+    for (;;) {
+      Node &child = node.children.emplace_back(node.children.get_allocator());
+      if (keyed) {
+        skip_space();
+        if (!parse_string(child.key))
+          return false;
+        skip_space();
+        if (m_pos >= m_text.size() || m_text[m_pos++] != ':')
+          return false;
+      }
+      if (!parse(child))
+        return false;
+
+      skip_space();
+      if (m_pos >= m_text.size())
+        return false;
+      char c = m_text[m_pos++];
+      if (c == close)
+        return true;
+      if (c != ',')
+        return false;
+    }
+  }
+};
+
+
+template <typename Policy> static size_t count_nodes(const JsonNode<Policy> &node) {
+  size_t count = 1;
+  for (const JsonNode<Policy> &child : node.children) {
+    count += count_nodes(child);
+  }
+  return count;
+}
+
+// Parses the document into a DOM and returns the number of nodes, 0 if it's invalid.
+template <typename Policy> size_t json_dom(PolicyArena<Policy> &arena, std::string_view doc) {
+  JsonNode<Policy> root{PolicyAllocator<char, Policy>(arena)};
+  JsonParser<Policy> parser(doc);
+  return parser.parse(root) ? count_nodes(root) : 0;
+}
+
+// range(0) is the document size in KiB.
+BENCHMARK_TEMPLATE_METHOD_F(AppFixture, JsonDom)(benchmark::State &state) {
+  const std::string &doc = json_document(static_cast<size_t>(state.range(0)) * 1024);
+  for (auto _ : state) {
+    if (!this->run(state, [&](auto &arena) { return json_dom(arena, doc); }))
+      break;
+  }
+
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(doc.size()));
+}
+ALLOCATOR_BENCHMARK_INSTANTIATE(AppFixture, JsonDom, ->ArgName("KiB")->Arg(16)->Arg(128));
+
+// String-heavy tokenizer.
+
+static const std::string &tokenizer_text(size_t bytes) {
+  static std::map<size_t, std::string> texts;
+  std::string &text = texts[bytes];
+  if (text.empty()) {
+    std::mt19937 rng(7);
+    // Zipf-like word frequencies over a fixed vocabulary, so words repeat the way they do
+    // in real text.
+    std::vector<std::string> vocabulary(4096);
+    for (std::string &word : vocabulary) {
+      append_word(rng, word);
+    }
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    const char *separators[] = {" ", " ", " ", ", ", ". ", "\n"};
+    while (text.size() < bytes) {
+      auto rank = static_cast<size_t>(std::pow((double)vocabulary.size(), uniform(rng)));
+      text += vocabulary[rank - 1];
+      text += separators[rng() % std::size(separators)];
+    }
+  }
+  return text;
+}
+
+template <typename Policy> struct PolicyStringHash {
+  size_t operator()(const PolicyString<Policy> &s) const {
+    return std::hash<std::string_view>{}(s);
+  }
+};
+
+// Splits the text into words, counts them in a hash map and joins the distinct words back
+// into one growing string. Returns the number of words.
+template <typename Policy> size_t tokenize(PolicyArena<Policy> &arena, std::string_view text) {
+  using String = PolicyString<Policy>;
+  PolicyAllocator<char, Policy> alloc(arena);
+
+  std::vector<String, PolicyAllocator<String, Policy>> words(alloc);
+  for (size_t pos = 0; pos < text.size();) {
+    size_t end = std::min(text.find_first_of(" ,.\n", pos), text.size());
+    if (end > pos)
+      words.emplace_back(text.substr(pos, end - pos), alloc);
+    pos = end + 1;
+  }
+
+  std::unordered_map<String, uint32_t, PolicyStringHash<Policy>, std::equal_to<String>,
+                     PolicyAllocator<std::pair<const String, uint32_t>, Policy>>
+      counts(64, PolicyStringHash<Policy>{}, std::equal_to<String>{}, alloc);
+  for (const String &word : words) {
+    counts[word]++;
+  }
+
+  String joined(alloc);
+  for (const auto &[word, count] : counts) {
+    joined += word;
+    joined += ' ';
+  }
+  benchmark::DoNotOptimize(joined.data());
+  return words.size();
+}
+
+// range(0) is the text size in KiB.
+BENCHMARK_TEMPLATE_METHOD_F(AppFixture, Tokenizer)(benchmark::State &state) {
+  const std::string &text = tokenizer_text(static_cast<size_t>(state.range(0)) * 1024);
+  for (auto _ : state) {
+    if (!this->run(state, [&](auto &arena) { return tokenize(arena, text); }))
+      break;
+  }
+
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(text.size()));
+}
+ALLOCATOR_BENCHMARK_INSTANTIATE(AppFixture, Tokenizer, ->ArgName("KiB")->Arg(64)->Arg(1024));
+
+// Ordered map churn: fills a map with `keys` random keys, then replaces the key after a
+// random one with a new random key 4 * `keys` times. Returns the final size.
+template <typename Policy> size_t map_churn(PolicyArena<Policy> &arena, size_t keys) {
+  using Map = std::map<uint64_t, uint64_t, std::less<>,
+                       PolicyAllocator<std::pair<const uint64_t, uint64_t>, Policy>>;
+  std::mt19937_64 rng(42);
+  Map map{typename Map::allocator_type(arena)};
+  while (map.size() < keys) {
+    map.emplace(rng(), 0);
+  }
+  for (size_t i = 0; i < keys * 4; i++) {
+    auto it = map.lower_bound(rng());
+    map.erase(it == map.end() ? map.begin() : it);
+    map.emplace(rng(), i);
+  }
+  return map.size();
+}
+
+// range(0) is the number of keys.
+BENCHMARK_TEMPLATE_METHOD_F(AppFixture, OrderedMapChurn)(benchmark::State &state) {
+  size_t keys = static_cast<size_t>(state.range(0));
+  for (auto _ : state) {
+    if (!this->run(state, [&](auto &arena) { return map_churn(arena, keys); }))
+      break;
+  }
+
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(keys * 5));
+}
+ALLOCATOR_BENCHMARK_INSTANTIATE(AppFixture, OrderedMapChurn,
+                                ->ArgName("keys")->RangeMultiplier(8)->Range(1 << 9, 1 << 12));
+
+constexpr size_t GRAPH_DEGREE = 8;
+
+// Graph build and BFS: `vertices` vertices with GRAPH_DEGREE random out-edges each on
+// average, adjacency lists grow edge by edge. Returns the number of vertices a
+// breadth-first search from vertex 0 reaches.
+template <typename Policy> size_t graph_bfs(PolicyArena<Policy> &arena, uint32_t vertices) {
+  using Edges = std::vector<uint32_t, PolicyAllocator<uint32_t, Policy>>;
+  PolicyAllocator<uint32_t, Policy> alloc(arena);
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<uint32_t> vertex(0, vertices - 1);
+
+  std::vector<Edges, PolicyAllocator<Edges, Policy>> graph(alloc);
+  graph.reserve(vertices);
+  for (uint32_t v = 0; v < vertices; v++) {
+    graph.emplace_back(alloc);
+  }
+  for (size_t e = 0; e < vertices * GRAPH_DEGREE; e++) {
+    graph[vertex(rng)].push_back(vertex(rng));
+  }
+
+  std::vector<uint32_t, PolicyAllocator<uint32_t, Policy>> distance(vertices, UINT32_MAX, alloc);
+  std::deque<uint32_t, PolicyAllocator<uint32_t, Policy>> queue(alloc);
+  size_t reached = 0;
+  distance[0] = 0;
+  queue.push_back(0);
+  while (!queue.empty()) {
+    uint32_t v = queue.front();
+    queue.pop_front();
+    reached++;
+    for (uint32_t next : graph[v]) {
+      if (distance[next] == UINT32_MAX) {
+        distance[next] = distance[v] + 1;
+        queue.push_back(next);
+      }
+    }
+  }
+  return reached;
+}
+
+// range(0) is the number of vertices.
+BENCHMARK_TEMPLATE_METHOD_F(AppFixture, GraphBfs)(benchmark::State &state) {
+  auto vertices = static_cast<uint32_t>(state.range(0));
+  for (auto _ : state) {
+    if (!this->run(state, [&](auto &arena) { return graph_bfs(arena, vertices); }))
+      break;
+  }
+
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(vertices * GRAPH_DEGREE));
+}
+ALLOCATOR_BENCHMARK_INSTANTIATE(AppFixture, GraphBfs,
+                                ->ArgName("vertices")->RangeMultiplier(8)->Range(1 << 9, 1 << 12));
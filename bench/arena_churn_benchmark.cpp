@@ -0,0 +1,152 @@
+#include <cstdlib>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocator_policies.h"
+
+// Lifecycle cost of short-lived arenas, one per request or task.
+//
+// Every iteration sets an arena up on the thread's buffer, allocates a request's worth of
+// objects from it and throws the whole arena away. Arenas are compared with a pmr
+// monotonic resource over the same buffer and with malloc per object followed by freeing
+// everything. instance_bytes is the arena's own bookkeeping, outside the buffer.
+
+// Objects per request are BUFFER / REQUEST_BYTES_PER_OBJECT, sized 16 to 256 bytes.
+constexpr size_t REQUEST_BYTES_PER_OBJECT = 256;
+constexpr size_t REQUEST_MIN_OBJECT = 16;
+constexpr size_t REQUEST_MAX_OBJECT = 256;
+
+struct DeadpoolArena {
+  static constexpr size_t instance_bytes = sizeof(dp_alloc);
+  dp_alloc allocator;
+
+  bool begin(void *buffer, size_t size) {
+    return dp_init(&allocator, buffer, size IF_DP_LOG(, null_logger));
+  }
+
+  void *alloc(size_t size) { return dp_malloc(&allocator, size); }
+
+  // Nothing to release, the next dp_init reclaims the buffer.
+  void end() {}
+};
+
+struct PmrMonotonicArena {
+  static constexpr size_t instance_bytes = sizeof(std::pmr::monotonic_buffer_resource);
+  std::optional<std::pmr::monotonic_buffer_resource> resource;
+
+  bool begin(void *buffer, size_t size) {
+    resource.emplace(buffer, size, std::pmr::null_memory_resource());
+    return true;
+  }
+
+  void *alloc(size_t size) {
+    try {
+      return resource->allocate(size, alignof(max_align_t));
+    } catch (const std::bad_alloc &) {
+      return nullptr;
+    }
+  }
+
+  void end() { resource.reset(); }
+};
+
+// No buffer, every object is its own malloc and the arena keeps a list to free them all.
+struct MallocFreeAllArena {
+  static constexpr size_t instance_bytes = sizeof(std::vector<void *>);
+  std::vector<void *> objects;
+
+  bool begin(void *, size_t) { return true; }
+
+  void *alloc(size_t size) {
+    void *ptr = std::malloc(size);
+    if (ptr)
+      objects.push_back(ptr);
+    return ptr;
+  }
+
+  void end() {
+    for (void *ptr : objects) {
+      std::free(ptr);
+    }
+    objects.clear();
+  }
+};
+
+// range(0) is the arena buffer size, every thread churns arenas on its own buffer.
+static void arena_churn_args(benchmark::internal::Benchmark *b) {
+  b->ArgName("buffer")->RangeMultiplier(16)->Range(4 << 10, 1 << 20);
+  b->ThreadRange(1, 8)->UseRealTime();
+}
+
+// Arena setup and teardown alone, the floor of a request's allocation cost.
+template <typename Arena> static void ArenaInit(benchmark::State &state) {
+  size_t buffer_size = static_cast<size_t>(state.range(0));
+  auto buffer = std::make_unique_for_overwrite<uint8_t[]>(buffer_size);
+  Arena arena;
+
+  for (auto _ : state) {
+    if (!arena.begin(buffer.get(), buffer_size)) {
+      state.SkipWithError("arena setup failed");
+      break;
+    }
+    benchmark::DoNotOptimize(arena);
+    arena.end();
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  state.counters["instance_bytes"] = benchmark::Counter(
+      static_cast<double>(Arena::instance_bytes), benchmark::Counter::kAvgThreads);
+}
+BENCHMARK_TEMPLATE(ArenaInit, DeadpoolArena)->Apply(arena_churn_args);
+BENCHMARK_TEMPLATE(ArenaInit, PmrMonotonicArena)->Apply(arena_churn_args);
+BENCHMARK_TEMPLATE(ArenaInit, MallocFreeAllArena)->Apply(arena_churn_args);
+
+// Full request lifecycle: setup, allocating and touching the request's objects, teardown.
+// Items are arenas, so items_per_second is requests served per second.
+template <typename Arena> static void ArenaChurn(benchmark::State &state) {
+  size_t buffer_size = static_cast<size_t>(state.range(0));
+  auto buffer = std::make_unique_for_overwrite<uint8_t[]>(buffer_size);
+  Arena arena;
+
+  std::mt19937 rng(static_cast<uint32_t>(state.thread_index()));
+  std::uniform_int_distribution<size_t> size_dist(REQUEST_MIN_OBJECT, REQUEST_MAX_OBJECT);
+  std::vector<size_t> sizes(buffer_size / REQUEST_BYTES_PER_OBJECT);
+  for (size_t &size : sizes) {
+    size = size_dist(rng);
+  }
+
+  for (auto _ : state) {
+    if (!arena.begin(buffer.get(), buffer_size)) {
+      state.SkipWithError("arena setup failed");
+      break;
+    }
+    bool failed = false;
+    for (size_t size : sizes) {
+      auto *ptr = static_cast<uint8_t *>(arena.alloc(size));
+      if (!ptr) {
+        failed = true;
+        break;
+      }
+      ptr[0] = 1;
+    }
+    arena.end();
+    if (failed) {
+      state.SkipWithError("allocation failed");
+      break;
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  state.counters["objects"] =
+      benchmark::Counter(static_cast<double>(sizes.size()), benchmark::Counter::kAvgThreads);
+  state.counters["instance_bytes"] = benchmark::Counter(
+      static_cast<double>(Arena::instance_bytes), benchmark::Counter::kAvgThreads);
+}
+BENCHMARK_TEMPLATE(ArenaChurn, DeadpoolArena)->Apply(arena_churn_args);
+BENCHMARK_TEMPLATE(ArenaChurn, PmrMonotonicArena)->Apply(arena_churn_args);
+BENCHMARK_TEMPLATE(ArenaChurn, MallocFreeAllArena)->Apply(arena_churn_args);
@@ -0,0 +1,79 @@
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocator_policies.h"
+#include "heap_state.h"
+
+// The granule bitmap engine against the free list engine on highly fragmented heaps.
+//
+// Heaps are aged to HeapState{2 * holes, BITMAP_FILL_RATIO, holes}, range(0) is the hole
+// count. Every iteration allocates and frees one block:
+//  FragmentedMiss - twice the mean block size, no hole fits so the search crosses the heap.
+//  FragmentedHit  - a quarter of the mean block size, most holes fit.
+// The bitmap engine runs on every SIMD level the CPU supports, levels it lacks are skipped.
+
+constexpr size_t BITMAP_BUFFER_SIZE = 16 << 20;
+constexpr double BITMAP_FILL_RATIO = 0.5;
+
+template <typename Policy>
+static void fragmented_alloc_free(benchmark::State &state, double size_factor) {
+  size_t holes = static_cast<size_t>(state.range(0));
+  HeapState target{holes * 2, BITMAP_FILL_RATIO, holes};
+
+  Policy policy;
+  policy.init(BITMAP_BUFFER_SIZE);
+  if constexpr (requires { policy.supported(); }) {
+    if (!policy.supported()) {
+      state.SkipWithError("SIMD level not supported on this CPU");
+      policy.teardown();
+      return;
+    }
+  }
+  std::vector<void *> live = age_heap(policy, BITMAP_BUFFER_SIZE, target);
+  size_t size = static_cast<size_t>(
+      static_cast<double>(aged_block_size(BITMAP_BUFFER_SIZE, target)) * size_factor);
+
+  size_t max_probes = 0;
+  for (auto _ : state) {
+    void *ptr = policy.alloc(size);
+    if (ptr == nullptr) {
+      state.SkipWithError("allocation failed");
+      break;
+    }
+    if constexpr (requires { policy.probes(); })
+      max_probes = std::max(max_probes, policy.probes());
+    policy.free(ptr);
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  state.counters["size"] = static_cast<double>(size);
+  if constexpr (requires { policy.probes(); })
+    state.counters["max_probes"] = static_cast<double>(max_probes);
+  for (void *ptr : live) {
+    policy.free(ptr);
+  }
+  policy.teardown();
+}
+
+template <typename Policy> static void FragmentedMiss(benchmark::State &state) {
+  fragmented_alloc_free<Policy>(state, 2.0);
+}
+
+template <typename Policy> static void FragmentedHit(benchmark::State &state) {
+  fragmented_alloc_free<Policy>(state, 0.25);
+}
+
+static void bitmap_args(benchmark::internal::Benchmark *b) {
+  b->ArgName("holes")->RangeMultiplier(4)->Range(64, 4096);
+}
+
+#define BITMAP_BENCHMARK(test)                                                                     \
+  BENCHMARK_TEMPLATE(test, DeadpoolPolicy)->Apply(bitmap_args);                                    \
+  BENCHMARK_TEMPLATE(test, DeadpoolBitmapPolicy<DP_SIMD_SCALAR>)->Apply(bitmap_args);              \
+  BENCHMARK_TEMPLATE(test, DeadpoolBitmapPolicy<DP_SIMD_SSE2>)->Apply(bitmap_args);                \
+  BENCHMARK_TEMPLATE(test, DeadpoolBitmapPolicy<DP_SIMD_AVX2>)->Apply(bitmap_args);                \
+  BENCHMARK_TEMPLATE(test, DeadpoolBitmapPolicy<DP_SIMD_NEON>)->Apply(bitmap_args)
+
+BITMAP_BENCHMARK(FragmentedMiss);
+BITMAP_BENCHMARK(FragmentedHit);
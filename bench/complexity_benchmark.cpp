@@ -0,0 +1,63 @@
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocator_policies.h"
+#include "heap_state.h"
+
+// Cost curves of alloc/free against the number of free blocks, fitted with
+// Google Benchmark's Complexity(). The declared bounds are enforced by
+// test/complexity_test.cpp, these runs show the measured curve for every policy.
+
+constexpr size_t COMPLEXITY_BUFFER_SIZE = 64 * 1024 * 1024;
+constexpr size_t COMPLEXITY_BLOCK_SIZE = 128;
+
+// range(0) free blocks between 2 * range(0) live blocks of COMPLEXITY_BLOCK_SIZE bytes.
+template <typename Policy> class ComplexityFixture : public benchmark::Fixture {
+public:
+  void SetUp(benchmark::State &state) override {
+    size_t free_blocks = static_cast<size_t>(state.range(0));
+    HeapState target{free_blocks * 2,
+                     static_cast<double>(free_blocks * 2 * COMPLEXITY_BLOCK_SIZE) /
+                         COMPLEXITY_BUFFER_SIZE,
+                     free_blocks};
+
+    m_policy.init(COMPLEXITY_BUFFER_SIZE);
+    m_live = age_heap(m_policy, COMPLEXITY_BUFFER_SIZE, target);
+  }
+
+  void TearDown(benchmark::State &) override {
+    for (void *ptr : m_live) {
+      m_policy.free(ptr);
+    }
+    m_live.clear();
+    m_policy.teardown();
+  }
+
+protected:
+  Policy m_policy;
+  std::vector<void *> m_live;
+};
+
+// Request larger than every hole, so a best-fit search has to look at all of them.
+BENCHMARK_TEMPLATE_METHOD_F(ComplexityFixture, AllocFreeVsFreeBlocks)(benchmark::State &state) {
+  size_t probes = 0;
+  for (auto _ : state) {
+    void *ptr = this->m_policy.alloc(COMPLEXITY_BLOCK_SIZE * 4);
+    benchmark::DoNotOptimize(ptr);
+    if constexpr (requires { this->m_policy.probes(); })
+      probes += this->m_policy.probes();
+    this->m_policy.free(ptr);
+    if constexpr (requires { this->m_policy.probes(); })
+      probes += this->m_policy.probes();
+  }
+
+  state.SetComplexityN(state.range(0));
+  if constexpr (requires { this->m_policy.probes(); })
+    state.counters["probes"] = benchmark::Counter(static_cast<double>(probes),
+                                                  benchmark::Counter::kAvgIterations);
+}
+ALLOCATOR_BENCHMARK_INSTANTIATE(ComplexityFixture, AllocFreeVsFreeBlocks,
+                                ->RangeMultiplier(4)
+                                    ->Range(16, 16384)
+                                    ->Complexity());
@@ -0,0 +1,128 @@
+#include <memory>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocator_policies.h"
+#include "compose.hpp"
+#include "workload.h"
+
+// Composed allocators against one monolithic heap over the mixed size workloads of
+// WORKLOAD_PROFILES, every policy holding COMPOSE_BUFFER_SIZE bytes in total.
+//
+//  DeadpoolPolicy           - one dp_alloc over the whole buffer.
+//  DeadpoolHeapPolicy<>     - one dp::heap over the whole buffer.
+//  ComposedPolicy           - dp::stats over a segregator at 256 bytes: a pool per 16 byte
+//                             size class falling back to a small heap, then a heap for the
+//                             rest falling back to mmap. Resolved at compile time.
+//  ComposedVtablePolicy     - the same shape through compose.h, with a 16 byte granule
+//                             bitmap in place of the pools.
+
+constexpr size_t COMPOSE_BUFFER_SIZE = 32 * 1024 * 1024;
+constexpr size_t COMPOSE_THRESHOLD = 256;
+constexpr size_t COMPOSE_POOL_SIZE = 512 * 1024;
+constexpr size_t COMPOSE_OVERFLOW_SIZE = 2 * 1024 * 1024;
+
+using ComposeSmallPools = dp::bucketizer<dp::pool, 0, COMPOSE_THRESHOLD, 16>;
+using ComposeAllocator =
+    dp::stats<dp::segregator<COMPOSE_THRESHOLD, dp::fallback<ComposeSmallPools, dp::heap<>>,
+                             dp::fallback<dp::heap<>, dp::mmap_allocator>>>;
+
+constexpr size_t COMPOSE_SMALL_SIZE =
+    ComposeSmallPools::count * COMPOSE_POOL_SIZE + COMPOSE_OVERFLOW_SIZE;
+
+struct ComposedPolicy {
+  std::unique_ptr<uint8_t[]> buffer;
+  std::unique_ptr<ComposeAllocator> allocator;
+
+  void init(size_t size) {
+    buffer = std::make_unique_for_overwrite<uint8_t[]>(size);
+    allocator = std::make_unique<ComposeAllocator>();
+    auto &small = allocator->inner.small;
+    for (size_t i = 0; i < ComposeSmallPools::count; i++) {
+      small.primary.buckets[i].init(buffer.get() + i * COMPOSE_POOL_SIZE, COMPOSE_POOL_SIZE,
+                                    ComposeSmallPools::bucket_size(i));
+    }
+    small.secondary.init(buffer.get() + COMPOSE_SMALL_SIZE - COMPOSE_OVERFLOW_SIZE,
+                         COMPOSE_OVERFLOW_SIZE);
+    allocator->inner.large.primary.init(buffer.get() + COMPOSE_SMALL_SIZE,
+                                        size - COMPOSE_SMALL_SIZE);
+  }
+
+  void *alloc(size_t size) { return allocator->allocate(size); }
+
+  void free(void *ptr) { allocator->deallocate(ptr); }
+
+  void teardown() {
+    allocator.reset();
+    buffer.reset();
+  }
+};
+
+struct ComposedVtablePolicy {
+  std::unique_ptr<uint8_t[]> buffer;
+  dp_bitmap pools{};
+  dp_alloc overflow{};
+  dp_alloc large{};
+  dp_fallback small_fallback{};
+  dp_fallback large_fallback{};
+  dp_segregator segregator{};
+  dp_stats stats{};
+  dp_allocator allocator{};
+
+  void init(size_t size) {
+    buffer = std::make_unique_for_overwrite<uint8_t[]>(size);
+    size_t pools_size = COMPOSE_SMALL_SIZE - COMPOSE_OVERFLOW_SIZE;
+    dp_bitmap_init(&pools, buffer.get(), pools_size, 16 IF_DP_LOG(, null_logger));
+    dp_init(&overflow, buffer.get() + pools_size, COMPOSE_OVERFLOW_SIZE IF_DP_LOG(, null_logger));
+    dp_init(&large, buffer.get() + COMPOSE_SMALL_SIZE,
+            size - COMPOSE_SMALL_SIZE IF_DP_LOG(, null_logger));
+    small_fallback = {dp_bitmap_allocator(&pools), dp_heap_allocator(&overflow)};
+    large_fallback = {dp_heap_allocator(&large), dp_mmap_allocator()};
+    segregator = {COMPOSE_THRESHOLD, dp_fallback_allocator(&small_fallback),
+                  dp_fallback_allocator(&large_fallback)};
+    stats = {};
+    stats.inner = dp_segregator_allocator(&segregator);
+    allocator = dp_stats_allocator(&stats);
+  }
+
+  void *alloc(size_t size) { return dp_allocator_malloc(allocator, size); }
+
+  void free(void *ptr) { dp_allocator_free(allocator, ptr); }
+
+  void teardown() { buffer.reset(); }
+};
+
+// Replays the trace of WORKLOAD_PROFILES[range(0)].
+template <typename Policy> static void ComposeReplay(benchmark::State &state) {
+  static const std::vector<Trace> traces = [] {
+    std::vector<Trace> all;
+    for (const WorkloadProfile *profile : WORKLOAD_PROFILES) {
+      all.push_back(generate_trace(*profile));
+    }
+    return all;
+  }();
+  const Trace &trace = traces[state.range(0)];
+  std::vector<void *> slots(trace.slots, nullptr);
+  Policy policy;
+  policy.init(COMPOSE_BUFFER_SIZE);
+  state.SetLabel(WORKLOAD_PROFILES[state.range(0)]->name);
+
+  size_t failed = 0;
+  for (auto _ : state) {
+    failed += replay_trace(policy, trace, slots);
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(trace.ops.size()));
+  state.counters["failed_allocs"] =
+      benchmark::Counter(static_cast<double>(failed), benchmark::Counter::kAvgIterations);
+  policy.teardown();
+}
+
+#define COMPOSE_BENCHMARK_POLICIES(benchmark_fn, ...)                                              \
+  BENCHMARK_TEMPLATE(benchmark_fn, DeadpoolPolicy) __VA_ARGS__;                                    \
+  BENCHMARK_TEMPLATE(benchmark_fn, DeadpoolHeapPolicy<>) __VA_ARGS__;                              \
+  BENCHMARK_TEMPLATE(benchmark_fn, ComposedPolicy) __VA_ARGS__;                                    \
+  BENCHMARK_TEMPLATE(benchmark_fn, ComposedVtablePolicy) __VA_ARGS__;
+
+COMPOSE_BENCHMARK_POLICIES(ComposeReplay,
+                           ->ArgName("profile")->DenseRange(0, WORKLOAD_PROFILES.size() - 1));
@@ -0,0 +1,73 @@
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocator_policies.h"
+#include "perf_trace.hpp"
+
+// Replays the performance regression corpus (test/perf_corpus) against every policy.
+//
+// The corpus holds traces the performance fuzz targets in test/allocator_fuzz.cpp found to
+// maximise deadpool's probe counts or fragmentation, one benchmark is registered per trace
+// and policy as CorpusReplay<Policy>/<trace name>. Traces are replayed on a buffer of the
+// size they were found on.
+
+#ifndef DP_PERF_CORPUS_DIR
+#define DP_PERF_CORPUS_DIR "test/perf_corpus"
+#endif
+
+constexpr size_t CORPUS_BUFFER_SIZE = 64 * 1024;
+
+template <typename Policy>
+static void corpus_replay(benchmark::State &state, const PerfTrace &trace) {
+  Policy policy;
+  policy.init(CORPUS_BUFFER_SIZE);
+
+  size_t failed = 0;
+  size_t max_probes = 0;
+  for (auto _ : state) {
+    failed = 0;
+    std::vector<void *> live = run_perf_trace(
+        trace, [&](size_t size) { return policy.alloc(size); },
+        [&](void *ptr) { policy.free(ptr); },
+        [&](const PerfOp &op, void *ptr) {
+          failed += op.is_alloc && !ptr;
+          if constexpr (requires { policy.probes(); })
+            max_probes = std::max(max_probes, policy.probes());
+        });
+
+    state.PauseTiming();
+    for (void *ptr : live) {
+      policy.free(ptr);
+    }
+    state.ResumeTiming();
+  }
+
+  state.counters["failed_allocs"] = static_cast<double>(failed);
+  if constexpr (requires { policy.probes(); })
+    state.counters["max_probes"] = static_cast<double>(max_probes);
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(trace.size()));
+  policy.teardown();
+}
+
+template <typename Policy> static void register_corpus(const char *policy_name) {
+  for (const auto &path : perf_corpus_files(DP_PERF_CORPUS_DIR)) {
+    PerfTrace trace;
+    if (!read_perf_trace(path, trace))
+      continue;
+    std::string name = std::string("CorpusReplay<") + policy_name + ">/" + path.stem().string();
+    benchmark::RegisterBenchmark(name.c_str(),
+                                 [trace = std::move(trace)](benchmark::State &state) {
+                                   corpus_replay<Policy>(state, trace);
+                                 });
+  }
+}
+
+[[maybe_unused]] static const bool corpus_registered = [] {
+  register_corpus<DeadpoolPolicy>("DeadpoolPolicy");
+  register_corpus<MallocPolicy>("MallocPolicy");
+  register_corpus<MimallocPolicy>("MimallocPolicy");
+  register_corpus<O1HeapPolicy>("O1HeapPolicy");
+  return true;
+}();
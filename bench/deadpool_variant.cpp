@@ -0,0 +1,71 @@
+#include <new>
+
+#include "allocator.h"
+#include "allocator_inline.h"
+#include "deadpool_variant.h"
+
+// Compiled once per variant against that variant's config_macros.h, which renames
+// everything allocator.h declares to the variant's prefixed symbols.
+
+#ifndef DP_VARIANT
+#error "DP_VARIANT must name the variant being built"
+#endif
+
+#define DP_VARIANT_OBJECT(name) DP_VARIANT_OBJECT_(name)
+#define DP_VARIANT_OBJECT_(name) deadpool_##name##_variant
+
+namespace {
+
+#if DP_LOG
+void noop_log(const char *, ...) {}
+#endif
+
+#if DP_WATERMARKS
+void noop_watermark(dp_alloc *, dp_watermark, bool, size_t, void *) {}
+#endif
+
+bool variant_init(void *instance, void *buffer, size_t size) {
+  auto *allocator = new (instance) dp_alloc{};
+  if (!dp_init(allocator, buffer,
+               size IF_DP_LOG(, dp_logger{noop_log, noop_log, noop_log, noop_log})))
+    return false;
+#if DP_WATERMARKS
+  // Armed, so the compares run against real bounds and crossings pay for their callbacks.
+  dp_set_watermark(allocator, DP_WATERMARK_AVAILABLE, size / 8, size / 4, noop_watermark,
+                   nullptr);
+  dp_set_watermark(allocator, DP_WATERMARK_LARGEST, size / 16, size / 8, noop_watermark,
+                   nullptr);
+#endif
+  return true;
+}
+
+void *variant_malloc(void *instance, size_t size) {
+  return dp_malloc(static_cast<dp_alloc *>(instance), size);
+}
+
+int variant_free(void *instance, void *ptr) {
+  return dp_free(static_cast<dp_alloc *>(instance), ptr);
+}
+
+void *variant_malloc_inline(void *instance, size_t size) {
+  return dp_malloc_inline(static_cast<dp_alloc *>(instance), size);
+}
+
+int variant_free_inline(void *instance, void *ptr) {
+  return dp_free_inline(static_cast<dp_alloc *>(instance), ptr);
+}
+
+void *variant_realloc(void *instance, void *ptr, size_t size) {
+  return dp_realloc(static_cast<dp_alloc *>(instance), ptr, size);
+}
+
+size_t variant_used(const void *instance) {
+  const auto *allocator = static_cast<const dp_alloc *>(instance);
+  return allocator->buffer_size - allocator->available;
+}
+
+} // namespace
+
+extern const DeadpoolVariant DP_VARIANT_OBJECT(DP_VARIANT) = {
+    sizeof(dp_alloc),    variant_init,    variant_malloc, variant_free, variant_malloc_inline,
+    variant_free_inline, variant_realloc, variant_used};
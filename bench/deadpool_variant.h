@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+
+// Type-erased entry points of a deadpool build compiled with its own configuration and
+// symbol prefix, see DP_VARIANTS in bench/CMakeLists.txt. The instance is an opaque block of
+// instance_size bytes, aligned for max_align_t.
+struct DeadpoolVariant {
+  size_t instance_size;
+  bool (*init)(void *instance, void *buffer, size_t size);
+  void *(*malloc)(void *instance, size_t size);
+  int (*free)(void *instance, void *ptr);
+  // dp_malloc_inline and dp_free_inline, the size class fast path compiled into the entry.
+  void *(*malloc_inline)(void *instance, size_t size);
+  int (*free_inline)(void *instance, void *ptr);
+  void *(*realloc)(void *instance, void *ptr, size_t size);
+  // buffer_size - available of the instance.
+  size_t (*used)(const void *instance);
+};
+
+// One per entry of DP_VARIANTS.
+extern const DeadpoolVariant deadpool_default_variant;
+extern const DeadpoolVariant deadpool_log_variant;
+extern const DeadpoolVariant deadpool_stats_variant;
+extern const DeadpoolVariant deadpool_free_validation_variant;
+extern const DeadpoolVariant deadpool_all_variant;
+extern const DeadpoolVariant deadpool_align8_variant;
+extern const DeadpoolVariant deadpool_align64_variant;
+extern const DeadpoolVariant deadpool_first_fit_variant;
+extern const DeadpoolVariant deadpool_probe_limit16_variant;
+extern const DeadpoolVariant deadpool_split64_variant;
+extern const DeadpoolVariant deadpool_canary_variant;
+extern const DeadpoolVariant deadpool_check_slice4_variant;
+extern const DeadpoolVariant deadpool_free_index_variant;
+extern const DeadpoolVariant deadpool_out_of_line_variant;
+extern const DeadpoolVariant deadpool_size_classes_variant;
+extern const DeadpoolVariant deadpool_huge_variant;
+extern const DeadpoolVariant deadpool_watermarks_variant;
@@ -0,0 +1,55 @@
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocator_policies.h"
+#include "heap_state.h"
+
+// Best fit search through the free block index (DP_FREE_INDEX) against the free list, on
+// heaps aged to range(0) free blocks with twice as many live blocks between them.
+//
+// Every iteration allocates half the mean block size, which most holes fit, and frees it
+// again, so both the best fit search and coalescing scan every free block. The list is
+// only aged up to 16k free blocks, aging larger heaps through it takes minutes.
+
+constexpr size_t FREE_INDEX_BUFFER_SIZE = 256 << 20;
+constexpr double FREE_INDEX_FILL_RATIO = 0.5;
+
+template <typename Policy> static void FreeIndexBestFit(benchmark::State &state) {
+  size_t holes = static_cast<size_t>(state.range(0));
+  HeapState target{holes * 2, FREE_INDEX_FILL_RATIO, holes};
+
+  Policy policy;
+  policy.init(FREE_INDEX_BUFFER_SIZE);
+  std::vector<void *> live = age_heap(policy, FREE_INDEX_BUFFER_SIZE, target);
+  size_t size = aged_block_size(FREE_INDEX_BUFFER_SIZE, target) / 2;
+
+  for (auto _ : state) {
+    void *ptr = policy.alloc(size);
+    if (ptr == nullptr) {
+      state.SkipWithError("allocation failed");
+      break;
+    }
+    policy.free(ptr);
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  state.SetComplexityN(static_cast<int64_t>(holes));
+  state.counters["live_blocks"] = static_cast<double>(live.size());
+  for (void *ptr : live) {
+    policy.free(ptr);
+  }
+  policy.teardown();
+}
+BENCHMARK_TEMPLATE(FreeIndexBestFit, DeadpoolDefaultVariant)
+    ->ArgName("free_blocks")
+    ->RangeMultiplier(4)
+    ->Range(1 << 10, 1 << 14)
+    ->Complexity(benchmark::oN);
+BENCHMARK_TEMPLATE(FreeIndexBestFit, DeadpoolFreeIndexVariant)
+    ->ArgName("free_blocks")
+    ->Args({1 << 10})
+    ->Args({1 << 12})
+    ->Args({1 << 14})
+    ->Args({100000})
+    ->Complexity(benchmark::oN);
@@ -0,0 +1,107 @@
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocator_policies.h"
+
+// The compile time specialised C++ heap (dp::heap) against the C library.
+//
+//  HeapBatch   - allocate range(0) blocks of 64 bytes, then free them all.
+//  HeapChurn   - random sizes of 16 to 256 bytes alloc'd and freed in random order,
+//                HEAP_CHURN_LIVE blocks live on average.
+//  HeapTyped   - make<T> and destroy of range(0) 48 byte objects, the size class is picked
+//                at compile time, against allocate(sizeof(T)) where it is picked at runtime.
+//
+// DeadpoolPolicy and DeadpoolHeapPolicy<> run the same algorithm with the default options,
+// the C library through calls into allocator.c, the heap inlined into the benchmark.
+// HeapSizeClasses matches the size_classes variant, which is reached through its variant
+// table.
+
+constexpr size_t HEAP_BUFFER_SIZE = 1024 * 1024;
+constexpr size_t HEAP_CHURN_LIVE = 100;
+
+struct HeapSizeClasses : dp::default_config {
+  static constexpr size_t size_classes = 16;
+  static constexpr size_t class_cache_depth = 256;
+};
+
+template <typename Policy> static void HeapBatch(benchmark::State &state) {
+  size_t count = static_cast<size_t>(state.range(0));
+  std::vector<void *> ptrs(count);
+  Policy policy;
+  policy.init(HEAP_BUFFER_SIZE);
+
+  for (auto _ : state) {
+    for (size_t i = 0; i < count; i++) {
+      ptrs[i] = policy.alloc(64);
+    }
+    for (size_t i = 0; i < count; i++) {
+      policy.free(ptrs[i]);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(count) * 2);
+  policy.teardown();
+}
+
+template <typename Policy> static void HeapChurn(benchmark::State &state) {
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<size_t> size_dist(16, 256);
+  std::vector<void *> live;
+  live.reserve(2 * HEAP_CHURN_LIVE);
+  Policy policy;
+  policy.init(HEAP_BUFFER_SIZE);
+
+  for (auto _ : state) {
+    if (live.size() < HEAP_CHURN_LIVE / 2 || (live.size() < 2 * HEAP_CHURN_LIVE && rng() % 2)) {
+      if (void *ptr = policy.alloc(size_dist(rng)))
+        live.push_back(ptr);
+    } else {
+      size_t idx = rng() % live.size();
+      policy.free(live[idx]);
+      live[idx] = live.back();
+      live.pop_back();
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  for (void *ptr : live) {
+    policy.free(ptr);
+  }
+  policy.teardown();
+}
+
+#define HEAP_BENCHMARK_POLICIES(benchmark_fn, ...)                                                 \
+  BENCHMARK_TEMPLATE(benchmark_fn, DeadpoolPolicy) __VA_ARGS__;                                    \
+  BENCHMARK_TEMPLATE(benchmark_fn, DeadpoolHeapPolicy<>) __VA_ARGS__;                              \
+  BENCHMARK_TEMPLATE(benchmark_fn, DeadpoolSizeClassesVariant) __VA_ARGS__;                        \
+  BENCHMARK_TEMPLATE(benchmark_fn, DeadpoolSizeClassesInlineVariant) __VA_ARGS__;                  \
+  BENCHMARK_TEMPLATE(benchmark_fn, DeadpoolHeapPolicy<HeapSizeClasses>) __VA_ARGS__;
+
+HEAP_BENCHMARK_POLICIES(HeapBatch, ->RangeMultiplier(4)->Range(16, 256));
+HEAP_BENCHMARK_POLICIES(HeapChurn);
+
+struct HeapObject {
+  uint64_t fields[6];
+};
+
+template <bool Typed> static void HeapTyped(benchmark::State &state) {
+  size_t count = static_cast<size_t>(state.range(0));
+  std::vector<HeapObject *> objects(count);
+  auto buffer = std::make_unique_for_overwrite<uint8_t[]>(HEAP_BUFFER_SIZE);
+  dp::heap<HeapSizeClasses> heap;
+  heap.init(buffer.get(), HEAP_BUFFER_SIZE);
+  size_t size = sizeof(HeapObject);
+  benchmark::DoNotOptimize(size); // keeps the untyped size a runtime value.
+
+  for (auto _ : state) {
+    for (size_t i = 0; i < count; i++) {
+      objects[i] = Typed ? heap.make<HeapObject>() : new (heap.allocate(size)) HeapObject();
+    }
+    for (size_t i = 0; i < count; i++) {
+      heap.destroy(objects[i]);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(count) * 2);
+}
+BENCHMARK_TEMPLATE(HeapTyped, true)->RangeMultiplier(4)->Range(16, 256);
+BENCHMARK_TEMPLATE(HeapTyped, false)->RangeMultiplier(4)->Range(16, 256);
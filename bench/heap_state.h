@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Target state for a pre-aged heap.
+//  live_blocks - number of blocks left allocated once aging is done.
+//  fill_ratio  - fraction of the buffer handed out to live blocks.
+//  free_blocks - number of non-adjacent holes punched between the live blocks.
+struct HeapState {
+  size_t live_blocks;
+  double fill_ratio;
+  size_t free_blocks;
+};
+
+// Blocks in an aged heap have a mean payload of this size or more,
+// states that would need smaller blocks are not generated.
+constexpr size_t MIN_AGED_BLOCK_SIZE = 64;
+
+inline size_t aged_block_size(size_t buffer_size, const HeapState &target) {
+  return static_cast<size_t>(static_cast<double>(buffer_size) * target.fill_ratio /
+                             static_cast<double>(target.live_blocks));
+}
+
+inline bool aged_state_feasible(size_t buffer_size, const HeapState &target) {
+  if (target.live_blocks == 0 || target.free_blocks > target.live_blocks)
+    return false;
+
+  // Holes are as large as live blocks on average, and every block pays roughly another
+  // MIN_AGED_BLOCK_SIZE of metadata and padding, so the whole layout must fit the buffer.
+  size_t block_size = aged_block_size(buffer_size, target);
+  size_t total_blocks = target.live_blocks + target.free_blocks;
+  return block_size >= MIN_AGED_BLOCK_SIZE &&
+         total_blocks * (block_size + MIN_AGED_BLOCK_SIZE) <= buffer_size;
+}
+
+// Ages a freshly initialised heap into the requested state.
+//
+// live_blocks + free_blocks blocks are allocated back to back with sizes jittered around
+// the mean block size, then every hole is freed. Holes are spread evenly and never touch
+// each other (free_blocks <= live_blocks), so coalescing can't merge them and the heap
+// ends up with free_blocks + 1 free blocks (the holes and the untouched tail).
+//
+// Returns the live pointers, the caller owns them. If the policy runs out of memory
+// while aging, the heap is left in the state reached so far.
+template <typename Policy>
+std::vector<void *> age_heap(Policy &policy, size_t buffer_size, const HeapState &target,
+                             uint32_t seed = 42) {
+  std::mt19937 rng(seed);
+  size_t mean_size = aged_block_size(buffer_size, target);
+  std::uniform_int_distribution<size_t> size_dist(mean_size / 2, mean_size + mean_size / 2);
+
+  size_t total_blocks = target.live_blocks + target.free_blocks;
+  std::vector<void *> live;
+  std::vector<void *> holes;
+  live.reserve(target.live_blocks);
+  holes.reserve(target.free_blocks);
+
+  for (size_t i = 0; i < total_blocks; i++) {
+    void *ptr = policy.alloc(size_dist(rng));
+    if (ptr == nullptr)
+      break;
+
+    size_t hole_index = i * target.free_blocks / total_blocks;
+    bool is_hole = (i + 1) * target.free_blocks / total_blocks != hole_index;
+    if (is_hole)
+      holes.push_back(ptr);
+    else
+      live.push_back(ptr);
+  }
+
+  // Free holes in random order so the free list isn't sorted by address.
+  std::shuffle(holes.begin(), holes.end(), rng);
+  for (void *ptr : holes) {
+    policy.free(ptr);
+  }
+
+  return live;
+}
@@ -0,0 +1,98 @@
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocator_policies.h"
+
+// The huge allocation bypass (DP_HUGE_THRESHOLD) against huge blocks carved from the buffer.
+//
+//  HugeMixed   - small blocks of 16 to 1024 bytes alloc'd and freed in random order,
+//                HUGE_SMALL_LIVE live on average, and every HUGE_PERIOD operations a block of
+//                1 to 4MiB replacing the oldest of HUGE_LIVE huge blocks. The buffer holds the
+//                live set with a few MiB to spare, failed_allocs counts what fragmentation
+//                costs, peak_used the buffer the workload needed.
+//  HugeRealloc - a block grown from 4KiB to range(0) bytes by doubling dp_realloc, then
+//                freed. Copied block to block in the buffer, remapped past the threshold.
+//
+// DeadpoolHugeVariant maps requests over 128KiB, DeadpoolDefaultVariant is the same build
+// without the bypass.
+
+constexpr size_t HUGE_BUFFER_SIZE = 24 * 1024 * 1024;
+constexpr size_t HUGE_SMALL_LIVE = 4000;
+constexpr size_t HUGE_LIVE = 4;
+constexpr size_t HUGE_PERIOD = 256;
+
+template <typename Policy> static void HugeMixed(benchmark::State &state) {
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<size_t> small_dist(16, 1024);
+  std::uniform_int_distribution<size_t> huge_dist(1024 * 1024, 4 * 1024 * 1024);
+  std::vector<void *> small;
+  small.reserve(2 * HUGE_SMALL_LIVE);
+  std::vector<void *> huge(HUGE_LIVE, nullptr);
+  Policy policy;
+  policy.init(HUGE_BUFFER_SIZE);
+
+  size_t ops = 0;
+  size_t failed = 0;
+  for (auto _ : state) {
+    if (++ops % HUGE_PERIOD == 0) {
+      void *&oldest = huge[ops / HUGE_PERIOD % HUGE_LIVE];
+      if (oldest != nullptr)
+        policy.free(oldest);
+      oldest = policy.alloc(huge_dist(rng));
+      failed += oldest == nullptr;
+    } else if (small.size() < HUGE_SMALL_LIVE / 2 ||
+               (small.size() < 2 * HUGE_SMALL_LIVE && rng() % 2)) {
+      if (void *ptr = policy.alloc(small_dist(rng)))
+        small.push_back(ptr);
+      else
+        failed++;
+    } else {
+      size_t idx = rng() % small.size();
+      policy.free(small[idx]);
+      small[idx] = small.back();
+      small.pop_back();
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["failed_allocs"] =
+      benchmark::Counter(static_cast<double>(failed), benchmark::Counter::kAvgIterations);
+  state.counters["peak_used"] =
+      benchmark::Counter(static_cast<double>(policy.peak_used()), benchmark::Counter::kDefaults,
+                         benchmark::Counter::kIs1024);
+  for (void *ptr : small) {
+    policy.free(ptr);
+  }
+  for (void *ptr : huge) {
+    if (ptr != nullptr)
+      policy.free(ptr);
+  }
+  policy.teardown();
+}
+BENCHMARK_TEMPLATE(HugeMixed, DeadpoolDefaultVariant);
+BENCHMARK_TEMPLATE(HugeMixed, DeadpoolHugeVariant);
+
+template <typename Policy> static void HugeRealloc(benchmark::State &state) {
+  size_t target = static_cast<size_t>(state.range(0));
+  Policy policy;
+  policy.init(HUGE_BUFFER_SIZE);
+
+  for (auto _ : state) {
+    void *ptr = policy.alloc(4096);
+    for (size_t size = 8192; size <= target && ptr != nullptr; size *= 2) {
+      ptr = policy.realloc(ptr, size);
+    }
+    benchmark::DoNotOptimize(ptr);
+    if (ptr == nullptr)
+      state.SkipWithError("realloc failed");
+    else
+      policy.free(ptr);
+  }
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(target));
+  policy.teardown();
+}
+BENCHMARK_TEMPLATE(HugeRealloc, DeadpoolDefaultVariant)
+    ->RangeMultiplier(4)
+    ->Range(1 << 20, 8 << 20);
+BENCHMARK_TEMPLATE(HugeRealloc, DeadpoolHugeVariant)->RangeMultiplier(4)->Range(1 << 20, 8 << 20);
@@ -0,0 +1,91 @@
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocator_policies.h"
+
+// Fragmentation of a heap shared by long lived and short lived blocks, with and without
+// lifetime hints.
+//
+//  TwoLifetimes - a 16MiB heap holds range(1) sessions of 8 to 32KiB, long lived, and serves
+//                 requests of 1 to 8 buffers of 1 to 64KiB, freed when the request ends.
+//                 Every 16th request replaces a random session. Sessions and buffers come
+//                 from dp_malloc_hint when range(0) is set and from dp_malloc otherwise.
+//                 Times the requests and reports fragmentation, 1 - largest free block /
+//                 free bytes, sampled between requests, and failed, the allocations the heap
+//                 couldn't serve.
+
+static constexpr size_t LIFETIME_HEAP = 16 * 1024 * 1024;
+static constexpr size_t LIFETIME_REQUESTS = 20000;
+
+static void TwoLifetimes(benchmark::State &state) {
+  using clock = std::chrono::steady_clock;
+  bool hinted = state.range(0) != 0;
+  size_t session_count = static_cast<size_t>(state.range(1));
+  auto buffer = std::make_unique<max_align_t[]>(LIFETIME_HEAP / sizeof(max_align_t));
+  double fragmentation = 0;
+  size_t samples = 0;
+  size_t failed = 0;
+  size_t allocations = 0;
+
+  for (auto _ : state) {
+    dp_alloc allocator;
+    dp_init(&allocator, buffer.get(), LIFETIME_HEAP IF_DP_LOG(, null_logger));
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<size_t> session_size(8 * 1024, 32 * 1024);
+    std::uniform_int_distribution<size_t> buffer_size(1024, 64 * 1024);
+    std::uniform_int_distribution<size_t> buffer_count(1, 8);
+    std::uniform_int_distribution<size_t> session_pick(0, session_count - 1);
+    auto allocate = [&](size_t size, dp_lifetime lifetime) {
+      void *ptr = hinted ? dp_malloc_hint(&allocator, size, lifetime) : dp_malloc(&allocator, size);
+      failed += ptr == nullptr;
+      allocations++;
+      return ptr;
+    };
+
+    std::vector<void *> sessions;
+    for (size_t i = 0; i < session_count; i++) {
+      sessions.push_back(allocate(session_size(rng), DP_LIFETIME_LONG));
+    }
+    std::vector<void *> buffers;
+    double elapsed = 0;
+    auto start = clock::now();
+    for (size_t request = 0; request < LIFETIME_REQUESTS; request++) {
+      for (size_t i = buffer_count(rng); i > 0; i--) {
+        buffers.push_back(allocate(buffer_size(rng), DP_LIFETIME_SHORT));
+      }
+      if (request % 16 == 0) {
+        void *&session = sessions[session_pick(rng)];
+        dp_free(&allocator, session);
+        session = allocate(session_size(rng), DP_LIFETIME_LONG);
+      }
+      for (void *ptr : buffers) {
+        dp_free(&allocator, ptr);
+      }
+      buffers.clear();
+      if (request % 64 == 0) {
+        // The sample walks the free blocks, keep it out of the timing.
+        elapsed += std::chrono::duration<double>(clock::now() - start).count();
+        fragmentation += 1.0 - static_cast<double>(dp_largest_free(&allocator)) /
+                                   static_cast<double>(allocator.available);
+        samples++;
+        start = clock::now();
+      }
+    }
+    elapsed += std::chrono::duration<double>(clock::now() - start).count();
+    state.SetIterationTime(elapsed);
+  }
+
+  double iterations = static_cast<double>(state.iterations());
+  state.SetItemsProcessed(static_cast<int64_t>(allocations));
+  state.SetLabel(hinted ? "hinted" : "unhinted");
+  state.counters["fragmentation"] = samples > 0 ? fragmentation / static_cast<double>(samples) : 0;
+  state.counters["failed"] = static_cast<double>(failed) / iterations;
+}
+BENCHMARK(TwoLifetimes)
+    ->ArgsProduct({{0, 1}, {128, 512}})
+    ->UseManualTime()
+    ->Unit(benchmark::kMillisecond);
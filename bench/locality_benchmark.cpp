@@ -0,0 +1,302 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <new>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocator_policies.h"
+
+// Access cost of data structures built through each policy.
+//
+// Every iteration builds a linked structure, interleaving its nodes with short-lived
+// scratch allocations the way a real program would, then runs a read-only traversal
+// and a mutating pass over it. The wall time of each phase is reported per node
+// (build_ns, traverse_ns, mutate_ns), the benchmark time is their sum. Teardown is
+// not timed.
+
+constexpr size_t LOCALITY_BUFFER_SIZE = 64 * 1024 * 1024;
+
+using LocalityClock = std::chrono::steady_clock;
+
+template <typename Policy> class LocalityFixture : public benchmark::Fixture {
+public:
+  void SetUp(benchmark::State &) override {
+    m_policy.init(LOCALITY_BUFFER_SIZE);
+    m_rng.seed(42);
+    m_scratch.fill(nullptr);
+  }
+
+  void TearDown(benchmark::State &) override { m_policy.teardown(); }
+
+  // Allocates a node, with a scratch allocation in between every other node. Scratch
+  // blocks live for SCRATCH_DEPTH scratch allocations.
+  template <typename T> T *alloc_node() {
+    if (m_rng() % 2 == 0) {
+      std::uniform_int_distribution<size_t> size_dist(16, 256);
+      void *&slot = m_scratch[m_scratch_next++ % SCRATCH_DEPTH];
+      if (slot)
+        m_policy.free(slot);
+      slot = m_policy.alloc(size_dist(m_rng));
+    }
+    void *ptr = m_policy.alloc(sizeof(T));
+    return ptr ? new (ptr) T{} : nullptr;
+  }
+
+  void free_scratch() {
+    for (void *&slot : m_scratch) {
+      if (slot)
+        m_policy.free(slot);
+      slot = nullptr;
+    }
+  }
+
+  void start_phase() { m_phase_start = LocalityClock::now(); }
+
+  void end_phase(double &total_ns) {
+    total_ns += std::chrono::duration<double, std::nano>(LocalityClock::now() - m_phase_start)
+                    .count();
+  }
+
+  static void report(benchmark::State &state, size_t nodes, double build_ns, double traverse_ns,
+                     double mutate_ns) {
+    double per_node = static_cast<double>(state.iterations()) * static_cast<double>(nodes);
+    state.counters["build_ns"] = build_ns / per_node;
+    state.counters["traverse_ns"] = traverse_ns / per_node;
+    state.counters["mutate_ns"] = mutate_ns / per_node;
+    state.SetItemsProcessed(state.iterations() * nodes);
+  }
+
+protected:
+  static constexpr size_t SCRATCH_DEPTH = 8;
+
+  Policy m_policy;
+  std::mt19937 m_rng;
+  std::array<void *, SCRATCH_DEPTH> m_scratch;
+  size_t m_scratch_next = 0;
+  LocalityClock::time_point m_phase_start;
+};
+
+struct ListNode {
+  ListNode *next;
+  uint64_t value;
+  uint8_t payload[16];
+};
+
+BENCHMARK_TEMPLATE_METHOD_F(LocalityFixture, LinkedList)(benchmark::State &state) {
+  size_t nodes = static_cast<size_t>(state.range(0));
+  double build_ns = 0, traverse_ns = 0, mutate_ns = 0;
+
+  for (auto _ : state) {
+    this->start_phase();
+    ListNode *head = nullptr;
+    for (size_t i = 0; i < nodes; i++) {
+      ListNode *node = this->template alloc_node<ListNode>();
+      if (!node) {
+        state.SkipWithError("allocation failed");
+        break;
+      }
+      node->value = i;
+      node->next = head;
+      head = node;
+    }
+    this->end_phase(build_ns);
+
+    this->start_phase();
+    uint64_t sum = 0;
+    for (ListNode *node = head; node; node = node->next) {
+      sum += node->value;
+    }
+    benchmark::DoNotOptimize(sum);
+    this->end_phase(traverse_ns);
+
+    this->start_phase();
+    for (ListNode *node = head; node; node = node->next) {
+      node->value = node->value * 3 + 1;
+    }
+    benchmark::ClobberMemory();
+    this->end_phase(mutate_ns);
+
+    state.PauseTiming();
+    while (head) {
+      ListNode *next = head->next;
+      this->m_policy.free(head);
+      head = next;
+    }
+    this->free_scratch();
+    state.ResumeTiming();
+  }
+
+  this->report(state, nodes, build_ns, traverse_ns, mutate_ns);
+}
+ALLOCATOR_BENCHMARK_INSTANTIATE(LocalityFixture,
+                                LinkedList, ->RangeMultiplier(8)->Range(1 << 10, 1 << 15));
+
+struct TreeNode {
+  TreeNode *left;
+  TreeNode *right;
+  uint64_t key;
+  uint64_t value;
+};
+
+// Unbalanced BST over shuffled keys, traversal looks every key up in a different random
+// order and the mutation pass is an in-order walk updating values.
+BENCHMARK_TEMPLATE_METHOD_F(LocalityFixture, BinaryTree)(benchmark::State &state) {
+  size_t nodes = static_cast<size_t>(state.range(0));
+  double build_ns = 0, traverse_ns = 0, mutate_ns = 0;
+
+  std::vector<uint64_t> keys(nodes);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(1));
+  std::vector<uint64_t> lookups = keys;
+  std::shuffle(lookups.begin(), lookups.end(), std::mt19937(2));
+  std::vector<TreeNode *> stack;
+
+  for (auto _ : state) {
+    this->start_phase();
+    TreeNode *root = nullptr;
+    for (uint64_t key : keys) {
+      TreeNode *node = this->template alloc_node<TreeNode>();
+      if (!node) {
+        state.SkipWithError("allocation failed");
+        break;
+      }
+      node->key = key;
+      node->value = key;
+      TreeNode **link = &root;
+      while (*link) {
+        link = key < (*link)->key ? &(*link)->left : &(*link)->right;
+      }
+      *link = node;
+    }
+    this->end_phase(build_ns);
+
+    this->start_phase();
+    uint64_t sum = 0;
+    for (uint64_t key : lookups) {
+      TreeNode *node = root;
+      while (node && node->key != key) {
+        node = key < node->key ? node->left : node->right;
+      }
+      sum += node ? node->value : 0;
+    }
+    benchmark::DoNotOptimize(sum);
+    this->end_phase(traverse_ns);
+
+    this->start_phase();
+    for (TreeNode *node = root; node || !stack.empty();) {
+      while (node) {
+        stack.push_back(node);
+        node = node->left;
+      }
+      node = stack.back();
+      stack.pop_back();
+      node->value += 1;
+      node = node->right;
+    }
+    benchmark::ClobberMemory();
+    this->end_phase(mutate_ns);
+
+    state.PauseTiming();
+    if (root)
+      stack.push_back(root);
+    while (!stack.empty()) {
+      TreeNode *node = stack.back();
+      stack.pop_back();
+      if (node->left)
+        stack.push_back(node->left);
+      if (node->right)
+        stack.push_back(node->right);
+      this->m_policy.free(node);
+    }
+    this->free_scratch();
+    state.ResumeTiming();
+  }
+
+  this->report(state, nodes, build_ns, traverse_ns, mutate_ns);
+}
+ALLOCATOR_BENCHMARK_INSTANTIATE(LocalityFixture,
+                                BinaryTree, ->RangeMultiplier(8)->Range(1 << 10, 1 << 15));
+
+struct HashNode {
+  HashNode *next;
+  uint64_t key;
+  uint64_t value;
+};
+
+// Chained hash table with a load factor of 4, the bucket array is allocated through
+// the policy as well.
+BENCHMARK_TEMPLATE_METHOD_F(LocalityFixture, HashChains)(benchmark::State &state) {
+  size_t nodes = static_cast<size_t>(state.range(0));
+  size_t num_buckets = nodes / 4;
+  double build_ns = 0, traverse_ns = 0, mutate_ns = 0;
+
+  std::vector<uint64_t> lookups(nodes);
+  std::iota(lookups.begin(), lookups.end(), 0);
+  std::shuffle(lookups.begin(), lookups.end(), std::mt19937(2));
+  auto bucket_of = [&](uint64_t key) { return (key * 0x9E3779B97F4A7C15ull) % num_buckets; };
+
+  for (auto _ : state) {
+    this->start_phase();
+    auto **buckets =
+        static_cast<HashNode **>(this->m_policy.alloc(num_buckets * sizeof(HashNode *)));
+    if (!buckets) {
+      state.SkipWithError("allocation failed");
+      break;
+    }
+    std::fill_n(buckets, num_buckets, nullptr);
+    for (uint64_t key = 0; key < nodes; key++) {
+      HashNode *node = this->template alloc_node<HashNode>();
+      if (!node) {
+        state.SkipWithError("allocation failed");
+        break;
+      }
+      node->key = key;
+      node->value = key;
+      node->next = buckets[bucket_of(key)];
+      buckets[bucket_of(key)] = node;
+    }
+    this->end_phase(build_ns);
+
+    this->start_phase();
+    uint64_t sum = 0;
+    for (uint64_t key : lookups) {
+      HashNode *node = buckets[bucket_of(key)];
+      while (node && node->key != key) {
+        node = node->next;
+      }
+      sum += node ? node->value : 0;
+    }
+    benchmark::DoNotOptimize(sum);
+    this->end_phase(traverse_ns);
+
+    this->start_phase();
+    for (size_t b = 0; b < num_buckets; b++) {
+      for (HashNode *node = buckets[b]; node; node = node->next) {
+        node->value ^= node->key;
+      }
+    }
+    benchmark::ClobberMemory();
+    this->end_phase(mutate_ns);
+
+    state.PauseTiming();
+    for (size_t b = 0; b < num_buckets; b++) {
+      HashNode *node = buckets[b];
+      while (node) {
+        HashNode *next = node->next;
+        this->m_policy.free(node);
+        node = next;
+      }
+    }
+    this->m_policy.free(buckets);
+    this->free_scratch();
+    state.ResumeTiming();
+  }
+
+  this->report(state, nodes, build_ns, traverse_ns, mutate_ns);
+}
+ALLOCATOR_BENCHMARK_INSTANTIATE(LocalityFixture,
+                                HashChains, ->RangeMultiplier(8)->Range(1 << 10, 1 << 15));
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+// Memory-efficiency counters for policies that report their usage
+// (capacity/used/peak_used, see allocator_policies.h).
+//
+//  overhead_per_alloc - metadata and padding bytes per allocation of the probe size,
+//                       measured on a fresh instance.
+//  peak_used          - high-water mark of the benchmarked instance.
+//  largest_free_min   - smallest "largest satisfiable request" seen across samples.
+//  usable_at_failure  - fraction of the buffer handed out as user bytes when a fresh
+//                       instance filled with probe size blocks first fails.
+//
+// Unbounded policies (capacity() == 0) only report the first two.
+
+template <typename Policy>
+concept MemoryIntrospectable = requires(Policy policy) {
+  policy.capacity();
+  policy.used();
+  policy.peak_used();
+};
+
+// Binary search for the largest request the policy can currently satisfy, leaves the
+// policy in the state it found it.
+template <typename Policy> size_t largest_satisfiable(Policy &policy) {
+  size_t low = 0;
+  size_t high = policy.capacity();
+  while (low < high) {
+    size_t mid = low + (high - low + 1) / 2;
+    void *ptr = policy.alloc(mid);
+    if (ptr) {
+      policy.free(ptr);
+      low = mid;
+    } else {
+      high = mid - 1;
+    }
+  }
+  return low;
+}
+
+template <typename Policy> class MemorySampler {
+public:
+  // Records the current largest satisfiable request, call outside timed regions.
+  void sample(Policy &policy) {
+    if constexpr (MemoryIntrospectable<Policy>) {
+      if (policy.capacity() != 0)
+        m_largest_free_min = std::min(m_largest_free_min, largest_satisfiable(policy));
+    }
+  }
+
+  void report(benchmark::State &state, Policy &policy, size_t buffer_size, size_t probe_size) {
+    if constexpr (MemoryIntrospectable<Policy>) {
+      state.counters["peak_used"] = benchmark::Counter(static_cast<double>(policy.peak_used()),
+                                                       benchmark::Counter::kDefaults,
+                                                       benchmark::Counter::kIs1024);
+      state.counters["overhead_per_alloc"] = overhead_per_alloc(buffer_size, probe_size);
+
+      if (policy.capacity() != 0) {
+        sample(policy);
+        state.counters["largest_free_min"] = benchmark::Counter(
+            static_cast<double>(m_largest_free_min), benchmark::Counter::kDefaults,
+            benchmark::Counter::kIs1024);
+        state.counters["usable_at_failure"] = usable_at_failure(buffer_size, probe_size);
+      }
+    }
+    m_largest_free_min = SIZE_MAX;
+  }
+
+private:
+  static constexpr size_t OVERHEAD_PROBES = 64;
+
+  size_t m_largest_free_min = SIZE_MAX;
+
+  static double overhead_per_alloc(size_t buffer_size, size_t probe_size) {
+    Policy fresh;
+    fresh.init(buffer_size);
+    std::vector<void *> ptrs;
+    size_t before = fresh.used();
+    size_t footprint = 0;
+    for (size_t i = 0; i < OVERHEAD_PROBES; i++) {
+      void *ptr = fresh.alloc(probe_size);
+      if (!ptr)
+        break;
+      if constexpr (requires { fresh.footprint(ptr); })
+        footprint += fresh.footprint(ptr);
+      ptrs.push_back(ptr);
+    }
+    size_t after = fresh.used();
+    if constexpr (requires { fresh.footprint(nullptr); })
+      after = before + footprint;
+    for (void *ptr : ptrs) {
+      fresh.free(ptr);
+    }
+    fresh.teardown();
+
+    if (ptrs.empty())
+      return 0;
+    double per_alloc = static_cast<double>(after - before) / static_cast<double>(ptrs.size());
+    return per_alloc - static_cast<double>(probe_size);
+  }
+
+  static double usable_at_failure(size_t buffer_size, size_t probe_size) {
+    Policy fresh;
+    fresh.init(buffer_size);
+    std::vector<void *> ptrs;
+    for (;;) {
+      void *ptr = fresh.alloc(probe_size);
+      if (!ptr)
+        break;
+      ptrs.push_back(ptr);
+    }
+    double usable =
+        static_cast<double>(ptrs.size() * probe_size) / static_cast<double>(buffer_size);
+    for (void *ptr : ptrs) {
+      fresh.free(ptr);
+    }
+    fresh.teardown();
+    return usable;
+  }
+};
@@ -0,0 +1,77 @@
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocator_policies.h"
+#include "heap_state.h"
+
+// Out of line metadata (DP_OUT_OF_LINE_METADATA) against inline block headers.
+//
+//  PackedFill      - fills a buffer with range(0) byte blocks, powers of two, until the
+//                    allocator runs out. utilization is the share of the buffer handed to
+//                    the user, inline headers cost a header and its padding per block.
+//  AgedBestFitScan - alloc/free of half the mean block size on a heap aged to range(0)
+//                    free blocks. The inline search follows free list links through the
+//                    blocks, the out of line one only reads the bitmaps.
+
+constexpr size_t OUT_OF_LINE_FILL_BUFFER_SIZE = 1 << 20;
+constexpr size_t OUT_OF_LINE_AGED_BUFFER_SIZE = 64 << 20;
+constexpr double OUT_OF_LINE_FILL_RATIO = 0.5;
+
+template <typename Policy> static void PackedFill(benchmark::State &state) {
+  size_t size = static_cast<size_t>(state.range(0));
+  std::vector<void *> ptrs;
+  ptrs.reserve(OUT_OF_LINE_FILL_BUFFER_SIZE / size);
+
+  Policy policy;
+  for (auto _ : state) {
+    state.PauseTiming();
+    policy.init(OUT_OF_LINE_FILL_BUFFER_SIZE);
+    ptrs.clear();
+    state.ResumeTiming();
+
+    while (void *ptr = policy.alloc(size)) {
+      ptrs.push_back(ptr);
+    }
+
+    state.PauseTiming();
+    policy.teardown();
+    state.ResumeTiming();
+  }
+
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(ptrs.size()));
+  state.counters["blocks"] = static_cast<double>(ptrs.size());
+  state.counters["utilization"] =
+      static_cast<double>(ptrs.size() * size) / static_cast<double>(OUT_OF_LINE_FILL_BUFFER_SIZE);
+}
+BENCHMARK_TEMPLATE(PackedFill, DeadpoolDefaultVariant)->RangeMultiplier(4)->Range(16, 4096);
+BENCHMARK_TEMPLATE(PackedFill, DeadpoolOutOfLineVariant)->RangeMultiplier(4)->Range(16, 4096);
+
+template <typename Policy> static void AgedBestFitScan(benchmark::State &state) {
+  size_t holes = static_cast<size_t>(state.range(0));
+  HeapState target{holes * 2, OUT_OF_LINE_FILL_RATIO, holes};
+
+  Policy policy;
+  policy.init(OUT_OF_LINE_AGED_BUFFER_SIZE);
+  std::vector<void *> live = age_heap(policy, OUT_OF_LINE_AGED_BUFFER_SIZE, target);
+  size_t size = aged_block_size(OUT_OF_LINE_AGED_BUFFER_SIZE, target) / 2;
+
+  for (auto _ : state) {
+    void *ptr = policy.alloc(size);
+    if (ptr == nullptr) {
+      state.SkipWithError("allocation failed");
+      break;
+    }
+    policy.free(ptr);
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  for (void *ptr : live) {
+    policy.free(ptr);
+  }
+  policy.teardown();
+}
+BENCHMARK_TEMPLATE(AgedBestFitScan, DeadpoolDefaultVariant)->RangeMultiplier(4)->Range(256, 16384);
+BENCHMARK_TEMPLATE(AgedBestFitScan, DeadpoolOutOfLineVariant)
+    ->RangeMultiplier(4)
+    ->Range(256, 16384);
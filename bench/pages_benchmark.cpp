@@ -0,0 +1,100 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocator_policies.h"
+#include "pages.h"
+#include "perf_counter.h"
+
+// dTLB cost of random access over a heap on small pages against one on huge pages.
+//
+//  PagesTraversal - fills a heap of range(0) MiB with 64 byte nodes linked in random order and
+//                   times a walk of the whole chain, the node after a node is almost never on
+//                   its page. Reports the walk per node, dtlb_misses per node where the CPU
+//                   exposes the event, and huge_backed, the bytes of the heap the kernel
+//                   backed with huge pages (AnonHugePages of its mapping).
+//
+// Each kind falls back to a smaller one when the system can't give it (no hugetlbfs pool,
+// transparent huge pages disabled), the label names the kind the heap got.
+
+struct PagesNode {
+  PagesNode *next;
+  uint64_t payload[7];
+};
+
+// AnonHugePages of the mapping holding data, from /proc/self/smaps.
+static size_t huge_backed_bytes(const void *data) {
+  std::ifstream smaps("/proc/self/smaps");
+  std::string line;
+  bool inside = false;
+  auto address = reinterpret_cast<uintptr_t>(data);
+  while (std::getline(smaps, line)) {
+    unsigned long start = 0;
+    unsigned long end = 0;
+    if (std::sscanf(line.c_str(), "%lx-%lx ", &start, &end) == 2 && line.find(':') > 8) {
+      inside = address >= start && address < end;
+    } else if (inside && line.rfind("AnonHugePages:", 0) == 0) {
+      return std::stoul(line.substr(14)) * 1024;
+    }
+  }
+  return 0;
+}
+
+static const char *page_kind_name(dp_page_kind kind) {
+  switch (kind) {
+  case DP_PAGES_HUGETLB:
+    return "hugetlb";
+  case DP_PAGES_TRANSPARENT:
+    return "transparent";
+  case DP_PAGES_SMALL:
+    return "small";
+  }
+  return "";
+}
+
+template <dp_page_kind Kind> static void PagesTraversal(benchmark::State &state) {
+  size_t heap_size = static_cast<size_t>(state.range(0)) * 1024 * 1024;
+  dp_alloc allocator;
+  dp_pages pages;
+  if (!dp_init_pages(&allocator, &pages, heap_size, Kind, nullptr IF_DP_LOG(, null_logger))) {
+    state.SkipWithError("mapping the heap failed");
+    return;
+  }
+
+  std::vector<PagesNode *> nodes;
+  while (void *ptr = dp_malloc(&allocator, sizeof(PagesNode))) {
+    nodes.push_back(static_cast<PagesNode *>(ptr));
+  }
+  std::shuffle(nodes.begin(), nodes.end(), std::mt19937(42));
+  for (size_t i = 0; i < nodes.size(); i++) {
+    nodes[i]->next = nodes[(i + 1) % nodes.size()];
+  }
+
+  PerfCounter dtlb_misses = PerfCounter::dtlb_load_misses();
+  dtlb_misses.start();
+  for (auto _ : state) {
+    PagesNode *node = nodes[0];
+    for (size_t i = 0; i < nodes.size(); i++) {
+      node = node->next;
+    }
+    benchmark::DoNotOptimize(node);
+  }
+  dtlb_misses.stop();
+
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(nodes.size()));
+  state.SetLabel(page_kind_name(pages.kind));
+  dtlb_misses.report(state, "dtlb_misses", static_cast<double>(nodes.size()));
+  state.counters["huge_backed"] =
+      benchmark::Counter(static_cast<double>(huge_backed_bytes(pages.data)),
+                         benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+  dp_pages_unmap(&pages);
+}
+BENCHMARK_TEMPLATE(PagesTraversal, DP_PAGES_SMALL)->Arg(64)->Arg(256);
+BENCHMARK_TEMPLATE(PagesTraversal, DP_PAGES_TRANSPARENT)->Arg(64)->Arg(256);
+BENCHMARK_TEMPLATE(PagesTraversal, DP_PAGES_HUGETLB)->Arg(64)->Arg(256);
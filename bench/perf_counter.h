@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <benchmark/benchmark.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// One perf_event counter of the calling thread, user space only. Systems without the event
+// (virtual machines without a PMU, perf_event_paranoid, other kernels) leave it invalid and
+// every read at 0, benchmarks only report counters that are valid().
+class PerfCounter {
+public:
+  static PerfCounter dtlb_load_misses() {
+#if defined(__linux__)
+    return PerfCounter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                                               (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                               (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+#else
+    return PerfCounter();
+#endif
+  }
+
+  static PerfCounter page_faults() {
+#if defined(__linux__)
+    return PerfCounter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+#else
+    return PerfCounter();
+#endif
+  }
+
+  ~PerfCounter() {
+#if defined(__linux__)
+    if (m_fd >= 0)
+      close(m_fd);
+#endif
+  }
+
+  PerfCounter(const PerfCounter &) = delete;
+  PerfCounter &operator=(const PerfCounter &) = delete;
+
+  bool valid() const { return m_fd >= 0; }
+
+  void start() {
+#if defined(__linux__)
+    if (m_fd >= 0)
+      ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+  }
+
+  void stop() {
+#if defined(__linux__)
+    if (m_fd >= 0)
+      ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+  }
+
+  uint64_t read() const {
+    uint64_t value = 0;
+#if defined(__linux__)
+    if (m_fd >= 0 && ::read(m_fd, &value, sizeof(value)) != sizeof(value))
+      value = 0;
+#endif
+    return value;
+  }
+
+  // Reports the count as name, per unit of work with per_run units in every iteration.
+  void report(benchmark::State &state, const char *name, double per_run) const {
+    if (valid())
+      state.counters[name] = static_cast<double>(read()) / per_run / state.iterations();
+  }
+
+private:
+  int m_fd = -1;
+
+  PerfCounter() = default;
+
+#if defined(__linux__)
+  PerfCounter(uint32_t type, uint64_t config) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    m_fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+  }
+#endif
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <string>
+
+// Standard library allocator adapter over a policy, so containers can be benchmarked
+// against every policy.
+//
+// Every PolicyAllocator rebound from the same PolicyArena shares its policy and byte
+// counters. Allocation failure throws std::bad_alloc, as the standard requires.
+
+template <typename Policy> struct PolicyArena {
+  Policy &policy;
+  size_t live_bytes = 0;
+  size_t peak_bytes = 0;
+};
+
+template <typename T, typename Policy> class PolicyAllocator {
+public:
+  using value_type = T;
+
+  explicit PolicyAllocator(PolicyArena<Policy> &arena) noexcept : m_arena(&arena) {}
+
+  template <typename U>
+  PolicyAllocator(const PolicyAllocator<U, Policy> &other) noexcept : m_arena(other.arena()) {}
+
+  T *allocate(size_t n) {
+    if (n > std::numeric_limits<size_t>::max() / sizeof(T))
+      throw std::bad_array_new_length();
+
+    void *ptr = m_arena->policy.alloc(n * sizeof(T));
+    if (!ptr)
+      throw std::bad_alloc();
+
+    m_arena->live_bytes += n * sizeof(T);
+    m_arena->peak_bytes = std::max(m_arena->peak_bytes, m_arena->live_bytes);
+    return static_cast<T *>(ptr);
+  }
+
+  void deallocate(T *ptr, size_t n) noexcept {
+    m_arena->policy.free(ptr);
+    m_arena->live_bytes -= n * sizeof(T);
+  }
+
+  PolicyArena<Policy> *arena() const noexcept { return m_arena; }
+
+  template <typename U> bool operator==(const PolicyAllocator<U, Policy> &other) const noexcept {
+    return m_arena == other.arena();
+  }
+
+private:
+  PolicyArena<Policy> *m_arena;
+};
+
+template <typename Policy>
+using PolicyString = std::basic_string<char, std::char_traits<char>, PolicyAllocator<char, Policy>>;
@@ -0,0 +1,119 @@
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocator.h"
+
+// Cost of finding the arena that owns a pointer, with range(0) arenas registered.
+//
+// Arenas are carved back to back out of one buffer and are not page aligned, so every
+// page boundary between two arenas is shared. Lookups go through the registry's page map
+// (dp_owner) and, as a reference, through a linear scan of the arena ranges, which is what
+// callers do without the registry. Pointers are drawn from random arenas. Built against a
+// registry build of its own, allocator_registry in bench/CMakeLists.txt.
+
+constexpr size_t REGISTRY_ARENA_SIZE = 16 * 1024 - 64;
+constexpr size_t REGISTRY_LOOKUPS = 1024;
+
+class RegistryFixture : public benchmark::Fixture {
+public:
+  void SetUp(benchmark::State &state) override {
+    size_t arena_count = static_cast<size_t>(state.range(0));
+    m_buffer = std::make_unique_for_overwrite<uint8_t[]>(arena_count * REGISTRY_ARENA_SIZE);
+    m_arenas = std::make_unique<dp_alloc[]>(arena_count);
+    m_arena_count = arena_count;
+
+    for (size_t i = 0; i < arena_count; i++) {
+      dp_init(&m_arenas[i], m_buffer.get() + i * REGISTRY_ARENA_SIZE, REGISTRY_ARENA_SIZE);
+      if (!dp_register(&m_arenas[i])) {
+        state.SkipWithError("dp_register failed");
+        return;
+      }
+    }
+
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<size_t> arena_dist(0, arena_count - 1);
+    std::uniform_int_distribution<size_t> offset_dist(0, REGISTRY_ARENA_SIZE - 1);
+    m_lookups.resize(REGISTRY_LOOKUPS);
+    for (void *&ptr : m_lookups) {
+      ptr = m_buffer.get() + arena_dist(rng) * REGISTRY_ARENA_SIZE + offset_dist(rng);
+    }
+  }
+
+  void TearDown(benchmark::State &state) override {
+    state.counters["arenas"] = static_cast<double>(m_arena_count);
+    for (size_t i = 0; i < m_arena_count; i++) {
+      dp_unregister(&m_arenas[i]);
+    }
+    m_arenas.reset();
+    m_buffer.reset();
+  }
+
+protected:
+  std::unique_ptr<uint8_t[]> m_buffer;
+  std::unique_ptr<dp_alloc[]> m_arenas;
+  size_t m_arena_count = 0;
+  std::vector<void *> m_lookups;
+};
+
+BENCHMARK_DEFINE_F(RegistryFixture, Owner)(benchmark::State &state) {
+  for (auto _ : state) {
+    for (void *ptr : m_lookups) {
+      benchmark::DoNotOptimize(dp_owner(ptr));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(m_lookups.size()));
+}
+BENCHMARK_REGISTER_F(RegistryFixture, Owner)->RangeMultiplier(10)->Range(1, 10000);
+
+BENCHMARK_DEFINE_F(RegistryFixture, LinearScanOwner)(benchmark::State &state) {
+  auto owner = [&](void *ptr) -> dp_alloc * {
+    for (size_t i = 0; i < m_arena_count; i++) {
+      dp_alloc *arena = &m_arenas[i];
+      if (static_cast<uint8_t *>(ptr) >= arena->buffer &&
+          static_cast<uint8_t *>(ptr) < arena->buffer + arena->buffer_size)
+        return arena;
+    }
+    return nullptr;
+  };
+
+  for (auto _ : state) {
+    for (void *ptr : m_lookups) {
+      benchmark::DoNotOptimize(owner(ptr));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(m_lookups.size()));
+}
+BENCHMARK_REGISTER_F(RegistryFixture, LinearScanOwner)->RangeMultiplier(10)->Range(1, 10000);
+
+// Allocation from a random arena freed without naming the arena, compare with FreeKnown.
+BENCHMARK_DEFINE_F(RegistryFixture, FreeAny)(benchmark::State &state) {
+  std::mt19937 rng(7);
+  std::uniform_int_distribution<size_t> arena_dist(0, m_arena_count - 1);
+  for (auto _ : state) {
+    void *ptr = dp_malloc(&m_arenas[arena_dist(rng)], 64);
+    if (dp_free_any(ptr) != 0) {
+      state.SkipWithError("dp_free_any failed");
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_REGISTER_F(RegistryFixture, FreeAny)->RangeMultiplier(10)->Range(1, 10000);
+
+BENCHMARK_DEFINE_F(RegistryFixture, FreeKnown)(benchmark::State &state) {
+  std::mt19937 rng(7);
+  std::uniform_int_distribution<size_t> arena_dist(0, m_arena_count - 1);
+  for (auto _ : state) {
+    dp_alloc *arena = &m_arenas[arena_dist(rng)];
+    void *ptr = dp_malloc(arena, 64);
+    if (dp_free(arena, ptr) != 0) {
+      state.SkipWithError("dp_free failed");
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_REGISTER_F(RegistryFixture, FreeKnown)->RangeMultiplier(10)->Range(1, 10000);
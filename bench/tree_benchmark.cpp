@@ -0,0 +1,140 @@
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocator_policies.h"
+#include "heap_state.h"
+#include "memory_metrics.h"
+#include "workload.h"
+
+// The segment tree first fit engine (dp_tree).
+//
+//  FirstFitMiss          - alloc/free of twice the mean block size on a heap aged to
+//                          range(0) holes, no hole fits. The bitmap engine finds the same
+//                          lowest fit by scanning every hole, the tree in O(log n).
+//  FragmentationReplay   - replays WORKLOAD_PROFILES[range(0)] on a buffer only
+//                          TREE_REPLAY_HEADROOM times the trace's peak live bytes, and
+//                          samples external fragmentation (1 - largest satisfiable request
+//                          / free bytes) every TREE_SAMPLE_INTERVAL operations. Address
+//                          ordered first fit (the tree) against best fit and free list
+//                          order first fit (deadpool variants).
+
+constexpr size_t TREE_AGED_BUFFER_SIZE = 64 << 20;
+constexpr double TREE_FILL_RATIO = 0.5;
+constexpr double TREE_REPLAY_HEADROOM = 3.0;
+constexpr size_t TREE_SAMPLE_INTERVAL = 4096;
+
+template <typename Policy> static void FirstFitMiss(benchmark::State &state) {
+  size_t holes = static_cast<size_t>(state.range(0));
+  HeapState target{holes * 2, TREE_FILL_RATIO, holes};
+
+  Policy policy;
+  policy.init(TREE_AGED_BUFFER_SIZE);
+  std::vector<void *> live = age_heap(policy, TREE_AGED_BUFFER_SIZE, target);
+  size_t size = aged_block_size(TREE_AGED_BUFFER_SIZE, target) * 2;
+
+  for (auto _ : state) {
+    void *ptr = policy.alloc(size);
+    if (ptr == nullptr) {
+      state.SkipWithError("allocation failed");
+      break;
+    }
+    policy.free(ptr);
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  state.SetComplexityN(static_cast<int64_t>(holes));
+  for (void *ptr : live) {
+    policy.free(ptr);
+  }
+  policy.teardown();
+}
+BENCHMARK_TEMPLATE(FirstFitMiss, DeadpoolBitmapPolicy<DP_SIMD_SCALAR>)
+    ->RangeMultiplier(4)
+    ->Range(256, 65536)
+    ->Complexity();
+BENCHMARK_TEMPLATE(FirstFitMiss, DeadpoolTreePolicy<>)
+    ->RangeMultiplier(4)
+    ->Range(256, 65536)
+    ->Complexity();
+
+static const Trace &replay_trace_for(int64_t profile) {
+  static std::vector<Trace> traces = [] {
+    std::vector<Trace> all;
+    for (const WorkloadProfile *p : WORKLOAD_PROFILES) {
+      all.push_back(generate_trace(*p));
+    }
+    return all;
+  }();
+  return traces[profile];
+}
+
+template <typename Policy> static void FragmentationReplay(benchmark::State &state) {
+  const Trace &trace = replay_trace_for(state.range(0));
+  size_t buffer_size =
+      static_cast<size_t>(static_cast<double>(trace.peak_live_bytes) * TREE_REPLAY_HEADROOM);
+  state.SetLabel(WORKLOAD_PROFILES[state.range(0)]->name);
+
+  Policy policy;
+  std::vector<void *> slots(trace.slots, nullptr);
+  size_t failed = 0;
+  double fragmentation_sum = 0;
+  double fragmentation_max = 0;
+  size_t samples = 0;
+  for (auto _ : state) {
+    policy.init(buffer_size);
+    failed = 0;
+    fragmentation_sum = 0;
+    fragmentation_max = 0;
+    samples = 0;
+    for (size_t i = 0; i < trace.ops.size(); i++) {
+      const TraceOp &op = trace.ops[i];
+      if (op.kind == TraceOp::Alloc) {
+        slots[op.slot] = policy.alloc(op.size);
+        failed += slots[op.slot] == nullptr;
+      } else if (slots[op.slot] != nullptr) {
+        policy.free(slots[op.slot]);
+        slots[op.slot] = nullptr;
+      }
+
+      if (i % TREE_SAMPLE_INTERVAL == TREE_SAMPLE_INTERVAL - 1) {
+        state.PauseTiming();
+        size_t free_bytes = policy.capacity() - policy.used();
+        if (free_bytes > 0) {
+          double fragmentation = 1.0 - static_cast<double>(largest_satisfiable(policy)) /
+                                           static_cast<double>(free_bytes);
+          fragmentation_sum += fragmentation;
+          fragmentation_max = std::max(fragmentation_max, fragmentation);
+          samples++;
+        }
+        state.ResumeTiming();
+      }
+    }
+
+    state.PauseTiming();
+    for (void *&ptr : slots) {
+      if (ptr != nullptr)
+        policy.free(ptr);
+      ptr = nullptr;
+    }
+    policy.teardown();
+    state.ResumeTiming();
+  }
+
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(trace.ops.size()));
+  state.counters["failed_allocs"] = static_cast<double>(failed);
+  state.counters["fragmentation_mean"] = samples ? fragmentation_sum / samples : 0.0;
+  state.counters["fragmentation_max"] = fragmentation_max;
+}
+BENCHMARK_TEMPLATE(FragmentationReplay, DeadpoolTreePolicy<16>)
+    ->ArgName("profile")
+    ->DenseRange(0, WORKLOAD_PROFILES.size() - 1)
+    ->Iterations(1);
+BENCHMARK_TEMPLATE(FragmentationReplay, DeadpoolDefaultVariant)
+    ->ArgName("profile")
+    ->DenseRange(0, WORKLOAD_PROFILES.size() - 1)
+    ->Iterations(1);
+BENCHMARK_TEMPLATE(FragmentationReplay, DeadpoolFirstFitVariant)
+    ->ArgName("profile")
+    ->DenseRange(0, WORKLOAD_PROFILES.size() - 1)
+    ->Iterations(1);
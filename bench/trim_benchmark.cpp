@@ -0,0 +1,105 @@
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+
+#include "allocator_policies.h"
+#include "pages.h"
+#include "perf_counter.h"
+
+// Resident memory dp_trim gives back against what reusing the trimmed blocks costs.
+//
+//  TrimRefill - fills a 256MiB heap with range(0) KiB blocks and writes them, frees all but
+//               every 16th so the free blocks coalesce into runs, then trims the heap when
+//               range(1) is set. Times refilling the freed space with blocks of the same
+//               size, each written through. Reports rss_before and rss_after, the heap's
+//               resident bytes before and after the trim, trim_ms, the time dp_trim took,
+//               and page_faults per refilled block.
+
+static constexpr size_t TRIM_HEAP = 256 * 1024 * 1024;
+
+// Resident bytes of the mapping, from mincore.
+static size_t resident_bytes(const dp_pages &pages) {
+  size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  std::vector<unsigned char> flags(pages.size / page);
+  if (mincore(pages.data, pages.size, flags.data()) != 0)
+    return 0;
+  size_t resident = 0;
+  for (unsigned char flag : flags) {
+    resident += flag & 1;
+  }
+  return resident * page;
+}
+
+static void TrimRefill(benchmark::State &state) {
+  using clock = std::chrono::steady_clock;
+  size_t block_size = static_cast<size_t>(state.range(0)) * 1024;
+  bool trim = state.range(1) != 0;
+  double rss_before = 0;
+  double rss_after = 0;
+  double trim_total = 0;
+  size_t refilled = 0;
+
+  PerfCounter page_faults = PerfCounter::page_faults();
+  for (auto _ : state) {
+    dp_alloc allocator;
+    dp_pages pages;
+    if (!dp_init_pages(&allocator, &pages, TRIM_HEAP, DP_PAGES_SMALL,
+                       nullptr IF_DP_LOG(, null_logger))) {
+      state.SkipWithError("mapping the heap failed");
+      return;
+    }
+    std::vector<void *> blocks;
+    while (void *ptr = dp_malloc(&allocator, block_size)) {
+      std::memset(ptr, 1, block_size);
+      blocks.push_back(ptr);
+    }
+    size_t freed = 0;
+    for (size_t i = 0; i < blocks.size(); i++) {
+      if (i % 16 != 0) {
+        dp_free(&allocator, blocks[i]);
+        freed++;
+      }
+    }
+
+    rss_before += static_cast<double>(resident_bytes(pages));
+    auto trim_start = clock::now();
+    if (trim)
+      dp_trim(&allocator, 0);
+    trim_total += std::chrono::duration<double>(clock::now() - trim_start).count();
+    rss_after += static_cast<double>(resident_bytes(pages));
+
+    page_faults.start();
+    auto start = clock::now();
+    for (size_t i = 0; i < freed; i++) {
+      auto *ptr = static_cast<uint8_t *>(dp_malloc(&allocator, block_size));
+      if (ptr == nullptr)
+        break;
+      std::memset(ptr, 2, block_size);
+      refilled++;
+    }
+    state.SetIterationTime(std::chrono::duration<double>(clock::now() - start).count());
+    page_faults.stop();
+    dp_pages_unmap(&pages);
+  }
+
+  double iterations = static_cast<double>(state.iterations());
+  state.SetItemsProcessed(static_cast<int64_t>(refilled));
+  state.SetLabel(trim ? "trimmed" : "untrimmed");
+  page_faults.report(state, "page_faults", static_cast<double>(refilled) / iterations);
+  state.counters["rss_before"] = benchmark::Counter(rss_before / iterations,
+                                                    benchmark::Counter::kDefaults,
+                                                    benchmark::Counter::kIs1024);
+  state.counters["rss_after"] = benchmark::Counter(rss_after / iterations,
+                                                   benchmark::Counter::kDefaults,
+                                                   benchmark::Counter::kIs1024);
+  state.counters["trim_ms"] = trim_total * 1e3 / iterations;
+}
+BENCHMARK(TrimRefill)
+    ->ArgsProduct({{64, 1024}, {0, 1}})
+    ->UseManualTime()
+    ->Unit(benchmark::kMillisecond);
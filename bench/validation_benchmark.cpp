@@ -0,0 +1,42 @@
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocator_policies.h"
+#include "heap_state.h"
+
+// Cost of dp_check, the full heap audit, on heaps aged to a growing number of blocks.
+//
+// The audit walks every block in address order and then the free list, so its cost is
+// linear in the number of blocks. items_per_second is blocks audited per second. The
+// cheaper tiers, header canaries and the amortized slice, are measured by the canary and
+// check_slice4 variants of the allocator benchmarks.
+
+constexpr size_t VALIDATION_BUFFER_SIZE = 64 << 20;
+
+// range(0) is the number of free blocks, the heap holds twice as many live blocks.
+static void DpCheck(benchmark::State &state) {
+  size_t free_blocks = static_cast<size_t>(state.range(0));
+  HeapState target{free_blocks * 2, 0.5, free_blocks};
+
+  DeadpoolPolicy policy;
+  policy.init(VALIDATION_BUFFER_SIZE);
+  std::vector<void *> live = age_heap(policy, VALIDATION_BUFFER_SIZE, target);
+  size_t blocks = live.size() + free_blocks + 1;
+
+  for (auto _ : state) {
+    if (dp_check(&policy.allocator) != 0) {
+      state.SkipWithError("heap check failed");
+      break;
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(blocks));
+  state.SetComplexityN(static_cast<int64_t>(blocks));
+  state.counters["blocks"] = static_cast<double>(blocks);
+  for (void *ptr : live) {
+    policy.free(ptr);
+  }
+  policy.teardown();
+}
+BENCHMARK(DpCheck)->RangeMultiplier(8)->Range(64, 8192)->Complexity(benchmark::oN);
@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocator_policies.h"
+#include "pages.h"
+#include "perf_counter.h"
+
+// First allocations out of a fresh heap, with and without faulting its pages in up front.
+//
+//  WarmUpFirstAllocations - maps a heap of range(0) MiB on small pages, warms it up with
+//                           range(1) threads (0 for no warm up) and times filling it with
+//                           16KiB blocks, each written through like a caller would. Reports
+//                           the fill per block as the manual time, the 99.9th percentile and
+//                           slowest block as p999_latency_us and max_latency_us, page_faults
+//                           per block and warm_up_ms, the time dp_pages_warm took.
+//
+// The warm up moves every fault out of the allocations, its cost is paid once at startup.
+
+static constexpr size_t WARM_UP_BLOCK = 16 * 1024;
+
+static void WarmUpFirstAllocations(benchmark::State &state) {
+  using clock = std::chrono::steady_clock;
+  size_t heap_size = static_cast<size_t>(state.range(0)) * 1024 * 1024;
+  size_t threads = static_cast<size_t>(state.range(1));
+  double warm_up_total = 0;
+  std::vector<double> latencies;
+
+  PerfCounter page_faults = PerfCounter::page_faults();
+  for (auto _ : state) {
+    dp_pages pages;
+    if (!dp_pages_map(&pages, heap_size, DP_PAGES_SMALL)) {
+      state.SkipWithError("mapping the heap failed");
+      return;
+    }
+    auto warm_up_start = clock::now();
+    if (threads > 0)
+      dp_pages_warm(&pages, {.threads = threads, .lock = false});
+    warm_up_total += std::chrono::duration<double>(clock::now() - warm_up_start).count();
+
+    dp_alloc allocator;
+    dp_init(&allocator, pages.data, pages.size IF_DP_LOG(, null_logger));
+    double fill = 0;
+    page_faults.start();
+    while (true) {
+      auto start = clock::now();
+      auto *ptr = static_cast<uint8_t *>(dp_malloc(&allocator, WARM_UP_BLOCK));
+      if (ptr == nullptr)
+        break;
+      for (size_t offset = 0; offset < WARM_UP_BLOCK; offset += 4096) {
+        ptr[offset] = 1;
+      }
+      double latency = std::chrono::duration<double>(clock::now() - start).count();
+      fill += latency;
+      latencies.push_back(latency);
+    }
+    page_faults.stop();
+    state.SetIterationTime(fill);
+    dp_pages_unmap(&pages);
+  }
+
+  size_t blocks = latencies.size();
+  if (blocks == 0)
+    return;
+  std::sort(latencies.begin(), latencies.end());
+  state.SetItemsProcessed(static_cast<int64_t>(blocks));
+  state.SetLabel(threads > 0 ? "warm" : "cold");
+  page_faults.report(state, "page_faults",
+                     static_cast<double>(blocks) / static_cast<double>(state.iterations()));
+  state.counters["p999_latency_us"] = latencies[blocks * 999 / 1000] * 1e6;
+  state.counters["max_latency_us"] = latencies.back() * 1e6;
+  state.counters["warm_up_ms"] = warm_up_total * 1e3 / static_cast<double>(state.iterations());
+}
+BENCHMARK(WarmUpFirstAllocations)
+    ->ArgsProduct({{64, 256}, {0, 1, 4}})
+    ->UseManualTime()
+    ->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <random>
+#include <utility>
+#include <vector>
+
+// Declarative workload profiles and a trace generator for them.
+//
+// A profile describes where allocation sizes come from, how long objects live and which
+// operations the program performs. generate_trace() turns a profile into a deterministic
+// sequence of alloc/free operations over numbered slots, which replay_trace() then runs
+// against any policy.
+
+enum class SizeKind {
+  LogNormal, // exp(N(mu, sigma)).
+  PowerLaw,  // Pareto with exponent alpha, truncated to [min, max].
+  Histogram, // Exact sizes picked with the given weights.
+};
+
+struct SizeDistribution {
+  SizeKind kind;
+  double mu_or_alpha;
+  double sigma;
+  size_t min;
+  size_t max;
+  std::vector<std::pair<size_t, double>> histogram;
+};
+
+// Lifetimes are a mixture of three classes, weights don't need to sum to 1.
+//  short  - geometric with mean short_mean operations.
+//  long   - geometric with mean long_mean operations.
+//  phased - every object dies together at the end of the current phase
+//           (a compiler pass, a game frame).
+struct LifetimeDistribution {
+  double short_weight;
+  size_t short_mean;
+  double long_weight;
+  size_t long_mean;
+  double phased_weight;
+  size_t phase_length;
+};
+
+// Operation mix, weights don't need to sum to 1.
+//  alloc  - allocate a new object.
+//  resize - regrow the most recent live object to twice its size (free and allocate),
+//           like a growing vector or string buffer.
+// Frees are implied by the lifetime distribution.
+struct OpMix {
+  double alloc;
+  double resize;
+};
+
+struct WorkloadProfile {
+  const char *name;
+  SizeDistribution sizes;
+  LifetimeDistribution lifetimes;
+  OpMix mix;
+  size_t steps;
+};
+
+struct TraceOp {
+  enum Kind : uint8_t { Alloc, Free } kind;
+  uint32_t slot;
+  uint32_t size;
+};
+
+struct Trace {
+  std::vector<TraceOp> ops;
+  size_t slots;
+  size_t num_allocs;
+  size_t peak_live_bytes;
+};
+
+// Request-serving process: log-normal sizes, mostly short-lived request objects with a
+// tail of long-lived connection and cache state, some buffer growth.
+inline const WorkloadProfile SERVER_PROFILE = {
+    "server",
+    {SizeKind::LogNormal, std::log(128.0), 1.2, 8, 64 * 1024, {}},
+    {0.9, 20, 0.1, 20000, 0.0, 0},
+    {0.9, 0.1},
+    200000,
+};
+
+// Compiler: small AST/IR node sizes from a histogram, most nodes die at the end of their
+// pass, symbol tables live long, occasional vector growth.
+inline const WorkloadProfile COMPILER_PROFILE = {
+    "compiler",
+    {SizeKind::Histogram,
+     0,
+     0,
+     0,
+     0,
+     {{16, 0.3}, {24, 0.2}, {32, 0.2}, {48, 0.1}, {64, 0.1}, {128, 0.05}, {256, 0.05}}},
+    {0.0, 0, 0.2, 50000, 0.8, 5000},
+    {0.95, 0.05},
+    200000,
+};
+
+// Game frame: heavy-tailed sizes, almost everything is per-frame scratch freed at the
+// end of the frame, a few long-lived asset allocations.
+inline const WorkloadProfile GAME_FRAME_PROFILE = {
+    "game_frame",
+    {SizeKind::PowerLaw, 1.5, 0, 16, 16 * 1024, {}},
+    {0.0, 0, 0.05, 100000, 0.95, 1000},
+    {1.0, 0.0},
+    200000,
+};
+
+inline const std::vector<const WorkloadProfile *> WORKLOAD_PROFILES = {
+    &SERVER_PROFILE, &COMPILER_PROFILE, &GAME_FRAME_PROFILE};
+
+class SizeSampler {
+public:
+  explicit SizeSampler(const SizeDistribution &dist) : m_dist(dist) {
+    if (dist.kind == SizeKind::Histogram) {
+      std::vector<double> weights;
+      for (auto [size, weight] : dist.histogram) {
+        weights.push_back(weight);
+      }
+      m_histogram = std::discrete_distribution<size_t>(weights.begin(), weights.end());
+    }
+  }
+
+  size_t operator()(std::mt19937 &rng) {
+    switch (m_dist.kind) {
+    case SizeKind::LogNormal: {
+      std::lognormal_distribution<double> lognormal(m_dist.mu_or_alpha, m_dist.sigma);
+      return clamp(lognormal(rng));
+    }
+    case SizeKind::PowerLaw: {
+      // Inverse CDF of a Pareto distribution truncated to [min, max].
+      std::uniform_real_distribution<double> uniform(0.0, 1.0);
+      double alpha = m_dist.mu_or_alpha;
+      double lo = std::pow((double)m_dist.min, -alpha);
+      double hi = std::pow((double)m_dist.max, -alpha);
+      return clamp(std::pow(lo - uniform(rng) * (lo - hi), -1.0 / alpha));
+    }
+    case SizeKind::Histogram:
+      return m_dist.histogram[m_histogram(rng)].first;
+    }
+    return m_dist.min;
+  }
+
+private:
+  const SizeDistribution &m_dist;
+  std::discrete_distribution<size_t> m_histogram;
+
+  size_t clamp(double size) const {
+    return std::clamp(static_cast<size_t>(size), m_dist.min, m_dist.max);
+  }
+};
+
+inline Trace generate_trace(const WorkloadProfile &profile, uint32_t seed = 42) {
+  std::mt19937 rng(seed);
+  SizeSampler sample_size(profile.sizes);
+
+  const LifetimeDistribution &life = profile.lifetimes;
+  std::discrete_distribution<int> lifetime_class(
+      {life.short_weight, life.long_weight, life.phased_weight});
+  std::discrete_distribution<int> op_kind({profile.mix.alloc, profile.mix.resize});
+
+  auto geometric = [&](size_t mean) {
+    double p = 1.0 / static_cast<double>(std::max<size_t>(mean, 1));
+    return std::geometric_distribution<size_t>(p)(rng);
+  };
+
+  Trace trace{};
+  std::vector<uint32_t> free_slots;
+  std::vector<uint32_t> sizes;
+  std::vector<bool> alive;
+  size_t live_bytes = 0;
+  // (death step, slot), earliest death first.
+  using Death = std::pair<size_t, uint32_t>;
+  std::priority_queue<Death, std::vector<Death>, std::greater<>> deaths;
+  uint32_t last_slot = UINT32_MAX;
+
+  auto emit_free = [&](uint32_t slot) {
+    trace.ops.push_back({TraceOp::Free, slot, sizes[slot]});
+    live_bytes -= sizes[slot];
+    alive[slot] = false;
+    free_slots.push_back(slot);
+  };
+
+  auto emit_alloc = [&](uint32_t slot, size_t size) {
+    trace.ops.push_back({TraceOp::Alloc, slot, static_cast<uint32_t>(size)});
+    sizes[slot] = static_cast<uint32_t>(size);
+    alive[slot] = true;
+    live_bytes += size;
+    trace.num_allocs++;
+    trace.peak_live_bytes = std::max(trace.peak_live_bytes, live_bytes);
+  };
+
+  for (size_t step = 0; step < profile.steps; step++) {
+    while (!deaths.empty() && deaths.top().first <= step) {
+      emit_free(deaths.top().second);
+      deaths.pop();
+    }
+
+    if (op_kind(rng) == 1 && last_slot != UINT32_MAX && alive[last_slot]) {
+      size_t size = std::min<size_t>(sizes[last_slot] * 2, UINT32_MAX);
+      emit_free(last_slot);
+      free_slots.pop_back();
+      emit_alloc(last_slot, size);
+      continue;
+    }
+
+    uint32_t slot;
+    if (free_slots.empty()) {
+      slot = static_cast<uint32_t>(sizes.size());
+      sizes.push_back(0);
+      alive.push_back(false);
+    } else {
+      slot = free_slots.back();
+      free_slots.pop_back();
+    }
+    emit_alloc(slot, sample_size(rng));
+    last_slot = slot;
+
+    size_t death;
+    switch (lifetime_class(rng)) {
+    case 0:
+      death = step + 1 + geometric(life.short_mean);
+      break;
+    case 1:
+      death = step + 1 + geometric(life.long_mean);
+      break;
+    default:
+      death = (step / life.phase_length + 1) * life.phase_length;
+      break;
+    }
+    deaths.push({death, slot});
+  }
+
+  while (!deaths.empty()) {
+    emit_free(deaths.top().second);
+    deaths.pop();
+  }
+
+  trace.slots = sizes.size();
+  return trace;
+}
+
+// Runs the trace against the policy, `slots` must hold trace.slots entries. Allocations
+// the policy can't satisfy are skipped together with their frees.
+// Returns the number of failed allocations.
+template <typename Policy>
+size_t replay_trace(Policy &policy, const Trace &trace, std::vector<void *> &slots) {
+  size_t failed = 0;
+  for (const TraceOp &op : trace.ops) {
+    if (op.kind == TraceOp::Alloc) {
+      slots[op.slot] = policy.alloc(op.size);
+      failed += slots[op.slot] == nullptr;
+    } else if (slots[op.slot] != nullptr) {
+      policy.free(slots[op.slot]);
+      slots[op.slot] = nullptr;
+    }
+  }
+  return failed;
+}
@@ -0,0 +1,63 @@
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocator_policies.h"
+#include "memory_metrics.h"
+#include "workload.h"
+
+constexpr size_t WORKLOAD_BUFFER_SIZE = 32 * 1024 * 1024;
+
+// Replays the trace of WORKLOAD_PROFILES[range(0)].
+template <typename Policy> class WorkloadFixture : public benchmark::Fixture {
+public:
+  void SetUp(benchmark::State &state) override {
+    const WorkloadProfile &profile = *WORKLOAD_PROFILES[state.range(0)];
+    m_trace = &trace_for(state.range(0));
+    m_slots.assign(m_trace->slots, nullptr);
+    m_policy.init(WORKLOAD_BUFFER_SIZE);
+    state.SetLabel(profile.name);
+  }
+
+  void TearDown(benchmark::State &state) override {
+    state.counters["peak_live_bytes"] =
+        benchmark::Counter(static_cast<double>(m_trace->peak_live_bytes),
+                           benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+    m_memory.report(state, m_policy, WORKLOAD_BUFFER_SIZE, 64);
+    m_policy.teardown();
+  }
+
+protected:
+  Policy m_policy;
+  const Trace *m_trace;
+  std::vector<void *> m_slots;
+  MemorySampler<Policy> m_memory;
+
+  // Traces are generated once per profile and shared by every policy.
+  static const Trace &trace_for(int64_t profile) {
+    static std::vector<Trace> traces = [] {
+      std::vector<Trace> all;
+      for (const WorkloadProfile *p : WORKLOAD_PROFILES) {
+        all.push_back(generate_trace(*p));
+      }
+      return all;
+    }();
+    return traces[profile];
+  }
+};
+
+BENCHMARK_TEMPLATE_METHOD_F(WorkloadFixture, ProfileReplay)(benchmark::State &state) {
+  size_t failed = 0;
+  for (auto _ : state) {
+    failed += replay_trace(this->m_policy, *this->m_trace, this->m_slots);
+  }
+
+  state.SetItemsProcessed(state.iterations() * this->m_trace->ops.size());
+  state.counters["failed_allocs"] =
+      benchmark::Counter(static_cast<double>(failed), benchmark::Counter::kAvgIterations);
+}
+ALLOCATOR_BENCHMARK_INSTANTIATE(WorkloadFixture, ProfileReplay,
+                                ->ArgName("profile")
+                                    ->DenseRange(0, WORKLOAD_PROFILES.size() - 1));
+DEADPOOL_VARIANTS_INSTANTIATE(WorkloadFixture, ProfileReplay,
+                              ->ArgName("profile")->DenseRange(0, WORKLOAD_PROFILES.size() - 1));
@@ -24,3 +24,46 @@ function(generate_config_helpers)
   add_custom_target(gen_config_headers DEPENDS "${arg_GENERATED_HEADER_DIR}/config_macros.h")
   return(PROPAGATE GENERATED_HEADER_DIR)
 endfunction()
+
+# Generates the config helpers of a variant build, with OPTIONS (NAME=VALUE) forced and every
+# symbol declared by the SYMBOLS headers prefixed with NAME_, so several variants of the
+# allocator can be linked into one binary. Sets VARIANT_HEADER_DIR and creates the
+# gen_config_headers_<NAME> target.
+function(generate_config_variant)
+  cmake_parse_arguments(PARSE_ARGV 0 arg "" "NAME;CONFIG_HEADER" "SYMBOLS;OPTIONS")
+  if(NOT DEFINED arg_NAME)
+    message(FATAL_ERROR "variable NAME must be set.")
+  endif()
+  if(NOT DEFINED arg_CONFIG_HEADER OR NOT EXISTS ${arg_CONFIG_HEADER})
+    message(FATAL_ERROR "variable CONFIG_HEADER must be a valid header file.")
+  endif()
+
+  set(VARIANT_HEADER_DIR ${CMAKE_CURRENT_BINARY_DIR}/config_headers/${arg_NAME})
+  file(MAKE_DIRECTORY ${VARIANT_HEADER_DIR})
+
+  set(extra_args --prefix ${arg_NAME})
+  foreach(option ${arg_OPTIONS})
+    list(APPEND extra_args --set ${option})
+  endforeach()
+  foreach(header ${arg_SYMBOLS})
+    list(APPEND extra_args --symbols ${header})
+  endforeach()
+
+  find_package(Python3 REQUIRED COMPONENTS Interpreter)
+  add_custom_command(
+    OUTPUT "${VARIANT_HEADER_DIR}/config_macros.h"
+    COMMAND ${Python3_EXECUTABLE}
+      "${CMAKE_CURRENT_FUNCTION_LIST_DIR}/generate_config.py"
+      "${arg_CONFIG_HEADER}"
+      "${VARIANT_HEADER_DIR}/config_macros.h"
+      ${extra_args}
+    DEPENDS "${arg_CONFIG_HEADER}" "${CMAKE_CURRENT_FUNCTION_LIST_DIR}/generate_config.py"
+      ${arg_SYMBOLS}
+    COMMENT "Generating config helper macros for the ${arg_NAME} variant"
+    VERBATIM
+  )
+  add_custom_target(gen_config_headers_${arg_NAME}
+    DEPENDS "${VARIANT_HEADER_DIR}/config_macros.h"
+  )
+  return(PROPAGATE VARIANT_HEADER_DIR)
+endfunction()
@@ -6,8 +6,109 @@ import argparse
 # Regex to find lines like: #define MYCONF 1
 CONFIG_REGEX = re.compile(r"^#define\s+((\w+))\s+([01])")
 
-def generate_header(config_header, generated_header):
-    """Parses the input header and generates an output header with helper macros."""
+# Regexes to find typed parameters, declared by an annotation comment above their default:
+#   // @param size_t DP_ALIGNMENT zero pow2 min=4 max=128
+#   // @enum DP_FIT_POLICY DP_FIT_BEST DP_FIT_FIRST
+# Numeric parameters accept the attributes min=N, max=N, pow2 (a power of two) and zero
+# (0 is allowed regardless of the other attributes, usually meaning "default" or "off").
+# Enum values are numbered in order.
+PARAM_REGEX = re.compile(r"^//\s*@param\s+(\w+)\s+(\w+)((?:\s+[\w=]+)*)\s*$")
+ENUM_REGEX = re.compile(r"^//\s*@enum\s+(\w+)((?:\s+\w+)+)\s*$")
+PARAM_TYPES = ("size_t", "unsigned", "uint8_t", "uint16_t", "uint32_t", "uint64_t")
+
+# Regexes to find the public symbols of a variant: functions like dp_malloc( and
+# types like typedef struct dp_alloc.
+FUNCTION_REGEX = re.compile(r"\b(dp_[a-z]\w*)\s*\(")
+TYPE_REGEX = re.compile(r"typedef\s+struct\s+(\w+)")
+
+def parse_overrides(overrides):
+    """Parses NAME=VALUE pairs into a dict, values must be numbers or enum value names."""
+    values = {}
+    for override in overrides:
+        name, sep, value = override.partition("=")
+        if not sep or not re.fullmatch(r"\w+", value):
+            print(f"Error: invalid override '{override}', expected NAME=VALUE.")
+            sys.exit(1)
+        values[name] = value
+    return values
+
+def constant_name(conf_name):
+    """DP_ALIGNMENT -> dp_config_alignment."""
+    return "dp_config_" + conf_name.lower().removeprefix("dp_")
+
+def param_lines(conf_name, conf_type, attributes):
+    """Validation and constant for a numeric parameter."""
+    if conf_type not in PARAM_TYPES:
+        print(f"Error: parameter {conf_name} has unsupported type '{conf_type}'.")
+        sys.exit(1)
+
+    value = f"({conf_name})"
+    conditions = []
+    descriptions = []
+    allow_zero = False
+    for attribute in attributes.split():
+        key, _, arg = attribute.partition("=")
+        if key == "min":
+            conditions.append(f"{value} >= {arg}")
+            descriptions.append(f">= {arg}")
+        elif key == "max":
+            conditions.append(f"{value} <= {arg}")
+            descriptions.append(f"<= {arg}")
+        elif key == "pow2":
+            conditions.append(f"{value} > 0 && ({value} & ({value} - 1)) == 0")
+            descriptions.append("a power of two")
+        elif key == "zero":
+            allow_zero = True
+        else:
+            print(f"Error: parameter {conf_name} has unknown attribute '{attribute}'.")
+            sys.exit(1)
+
+    lines = []
+    if conditions:
+        condition = " && ".join(conditions)
+        description = ", ".join(descriptions)
+        if allow_zero:
+            condition = f"{value} == 0 || ({condition})"
+            description = f"0 or {description}"
+        lines.append(f"#if !({condition})\n")
+        lines.append(f"#error \"{conf_name} must be {description}\"\n")
+        lines.append("#endif\n")
+    lines.append(f"static const {conf_type} {constant_name(conf_name)} = {conf_name};\n\n")
+    return lines
+
+def enum_lines(conf_name, enum_values):
+    """Value macros, validation and constant for an enum parameter."""
+    lines = []
+    for index, enum_value in enumerate(enum_values):
+        lines.append(f"#define {enum_value} {index}\n")
+    condition = " && ".join(f"{conf_name} != {enum_value}" for enum_value in enum_values)
+    lines.append(f"#if {condition}\n")
+    lines.append(f"#error \"{conf_name} must be one of {', '.join(enum_values)}\"\n")
+    lines.append("#endif\n")
+    lines.append(f"static const unsigned {constant_name(conf_name)} = {conf_name};\n\n")
+    return lines
+
+def find_symbols(headers):
+    """Collects the function and type names declared by the given headers."""
+    symbols = []
+    for header in headers:
+        try:
+            with open(header, 'r') as f:
+                text = f.read()
+        except FileNotFoundError:
+            print(f"Error: Symbols file '{header}' not found.")
+            sys.exit(1)
+        for name in TYPE_REGEX.findall(text) + FUNCTION_REGEX.findall(text):
+            if name not in symbols:
+                symbols.append(name)
+    return symbols
+
+def generate_header(config_header, generated_header, prefix=None, overrides=(), symbol_headers=()):
+    """Parses the input header and generates an output header with helper macros.
+
+    A variant header additionally forces the overridden options before including the
+    config header and renames every symbol declared by symbol_headers to prefix_symbol,
+    so several variants can be linked into one binary."""
 
 
     generated_lines = [
@@ -15,32 +116,62 @@ def generate_header(config_header, generated_header):
         "// THIS FILE IS AUTOMATICALLY GENERATED. DO NOT EDIT.\n",
         "// YOU SHOULD REGENERATE THIS FILE ONLY WHEN ADDING OR REMOVING\n",
         "// CONFIGURATION OPTIONS, THERE IS NO NEED TO REGENERATE WHEN CHANGING THEM.\n"
-        f"#include <{os.path.basename(config_header)}>\n\n",
     ]
 
+    for name, value in parse_overrides(overrides).items():
+        generated_lines.append(f"#undef {name}\n")
+        generated_lines.append(f"#define {name} {value}\n")
+
+    generated_lines.append(f"#include <{os.path.basename(config_header)}>\n\n")
+
     try:
         with open(config_header, 'r') as f:
-            for line in f:
-                match = CONFIG_REGEX.match(line)
-                if not match:
-                    continue
-
-                conf_name = match.group(1)    # e.g., MYCONF
-
-                generated_lines.append(f"#if {conf_name}\n")
-                generated_lines.append(f"#define {conf_name}_ENABLED 1\n")
-                generated_lines.append(f"#define IF_{conf_name}(...) __VA_ARGS__\n")
-                generated_lines.append(f"#define IF_NOT_{conf_name}(...) /* {conf_name} Enabled */\n")
-                generated_lines.append("#else\n")
-                generated_lines.append(f"#define {conf_name}_DISABLED 1\n")
-                generated_lines.append(f"#define IF_{conf_name}(...) /* {conf_name} Disabled */\n")
-                generated_lines.append(f"#define IF_NOT_{conf_name}(...) __VA_ARGS__\n")
-                generated_lines.append("#endif\n\n")
-
+            lines = f.readlines()
     except FileNotFoundError:
         print(f"Error: Input file '{config_header}' not found.")
         sys.exit(1)
 
+    typed_names = set()
+    typed_lines = []
+    for line in lines:
+        param = PARAM_REGEX.match(line)
+        enum = ENUM_REGEX.match(line)
+        if param:
+            conf_type, conf_name, attributes = param.groups()
+            typed_names.add(conf_name)
+            typed_lines += param_lines(conf_name, conf_type, attributes)
+        elif enum:
+            conf_name, enum_values = enum.groups()
+            typed_names.add(conf_name)
+            typed_lines += enum_lines(conf_name, enum_values.split())
+
+    if typed_lines:
+        generated_lines.append("#include <stddef.h>\n#include <stdint.h>\n\n")
+
+    for line in lines:
+        match = CONFIG_REGEX.match(line)
+        if not match or match.group(1) in typed_names:
+            continue
+
+        conf_name = match.group(1)    # e.g., MYCONF
+
+        generated_lines.append(f"#if {conf_name}\n")
+        generated_lines.append(f"#define {conf_name}_ENABLED 1\n")
+        generated_lines.append(f"#define IF_{conf_name}(...) __VA_ARGS__\n")
+        generated_lines.append(f"#define IF_NOT_{conf_name}(...) /* {conf_name} Enabled */\n")
+        generated_lines.append("#else\n")
+        generated_lines.append(f"#define {conf_name}_DISABLED 1\n")
+        generated_lines.append(f"#define IF_{conf_name}(...) /* {conf_name} Disabled */\n")
+        generated_lines.append(f"#define IF_NOT_{conf_name}(...) __VA_ARGS__\n")
+        generated_lines.append("#endif\n\n")
+
+    generated_lines += typed_lines
+
+    if prefix:
+        generated_lines.append(f"// Symbols of the {prefix} variant.\n")
+        for symbol in find_symbols(symbol_headers):
+            generated_lines.append(f"#define {symbol} {prefix}_{symbol}\n")
+
     with open(generated_header, 'w') as f:
         f.writelines(generated_lines)
 
@@ -50,5 +181,11 @@ if __name__ == "__main__":
     parser = argparse.ArgumentParser()
     parser.add_argument("config_header")
     parser.add_argument("generated_header")
+    parser.add_argument("--prefix", help="symbol prefix of a variant build")
+    parser.add_argument("--set", dest="overrides", action="append", default=[],
+                        metavar="NAME=VALUE", help="force an option in a variant build")
+    parser.add_argument("--symbols", action="append", default=[], metavar="HEADER",
+                        help="header declaring the symbols to prefix")
     args = parser.parse_args()
-    generate_header(args.config_header, args.generated_header)
+    generate_header(args.config_header, args.generated_header, args.prefix, args.overrides,
+                    args.symbols)
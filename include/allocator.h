@@ -9,6 +9,10 @@
 
 #include "log.h"
 
+#if DP_REGISTRY && !defined(__cplusplus)
+#include <stdatomic.h>
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -17,8 +21,65 @@ typedef struct block_header {
   struct block_header *next;
   size_t size;
   bool is_free;
+  bool decommitted; // free, and the pages past the header were returned by a trim.
+  IF_DP_HEADER_CANARY(uint32_t canary;) // fits in the padding after is_free.
 } block_header;
 
+#if DP_OUT_OF_LINE_METADATA
+#define DP_SIDE_LEVELS 3
+
+// Bitmap over the granules of an out of line metadata heap with summary levels, bit i of
+// levels[l + 1] is set while word i of levels[l] isn't zero, so scans skip empty stretches
+// 64^l granules at a time.
+typedef struct dp_side_bitmap {
+  uint64_t *levels[DP_SIDE_LEVELS];
+  size_t words[DP_SIDE_LEVELS];
+} dp_side_bitmap;
+#endif
+
+#if DP_SIZE_CLASSES
+// Terminates the size class caches, so a cached block's next is never NULL and dp_free
+// tells it apart from a live one.
+#define DP_CACHE_END ((block_header *)UINTPTR_MAX)
+#endif
+
+#if DP_HUGE_THRESHOLD
+// A block mapped for itself, see DP_HUGE_THRESHOLD.
+typedef struct dp_huge_block {
+  void *ptr;     // start of the mapping, and the user pointer.
+  size_t length; // of the mapping, whole pages.
+} dp_huge_block;
+#endif
+
+#if DP_WATERMARKS
+struct dp_alloc;
+
+// Values a watermark watches.
+typedef enum dp_watermark {
+  DP_WATERMARK_AVAILABLE, // free bytes, available.
+  DP_WATERMARK_LARGEST,   // the largest free block, about the largest request that succeeds.
+  DP_WATERMARK_COUNT,
+} dp_watermark;
+
+// Called with pressure set when the watched value drops below low, and with it clear once
+// the value is back at high. value is the watched value, the allocator is consistent and may
+// be used from the callback.
+typedef void (*dp_watermark_callback)(struct dp_alloc *allocator, dp_watermark watermark,
+                                      bool pressure, size_t value, void *context);
+
+typedef struct dp_watermark_state {
+  size_t low;
+  size_t high;
+  // dp_malloc fires when the value drops under fire_below and dp_free when it reaches
+  // fire_at, low and SIZE_MAX until pressure fires, 0 and high while it lasts.
+  size_t fire_below;
+  size_t fire_at;
+  bool pressure;
+  dp_watermark_callback callback;
+  void *context;
+} dp_watermark_state;
+#endif
+
 typedef struct dp_alloc {
   uint8_t *buffer;
   size_t buffer_size;
@@ -26,14 +87,137 @@ typedef struct dp_alloc {
   block_header *free_list_head;
 
   IF_DP_LOG(dp_logger logger;)
-  IF_DP_STATS(size_t num_iterations;)
+  IF_DP_STATS(size_t num_iterations;)      // free blocks probed by the last dp_malloc.
+  IF_DP_STATS(size_t num_free_iterations;) // free blocks scanned by the last dp_free.
+#if DP_CHECK_SLICE
+  block_header *check_cursor; // next block the amortized check verifies.
+#endif
+#if DP_FREE_INDEX
+  // Free blocks' sizes and offsets from buffer, index_count entries long. They live past
+  // buffer + buffer_size and replace the free list, free_list_head stays NULL.
+  uint32_t *index_sizes;
+  uint32_t *index_offsets;
+  size_t index_count;
+#endif
+#if DP_OUT_OF_LINE_METADATA
+  // Side table at the start of buffer, a bit per granule of data in each bitmap. A block's
+  // size is the distance to the next block start, free_list_head stays NULL.
+  dp_side_bitmap block_starts;   // first granule of every block, and the one past the last.
+  dp_side_bitmap free_starts;    // first granule of every free block.
+  dp_side_bitmap trimmed_starts; // first granule of every free block whose pages were trimmed.
+  uint8_t *data;                 // first granule, past the side table.
+  size_t granules;
+#endif
+#if DP_SIZE_CLASSES
+  // Freed blocks still marked allocated, see DP_SIZE_CLASSES. class_cache[i] lists blocks
+  // with room for i + 1 granules through their next, class_count[i] of them.
+  block_header *class_cache[DP_SIZE_CLASSES];
+  uint32_t class_count[DP_SIZE_CLASSES];
+  size_t cached_blocks; // in all classes.
+#endif
+#if DP_HUGE_THRESHOLD
+  dp_huge_block huge_blocks[DP_HUGE_SLOTS]; // huge_count of them, in no order.
+  size_t huge_count;
+  size_t huge_bytes; // mapped for all huge blocks, not part of buffer_size or available.
+#endif
+#if DP_WATERMARKS
+  dp_watermark_state watermarks[DP_WATERMARK_COUNT];
+  // A lower bound on the largest free block, recounted whenever it drops under the largest
+  // watermark's low, see dp_watermark_crossed.
+  size_t largest_free;
+#endif
+#if DP_REGISTRY
+  // Next arena registered on this arena's first and last page, see dp_register. Lookups
+  // read them without the registry's lock, C++ sees them as the plain pointers they are
+  // laid out as.
+#ifdef __cplusplus
+  struct dp_alloc *registry_next[2];
+#else
+  _Atomic(struct dp_alloc *) registry_next[2];
+#endif
+#endif
 } dp_alloc;
 
+// How long a block is expected to live, see dp_malloc_hint.
+typedef enum dp_lifetime {
+  DP_LIFETIME_SHORT, // freed soon, like request buffers.
+  DP_LIFETIME_LONG,  // outlives most other blocks, like sessions.
+} dp_lifetime;
+
 bool dp_init(dp_alloc *allocator, void *buffer, size_t buffer_size IF_DP_LOG(, dp_logger logger));
 void *dp_malloc(dp_alloc *allocator, size_t size);
+// Allocates like dp_malloc, placing the block by its lifetime so short lived blocks don't end
+// up between long lived ones: long lived blocks at the start of the lowest free block that
+// fits, short lived ones at the end of the highest. Freed blocks coalesce across the two.
+// Hinted requests walk every free block, DP_FIT_POLICY and DP_PROBE_LIMIT don't apply.
+void *dp_malloc_hint(dp_alloc *allocator, size_t size, dp_lifetime lifetime);
 int dp_free(dp_alloc *allocator, void *ptr);
+int dp_check(dp_alloc *allocator);
+// Returns every block cached by DP_SIZE_CLASSES to the heap, and how many there were.
+size_t dp_flush_cache(dp_alloc *allocator);
+// Resizes the block at ptr to size bytes like realloc, moving it when it must grow. Huge
+// blocks are remapped rather than copied. A NULL ptr allocates, a size of 0 frees.
+void *dp_realloc(dp_alloc *allocator, void *ptr, size_t size);
+// Bytes usable at ptr, 0 if ptr isn't a live block of allocator.
+size_t dp_usable_size(dp_alloc *allocator, const void *ptr);
+// Returns the whole pages inside free blocks to the system, leaving free blocks of up to
+// keep_bytes in all committed, the most recently freed first. Blocks already trimmed are
+// skipped, the next dp_malloc out of them faults their pages back in. Returns the bytes
+// returned, see DP_TRIM_THRESHOLD for trimming on dp_free.
+size_t dp_trim(dp_alloc *allocator, size_t keep_bytes);
+// Size of the largest free block, a walk over every free block.
+size_t dp_largest_free(dp_alloc *allocator);
+#if DP_WATERMARKS
+// Watches watermark, calling callback when it drops below low and when it is back at high,
+// low = high = 0 stops watching it. The callback fires right away if the value is already
+// below low. Returns false if low > high. dp_init resets every watermark.
+bool dp_set_watermark(dp_alloc *allocator, dp_watermark watermark, size_t low, size_t high,
+                      dp_watermark_callback callback, void *context);
+// The slow path of dp_malloc and dp_free's watermark compares, fires the callback.
+void dp_watermark_crossed(dp_alloc *allocator, dp_watermark watermark);
+
+// dp_malloc's compares, after carving a free block of carved bytes down to a free block of
+// left bytes, 0 if it was taken whole.
+static inline void dp_watch_malloc(dp_alloc *allocator, size_t carved, size_t left) {
+  if (carved >= allocator->largest_free && left < allocator->largest_free)
+    allocator->largest_free = left;
+  if (allocator->available < allocator->watermarks[DP_WATERMARK_AVAILABLE].fire_below)
+    dp_watermark_crossed(allocator, DP_WATERMARK_AVAILABLE);
+  if (allocator->largest_free < allocator->watermarks[DP_WATERMARK_LARGEST].fire_below)
+    dp_watermark_crossed(allocator, DP_WATERMARK_LARGEST);
+}
+
+// dp_free's compares, after coalescing left a free block of merged bytes.
+static inline void dp_watch_free(dp_alloc *allocator, size_t merged) {
+  if (merged > allocator->largest_free)
+    allocator->largest_free = merged;
+  if (allocator->available >= allocator->watermarks[DP_WATERMARK_AVAILABLE].fire_at)
+    dp_watermark_crossed(allocator, DP_WATERMARK_AVAILABLE);
+  if (allocator->largest_free >= allocator->watermarks[DP_WATERMARK_LARGEST].fire_at)
+    dp_watermark_crossed(allocator, DP_WATERMARK_LARGEST);
+}
+#endif
+#if DP_HUGE_THRESHOLD
+// The direct mapped path of DP_HUGE_THRESHOLD, dp_malloc and dp_free route to it.
+void *dp_huge_malloc(dp_alloc *allocator, size_t size);
+int dp_huge_free(dp_alloc *allocator, void *ptr);
+size_t dp_huge_size(const dp_alloc *allocator, const void *ptr); // 0 if ptr isn't a huge block.
+#endif
 IF_DP_STATS(float dp_get_fragmentation(dp_alloc *allocator);)
 
+#if DP_REGISTRY
+// Global arena registry, maps addresses to the registered arena whose buffer holds them.
+// Register an arena after dp_init and unregister it before re-initialising or dropping it.
+// dp_register and dp_unregister take the registry's lock, dp_owner and dp_free_any don't and
+// may run on any thread alongside them. A lookup racing with dp_unregister may still find
+// the arena being unregistered. dp_free_any frees through dp_free, which must not race with
+// other calls on the same arena.
+bool dp_register(dp_alloc *allocator);
+void dp_unregister(dp_alloc *allocator);
+dp_alloc *dp_owner(const void *ptr);
+int dp_free_any(void *ptr);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,93 @@
+#ifndef ALLOCATOR_INLINE_H
+#define ALLOCATOR_INLINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#ifndef __cplusplus
+#include <stdalign.h>
+#endif
+
+#include "allocator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+Fast path of dp_malloc and dp_free for builds with DP_SIZE_CLASSES, compiled into the
+caller. A hit pops or pushes a cached block with a few loads and stores, anything else
+falls through to the out of line functions, which run the same checks again before
+touching the heap. Without the cache dp_malloc_inline and dp_free_inline are plain calls.
+Unlike the out of line functions they require a non NULL allocator.
+
+Blocks start aligned, so a block's user pointer always sits DP_CLASS_USER_OFFSET bytes
+past its header and its room is block->size + sizeof(block_header) - DP_CLASS_USER_OFFSET.
+*/
+
+#if DP_SIZE_CLASSES
+#define DP_CLASS_GRANULE ((size_t)(DP_ALIGNMENT ? DP_ALIGNMENT : alignof(max_align_t)))
+#define DP_CLASS_USER_OFFSET                                                                   \
+  ((sizeof(block_header) + DP_CLASS_GRANULE) & ~(DP_CLASS_GRANULE - 1))
+
+// Pops a cached block for size, NULL if its class is empty or size is outside the classes.
+static inline void *dp_class_pop(dp_alloc *allocator, size_t size) {
+  size_t cls = (size - 1) / DP_CLASS_GRANULE; // size 0 wraps past the last class.
+  if (cls >= DP_SIZE_CLASSES || allocator->class_cache[cls] == DP_CACHE_END)
+    return NULL;
+  block_header *block = allocator->class_cache[cls];
+  allocator->class_cache[cls] = block->next;
+  allocator->class_count[cls]--;
+  allocator->cached_blocks--;
+  block->next = NULL;
+  return (uint8_t *)block + DP_CLASS_USER_OFFSET;
+}
+
+// Caches the live block of ptr, false if it isn't one or its class is out of range or full.
+// Only the header fields the cache relies on are checked, dp_free validates the rest.
+static inline bool dp_class_push(dp_alloc *allocator, void *ptr) {
+  uint8_t *block_start = (uint8_t *)ptr - DP_CLASS_USER_OFFSET;
+  if ((uintptr_t)ptr < (uintptr_t)allocator->buffer + DP_CLASS_USER_OFFSET ||
+      (uint8_t *)ptr >= allocator->buffer + allocator->buffer_size ||
+      ((uint8_t *)ptr)[-1] != DP_CLASS_USER_OFFSET - sizeof(block_header))
+    return false;
+  block_header *block = (block_header *)block_start;
+  if (block->next != NULL || block->is_free)
+    return false;
+
+  // Rooms under a granule wrap past the last class.
+  size_t room = block->size + sizeof(block_header) - DP_CLASS_USER_OFFSET;
+  size_t cls = room / DP_CLASS_GRANULE - 1;
+  if (cls >= DP_SIZE_CLASSES || allocator->class_count[cls] >= dp_config_class_cache_depth)
+    return false;
+  block->next = allocator->class_cache[cls];
+  allocator->class_cache[cls] = block;
+  allocator->class_count[cls]++;
+  allocator->cached_blocks++;
+  return true;
+}
+#endif
+
+static inline void *dp_malloc_inline(dp_alloc *allocator, size_t size) {
+#if DP_SIZE_CLASSES
+  void *cached = dp_class_pop(allocator, size);
+  if (cached != NULL)
+    return cached;
+#endif
+  return dp_malloc(allocator, size);
+}
+
+// Validation tiers check every free, so with them enabled frees always go out of line.
+static inline int dp_free_inline(dp_alloc *allocator, void *ptr) {
+#if DP_SIZE_CLASSES && !DP_HEADER_CANARY && !DP_CHECK_SLICE
+  if (ptr != NULL && dp_class_push(allocator, ptr))
+    return 0;
+#endif
+  return dp_free(allocator, ptr);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ALLOCATOR_INLINE_H
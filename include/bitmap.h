@@ -0,0 +1,60 @@
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <config_macros.h>
+
+#include "log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bit scanning implementations the bitmap engine can run on, DP_SIMD_SCALAR is the
+// portable reference every other level must agree with.
+typedef enum dp_simd {
+  DP_SIMD_SCALAR,
+  DP_SIMD_SSE2,
+  DP_SIMD_AVX2,
+  DP_SIMD_NEON,
+} dp_simd;
+
+// Fixed granularity allocator engine, an alternative to dp_alloc's free list for
+// workloads made of small, similarly sized objects. The buffer is split into granules
+// tracked by two bitmaps at its start, allocations are first fit runs of whole granules.
+typedef struct dp_bitmap {
+  uint64_t *occupied; // bit per granule, set while allocated.
+  uint64_t *run_ends; // bit per granule, set on the last granule of every allocation.
+  size_t words;       // length of each bitmap in 64 bit words.
+  uint8_t *data;      // first granule.
+  size_t granule;
+  size_t granules;
+  size_t available; // free granules.
+  dp_simd simd;
+  // First word in [from, to) that isn't equal to value, to if there is none.
+  size_t (*skip)(const uint64_t *words, size_t from, size_t to, uint64_t value);
+
+  IF_DP_LOG(dp_logger logger;)
+  IF_DP_STATS(size_t num_iterations;) // free runs probed by the last dp_bitmap_malloc.
+} dp_bitmap;
+
+// Most capable level the running CPU supports.
+dp_simd dp_simd_best(void);
+bool dp_simd_supported(dp_simd simd);
+
+// granule must be a power of two of at least 8 bytes, pointers are aligned to the granule
+// up to alignof(max_align_t). The engine starts on dp_simd_best().
+bool dp_bitmap_init(dp_bitmap *bitmap, void *buffer, size_t buffer_size,
+                    size_t granule IF_DP_LOG(, dp_logger logger));
+bool dp_bitmap_set_simd(dp_bitmap *bitmap, dp_simd simd);
+void *dp_bitmap_malloc(dp_bitmap *bitmap, size_t size);
+int dp_bitmap_free(dp_bitmap *bitmap, void *ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BITMAP_H
@@ -0,0 +1,97 @@
+#ifndef COMPOSE_H
+#define COMPOSE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "allocator.h"
+#include "bitmap.h"
+#include "tree.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Runtime composition of allocators. Every allocator, deadpool's engines and the
+// combinators below alike, is reached through a dp_allocator, so a subsystem can assemble
+// its allocator from parts: a pool for small sizes, a heap for the rest, mmap for overflow.
+// compose.hpp has the same building blocks as C++ templates, resolved at compile time.
+
+typedef struct dp_allocator_ops {
+  void *(*malloc)(void *self, size_t size);
+  int (*free)(void *self, void *ptr); // 0 on success, like dp_free.
+  // Whether ptr lies in memory self allocates from, NULL if self can't tell.
+  bool (*owns)(const void *self, const void *ptr);
+} dp_allocator_ops;
+
+typedef struct dp_allocator {
+  const dp_allocator_ops *ops;
+  void *self;
+} dp_allocator;
+
+static inline void *dp_allocator_malloc(dp_allocator allocator, size_t size) {
+  return allocator.ops->malloc(allocator.self, size);
+}
+
+static inline int dp_allocator_free(dp_allocator allocator, void *ptr) {
+  return allocator.ops->free(allocator.self, ptr);
+}
+
+static inline bool dp_allocator_owns(dp_allocator allocator, const void *ptr) {
+  return allocator.ops->owns != NULL && allocator.ops->owns(allocator.self, ptr);
+}
+
+// Views of initialised engines, they own their buffers.
+dp_allocator dp_heap_allocator(dp_alloc *heap);
+dp_allocator dp_bitmap_allocator(dp_bitmap *bitmap);
+dp_allocator dp_tree_allocator(dp_tree *tree);
+// A mapping per allocation, for sizes no buffer should hold. Can't tell what it owns, frees
+// of anything it didn't map, or already unmapped, fail.
+dp_allocator dp_mmap_allocator(void);
+
+// Requests of up to threshold bytes go to small, larger ones to large. small must be able to
+// tell what it owns, frees of anything else go to large.
+typedef struct dp_segregator {
+  size_t threshold;
+  dp_allocator small;
+  dp_allocator large;
+} dp_segregator;
+
+// Requests primary fails go to secondary. primary must be able to tell what it owns, frees
+// of anything else go to secondary.
+typedef struct dp_fallback {
+  dp_allocator primary;
+  dp_allocator secondary;
+} dp_fallback;
+
+// Bucket i serves requests of (min + i * step, min + (i + 1) * step] bytes, others fail.
+// Every bucket must be able to tell what it owns.
+typedef struct dp_bucketizer {
+  dp_allocator *buckets;
+  size_t count;
+  size_t min;
+  size_t step;
+} dp_bucketizer;
+
+// Counts what passes through to inner.
+typedef struct dp_stats {
+  dp_allocator inner;
+  size_t allocations;
+  size_t frees;
+  size_t failures; // allocations inner failed.
+  size_t bytes_requested;
+  size_t live; // blocks allocated and not yet freed.
+  size_t peak_live;
+} dp_stats;
+
+dp_allocator dp_segregator_allocator(dp_segregator *segregator);
+dp_allocator dp_fallback_allocator(dp_fallback *fallback);
+dp_allocator dp_bucketizer_allocator(dp_bucketizer *bucketizer);
+dp_allocator dp_stats_allocator(dp_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // COMPOSE_H
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+
+#include "compose.h"
+#include "heap.hpp"
+
+// Compile time composition of allocators, the templates of compose.h's combinators. A
+// composition is a type, every call through it is resolved and inlined at compile time, and
+// its parts are public members a subsystem initialises in place:
+//
+//   dp::stats<dp::segregator<256, dp::bucketizer<dp::pool, 0, 256, 16>, dp::heap<>>> a;
+//   a.inner.large.init(buffer, size);
+//
+// to_dp_allocator() and vtable_allocator cross between the two layers, so a composition can
+// be handed to C code and a dp_allocator can be a part of a composition.
+
+namespace dp {
+
+template <typename A>
+concept allocator = requires(A &a, void *ptr, size_t size) {
+  { a.allocate(size) } -> std::same_as<void *>;
+  { a.deallocate(ptr) } -> std::same_as<bool>; // false if ptr isn't a live block of a.
+};
+
+// An allocator that can tell whether a pointer lies in memory it allocates from.
+template <typename A>
+concept owning_allocator = allocator<A> && requires(const A &a, const void *ptr) {
+  { a.owns(ptr) } -> std::same_as<bool>;
+};
+
+// Blocks of one size carved from a buffer, for the small sizes a general heap spends a header
+// on. Blocks are bumped off the buffer until it runs out, freed blocks are reused first.
+// Catches frees of pointers that aren't at a block start, not double frees.
+class pool {
+public:
+  pool() = default;
+  pool(const pool &) = delete;
+  pool &operator=(const pool &) = delete;
+
+  bool init(void *buffer, size_t buffer_size, size_t block_size) {
+    constexpr size_t align = alignof(std::max_align_t);
+    if (buffer == nullptr || block_size == 0)
+      return false;
+    auto start = (reinterpret_cast<uintptr_t>(buffer) + align - 1) & ~(align - 1);
+    size_t skipped = start - reinterpret_cast<uintptr_t>(buffer);
+    block_size_ = (block_size + align - 1) & ~(align - 1);
+    if (buffer_size < skipped + block_size_)
+      return false;
+    begin_ = reinterpret_cast<uint8_t *>(start);
+    next_ = begin_;
+    end_ = begin_ + (buffer_size - skipped) / block_size_ * block_size_;
+    free_list_ = nullptr;
+    return true;
+  }
+
+  void *allocate(size_t size) {
+    if (size == 0 || size > block_size_)
+      return nullptr;
+    if (free_list_ != nullptr) {
+      void *block = free_list_;
+      free_list_ = free_list_->next;
+      return block;
+    }
+    if (next_ == end_)
+      return nullptr;
+    void *block = next_;
+    next_ += block_size_;
+    return block;
+  }
+
+  bool deallocate(void *ptr) {
+    auto *byte = static_cast<uint8_t *>(ptr);
+    if (byte < begin_ || byte >= next_ || static_cast<size_t>(byte - begin_) % block_size_ != 0)
+      return false;
+    auto *block = static_cast<free_block *>(ptr);
+    block->next = free_list_;
+    free_list_ = block;
+    return true;
+  }
+
+  bool owns(const void *ptr) const {
+    auto *byte = static_cast<const uint8_t *>(ptr);
+    return byte >= begin_ && byte < end_;
+  }
+
+  size_t block_size() const { return block_size_; }
+
+private:
+  struct free_block {
+    free_block *next;
+  };
+
+  uint8_t *begin_ = nullptr;
+  uint8_t *next_ = nullptr; // first block never handed out.
+  uint8_t *end_ = nullptr;
+  size_t block_size_ = 0;
+  free_block *free_list_ = nullptr;
+};
+
+// A mapping per allocation, see dp_mmap_allocator.
+class mmap_allocator {
+public:
+  void *allocate(size_t size) { return dp_allocator_malloc(dp_mmap_allocator(), size); }
+
+  bool deallocate(void *ptr) { return dp_allocator_free(dp_mmap_allocator(), ptr) == 0; }
+};
+
+// Requests of up to Threshold bytes go to small, larger ones to large, like dp_segregator.
+template <size_t Threshold, owning_allocator Small, allocator Large> class segregator {
+public:
+  Small small;
+  Large large;
+
+  void *allocate(size_t size) {
+    return size <= Threshold ? small.allocate(size) : large.allocate(size);
+  }
+
+  bool deallocate(void *ptr) {
+    return small.owns(ptr) ? small.deallocate(ptr) : large.deallocate(ptr);
+  }
+
+  bool owns(const void *ptr) const
+    requires owning_allocator<Large>
+  {
+    return small.owns(ptr) || large.owns(ptr);
+  }
+};
+
+// Requests primary fails go to secondary, like dp_fallback.
+template <owning_allocator Primary, allocator Secondary> class fallback {
+public:
+  Primary primary;
+  Secondary secondary;
+
+  void *allocate(size_t size) {
+    void *ptr = primary.allocate(size);
+    return ptr != nullptr || size == 0 ? ptr : secondary.allocate(size);
+  }
+
+  bool deallocate(void *ptr) {
+    return primary.owns(ptr) ? primary.deallocate(ptr) : secondary.deallocate(ptr);
+  }
+
+  bool owns(const void *ptr) const
+    requires owning_allocator<Secondary>
+  {
+    return primary.owns(ptr) || secondary.owns(ptr);
+  }
+};
+
+// Bucket i serves requests of (Min + i * Step, Min + (i + 1) * Step] bytes up to Max, others
+// fail, like dp_bucketizer.
+template <owning_allocator Allocator, size_t Min, size_t Max, size_t Step> class bucketizer {
+  static_assert(Step > 0 && Max > Min && (Max - Min) % Step == 0);
+
+public:
+  static constexpr size_t count = (Max - Min) / Step;
+
+  std::array<Allocator, count> buckets;
+
+  // The largest request bucket i serves.
+  static constexpr size_t bucket_size(size_t i) { return Min + (i + 1) * Step; }
+
+  void *allocate(size_t size) {
+    if (size <= Min || size > Max)
+      return nullptr;
+    return buckets[(size - Min - 1) / Step].allocate(size);
+  }
+
+  bool deallocate(void *ptr) {
+    for (Allocator &bucket : buckets) {
+      if (bucket.owns(ptr))
+        return bucket.deallocate(ptr);
+    }
+    return false;
+  }
+
+  bool owns(const void *ptr) const {
+    for (const Allocator &bucket : buckets) {
+      if (bucket.owns(ptr))
+        return true;
+    }
+    return false;
+  }
+};
+
+// Counts what passes through to inner, like dp_stats.
+template <allocator Allocator> class stats {
+public:
+  Allocator inner;
+  size_t allocations = 0;
+  size_t frees = 0;
+  size_t failures = 0; // allocations inner failed.
+  size_t bytes_requested = 0;
+  size_t live = 0; // blocks allocated and not yet freed.
+  size_t peak_live = 0;
+
+  void *allocate(size_t size) {
+    void *ptr = inner.allocate(size);
+    allocations++;
+    bytes_requested += size;
+    if (ptr == nullptr) {
+      failures++;
+    } else if (++live > peak_live) {
+      peak_live = live;
+    }
+    return ptr;
+  }
+
+  bool deallocate(void *ptr) {
+    if (!inner.deallocate(ptr))
+      return false;
+    frees++;
+    live--;
+    return true;
+  }
+
+  bool owns(const void *ptr) const
+    requires owning_allocator<Allocator>
+  {
+    return inner.owns(ptr);
+  }
+};
+
+// A dp_allocator as a part of a composition, it owns what the dp_allocator says it owns.
+class vtable_allocator {
+public:
+  dp_allocator target{};
+
+  void *allocate(size_t size) { return dp_allocator_malloc(target, size); }
+
+  bool deallocate(void *ptr) { return dp_allocator_free(target, ptr) == 0; }
+
+  bool owns(const void *ptr) const { return dp_allocator_owns(target, ptr); }
+};
+
+// A view of a composition for C code, valid as long as a is.
+template <allocator A> dp_allocator to_dp_allocator(A &a) {
+  static constexpr dp_allocator_ops ops = {
+      [](void *self, size_t size) { return static_cast<A *>(self)->allocate(size); },
+      [](void *self, void *ptr) { return static_cast<A *>(self)->deallocate(ptr) ? 0 : 1; },
+      [] {
+        bool (*owns)(const void *, const void *) = nullptr;
+        if constexpr (owning_allocator<A>) {
+          owns = [](const void *self, const void *ptr) {
+            return static_cast<const A *>(self)->owns(ptr);
+          };
+        }
+        return owns;
+      }(),
+  };
+  return dp_allocator{&ops, &a};
+}
+
+} // namespace dp
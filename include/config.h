@@ -11,3 +11,128 @@
 #ifndef DP_FREE_VALIDATION
 #define DP_FREE_VALIDATION 0
 #endif
+
+// Validation tier 1: every block header carries a canary derived from its address and
+// contents, dp_free rejects blocks whose canary doesn't match in O(1).
+#ifndef DP_HEADER_CANARY
+#define DP_HEADER_CANARY 0
+#endif
+
+// Validation tier 2: blocks verified by every dp_malloc and dp_free, continuing in address
+// order from where the previous call stopped. 0 disables the amortized check.
+// Tier 3 is dp_check(), a full audit run on demand.
+// @param size_t DP_CHECK_SLICE max=65536
+#ifndef DP_CHECK_SLICE
+#define DP_CHECK_SLICE 0
+#endif
+
+// Track free blocks in a dense index of sizes and offsets reserved at the end of the
+// buffer instead of the free list, so best fit is a vectorized scan over contiguous sizes
+// rather than a walk over scattered headers. The index is sized for the most free blocks
+// the buffer can hold, about a tenth of the buffer at 16 byte alignment. Buffers must be
+// smaller than 4GiB. DP_PROBE_LIMIT doesn't apply.
+#ifndef DP_FREE_INDEX
+#define DP_FREE_INDEX 0
+#endif
+
+// Keep block metadata out of line, in three bitmaps at the front of the buffer with a bit per
+// granule of DP_ALIGNMENT bytes, instead of a header before every block: block starts, free
+// blocks and blocks trimmed by dp_trim, each followed by its summary levels. User blocks are
+// packed back to back and heap walks only touch the bitmaps. The bitmaps take a little over
+// 3 bits per granule, allocations are rounded up to whole granules. dp_trim is in every
+// build, so the trimmed bitmap is reserved even with DP_TRIM_THRESHOLD 0 and costs a third
+// of the metadata in programs that never trim. DP_HEADER_CANARY, DP_CHECK_SLICE and
+// DP_FREE_VALIDATION don't apply, DP_FREE_INDEX and DP_SIZE_CLASSES can't be combined with it.
+#ifndef DP_OUT_OF_LINE_METADATA
+#define DP_OUT_OF_LINE_METADATA 0
+#endif
+
+// Size classes of freed blocks dp_free keeps allocated for reuse instead of returning them
+// to the heap, class i holds blocks with room for i + 1 granules of DP_ALIGNMENT bytes.
+// dp_malloc serves requests of a class from its cache before searching the heap, and
+// allocator_inline.h does both without a call. Cached blocks go back to the heap when
+// dp_malloc runs out of space, or on dp_flush_cache. 0 disables the cache. Can't be combined
+// with DP_OUT_OF_LINE_METADATA.
+// @param size_t DP_SIZE_CLASSES max=64
+#ifndef DP_SIZE_CLASSES
+#define DP_SIZE_CLASSES 0
+#endif
+
+// Blocks each size class caches, further frees of the class go to the heap.
+// @param size_t DP_CLASS_CACHE_DEPTH min=1 max=65536
+#ifndef DP_CLASS_CACHE_DEPTH
+#define DP_CLASS_CACHE_DEPTH 32
+#endif
+
+// Requests of more than DP_HUGE_THRESHOLD bytes get a mapping of their own instead of a block
+// of the buffer, so a few huge blocks don't carve it up for everything else. dp_free unmaps
+// them and dp_realloc resizes them with mremap. Huge blocks are tracked in a table of
+// DP_HUGE_SLOTS entries in the dp_alloc, once it is full huge requests come from the buffer.
+// dp_owner and dp_free_any only know the buffer. 0 disables the bypass.
+// @param size_t DP_HUGE_THRESHOLD
+#ifndef DP_HUGE_THRESHOLD
+#define DP_HUGE_THRESHOLD 0
+#endif
+
+// Huge blocks live at a time, see DP_HUGE_THRESHOLD.
+// @param size_t DP_HUGE_SLOTS min=1 max=65536
+#ifndef DP_HUGE_SLOTS
+#define DP_HUGE_SLOTS 64
+#endif
+
+// Free blocks of at least DP_TRIM_THRESHOLD bytes after coalescing have the whole pages past
+// their header returned to the system by dp_free, as dp_trim would. Trimming costs a madvise
+// per such free and a page fault per page on reuse. 0 leaves trimming to dp_trim.
+// @param size_t DP_TRIM_THRESHOLD
+#ifndef DP_TRIM_THRESHOLD
+#define DP_TRIM_THRESHOLD 0
+#endif
+
+// Trim with MADV_FREE instead of MADV_DONTNEED, the system only reclaims trimmed pages under
+// memory pressure and pages reused before then don't fault, but they count towards RSS
+// until they are reclaimed.
+#ifndef DP_TRIM_LAZY
+#define DP_TRIM_LAZY 0
+#endif
+
+// Global arena registry mapping addresses to the arena that owns them, see dp_register.
+// Every dp_alloc carries two chain links for it.
+#ifndef DP_REGISTRY
+#define DP_REGISTRY 0
+#endif
+
+// Low and high watermarks on available and on the largest free block, with a callback fired
+// when a value drops below its low watermark and again once it is back at its high one, see
+// dp_set_watermark. dp_malloc and dp_free compare each watched value against where it next
+// crosses.
+#ifndef DP_WATERMARKS
+#define DP_WATERMARKS 0
+#endif
+
+// Alignment of returned pointers and block headers, 0 selects alignof(max_align_t).
+// @param size_t DP_ALIGNMENT zero pow2 min=4 max=128
+#ifndef DP_ALIGNMENT
+#define DP_ALIGNMENT 0
+#endif
+
+// Smallest free block dp_malloc splits off the end of an allocation, smaller remainders
+// stay part of the allocated block. 0 splits whenever a block header fits.
+// @param size_t DP_SPLIT_THRESHOLD max=1048576
+#ifndef DP_SPLIT_THRESHOLD
+#define DP_SPLIT_THRESHOLD 0
+#endif
+
+// Free blocks dp_malloc probes before settling for the best fit found so far, it keeps
+// probing past the limit until some block fits. 0 probes the whole free list.
+// @param size_t DP_PROBE_LIMIT
+#ifndef DP_PROBE_LIMIT
+#define DP_PROBE_LIMIT 0
+#endif
+
+// Which of the free blocks that fit dp_malloc picks.
+//  DP_FIT_BEST  - the smallest one.
+//  DP_FIT_FIRST - the first one in the free list.
+// @enum DP_FIT_POLICY DP_FIT_BEST DP_FIT_FIRST
+#ifndef DP_FIT_POLICY
+#define DP_FIT_POLICY DP_FIT_BEST
+#endif
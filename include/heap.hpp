@@ -0,0 +1,468 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Header only C++ build of the deadpool heap, specialised at compile time. Every option the C
+// library reads from config.h is a member of the Config type instead, so one program can hold
+// heaps of different configurations, and if constexpr drops the code of disabled options
+// rather than the IF_DP_* macros. Logging calls the Config's logger directly, without the
+// function pointers of dp_logger. Options a heap doesn't implement are members too, set to
+// anything but their defaults they fail to compile rather than being ignored.
+//
+// Blocks are laid out like allocator.c lays them out, with a header before every block and
+// the offset byte before the user pointer, and a heap and a dp_alloc with matching options
+// place every block at the same offset.
+
+namespace dp {
+
+enum class fit {
+  best,  // the smallest free block that fits.
+  first, // the first free block in the free list that fits.
+};
+
+// Logger that drops everything, a logger is a type with static debug, info, warning and
+// error functions taking a printf format and its arguments.
+struct no_log {};
+
+// Options and their defaults, configurations derive from it and override what they change.
+// Each option matches the config.h option of the same name.
+struct default_config {
+  static constexpr size_t alignment = alignof(std::max_align_t); // DP_ALIGNMENT
+  static constexpr fit fit_policy = fit::best;                   // DP_FIT_POLICY
+  static constexpr size_t split_threshold = 0;                   // DP_SPLIT_THRESHOLD
+  static constexpr size_t probe_limit = 0;                       // DP_PROBE_LIMIT
+  static constexpr size_t size_classes = 0;                      // DP_SIZE_CLASSES
+  static constexpr size_t class_cache_depth = 32;                // DP_CLASS_CACHE_DEPTH
+  static constexpr bool header_canary = false;                   // DP_HEADER_CANARY
+  static constexpr bool stats = false;                           // DP_STATS
+  using logger = no_log;                                         // DP_LOG
+
+  // Options of the C library a heap doesn't implement, they stay at their defaults. A heap
+  // keeps its headers and free list inline, never maps or decommits pages and never
+  // registers itself, configurations that need any of these use a dp_alloc built with them.
+  static constexpr bool free_index = false;           // DP_FREE_INDEX
+  static constexpr bool out_of_line_metadata = false; // DP_OUT_OF_LINE_METADATA
+  static constexpr size_t huge_threshold = 0;         // DP_HUGE_THRESHOLD
+  static constexpr size_t trim_threshold = 0;         // DP_TRIM_THRESHOLD
+  static constexpr bool trim_lazy = false;            // DP_TRIM_LAZY
+  static constexpr bool watermarks = false;           // DP_WATERMARKS
+  static constexpr bool registry = false;             // DP_REGISTRY
+  static constexpr size_t check_slice = 0;            // DP_CHECK_SLICE
+};
+
+namespace detail {
+
+struct empty {};
+
+template <bool Canary> struct block_header {
+  block_header *next;
+  size_t size;
+  bool is_free;
+  [[no_unique_address]] std::conditional_t<Canary, uint32_t, empty> canary;
+};
+
+struct heap_stats {
+  size_t num_iterations = 0;      // free blocks probed by the last allocation.
+  size_t num_free_iterations = 0; // free blocks scanned by the last deallocation.
+};
+
+} // namespace detail
+
+template <typename Config = default_config> class heap {
+  static constexpr size_t alignment = Config::alignment;
+  static constexpr size_t size_classes = Config::size_classes;
+  static constexpr bool logs = !std::is_same_v<typename Config::logger, no_log>;
+
+  using header = detail::block_header<Config::header_canary>;
+
+  static_assert(alignment >= alignof(header) && (alignment & (alignment - 1)) == 0,
+                "alignment must be a power of two of at least the header's alignment");
+  static_assert(alignment <= 128, "the offset byte can't reach past 128 bytes of padding");
+  static_assert(size_classes <= 64 && Config::class_cache_depth >= 1);
+  static_assert(!Config::free_index, "dp::heap doesn't support DP_FREE_INDEX");
+  static_assert(!Config::out_of_line_metadata,
+                "dp::heap doesn't support DP_OUT_OF_LINE_METADATA");
+  static_assert(Config::huge_threshold == 0, "dp::heap doesn't support DP_HUGE_THRESHOLD");
+  static_assert(Config::trim_threshold == 0, "dp::heap doesn't support DP_TRIM_THRESHOLD");
+  static_assert(!Config::trim_lazy, "dp::heap doesn't support DP_TRIM_LAZY");
+  static_assert(!Config::watermarks, "dp::heap doesn't support DP_WATERMARKS");
+  static_assert(!Config::registry, "dp::heap doesn't support DP_REGISTRY");
+  static_assert(Config::check_slice == 0, "dp::heap doesn't support DP_CHECK_SLICE");
+
+  // Blocks start aligned, so every user pointer sits user_offset bytes past its header.
+  static constexpr size_t user_offset = (sizeof(header) + alignment) & ~(alignment - 1);
+  static constexpr size_t padding = user_offset - sizeof(header);
+
+public:
+  heap() = default;
+  heap(const heap &) = delete;
+  heap &operator=(const heap &) = delete;
+
+  bool init(void *buffer, size_t buffer_size) {
+    if (buffer == nullptr)
+      return false;
+    uintptr_t start = align_address(reinterpret_cast<uintptr_t>(buffer));
+    size_t alignment_offset = start - reinterpret_cast<uintptr_t>(buffer);
+    if (buffer_size <= alignment_offset + sizeof(header))
+      return false;
+
+    buffer_ = reinterpret_cast<uint8_t *>(start);
+    buffer_size_ = buffer_size - alignment_offset;
+    available_ = buffer_size_ - sizeof(header);
+    free_list_head_ = reinterpret_cast<header *>(buffer_);
+    free_list_head_->size = available_;
+    free_list_head_->is_free = true;
+    free_list_head_->next = nullptr;
+    seal(free_list_head_);
+    for (size_t i = 0; i < size_classes; i++) {
+      class_cache_[i] = cache_end();
+      class_count_[i] = 0;
+    }
+    cached_blocks_ = 0;
+    return true;
+  }
+
+  void *allocate(size_t size) {
+    if (size == 0)
+      return nullptr;
+    if constexpr (size_classes > 0) {
+      size_t cls = (size - 1) / alignment;
+      if (cls < size_classes && class_cache_[cls] != cache_end())
+        return pop(cls);
+    }
+    return allocate_from_heap(size);
+  }
+
+  // Allocation of a size known at compile time, its size class is picked at compile time too.
+  template <size_t Size> void *allocate() {
+    static_assert(Size > 0);
+    if constexpr (constexpr size_t cls = (Size - 1) / alignment; cls < size_classes) {
+      if (class_cache_[cls] != cache_end())
+        return pop(cls);
+    }
+    return allocate_from_heap(Size);
+  }
+
+  // false if ptr wasn't allocated by this heap, or was already deallocated.
+  bool deallocate(void *ptr) {
+    if (ptr == nullptr) {
+      error("Trying to free null pointer.");
+      return false;
+    }
+    auto *bytes = static_cast<uint8_t *>(ptr);
+    auto *block = reinterpret_cast<header *>(bytes - bytes[-1] - sizeof(header));
+    if (reinterpret_cast<uint8_t *>(block) < buffer_ ||
+        reinterpret_cast<uint8_t *>(block) >= buffer_ + buffer_size_) {
+      error("Deallocating invalid pointer %p", ptr);
+      return false;
+    }
+    if (block->next != nullptr) {
+      error("Trying to free %p which is not a valid block", static_cast<void *>(block));
+      return false;
+    }
+    if (!intact(block)) {
+      error("Header of %p is corrupted", ptr);
+      return false;
+    }
+    if (block->is_free) {
+      error("Double free detected for pointer %p, block_size=%zu", ptr, block->size);
+      return false;
+    }
+
+    if constexpr (size_classes > 0) {
+      size_t cls = (block->size + sizeof(header) - user_offset) / alignment - 1;
+      if (cls < size_classes && class_count_[cls] < Config::class_cache_depth) {
+        block->next = class_cache_[cls];
+        class_cache_[cls] = block;
+        class_count_[cls]++;
+        cached_blocks_++;
+        return true;
+      }
+    }
+    release(block);
+    return true;
+  }
+
+  template <typename T, typename... Args> T *make(Args &&...args) {
+    static_assert(alignof(T) <= alignment, "T is over aligned for this heap");
+    void *ptr = allocate<sizeof(T)>();
+    return ptr == nullptr ? nullptr : new (ptr) T(std::forward<Args>(args)...);
+  }
+
+  template <typename T> void destroy(T *object) {
+    if (object == nullptr)
+      return;
+    object->~T();
+    deallocate(object);
+  }
+
+  // Returns every cached block to the heap, and how many there were.
+  size_t flush_cache() {
+    size_t flushed = 0;
+    if constexpr (size_classes > 0) {
+      for (size_t i = 0; i < size_classes && cached_blocks_ > 0; i++) {
+        header *block = class_cache_[i];
+        cached_blocks_ -= class_count_[i];
+        class_cache_[i] = cache_end();
+        class_count_[i] = 0;
+        while (block != cache_end()) {
+          header *next = block->next;
+          block->next = nullptr;
+          release(block);
+          block = next;
+          flushed++;
+        }
+      }
+    }
+    return flushed;
+  }
+
+  // Same audit as dp_check, true if the heap is consistent.
+  bool check() const {
+    uint8_t *end = buffer_ + buffer_size_;
+    size_t free_blocks = 0;
+    size_t free_bytes = 0;
+    bool prev_free = false;
+    for (auto *block = reinterpret_cast<header *>(buffer_);
+         reinterpret_cast<uint8_t *>(block) < end; block = next_phys(block)) {
+      size_t room = static_cast<size_t>(end - reinterpret_cast<uint8_t *>(block));
+      if (room < sizeof(header) || !intact(block) || block->size > room - sizeof(header) ||
+          (block->is_free && prev_free)) {
+        error("Heap check: block %p is corrupted", static_cast<void *>(block));
+        return false;
+      }
+      if (block->is_free) {
+        free_blocks++;
+        free_bytes += block->size;
+      }
+      prev_free = block->is_free;
+    }
+
+    size_t listed = 0;
+    for (header *node = free_list_head_; node != nullptr; node = node->next) {
+      if (++listed > free_blocks || reinterpret_cast<uint8_t *>(node) < buffer_ ||
+          reinterpret_cast<uint8_t *>(node) >= end || !node->is_free) {
+        error("Heap check: free list is corrupted at %p", static_cast<void *>(node));
+        return false;
+      }
+    }
+    size_t cached = 0;
+    for (size_t i = 0; i < size_classes; i++) {
+      size_t count = 0;
+      for (header *node = class_cache_[i]; node != cache_end(); node = node->next) {
+        if (++count > class_count_[i] || reinterpret_cast<uint8_t *>(node) < buffer_ ||
+            reinterpret_cast<uint8_t *>(node) >= end || node->is_free) {
+          error("Heap check: size class %zu cache is corrupted", i);
+          return false;
+        }
+      }
+      cached += count;
+    }
+    if (free_bytes != available_ || listed != free_blocks || cached != cached_blocks_) {
+      error("Heap check: counts don't match the blocks");
+      return false;
+    }
+    return true;
+  }
+
+  uint8_t *buffer() const { return buffer_; }
+  size_t buffer_size() const { return buffer_size_; }
+  size_t available() const { return available_; }
+  size_t cached_blocks() const { return cached_blocks_; }
+
+  // Whether ptr lies in the buffer, not whether it is allocated. Unlike dp_alloc with
+  // DP_HUGE_THRESHOLD, a heap never maps blocks outside its buffer.
+  bool owns(const void *ptr) const {
+    auto *byte = static_cast<const uint8_t *>(ptr);
+    return byte >= buffer_ && byte < buffer_ + buffer_size_;
+  }
+
+  const detail::heap_stats &stats() const
+    requires Config::stats
+  {
+    return stats_;
+  }
+
+private:
+  static header *cache_end() { return reinterpret_cast<header *>(UINTPTR_MAX); }
+
+  static uintptr_t align_address(uintptr_t address) {
+    return (address + (alignment - 1)) & ~(alignment - 1);
+  }
+
+  static header *next_phys(header *block) {
+    return reinterpret_cast<header *>(reinterpret_cast<uint8_t *>(block) + block->size +
+                                      sizeof(header));
+  }
+
+  // Same canary as allocator.c.
+  static uint32_t canary_of(const header *block) {
+    uint64_t mix = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(block)) ^
+                   (static_cast<uint64_t>(block->size) << 1) ^ block->is_free;
+    mix *= 0x9E3779B97F4A7C15ull;
+    return static_cast<uint32_t>(mix >> 32) ^ 0xDEAD9001u;
+  }
+
+  static void seal(header *block) {
+    if constexpr (Config::header_canary)
+      block->canary = canary_of(block);
+  }
+
+  static bool intact(const header *block) {
+    if constexpr (Config::header_canary)
+      return block->canary == canary_of(block);
+    else
+      return true;
+  }
+
+  template <typename... Args> static void info(const char *fmt, Args... args) {
+    if constexpr (logs)
+      Config::logger::info(fmt, args...);
+  }
+
+  template <typename... Args> static void error(const char *fmt, Args... args) {
+    if constexpr (logs)
+      Config::logger::error(fmt, args...);
+  }
+
+  void *pop(size_t cls) {
+    header *block = class_cache_[cls];
+    class_cache_[cls] = block->next;
+    class_count_[cls]--;
+    cached_blocks_--;
+    block->next = nullptr;
+    if constexpr (Config::stats)
+      stats_.num_iterations = 0;
+    return reinterpret_cast<uint8_t *>(block) + user_offset;
+  }
+
+  void *allocate_from_heap(size_t size) {
+    void *ptr = search(size);
+    // The cache may hold what the heap is missing, give it back and search again.
+    if constexpr (size_classes > 0) {
+      if (ptr == nullptr && cached_blocks_ > 0 && flush_cache() > 0)
+        ptr = search(size);
+    }
+    return ptr;
+  }
+
+  void *search(size_t size) {
+    // Same bound as dp_malloc, the largest padding plus the offset byte, without the sum
+    // that would wrap for sizes near SIZE_MAX.
+    if (size > available_ || available_ - size < alignment || free_list_head_ == nullptr)
+      return nullptr;
+
+    size_t alloc_size = size + padding;
+    header *best_fit = nullptr;
+    header *prev_best_fit = nullptr;
+    size_t min_fit = SIZE_MAX;
+    size_t probes = 0;
+    if constexpr (Config::stats)
+      stats_.num_iterations = 1;
+    for (header *current = free_list_head_, *prev = nullptr; current != nullptr;
+         prev = current, current = current->next) {
+      if (alloc_size <= current->size && current->size - alloc_size < min_fit) {
+        best_fit = current;
+        prev_best_fit = prev;
+        min_fit = current->size - alloc_size;
+        if (min_fit == 0 || Config::fit_policy == fit::first)
+          break;
+      }
+      if (Config::probe_limit != 0 && ++probes >= Config::probe_limit && best_fit != nullptr)
+        break;
+      if constexpr (Config::stats)
+        stats_.num_iterations++;
+    }
+    if (best_fit == nullptr)
+      return nullptr;
+
+    uintptr_t block_start = reinterpret_cast<uintptr_t>(best_fit) + sizeof(header);
+    uintptr_t next_block = align_address(block_start + alloc_size);
+    size_t actual_size = next_block - block_start;
+    size_t remainder = actual_size < best_fit->size ? best_fit->size - actual_size : 0;
+    header *replacement = best_fit->next;
+    if (remainder < sizeof(header) + Config::split_threshold) {
+      actual_size = best_fit->size;
+    } else {
+      replacement = reinterpret_cast<header *>(next_block);
+      replacement->size = remainder - sizeof(header);
+      replacement->is_free = true;
+      replacement->next = best_fit->next;
+      seal(replacement);
+      available_ -= sizeof(header);
+    }
+    if (prev_best_fit == nullptr)
+      free_list_head_ = replacement;
+    else
+      prev_best_fit->next = replacement;
+
+    best_fit->size = actual_size;
+    best_fit->is_free = false;
+    best_fit->next = nullptr;
+    seal(best_fit);
+    available_ -= actual_size;
+
+    auto *user = reinterpret_cast<uint8_t *>(block_start + padding);
+    user[-1] = static_cast<uint8_t>(padding);
+    info("Allocated block at %p (size=%zu, available=%zu)", static_cast<void *>(best_fit),
+         best_fit->size, available_);
+    return user;
+  }
+
+  // Returns a validated live block to the heap, merged with its free neighbours.
+  void release(header *block) {
+    available_ += block->size;
+    block->is_free = true;
+
+    header *left = nullptr;
+    header *right = nullptr;
+    header **link = &free_list_head_;
+    if constexpr (Config::stats)
+      stats_.num_free_iterations = 0;
+    while (*link != nullptr && (left == nullptr || right == nullptr)) {
+      header *current = *link;
+      if constexpr (Config::stats)
+        stats_.num_free_iterations++;
+      if (next_phys(block) == current) {
+        right = current;
+      } else if (next_phys(current) == block) {
+        left = current;
+      } else {
+        link = &current->next;
+        continue;
+      }
+      *link = current->next; // unlink the neighbour, the merged block goes back at the head.
+      current->next = nullptr;
+    }
+
+    if (left != nullptr) {
+      left->size += sizeof(header) + block->size;
+      available_ += sizeof(header);
+      block = left;
+    }
+    if (right != nullptr) {
+      block->size += sizeof(header) + right->size;
+      available_ += sizeof(header);
+    }
+    seal(block);
+    block->next = free_list_head_;
+    free_list_head_ = block;
+    info("Freed block at %p (available=%zu)", static_cast<void *>(block), available_);
+  }
+
+  uint8_t *buffer_ = nullptr;
+  size_t buffer_size_ = 0;
+  size_t available_ = 0;
+  header *free_list_head_ = nullptr;
+  header *class_cache_[size_classes > 0 ? size_classes : 1]{};
+  uint32_t class_count_[size_classes > 0 ? size_classes : 1]{};
+  size_t cached_blocks_ = 0;
+  [[no_unique_address]] std::conditional_t<Config::stats, detail::heap_stats, detail::empty>
+      stats_;
+};
+
+} // namespace dp
@@ -1,3 +1,5 @@
+#pragma once
+
 #if DP_LOG
 
 typedef struct dp_logger {
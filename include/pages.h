@@ -0,0 +1,66 @@
+#ifndef PAGES_H
+#define PAGES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "allocator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Size of the huge pages dp_pages_map asks for, the x86-64 and AArch64 (4KiB granule) PMD
+// size.
+#define DP_HUGE_PAGE_SIZE ((size_t)2 * 1024 * 1024)
+
+// Most threads dp_pages_warm faults pages in from.
+#define DP_WARM_MAX_THREADS 64
+
+// Pages backing a mapping, from the largest to the fallback every system has.
+typedef enum dp_page_kind {
+  DP_PAGES_HUGETLB,     // explicit huge pages reserved in the hugetlbfs pool.
+  DP_PAGES_TRANSPARENT, // huge page aligned and advised MADV_HUGEPAGE, the kernel backs it
+                        // with transparent huge pages where it finds them.
+  DP_PAGES_SMALL,       // base pages, 4KiB on most systems.
+} dp_page_kind;
+
+// Anonymous memory to hand dp_init, large arenas on huge pages take a dTLB entry per 2MiB
+// rather than per 4KiB.
+typedef struct dp_pages {
+  void *data;        // DP_HUGE_PAGE_SIZE aligned unless kind is DP_PAGES_SMALL.
+  size_t size;       // rounded up to whole pages of kind.
+  dp_page_kind kind; // what the mapping got, no larger than what was asked for.
+} dp_pages;
+
+// Maps at least size bytes on pages of kind, falling back to the next smaller kind when the
+// system has none to give.
+bool dp_pages_map(dp_pages *pages, size_t size, dp_page_kind kind);
+void dp_pages_unmap(dp_pages *pages);
+
+// Returns the whole pages within size bytes at data to the system, they read as zeros when
+// next touched, or keep their contents until reclaimed with DP_TRIM_LAZY. Returns the bytes
+// of the pages it returned.
+size_t dp_decommit(void *data, size_t size);
+
+// Faulting a mapping in ahead of use, so first touches don't fault inside user code.
+typedef struct dp_warm_up {
+  size_t threads; // faulting pages in in parallel, each over a slice of the mapping. At most
+                  // the online CPUs and DP_WARM_MAX_THREADS are used.
+  bool lock;      // mlock the mapping, so its pages stay resident.
+} dp_warm_up;
+
+// Faults every page of pages in, false if the lock failed (RLIMIT_MEMLOCK), the pages are
+// faulted in either way.
+bool dp_pages_warm(dp_pages *pages, dp_warm_up warm_up);
+
+// dp_init over a new mapping of pages, warmed up first unless warm_up is NULL. Unmap it after
+// the allocator is done with it.
+bool dp_init_pages(dp_alloc *allocator, dp_pages *pages, size_t size, dp_page_kind kind,
+                   const dp_warm_up *warm_up IF_DP_LOG(, dp_logger logger));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PAGES_H
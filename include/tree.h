@@ -0,0 +1,59 @@
+#ifndef TREE_H
+#define TREE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <config_macros.h>
+
+#include "log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Free granule runs within a node's span of the heap.
+typedef struct dp_tree_node {
+  uint32_t prefix; // free granules at the start of the span.
+  uint32_t suffix; // free granules at the end of the span.
+  uint32_t max;    // longest free run inside the span.
+} dp_tree_node;
+
+// Address ordered first fit engine. Like dp_bitmap the buffer is split into granules
+// tracked by an occupancy bitmap, on top of it a segment tree summarises the free runs of
+// every 64 granule word, so the lowest run that fits is found in O(log n) and frees merge
+// with their neighbours in O(log n) plus a step per 64 granules freed.
+typedef struct dp_tree {
+  uint64_t *occupied; // bit per granule, set while allocated.
+  uint64_t *run_ends; // bit per granule, set on the last granule of every allocation.
+  size_t words;       // length of each bitmap in 64 bit words.
+  // nodes[1] is the root, the children of node i are 2i and 2i + 1 and word w is summarised
+  // by leaf nodes[leaves + w]. leaves is a power of two, leaves past words are allocated.
+  dp_tree_node *nodes;
+  size_t leaves;
+  uint8_t *data; // first granule.
+  size_t granule;
+  size_t granules;
+  size_t available; // free granules.
+
+  IF_DP_LOG(dp_logger logger;)
+  IF_DP_STATS(size_t num_iterations;) // tree levels descended by the last dp_tree_malloc.
+} dp_tree;
+
+// granule must be a power of two of at least 8 bytes, pointers are aligned to the granule
+// up to alignof(max_align_t). Heaps are limited to 2^31 granules.
+bool dp_tree_init(dp_tree *tree, void *buffer, size_t buffer_size,
+                  size_t granule IF_DP_LOG(, dp_logger logger));
+void *dp_tree_malloc(dp_tree *tree, size_t size);
+int dp_tree_free(dp_tree *tree, void *ptr);
+// Largest request dp_tree_malloc can currently satisfy, in O(1).
+size_t dp_tree_largest_free(const dp_tree *tree);
+// Rebuilds every node from the bitmaps and compares, 0 if the tree is consistent.
+int dp_tree_check(dp_tree *tree);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TREE_H
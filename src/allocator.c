@@ -1,16 +1,34 @@
 #include <limits.h>
+#include <pthread.h>
 #include <stdalign.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "allocator.h"
+#include "allocator_inline.h"
+#include "pages.h"
+
+// Out of line metadata replaces everything below, see side_table.c.
+#if !DP_OUT_OF_LINE_METADATA
+
+#if DP_FREE_INDEX && defined(__GNUC__) && defined(__x86_64__)
+#define DP_INDEX_AVX2 1
+#include <immintrin.h>
+#elif DP_FREE_INDEX && defined(__aarch64__)
+#define DP_INDEX_NEON 1
+#include <arm_neon.h>
+#endif
 
 #define ILLEGAL_BLOCK_PTR UINTPTR_MAX
 
-static const uint8_t default_align = alignof(max_align_t);
+static const uint8_t default_align = DP_ALIGNMENT ? DP_ALIGNMENT : alignof(max_align_t);
+
+_Static_assert(DP_ALIGNMENT == 0 || DP_ALIGNMENT >= alignof(block_header),
+               "DP_ALIGNMENT must be at least the alignment of block_header");
 
 static inline uintptr_t align_address(uintptr_t address, size_t alignment) {
   return (address + (alignment - 1)) & ~(alignment - 1);
@@ -20,6 +38,326 @@ static block_header *next_phys(dp_alloc *allocator, block_header *block) {
   return (block_header *)((uint8_t *)block + block->size + sizeof(block_header));
 }
 
+#if DP_HEADER_CANARY
+// Mixes the header's address with its contents, so both stray writes into a header and
+// pointers that never pointed at a header fail the check.
+static uint32_t header_canary(const block_header *header) {
+  uint64_t mix = (uint64_t)(uintptr_t)header ^ ((uint64_t)header->size << 1) ^ header->is_free;
+  mix *= 0x9E3779B97F4A7C15ull;
+  return (uint32_t)(mix >> 32) ^ 0xDEAD9001u;
+}
+#endif
+
+// Recomputes the header's canary, called whenever its size or is_free change.
+static inline void seal(block_header *header) {
+  IF_DP_HEADER_CANARY(header->canary = header_canary(header);)
+  (void)header;
+}
+
+static inline bool header_intact(const block_header *header) {
+#if DP_HEADER_CANARY
+  return header->canary == header_canary(header);
+#else
+  (void)header;
+  return true;
+#endif
+}
+
+// Checks a single block in place: its canary, that it ends inside the buffer and that its
+// free list link is consistent with its state.
+static bool block_intact(dp_alloc *allocator, block_header *block) {
+  uint8_t *end = allocator->buffer + allocator->buffer_size;
+  if ((size_t)(end - (uint8_t *)block) < sizeof(block_header) || !header_intact(block) ||
+      block->size > (size_t)(end - (uint8_t *)block) - sizeof(block_header))
+    return false;
+#if DP_SIZE_CLASSES
+  // Cached blocks stay allocated and link to the next cached block or DP_CACHE_END.
+  if (!block->is_free && block->next == DP_CACHE_END)
+    return true;
+#else
+  if (!block->is_free)
+    return block->next == NULL;
+#endif
+  return block->next == NULL ||
+         ((uint8_t *)block->next >= allocator->buffer && (uint8_t *)block->next < end);
+}
+
+#if DP_CHECK_SLICE
+// Verifies the next dp_config_check_slice blocks in address order, wrapping around at the
+// end of the buffer, so the whole heap is covered every few calls at O(1) cost per call.
+static bool check_slice(dp_alloc *allocator) {
+  block_header *block = allocator->check_cursor;
+  for (size_t i = 0; i < dp_config_check_slice; i++) {
+    if (!block_intact(allocator, block)) {
+      DP_ERROR(allocator, "Heap corruption detected at block %p", block);
+      return false;
+    }
+    block = next_phys(allocator, block);
+    if ((uint8_t *)block >= allocator->buffer + allocator->buffer_size)
+      block = (block_header *)allocator->buffer;
+  }
+  allocator->check_cursor = block;
+  return true;
+}
+#endif
+
+#if DP_FREE_INDEX
+/*
+Free block index, used instead of the free list. Entry i describes the free block at
+buffer + index_offsets[i] with index_sizes[i] == block->size, entries are unordered and
+removed by moving the last entry into their slot. Every query is a linear scan over one or
+both arrays, vectorized with AVX2 (picked at runtime) or NEON, with a scalar fallback.
+*/
+
+#define INDEX_NONE SIZE_MAX
+
+typedef struct index_kernels {
+  // First i with values[i] == value.
+  size_t (*find_equal)(const uint32_t *values, size_t count, uint32_t value);
+  // First i with offsets[i] + sizes[i] == end.
+  size_t (*find_end)(const uint32_t *offsets, const uint32_t *sizes, size_t count, uint32_t end);
+  // First i with values[i] >= floor.
+  size_t (*find_at_least)(const uint32_t *values, size_t count, uint32_t floor);
+  // Smallest values[i] >= floor, UINT32_MAX if there is none.
+  uint32_t (*min_at_least)(const uint32_t *values, size_t count, uint32_t floor);
+} index_kernels;
+
+static size_t find_equal_scalar(const uint32_t *values, size_t count, uint32_t value) {
+  for (size_t i = 0; i < count; i++) {
+    if (values[i] == value)
+      return i;
+  }
+  return INDEX_NONE;
+}
+
+static size_t find_end_scalar(const uint32_t *offsets, const uint32_t *sizes, size_t count,
+                              uint32_t end) {
+  for (size_t i = 0; i < count; i++) {
+    if (offsets[i] + sizes[i] == end)
+      return i;
+  }
+  return INDEX_NONE;
+}
+
+static size_t find_at_least_scalar(const uint32_t *values, size_t count, uint32_t floor) {
+  for (size_t i = 0; i < count; i++) {
+    if (values[i] >= floor)
+      return i;
+  }
+  return INDEX_NONE;
+}
+
+static uint32_t min_at_least_scalar(const uint32_t *values, size_t count, uint32_t floor) {
+  uint32_t min = UINT32_MAX;
+  for (size_t i = 0; i < count; i++) {
+    if (values[i] >= floor && values[i] < min)
+      min = values[i];
+  }
+  return min;
+}
+
+static const index_kernels scalar_kernels = {find_equal_scalar, find_end_scalar,
+                                             find_at_least_scalar, min_at_least_scalar};
+
+#if DP_INDEX_AVX2
+#define AVX2 __attribute__((target("avx2")))
+
+// Index of the first lane set in an 8 lane comparison mask, INDEX_NONE if none is.
+AVX2 static inline size_t first_lane(__m256i mask) {
+  int bits = _mm256_movemask_ps(_mm256_castsi256_ps(mask));
+  return bits ? (size_t)__builtin_ctz((unsigned)bits) : INDEX_NONE;
+}
+
+AVX2 static inline __m256i at_least(__m256i values, __m256i floor) {
+  return _mm256_cmpeq_epi32(_mm256_max_epu32(values, floor), values);
+}
+
+AVX2 static size_t find_equal_avx2(const uint32_t *values, size_t count, uint32_t value) {
+  __m256i target = _mm256_set1_epi32((int)value);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i chunk = _mm256_loadu_si256((const __m256i *)(values + i));
+    size_t lane = first_lane(_mm256_cmpeq_epi32(chunk, target));
+    if (lane != INDEX_NONE)
+      return i + lane;
+  }
+  size_t rest = find_equal_scalar(values + i, count - i, value);
+  return rest == INDEX_NONE ? INDEX_NONE : i + rest;
+}
+
+AVX2 static size_t find_end_avx2(const uint32_t *offsets, const uint32_t *sizes, size_t count,
+                                 uint32_t end) {
+  __m256i target = _mm256_set1_epi32((int)end);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i ends = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(offsets + i)),
+                                    _mm256_loadu_si256((const __m256i *)(sizes + i)));
+    size_t lane = first_lane(_mm256_cmpeq_epi32(ends, target));
+    if (lane != INDEX_NONE)
+      return i + lane;
+  }
+  size_t rest = find_end_scalar(offsets + i, sizes + i, count - i, end);
+  return rest == INDEX_NONE ? INDEX_NONE : i + rest;
+}
+
+AVX2 static size_t find_at_least_avx2(const uint32_t *values, size_t count, uint32_t floor) {
+  __m256i floors = _mm256_set1_epi32((int)floor);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i chunk = _mm256_loadu_si256((const __m256i *)(values + i));
+    size_t lane = first_lane(at_least(chunk, floors));
+    if (lane != INDEX_NONE)
+      return i + lane;
+  }
+  size_t rest = find_at_least_scalar(values + i, count - i, floor);
+  return rest == INDEX_NONE ? INDEX_NONE : i + rest;
+}
+
+AVX2 static uint32_t min_at_least_avx2(const uint32_t *values, size_t count, uint32_t floor) {
+  __m256i floors = _mm256_set1_epi32((int)floor);
+  __m256i none = _mm256_set1_epi32(-1);
+  __m256i min = none;
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i chunk = _mm256_loadu_si256((const __m256i *)(values + i));
+    __m256i candidates = _mm256_blendv_epi8(none, chunk, at_least(chunk, floors));
+    min = _mm256_min_epu32(min, candidates);
+  }
+  __m128i half = _mm_min_epu32(_mm256_castsi256_si128(min), _mm256_extracti128_si256(min, 1));
+  half = _mm_min_epu32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+  half = _mm_min_epu32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+  uint32_t result = (uint32_t)_mm_cvtsi128_si32(half);
+  uint32_t rest = min_at_least_scalar(values + i, count - i, floor);
+  return rest < result ? rest : result;
+}
+
+static const index_kernels avx2_kernels = {find_equal_avx2, find_end_avx2, find_at_least_avx2,
+                                           min_at_least_avx2};
+#endif
+
+#if DP_INDEX_NEON
+static size_t find_equal_neon(const uint32_t *values, size_t count, uint32_t value) {
+  uint32x4_t target = vdupq_n_u32(value);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    if (vmaxvq_u32(vceqq_u32(vld1q_u32(values + i), target)) != 0)
+      break;
+  }
+  size_t rest = find_equal_scalar(values + i, count - i, value);
+  return rest == INDEX_NONE ? INDEX_NONE : i + rest;
+}
+
+static size_t find_end_neon(const uint32_t *offsets, const uint32_t *sizes, size_t count,
+                            uint32_t end) {
+  uint32x4_t target = vdupq_n_u32(end);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    uint32x4_t ends = vaddq_u32(vld1q_u32(offsets + i), vld1q_u32(sizes + i));
+    if (vmaxvq_u32(vceqq_u32(ends, target)) != 0)
+      break;
+  }
+  size_t rest = find_end_scalar(offsets + i, sizes + i, count - i, end);
+  return rest == INDEX_NONE ? INDEX_NONE : i + rest;
+}
+
+static size_t find_at_least_neon(const uint32_t *values, size_t count, uint32_t floor) {
+  uint32x4_t floors = vdupq_n_u32(floor);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    if (vmaxvq_u32(vcgeq_u32(vld1q_u32(values + i), floors)) != 0)
+      break;
+  }
+  size_t rest = find_at_least_scalar(values + i, count - i, floor);
+  return rest == INDEX_NONE ? INDEX_NONE : i + rest;
+}
+
+static uint32_t min_at_least_neon(const uint32_t *values, size_t count, uint32_t floor) {
+  uint32x4_t floors = vdupq_n_u32(floor);
+  uint32x4_t none = vdupq_n_u32(UINT32_MAX);
+  uint32x4_t min = none;
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    uint32x4_t chunk = vld1q_u32(values + i);
+    min = vminq_u32(min, vbslq_u32(vcgeq_u32(chunk, floors), chunk, none));
+  }
+  uint32_t result = vminvq_u32(min);
+  uint32_t rest = min_at_least_scalar(values + i, count - i, floor);
+  return rest < result ? rest : result;
+}
+
+static const index_kernels neon_kernels = {find_equal_neon, find_end_neon, find_at_least_neon,
+                                           min_at_least_neon};
+#endif
+
+static const index_kernels *select_index_kernels(void) {
+#if DP_INDEX_AVX2
+  if (__builtin_cpu_supports("avx2"))
+    return &avx2_kernels;
+#elif DP_INDEX_NEON
+  return &neon_kernels;
+#endif
+  return &scalar_kernels;
+}
+
+// Picked once by the first dp_init, every arena of the process shares the choice. Threads
+// initialising their own arenas may race to it, pthread_once orders the store before any of
+// their reads.
+static const index_kernels *kernels = &scalar_kernels;
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+static void pick_index_kernels(void) { kernels = select_index_kernels(); }
+
+static inline uint32_t block_offset(dp_alloc *allocator, block_header *block) {
+  return (uint32_t)((uint8_t *)block - allocator->buffer);
+}
+
+static inline block_header *block_at(dp_alloc *allocator, uint32_t offset) {
+  return (block_header *)(allocator->buffer + offset);
+}
+
+static inline void index_insert(dp_alloc *allocator, block_header *block) {
+  size_t slot = allocator->index_count++;
+  allocator->index_sizes[slot] = (uint32_t)block->size;
+  allocator->index_offsets[slot] = block_offset(allocator, block);
+}
+
+static inline void index_remove(dp_alloc *allocator, size_t slot) {
+  size_t last = --allocator->index_count;
+  allocator->index_sizes[slot] = allocator->index_sizes[last];
+  allocator->index_offsets[slot] = allocator->index_offsets[last];
+}
+
+// Slot of the free block the fit policy picks for a block of need bytes, INDEX_NONE if
+// none fits.
+static size_t index_search(dp_alloc *allocator, size_t need) {
+  IF_DP_STATS(allocator->num_iterations = allocator->index_count;)
+  if (need >= UINT32_MAX)
+    return INDEX_NONE;
+
+  uint32_t floor = (uint32_t)need;
+  if (dp_config_fit_policy == DP_FIT_FIRST)
+    return kernels->find_at_least(allocator->index_sizes, allocator->index_count, floor);
+
+  uint32_t best = kernels->min_at_least(allocator->index_sizes, allocator->index_count, floor);
+  if (best == UINT32_MAX)
+    return INDEX_NONE;
+  return kernels->find_equal(allocator->index_sizes, allocator->index_count, best);
+}
+
+// Slot of the lowest or highest free block of at least need bytes, INDEX_NONE if none fits.
+static size_t index_place(dp_alloc *allocator, size_t need, bool high) {
+  IF_DP_STATS(allocator->num_iterations = allocator->index_count;)
+  size_t slot = INDEX_NONE;
+  for (size_t i = 0; i < allocator->index_count; i++) {
+    if (allocator->index_sizes[i] >= need &&
+        (slot == INDEX_NONE ||
+         (allocator->index_offsets[i] > allocator->index_offsets[slot]) == high))
+      slot = i;
+  }
+  return slot;
+}
+#endif
+
 bool dp_init(dp_alloc *allocator, void *buffer, size_t buffer_size IF_DP_LOG(, dp_logger logger)) {
   if (buffer == NULL || buffer_size < sizeof(block_header)) {
     return false;
@@ -33,19 +371,101 @@ bool dp_init(dp_alloc *allocator, void *buffer, size_t buffer_size IF_DP_LOG(, d
 
   allocator->buffer = (uint8_t *)aligned_start;
   allocator->buffer_size = buffer_size - alignment_offset;
+#if DP_FREE_INDEX
+  // Free blocks are never adjacent, so every free block but the last is followed by an
+  // allocated one, and the index needs an entry per smallest free and allocated pair.
+  size_t padding = align_address(sizeof(block_header) + 1, default_align) - sizeof(block_header);
+  size_t min_pair = align_address(sizeof(block_header), default_align) +
+                    align_address(sizeof(block_header) + padding + 1, default_align);
+  size_t capacity = allocator->buffer_size / min_pair + 1;
+  if (allocator->buffer_size >= UINT32_MAX ||
+      allocator->buffer_size < capacity * 2 * sizeof(uint32_t) + 2 * sizeof(block_header)) {
+    return false;
+  }
+  uintptr_t index_start =
+      (aligned_start + allocator->buffer_size - capacity * 2 * sizeof(uint32_t)) &
+      ~(uintptr_t)(default_align - 1);
+  allocator->buffer_size = index_start - aligned_start;
+  allocator->index_sizes = (uint32_t *)index_start;
+  allocator->index_offsets = allocator->index_sizes + capacity;
+  allocator->index_count = 0;
+  pthread_once(&kernels_once, pick_index_kernels);
+#endif
   allocator->available = allocator->buffer_size - sizeof(block_header);
   IF_DP_LOG(allocator->logger = logger;)
+  IF_DP_STATS(allocator->num_iterations = 0;)
+  IF_DP_STATS(allocator->num_free_iterations = 0;)
 
   block_header *header = (block_header *)allocator->buffer;
   header->size = allocator->buffer_size - sizeof(block_header);
   header->is_free = true;
+  header->decommitted = false;
   header->next = NULL;
+  seal(header);
 
+#if DP_FREE_INDEX
+  allocator->free_list_head = NULL;
+  index_insert(allocator, header);
+#else
   allocator->free_list_head = header;
+#endif
+#if DP_CHECK_SLICE
+  allocator->check_cursor = header;
+#endif
+#if DP_SIZE_CLASSES
+  for (size_t i = 0; i < DP_SIZE_CLASSES; i++) {
+    allocator->class_cache[i] = DP_CACHE_END;
+    allocator->class_count[i] = 0;
+  }
+  allocator->cached_blocks = 0;
+#endif
+#if DP_HUGE_THRESHOLD
+  allocator->huge_count = 0;
+  allocator->huge_bytes = 0;
+#endif
+#if DP_WATERMARKS
+  memset(allocator->watermarks, 0, sizeof(allocator->watermarks));
+  for (size_t i = 0; i < DP_WATERMARK_COUNT; i++) {
+    allocator->watermarks[i].fire_at = SIZE_MAX;
+  }
+  allocator->largest_free = header->size;
+#endif
   return true;
 }
 
-void *dp_malloc(dp_alloc *allocator, size_t size) {
+// Allocates [start, end) off the end of the free block, which stays free with the rest.
+static void *carve_end(dp_alloc *allocator, block_header *free_block,
+                       IF_DP_FREE_INDEX(size_t slot, ) uintptr_t start, uintptr_t end) {
+  IF_DP_WATERMARKS(size_t carved = free_block->size;)
+  block_header *block = (block_header *)start;
+  block->size = end - start - sizeof(block_header);
+  block->is_free = false;
+  block->decommitted = false;
+  block->next = NULL;
+  seal(block);
+  free_block->size = start - (uintptr_t)free_block - sizeof(block_header);
+  seal(free_block);
+  IF_DP_FREE_INDEX(allocator->index_sizes[slot] = (uint32_t)free_block->size;)
+  allocator->available -= block->size + sizeof(block_header);
+
+  uintptr_t aligned_user_ptr = align_address(start + sizeof(block_header) + 1, default_align);
+  uint8_t offset = (uint8_t)(aligned_user_ptr - start - sizeof(block_header));
+  *((uint8_t *)aligned_user_ptr - 1) = offset;
+  IF_DP_WATERMARKS(dp_watch_malloc(allocator, carved, free_block->size);)
+
+  DP_INFO(allocator, "Allocated block at %p off the end of %p (size=%zu, available=%zu)", block,
+          free_block, block->size, allocator->available);
+  return (void *)aligned_user_ptr;
+}
+
+// Where heap_malloc places a block, see dp_malloc_hint.
+typedef enum placement {
+  PLACE_FIT,  // at the start of the free block DP_FIT_POLICY picks.
+  PLACE_LOW,  // at the start of the lowest free block that fits.
+  PLACE_HIGH, // at the end of the highest free block that fits.
+} placement;
+
+static void *heap_malloc(dp_alloc *allocator, size_t size, placement place) {
   /*
   Layout of allocated buffer:
 
@@ -65,19 +485,38 @@ void *dp_malloc(dp_alloc *allocator, size_t size) {
    */
 
   size_t max_padding = default_align - 1 + 1; // alignment padding + 1 byte for offset
-  size_t min_alloc_size = size + max_padding;
 
-  if (size == 0 || allocator == NULL || min_alloc_size > allocator->available ||
-      allocator->free_list_head == NULL) {
+  // size + max_padding must fit in what is available, checked without the sum so sizes near
+  // SIZE_MAX don't wrap around to a small request.
+  if (size == 0 || allocator == NULL || size > allocator->available ||
+      allocator->available - size < max_padding ||
+      IF_DP_FREE_INDEX(allocator->index_count == 0)
+          IF_NOT_DP_FREE_INDEX(allocator->free_list_head == NULL)) {
     return NULL;
   }
+#if DP_CHECK_SLICE
+  if (!check_slice(allocator))
+    return NULL;
+#endif
 
+#if DP_FREE_INDEX
+  // Blocks start aligned, so every free block needs the same padding.
+  size_t padding = align_address(sizeof(block_header) + 1, default_align) - sizeof(block_header);
+  size_t best_fit_alloc_size = size + padding;
+  size_t best_fit_slot = place == PLACE_FIT
+                             ? index_search(allocator, best_fit_alloc_size)
+                             : index_place(allocator, best_fit_alloc_size, place == PLACE_HIGH);
+  if (best_fit_slot == INDEX_NONE)
+    return NULL;
+  block_header *best_fit = block_at(allocator, allocator->index_offsets[best_fit_slot]);
+#else
   block_header *current = allocator->free_list_head;
   block_header *prev = NULL;
   block_header *prev_best_fit = NULL;
   block_header *best_fit = NULL;
   size_t best_fit_alloc_size = 0;
   size_t min_fit = UINTPTR_MAX;
+  size_t probes = 0;
   IF_DP_STATS(allocator->num_iterations = 1;)
 
   do {
@@ -88,15 +527,20 @@ void *dp_malloc(dp_alloc *allocator, size_t size) {
 
     if (alloc_size <= current->size) {
       size_t fit = current->size - alloc_size;
-      if (fit < min_fit) {
+      // The free list isn't address ordered, placed blocks need a walk over all of it.
+      if (place == PLACE_FIT ? fit < min_fit
+                             : best_fit == NULL || (current > best_fit) == (place == PLACE_HIGH)) {
         best_fit = current;
         prev_best_fit = prev;
         best_fit_alloc_size = alloc_size;
         min_fit = fit;
       }
-      if (min_fit == 0)
-        break; // perfect fit.
+      if (place == PLACE_FIT && (min_fit == 0 || dp_config_fit_policy == DP_FIT_FIRST))
+        break; // perfect fit, or the first fit is all we want.
     }
+    if (place == PLACE_FIT && dp_config_probe_limit != 0 && ++probes >= dp_config_probe_limit &&
+        best_fit != NULL)
+      break; // settle for the best fit within the probe limit.
     prev = current;
     current = current->next;
     IF_DP_STATS(allocator->num_iterations++;)
@@ -104,39 +548,70 @@ void *dp_malloc(dp_alloc *allocator, size_t size) {
 
   if (best_fit == NULL)
     return NULL;
+#endif
+
+  if (place == PLACE_HIGH) {
+    // The last aligned start the block fits after, best_fit keeps its header and its place
+    // among the free blocks and gives up its end.
+    uintptr_t end = (uintptr_t)next_phys(allocator, best_fit);
+    uintptr_t user_offset = align_address(sizeof(block_header) + 1, default_align);
+    uintptr_t start = (end - user_offset - size) & ~(uintptr_t)(default_align - 1);
+    if (start >= (uintptr_t)best_fit + sizeof(block_header) + dp_config_split_threshold)
+      return carve_end(allocator, best_fit, IF_DP_FREE_INDEX(best_fit_slot, ) start, end);
+  }
 
   uintptr_t next_block_addr = align_address(
       (uintptr_t)best_fit + sizeof(block_header) + best_fit_alloc_size, default_align);
   size_t actual_alloc_size = next_block_addr - (uintptr_t)best_fit - sizeof(block_header);
-  size_t remainder = best_fit->size - actual_alloc_size;
+  // The buffer end needn't be aligned, so the last block can end before next_block_addr.
+  size_t remainder = actual_alloc_size < best_fit->size ? best_fit->size - actual_alloc_size : 0;
+  IF_DP_WATERMARKS(size_t carved = best_fit->size;)
+  IF_DP_WATERMARKS(size_t left = 0;)
 
-  // Handle leftover space: if remainder is too small for a new block header,
-  // remove best_fit from free list entirely. Otherwise, create a new free block.
-  if (remainder < sizeof(block_header)) {
+  // Handle leftover space: if remainder is too small for a new block header (plus the
+  // split threshold), remove best_fit from free list entirely. Otherwise, create a new
+  // free block.
+  if (remainder < sizeof(block_header) + dp_config_split_threshold) {
     actual_alloc_size = best_fit->size;
+#if DP_FREE_INDEX
+    index_remove(allocator, best_fit_slot);
+#else
     if (best_fit == allocator->free_list_head) {
       allocator->free_list_head = best_fit->next;
     } else {
       prev_best_fit->next = best_fit->next;
     }
+#endif
   } else {
     block_header *new_best_fit = (block_header *)next_block_addr;
     new_best_fit->size = best_fit->size - actual_alloc_size - sizeof(block_header);
     new_best_fit->is_free = true;
+    // Its pages past the header were past best_fit's header too.
+    new_best_fit->decommitted = best_fit->decommitted;
     new_best_fit->next = best_fit->next;
+    seal(new_best_fit);
 
+#if DP_FREE_INDEX
+    // The new free block takes best_fit's entry.
+    allocator->index_sizes[best_fit_slot] = (uint32_t)new_best_fit->size;
+    allocator->index_offsets[best_fit_slot] = block_offset(allocator, new_best_fit);
+#else
     // Link the new free block into the free list
     if (best_fit == allocator->free_list_head) {
       allocator->free_list_head = new_best_fit;
     } else {
       prev_best_fit->next = new_best_fit;
     }
+#endif
     allocator->available -= sizeof(block_header); // Account for new header
+    IF_DP_WATERMARKS(left = new_best_fit->size;)
   }
 
   best_fit->size = actual_alloc_size;
   best_fit->is_free = false;
+  best_fit->decommitted = false;
   best_fit->next = NULL;
+  seal(best_fit);
   allocator->available -= actual_alloc_size;
 
   uintptr_t block_start = (uintptr_t)best_fit + sizeof(block_header);
@@ -144,6 +619,7 @@ void *dp_malloc(dp_alloc *allocator, size_t size) {
   uint8_t offset = (uint8_t)(aligned_user_ptr - block_start);
 
   *((uint8_t *)aligned_user_ptr - 1) = offset;
+  IF_DP_WATERMARKS(dp_watch_malloc(allocator, carved, left);)
 
   DP_INFO(allocator,
           "Allocated block at %p (size=%zu, offset=%u, free_list_head=%p, available=%zu)", best_fit,
@@ -152,13 +628,78 @@ void *dp_malloc(dp_alloc *allocator, size_t size) {
   return (void *)aligned_user_ptr;
 }
 
-static block_header *coalsce(dp_alloc *allocator, block_header *free_block) {
-  block_header *current = allocator->free_list_head;
-  block_header *prev = NULL;
+// Only blocks placed by the fit policy come out of the size class caches, cached blocks sit
+// wherever they were freed.
+static void *place_malloc(dp_alloc *allocator, size_t size, placement place) {
+#if DP_HUGE_THRESHOLD
+  // Falls back to the buffer when the request can't be mapped.
+  if (size > DP_HUGE_THRESHOLD && allocator != NULL) {
+    void *huge = dp_huge_malloc(allocator, size);
+    if (huge != NULL)
+      return huge;
+  }
+#endif
+#if DP_SIZE_CLASSES
+  if (allocator == NULL)
+    return NULL;
+  void *ptr = place == PLACE_FIT ? dp_class_pop(allocator, size) : NULL;
+  if (ptr != NULL) {
+    IF_DP_STATS(allocator->num_iterations = 0;)
+    return ptr;
+  }
+  // The cache may hold what the heap is missing, give it back and search again.
+  ptr = heap_malloc(allocator, size, place);
+  if (ptr == NULL && size != 0 && allocator->cached_blocks > 0 && dp_flush_cache(allocator) > 0)
+    ptr = heap_malloc(allocator, size, place);
+  return ptr;
+#else
+  return heap_malloc(allocator, size, place);
+#endif
+}
+
+void *dp_malloc(dp_alloc *allocator, size_t size) {
+  return place_malloc(allocator, size, PLACE_FIT);
+}
+
+void *dp_malloc_hint(dp_alloc *allocator, size_t size, dp_lifetime lifetime) {
+  return place_malloc(allocator, size, lifetime == DP_LIFETIME_LONG ? PLACE_LOW : PLACE_HIGH);
+}
+
+// Merges free_block with its free neighbours. The pages of the merged block from *lo to *hi
+// are still committed, those of trimmed neighbours outside them aren't.
+static block_header *coalsce(dp_alloc *allocator, block_header *free_block, uint8_t **lo,
+                             uint8_t **hi) {
   block_header *to_coalsce_left = NULL;
   block_header *to_coalsce_right = NULL;
+  *lo = (uint8_t *)free_block + sizeof(block_header);
+  *hi = (uint8_t *)next_phys(allocator, free_block);
+
+#if DP_FREE_INDEX
+  // The right neighbour is found by its offset and the left one by where it ends, the
+  // merged block keeps the left neighbour's entry or gets a new one.
+  IF_DP_STATS(allocator->num_free_iterations = allocator->index_count;)
+  block_header *right = next_phys(allocator, free_block);
+  if ((uint8_t *)right < allocator->buffer + allocator->buffer_size && right->is_free) {
+    size_t right_slot = kernels->find_equal(allocator->index_offsets, allocator->index_count,
+                                            block_offset(allocator, right));
+    if (right_slot != INDEX_NONE) {
+      index_remove(allocator, right_slot);
+      to_coalsce_right = right;
+    }
+  }
+  size_t left_slot =
+      kernels->find_end(allocator->index_offsets, allocator->index_sizes,
+                        allocator->index_count,
+                        block_offset(allocator, free_block) - (uint32_t)sizeof(block_header));
+  if (left_slot != INDEX_NONE)
+    to_coalsce_left = block_at(allocator, allocator->index_offsets[left_slot]);
+#else
+  block_header *current = allocator->free_list_head;
+  block_header *prev = NULL;
+  IF_DP_STATS(allocator->num_free_iterations = 0;)
 
   while (current != NULL) {
+    IF_DP_STATS(allocator->num_free_iterations++;)
     if (next_phys(allocator, free_block) == current) {
       DP_DEBUG(allocator, "Found coalscing block on the right (free)%p-%p with (coalscing)%p-%p",
                free_block, current, current, next_phys(allocator, current));
@@ -197,15 +738,21 @@ static block_header *coalsce(dp_alloc *allocator, block_header *free_block) {
     prev = current;
     current = current->next;
   }
+#endif
 
-  if (to_coalsce_left == NULL && to_coalsce_right == NULL)
+  if (to_coalsce_left == NULL && to_coalsce_right == NULL) {
+    IF_DP_FREE_INDEX(index_insert(allocator, free_block);)
     return free_block;
+  }
 
   if (to_coalsce_left != NULL) {
     DP_DEBUG(allocator, "Coalscing left (cb=%zu, fb=%zu, avl=%zu)", to_coalsce_left->size,
              free_block->size, allocator->available);
     to_coalsce_left->size += sizeof(block_header) + free_block->size;
     allocator->available += sizeof(block_header);
+    // The freed block's header is part of the merged block now.
+    *lo = to_coalsce_left->decommitted ? (uint8_t *)free_block
+                                       : (uint8_t *)to_coalsce_left + sizeof(block_header);
     free_block = to_coalsce_left;
   }
 
@@ -214,18 +761,74 @@ static block_header *coalsce(dp_alloc *allocator, block_header *free_block) {
              to_coalsce_right->size, allocator->available);
     free_block->size += sizeof(block_header) + to_coalsce_right->size;
     allocator->available += sizeof(block_header);
+    if (!to_coalsce_right->decommitted)
+      *hi = (uint8_t *)next_phys(allocator, to_coalsce_right);
   }
+  free_block->decommitted = false; // it covers the freed block's committed pages now.
+  seal(free_block);
+
+#if DP_FREE_INDEX
+  if (to_coalsce_left != NULL)
+    allocator->index_sizes[left_slot] = (uint32_t)free_block->size;
+  else
+    index_insert(allocator, free_block);
+#endif
+
+#if DP_CHECK_SLICE
+  // The merged away headers are no longer blocks, resume from the block that absorbed them.
+  if (allocator->check_cursor > free_block &&
+      allocator->check_cursor <= (block_header *)((uint8_t *)free_block + free_block->size))
+    allocator->check_cursor = free_block;
+#endif
 
   DP_INFO(allocator, "Successfull coalscence (left=%p, right=%p, avl=%zu)", to_coalsce_left,
           to_coalsce_right, allocator->available);
   return free_block;
 }
 
+static int release(dp_alloc *allocator, block_header *to_free);
+
+// Returns the pages past a free block's header to the system.
+static size_t trim_block(dp_alloc *allocator, block_header *block) {
+  size_t released = dp_decommit((uint8_t *)block + sizeof(block_header), block->size);
+  block->decommitted = true;
+  DP_DEBUG(allocator, "Trimmed %zu bytes of free block %p (size=%zu)", released, block,
+           block->size);
+  (void)allocator;
+  return released;
+}
+
+#if DP_TRIM_THRESHOLD
+// Trims a block just freed, whose pages from lo to hi are still committed. Its trimmed
+// neighbours' pages stay decommitted, only the pages they share with lo-hi are decommitted
+// again.
+static void trim_freed(dp_alloc *allocator, block_header *block, uint8_t *lo, uint8_t *hi) {
+  uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+  uintptr_t begin = (uintptr_t)block + sizeof(block_header);
+  uintptr_t end = (uintptr_t)next_phys(allocator, block);
+  uintptr_t from = (uintptr_t)lo;
+  uintptr_t to = (uintptr_t)hi;
+  from = from - begin >= page ? from - (page - 1) : begin;
+  to = end - to >= page ? to + (page - 1) : end;
+  size_t released = dp_decommit((void *)from, to - from);
+  block->decommitted = true;
+  DP_DEBUG(allocator, "Trimmed %zu bytes of free block %p (size=%zu)", released, block,
+           block->size);
+  (void)released;
+}
+#endif
+
 int dp_free(dp_alloc *allocator, void *ptr) {
   if (ptr == NULL || allocator == NULL) {
     DP_ERROR(allocator, "Trying to free null pointer, or with null allocator.");
     return 1;
   }
+#if DP_HUGE_THRESHOLD
+  // Nothing in front of a huge block can be read, route them before the offset byte.
+  if ((uint8_t *)ptr <= allocator->buffer ||
+      (uint8_t *)ptr >= allocator->buffer + allocator->buffer_size)
+    return dp_huge_free(allocator, ptr);
+#endif
 
   uint8_t offset = *((uint8_t *)ptr - 1);
   block_header *to_free = (block_header *)((uint8_t *)ptr - offset - sizeof(block_header));
@@ -240,18 +843,50 @@ int dp_free(dp_alloc *allocator, void *ptr) {
     DP_ERROR(allocator, "Deallocating invalid pointer %p", ptr);
     return 1; // Invalid pointer
   }
+  if (!header_intact(to_free)) {
+    DP_ERROR(allocator, "Header of %p is corrupted", ptr);
+    return 1;
+  }
   if (to_free->is_free) {
     DP_ERROR(allocator, "Double free detected for pointer %p, block_size=%zu", ptr, to_free->size);
     return 1;
   }
 
+  int result = 0;
+#if DP_SIZE_CLASSES
+  if (!dp_class_push(allocator, ptr))
+#endif
+    result = release(allocator, to_free);
+
+#if DP_CHECK_SLICE
+  if (result == 0 && !check_slice(allocator))
+    return 1;
+#endif
+
+  return result;
+}
+
+// Returns a validated live block to the heap.
+static int release(dp_alloc *allocator, block_header *to_free) {
   allocator->available += to_free->size;
   to_free->is_free = true;
-  DP_INFO(allocator, "Freeing block at %p (ptr=%p, free_list_head=%p, available=%zu)", to_free, ptr,
+  seal(to_free);
+  DP_INFO(allocator, "Freeing block at %p (free_list_head=%p, available=%zu)", to_free,
           allocator->free_list_head, allocator->available);
-  to_free = coalsce(allocator, to_free);
+  uint8_t *lo, *hi;
+  to_free = coalsce(allocator, to_free, &lo, &hi);
+#if !DP_FREE_INDEX
   to_free->next = allocator->free_list_head;
   allocator->free_list_head = to_free;
+#endif
+#if DP_TRIM_THRESHOLD
+  if (to_free->size >= DP_TRIM_THRESHOLD)
+    trim_freed(allocator, to_free, lo, hi);
+#else
+  (void)lo;
+  (void)hi;
+#endif
+  IF_DP_WATERMARKS(dp_watch_free(allocator, to_free->size);)
 
 #if DP_FREE_VALIDATION
   block_header *current = allocator->free_list_head;
@@ -275,10 +910,202 @@ int dp_free(dp_alloc *allocator, void *ptr) {
   return 0;
 }
 
+size_t dp_usable_size(dp_alloc *allocator, const void *ptr) {
+  if (allocator == NULL || ptr == NULL)
+    return 0;
+  const uint8_t *byte = ptr;
+  if (byte <= allocator->buffer || byte >= allocator->buffer + allocator->buffer_size)
+#if DP_HUGE_THRESHOLD
+    return dp_huge_size(allocator, ptr);
+#else
+    return 0;
+#endif
+
+  uint8_t offset = byte[-1];
+  block_header *block = (block_header *)(byte - offset - sizeof(block_header));
+  if ((uint8_t *)block < allocator->buffer || block->next != NULL || block->is_free ||
+      !header_intact(block))
+    return 0;
+  return block->size - offset;
+}
+
+size_t dp_trim(dp_alloc *allocator, size_t keep_bytes) {
+  if (allocator == NULL)
+    return 0;
+  // Free blocks from the most recently freed, the free list is LIFO and the index keeps no
+  // order. Blocks that fit what is left of keep_bytes stay committed.
+  size_t kept = 0;
+  size_t released = 0;
+#if DP_FREE_INDEX
+  for (size_t i = 0; i < allocator->index_count; i++) {
+    block_header *block = block_at(allocator, allocator->index_offsets[i]);
+#else
+  for (block_header *block = allocator->free_list_head; block != NULL; block = block->next) {
+#endif
+    if (block->decommitted)
+      continue;
+    if (block->size <= keep_bytes - kept)
+      kept += block->size;
+    else
+      released += trim_block(allocator, block);
+  }
+  DP_INFO(allocator, "Trimmed %zu bytes, kept %zu free bytes committed", released, kept);
+  return released;
+}
+
+size_t dp_flush_cache(dp_alloc *allocator) {
+  size_t flushed = 0;
+#if DP_SIZE_CLASSES
+  if (allocator == NULL)
+    return 0;
+  for (size_t i = 0; i < DP_SIZE_CLASSES && allocator->cached_blocks > 0; i++) {
+    block_header *block = allocator->class_cache[i];
+    if (block == DP_CACHE_END)
+      continue;
+    allocator->cached_blocks -= allocator->class_count[i];
+    allocator->class_cache[i] = DP_CACHE_END;
+    allocator->class_count[i] = 0;
+    while (block != DP_CACHE_END) {
+      block_header *next = block->next;
+      block->next = NULL;
+      release(allocator, block);
+      block = next;
+      flushed++;
+    }
+  }
+  DP_INFO(allocator, "Flushed %zu cached blocks (available=%zu)", flushed, allocator->available);
+#else
+  (void)allocator;
+#endif
+  return flushed;
+}
+
+int dp_check(dp_alloc *allocator) {
+  if (allocator == NULL)
+    return 1;
+
+  // Walk the blocks in address order, they must tile the buffer exactly.
+  uint8_t *end = allocator->buffer + allocator->buffer_size;
+  block_header *block = (block_header *)allocator->buffer;
+  size_t free_blocks = 0;
+  size_t free_bytes = 0;
+  bool prev_free = false;
+  while ((uint8_t *)block < end) {
+    if (!block_intact(allocator, block)) {
+      DP_ERROR(allocator, "Heap check: block %p is corrupted", block);
+      return 1;
+    }
+    if (block->is_free) {
+      if (prev_free) {
+        DP_ERROR(allocator, "Heap check: free block %p wasn't coalesced", block);
+        return 1;
+      }
+      free_blocks++;
+      free_bytes += block->size;
+    }
+    prev_free = block->is_free;
+    block = next_phys(allocator, block);
+  }
+  if (free_bytes != allocator->available) {
+    DP_ERROR(allocator, "Heap check: available=%zu but free blocks hold %zu",
+             allocator->available, free_bytes);
+    return 1;
+  }
+
+#if DP_FREE_INDEX
+  // Every entry must describe a free block, and together they must cover every free byte.
+  size_t indexed_bytes = 0;
+  for (size_t i = 0; i < allocator->index_count; i++) {
+    block_header *node = block_at(allocator, allocator->index_offsets[i]);
+    if (allocator->index_offsets[i] >= allocator->buffer_size || !node->is_free ||
+        node->size != allocator->index_sizes[i]) {
+      DP_ERROR(allocator, "Heap check: index entry %zu is corrupted", i);
+      return 1;
+    }
+    indexed_bytes += node->size;
+  }
+  if (allocator->index_count != free_blocks || indexed_bytes != free_bytes) {
+    DP_ERROR(allocator, "Heap check: index holds %zu of %zu free blocks",
+             allocator->index_count, free_blocks);
+    return 1;
+  }
+#else
+  // Every free block must be on the free list exactly once, the count bounds the walk
+  // so a cycle can't hang it.
+  size_t listed = 0;
+  for (block_header *node = allocator->free_list_head; node != NULL; node = node->next) {
+    if (++listed > free_blocks || (uint8_t *)node < allocator->buffer || (uint8_t *)node >= end ||
+        !node->is_free) {
+      DP_ERROR(allocator, "Heap check: free list is corrupted at %p", node);
+      return 1;
+    }
+  }
+  if (listed != free_blocks) {
+    DP_ERROR(allocator, "Heap check: free list holds %zu of %zu free blocks", listed,
+             free_blocks);
+    return 1;
+  }
+#endif
+
+#if DP_SIZE_CLASSES
+  // Cached blocks must be live blocks with room for their class, the count bounds the walk.
+  size_t cached_blocks = 0;
+  for (size_t i = 0; i < DP_SIZE_CLASSES; i++) {
+    size_t cached = 0;
+    block_header *node = allocator->class_cache[i];
+    for (; node != DP_CACHE_END; node = node->next) {
+      if (++cached > allocator->class_count[i] || (uint8_t *)node < allocator->buffer ||
+          (uint8_t *)node >= end || node->is_free ||
+          (node->size + sizeof(block_header) - DP_CLASS_USER_OFFSET) / DP_CLASS_GRANULE != i + 1) {
+        DP_ERROR(allocator, "Heap check: size class %zu cache is corrupted at %p", i, node);
+        return 1;
+      }
+    }
+    if (cached != allocator->class_count[i]) {
+      DP_ERROR(allocator, "Heap check: size class %zu holds %zu of %u cached blocks", i, cached,
+               allocator->class_count[i]);
+      return 1;
+    }
+    cached_blocks += cached;
+  }
+  if (cached_blocks != allocator->cached_blocks) {
+    DP_ERROR(allocator, "Heap check: size classes hold %zu of %zu cached blocks", cached_blocks,
+             allocator->cached_blocks);
+    return 1;
+  }
+#endif
+  return 0;
+}
+
+size_t dp_largest_free(dp_alloc *allocator) {
+  size_t largest = 0;
+  if (allocator == NULL)
+    return 0;
+#if DP_FREE_INDEX
+  for (size_t i = 0; i < allocator->index_count; i++) {
+    if (allocator->index_sizes[i] > largest)
+      largest = allocator->index_sizes[i];
+  }
+#else
+  for (block_header *block = allocator->free_list_head; block != NULL; block = block->next) {
+    if (block->size > largest)
+      largest = block->size;
+  }
+#endif
+  return largest;
+}
+
 #if DP_STATS
 float dp_get_fragmentation(dp_alloc *allocator) {
   size_t largest = 0;
   size_t total = 0;
+#if DP_FREE_INDEX
+  for (size_t i = 0; i < allocator->index_count; i++) {
+    total += allocator->index_sizes[i];
+    if (allocator->index_sizes[i] > largest)
+      largest = allocator->index_sizes[i];
+  }
+#else
   block_header *curr = allocator->free_list_head;
   while (curr) {
     total += curr->size;
@@ -286,7 +1113,10 @@ float dp_get_fragmentation(dp_alloc *allocator) {
       largest = curr->size;
     curr = curr->next;
   }
+#endif
 
   return (total > 0) ? 1.0f - (float)largest / total : 0.0f;
 }
 #endif
+
+#endif // !DP_OUT_OF_LINE_METADATA
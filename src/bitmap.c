@@ -0,0 +1,299 @@
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "bitmap.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DP_BITMAP_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define DP_BITMAP_NEON 1
+#include <arm_neon.h>
+#endif
+
+/*
+Layout of the buffer:
+
+  ┌────────────────┬────────────────┬───────┬─────────┬─────────┬─────┐
+  │ occupied words │ run_ends words │padding│ granule │ granule │ ... │
+  └────────────────┴────────────────┴───────┴─────────┴─────────┴─────┘
+
+Bits past the last granule are set in occupied, so no free run extends past the end.
+Allocation looks for the first run of enough clear bits in occupied, skipping whole words
+of allocated granules with the SIMD skip. Free finds the end of the run through run_ends.
+*/
+
+#define ALL_ONES (~UINT64_C(0))
+
+static inline size_t ctz64(uint64_t bits) { return (size_t)__builtin_ctzll(bits); }
+
+static inline bool test_bit(const uint64_t *words, size_t bit) {
+  return (words[bit / 64] >> (bit % 64)) & 1;
+}
+
+static void assign_bits(uint64_t *words, size_t from, size_t count, bool set) {
+  while (count > 0) {
+    size_t shift = from % 64;
+    size_t n = count < 64 - shift ? count : 64 - shift;
+    uint64_t mask = (n == 64 ? ALL_ONES : (UINT64_C(1) << n) - 1) << shift;
+    if (set)
+      words[from / 64] |= mask;
+    else
+      words[from / 64] &= ~mask;
+    from += n;
+    count -= n;
+  }
+}
+
+static size_t skip_scalar(const uint64_t *words, size_t from, size_t to, uint64_t value) {
+  while (from < to && words[from] == value)
+    from++;
+  return from;
+}
+
+#if DP_BITMAP_X86
+__attribute__((target("sse2"))) static size_t skip_sse2(const uint64_t *words, size_t from,
+                                                         size_t to, uint64_t value) {
+  __m128i target = _mm_set1_epi64x((long long)value);
+  for (; from + 2 <= to; from += 2) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)(words + from));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(chunk, target)) != 0xFFFF)
+      break;
+  }
+  return skip_scalar(words, from, to, value);
+}
+
+__attribute__((target("avx2"))) static size_t skip_avx2(const uint64_t *words, size_t from,
+                                                         size_t to, uint64_t value) {
+  __m256i target = _mm256_set1_epi64x((long long)value);
+  for (; from + 8 <= to; from += 8) {
+    __m256i low = _mm256_loadu_si256((const __m256i *)(words + from));
+    __m256i high = _mm256_loadu_si256((const __m256i *)(words + from + 4));
+    __m256i equal =
+        _mm256_and_si256(_mm256_cmpeq_epi64(low, target), _mm256_cmpeq_epi64(high, target));
+    if (_mm256_movemask_epi8(equal) != -1)
+      break;
+  }
+  return skip_scalar(words, from, to, value);
+}
+#endif
+
+#if DP_BITMAP_NEON
+static size_t skip_neon(const uint64_t *words, size_t from, size_t to, uint64_t value) {
+  uint64x2_t target = vdupq_n_u64(value);
+  for (; from + 4 <= to; from += 4) {
+    uint64x2_t low = vceqq_u64(vld1q_u64(words + from), target);
+    uint64x2_t high = vceqq_u64(vld1q_u64(words + from + 2), target);
+    if (vminvq_u32(vreinterpretq_u32_u64(vandq_u64(low, high))) != UINT32_MAX)
+      break;
+  }
+  return skip_scalar(words, from, to, value);
+}
+#endif
+
+bool dp_simd_supported(dp_simd simd) {
+  switch (simd) {
+  case DP_SIMD_SCALAR:
+    return true;
+#if DP_BITMAP_X86
+  case DP_SIMD_SSE2:
+    return __builtin_cpu_supports("sse2");
+  case DP_SIMD_AVX2:
+    return __builtin_cpu_supports("avx2");
+#endif
+#if DP_BITMAP_NEON
+  case DP_SIMD_NEON:
+    return true;
+#endif
+  default:
+    return false;
+  }
+}
+
+dp_simd dp_simd_best(void) {
+  static const dp_simd by_preference[] = {DP_SIMD_AVX2, DP_SIMD_NEON, DP_SIMD_SSE2};
+  for (size_t i = 0; i < sizeof(by_preference) / sizeof(by_preference[0]); i++) {
+    if (dp_simd_supported(by_preference[i]))
+      return by_preference[i];
+  }
+  return DP_SIMD_SCALAR;
+}
+
+bool dp_bitmap_set_simd(dp_bitmap *bitmap, dp_simd simd) {
+  if (bitmap == NULL || !dp_simd_supported(simd))
+    return false;
+
+  switch (simd) {
+#if DP_BITMAP_X86
+  case DP_SIMD_SSE2:
+    bitmap->skip = skip_sse2;
+    break;
+  case DP_SIMD_AVX2:
+    bitmap->skip = skip_avx2;
+    break;
+#endif
+#if DP_BITMAP_NEON
+  case DP_SIMD_NEON:
+    bitmap->skip = skip_neon;
+    break;
+#endif
+  default:
+    bitmap->skip = skip_scalar;
+    break;
+  }
+  bitmap->simd = simd;
+  return true;
+}
+
+bool dp_bitmap_init(dp_bitmap *bitmap, void *buffer, size_t buffer_size,
+                    size_t granule IF_DP_LOG(, dp_logger logger)) {
+  if (bitmap == NULL || buffer == NULL || granule < 8 || (granule & (granule - 1)) != 0) {
+    return false;
+  }
+
+  size_t align = granule < alignof(max_align_t) ? granule : alignof(max_align_t);
+  uintptr_t start = ((uintptr_t)buffer + alignof(uint64_t) - 1) & ~(alignof(uint64_t) - 1);
+  uintptr_t end = (uintptr_t)buffer + buffer_size;
+  if (start >= end)
+    return false;
+
+  // Start from the granule count ignoring padding and shrink until everything fits.
+  size_t granules = (size_t)(end - start) * 4 / (granule * 4 + 1);
+  uintptr_t data = 0;
+  size_t words = 0;
+  for (; granules > 0; granules--) {
+    words = (granules + 63) / 64;
+    data = (start + 2 * words * sizeof(uint64_t) + align - 1) & ~(uintptr_t)(align - 1);
+    if (data <= end && (end - data) / granule >= granules)
+      break;
+  }
+  if (granules == 0)
+    return false;
+
+  bitmap->occupied = (uint64_t *)start;
+  bitmap->run_ends = bitmap->occupied + words;
+  bitmap->words = words;
+  bitmap->data = (uint8_t *)data;
+  bitmap->granule = granule;
+  bitmap->granules = granules;
+  bitmap->available = granules;
+  IF_DP_LOG(bitmap->logger = logger;)
+  IF_DP_STATS(bitmap->num_iterations = 0;)
+
+  memset(bitmap->occupied, 0, 2 * words * sizeof(uint64_t));
+  assign_bits(bitmap->occupied, granules, words * 64 - granules, true);
+  dp_bitmap_set_simd(bitmap, dp_simd_best());
+
+  DP_INFO(bitmap, "Bitmap engine over %zu granules of %zu bytes (simd=%d)", granules, granule,
+          (int)bitmap->simd);
+  return true;
+}
+
+// First set bit of words in [from, limit), limit if there is none.
+static size_t next_set(const dp_bitmap *bitmap, const uint64_t *words, size_t from,
+                       size_t limit) {
+  size_t word = from / 64;
+  size_t last_word = (limit - 1) / 64;
+  uint64_t bits = words[word] & (ALL_ONES << (from % 64));
+  if (bits == 0 && word < last_word) {
+    word = bitmap->skip(words, word + 1, last_word + 1, 0);
+    if (word > last_word)
+      return limit;
+    bits = words[word];
+  }
+  if (bits == 0)
+    return limit;
+
+  size_t found = word * 64 + ctz64(bits);
+  return found < limit ? found : limit;
+}
+
+// Start of the first free run of at least count granules, SIZE_MAX if there is none.
+static size_t find_free_run(dp_bitmap *bitmap, size_t count) {
+  const uint64_t *occupied = bitmap->occupied;
+  size_t bit = 0;
+  IF_DP_STATS(bitmap->num_iterations = 0;)
+
+  while (bit < bitmap->granules) {
+    // Start of the next free run, skipping whole words of allocated granules.
+    size_t word = bit / 64;
+    uint64_t free_bits = ~occupied[word] & (ALL_ONES << (bit % 64));
+    if (free_bits == 0) {
+      word = bitmap->skip(occupied, word + 1, bitmap->words, ALL_ONES);
+      if (word == bitmap->words)
+        return SIZE_MAX;
+      free_bits = ~occupied[word];
+    }
+    size_t start = word * 64 + ctz64(free_bits);
+    IF_DP_STATS(bitmap->num_iterations++;)
+    if (start + count > bitmap->granules)
+      return SIZE_MAX; // runs are found in address order, later ones fit even less.
+
+    // Only look as far into the run as the request needs.
+    size_t end = next_set(bitmap, occupied, start, start + count);
+    if (end == start + count)
+      return start;
+    bit = end + 1;
+  }
+  return SIZE_MAX;
+}
+
+void *dp_bitmap_malloc(dp_bitmap *bitmap, size_t size) {
+  if (bitmap == NULL || size == 0 || size > bitmap->available * bitmap->granule)
+    return NULL;
+
+  size_t count = (size + bitmap->granule - 1) / bitmap->granule;
+  size_t start = find_free_run(bitmap, count);
+  if (start == SIZE_MAX)
+    return NULL;
+
+  assign_bits(bitmap->occupied, start, count, true);
+  assign_bits(bitmap->run_ends, start + count - 1, 1, true);
+  bitmap->available -= count;
+
+  DP_INFO(bitmap, "Allocated granules %zu-%zu (available=%zu)", start, start + count - 1,
+          bitmap->available);
+  return bitmap->data + start * bitmap->granule;
+}
+
+int dp_bitmap_free(dp_bitmap *bitmap, void *ptr) {
+  if (ptr == NULL || bitmap == NULL) {
+    DP_ERROR(bitmap, "Trying to free null pointer, or with null allocator.");
+    return 1;
+  }
+
+  uintptr_t offset = (uintptr_t)ptr - (uintptr_t)bitmap->data;
+  if ((uint8_t *)ptr < bitmap->data || offset % bitmap->granule != 0 ||
+      offset / bitmap->granule >= bitmap->granules) {
+    DP_ERROR(bitmap, "Deallocating invalid pointer %p", ptr);
+    return 1;
+  }
+
+  size_t start = offset / bitmap->granule;
+  if (!test_bit(bitmap->occupied, start)) {
+    DP_ERROR(bitmap, "Double free detected for pointer %p", ptr);
+    return 1;
+  }
+  // Granule before an allocation is either free or the end of another allocation.
+  if (start > 0 && test_bit(bitmap->occupied, start - 1) &&
+      !test_bit(bitmap->run_ends, start - 1)) {
+    DP_ERROR(bitmap, "Trying to free %p which is inside an allocation", ptr);
+    return 1;
+  }
+
+  size_t end = next_set(bitmap, bitmap->run_ends, start, bitmap->granules);
+  if (end == bitmap->granules) {
+    DP_ERROR(bitmap, "Allocation at %p has no end, the bitmap is corrupted", ptr);
+    return 1;
+  }
+  size_t count = end - start + 1;
+  assign_bits(bitmap->occupied, start, count, false);
+  assign_bits(bitmap->run_ends, end, 1, false);
+  bitmap->available += count;
+
+  DP_INFO(bitmap, "Freed granules %zu-%zu (available=%zu)", start, end, bitmap->available);
+  return 0;
+}
@@ -0,0 +1,267 @@
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "compose.h"
+
+/*
+The adapters cast self back to the engine they view, the combinators to their struct, and
+route every call through the dp_allocator members of the struct. Nothing is allocated here,
+a composition lives wherever its structs live.
+*/
+
+// ---- Engines ----
+
+static void *heap_malloc(void *self, size_t size) { return dp_malloc(self, size); }
+
+static int heap_free(void *self, void *ptr) { return dp_free(self, ptr); }
+
+// The buffer, and the huge blocks mapped outside it.
+static bool heap_owns(const void *self, const void *ptr) {
+  const dp_alloc *heap = self;
+  const uint8_t *byte = ptr;
+  if (byte >= heap->buffer && byte < heap->buffer + heap->buffer_size)
+    return true;
+#if DP_HUGE_THRESHOLD
+  return dp_huge_size(heap, ptr) != 0;
+#else
+  return false;
+#endif
+}
+
+static const dp_allocator_ops heap_ops = {heap_malloc, heap_free, heap_owns};
+
+dp_allocator dp_heap_allocator(dp_alloc *heap) {
+  return (dp_allocator){.ops = &heap_ops, .self = heap};
+}
+
+static void *bitmap_malloc(void *self, size_t size) { return dp_bitmap_malloc(self, size); }
+
+static int bitmap_free(void *self, void *ptr) { return dp_bitmap_free(self, ptr); }
+
+static bool bitmap_owns(const void *self, const void *ptr) {
+  const dp_bitmap *bitmap = self;
+  const uint8_t *byte = ptr;
+  return byte >= bitmap->data && byte < bitmap->data + bitmap->granules * bitmap->granule;
+}
+
+static const dp_allocator_ops bitmap_ops = {bitmap_malloc, bitmap_free, bitmap_owns};
+
+dp_allocator dp_bitmap_allocator(dp_bitmap *bitmap) {
+  return (dp_allocator){.ops = &bitmap_ops, .self = bitmap};
+}
+
+static void *tree_malloc(void *self, size_t size) { return dp_tree_malloc(self, size); }
+
+static int tree_free(void *self, void *ptr) { return dp_tree_free(self, ptr); }
+
+static bool tree_owns(const void *self, const void *ptr) {
+  const dp_tree *tree = self;
+  const uint8_t *byte = ptr;
+  return byte >= tree->data && byte < tree->data + tree->granules * tree->granule;
+}
+
+static const dp_allocator_ops tree_ops = {tree_malloc, tree_free, tree_owns};
+
+dp_allocator dp_tree_allocator(dp_tree *tree) {
+  return (dp_allocator){.ops = &tree_ops, .self = tree};
+}
+
+// ---- mmap ----
+
+// Every live mapping starts with a header linking it into mmap_blocks, the block starts past it.
+// Frees only unmap blocks found on the list, so a foreign or freed pointer is refused without
+// reading the memory in front of it.
+typedef struct mmap_block {
+  struct mmap_block *prev;
+  struct mmap_block *next;
+  size_t length;
+} mmap_block;
+
+#define MMAP_HEADER                                                                           \
+  ((sizeof(mmap_block) + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1))
+
+// Any thread may map or unmap, the list is only walked or changed under mmap_lock. The walk
+// costs far less than the munmap it guards.
+static pthread_mutex_t mmap_lock = PTHREAD_MUTEX_INITIALIZER;
+static mmap_block *mmap_blocks = NULL;
+
+static size_t page_size(void) {
+  static size_t size = 0;
+  if (size == 0)
+    size = (size_t)sysconf(_SC_PAGESIZE);
+  return size;
+}
+
+static void *mmap_malloc(void *self, size_t size) {
+  (void)self;
+  size_t page = page_size();
+  if (size == 0 || size > SIZE_MAX - MMAP_HEADER - page)
+    return NULL;
+  size_t length = (size + MMAP_HEADER + page - 1) & ~(page - 1);
+  void *mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapping == MAP_FAILED)
+    return NULL;
+  mmap_block *block = mapping;
+  block->prev = NULL;
+  block->length = length;
+  pthread_mutex_lock(&mmap_lock);
+  block->next = mmap_blocks;
+  if (mmap_blocks != NULL)
+    mmap_blocks->prev = block;
+  mmap_blocks = block;
+  pthread_mutex_unlock(&mmap_lock);
+  return (uint8_t *)mapping + MMAP_HEADER;
+}
+
+static int mmap_free(void *self, void *ptr) {
+  (void)self;
+  // Anything not at the block offset of a page can't be a block of ours.
+  if (ptr == NULL || ((uintptr_t)ptr & (page_size() - 1)) != MMAP_HEADER)
+    return 1;
+  mmap_block *block;
+  pthread_mutex_lock(&mmap_lock);
+  for (block = mmap_blocks; block != NULL; block = block->next) {
+    if ((uint8_t *)block + MMAP_HEADER == ptr)
+      break;
+  }
+  if (block == NULL) {
+    pthread_mutex_unlock(&mmap_lock);
+    return 1;
+  }
+  if (block->prev != NULL)
+    block->prev->next = block->next;
+  else
+    mmap_blocks = block->next;
+  if (block->next != NULL)
+    block->next->prev = block->prev;
+  pthread_mutex_unlock(&mmap_lock);
+  return munmap(block, block->length) == 0 ? 0 : 1;
+}
+
+static const dp_allocator_ops mmap_ops = {mmap_malloc, mmap_free, NULL};
+
+dp_allocator dp_mmap_allocator(void) { return (dp_allocator){.ops = &mmap_ops, .self = NULL}; }
+
+// ---- Combinators ----
+
+static void *segregator_malloc(void *self, size_t size) {
+  dp_segregator *segregator = self;
+  return dp_allocator_malloc(size <= segregator->threshold ? segregator->small : segregator->large,
+                             size);
+}
+
+static int segregator_free(void *self, void *ptr) {
+  dp_segregator *segregator = self;
+  return dp_allocator_free(
+      dp_allocator_owns(segregator->small, ptr) ? segregator->small : segregator->large, ptr);
+}
+
+static bool segregator_owns(const void *self, const void *ptr) {
+  const dp_segregator *segregator = self;
+  return dp_allocator_owns(segregator->small, ptr) || dp_allocator_owns(segregator->large, ptr);
+}
+
+static const dp_allocator_ops segregator_ops = {segregator_malloc, segregator_free,
+                                                segregator_owns};
+
+dp_allocator dp_segregator_allocator(dp_segregator *segregator) {
+  return (dp_allocator){.ops = &segregator_ops, .self = segregator};
+}
+
+static void *fallback_malloc(void *self, size_t size) {
+  dp_fallback *fallback = self;
+  void *ptr = dp_allocator_malloc(fallback->primary, size);
+  return ptr != NULL || size == 0 ? ptr : dp_allocator_malloc(fallback->secondary, size);
+}
+
+static int fallback_free(void *self, void *ptr) {
+  dp_fallback *fallback = self;
+  return dp_allocator_free(
+      dp_allocator_owns(fallback->primary, ptr) ? fallback->primary : fallback->secondary, ptr);
+}
+
+static bool fallback_owns(const void *self, const void *ptr) {
+  const dp_fallback *fallback = self;
+  return dp_allocator_owns(fallback->primary, ptr) || dp_allocator_owns(fallback->secondary, ptr);
+}
+
+static const dp_allocator_ops fallback_ops = {fallback_malloc, fallback_free, fallback_owns};
+
+dp_allocator dp_fallback_allocator(dp_fallback *fallback) {
+  return (dp_allocator){.ops = &fallback_ops, .self = fallback};
+}
+
+static void *bucketizer_malloc(void *self, size_t size) {
+  dp_bucketizer *bucketizer = self;
+  if (size <= bucketizer->min)
+    return NULL;
+  size_t bucket = (size - bucketizer->min - 1) / bucketizer->step;
+  return bucket < bucketizer->count ? dp_allocator_malloc(bucketizer->buckets[bucket], size)
+                                    : NULL;
+}
+
+static int bucketizer_free(void *self, void *ptr) {
+  dp_bucketizer *bucketizer = self;
+  for (size_t i = 0; i < bucketizer->count; i++) {
+    if (dp_allocator_owns(bucketizer->buckets[i], ptr))
+      return dp_allocator_free(bucketizer->buckets[i], ptr);
+  }
+  return 1;
+}
+
+static bool bucketizer_owns(const void *self, const void *ptr) {
+  const dp_bucketizer *bucketizer = self;
+  for (size_t i = 0; i < bucketizer->count; i++) {
+    if (dp_allocator_owns(bucketizer->buckets[i], ptr))
+      return true;
+  }
+  return false;
+}
+
+static const dp_allocator_ops bucketizer_ops = {bucketizer_malloc, bucketizer_free,
+                                                bucketizer_owns};
+
+dp_allocator dp_bucketizer_allocator(dp_bucketizer *bucketizer) {
+  return (dp_allocator){.ops = &bucketizer_ops, .self = bucketizer};
+}
+
+static void *stats_malloc(void *self, size_t size) {
+  dp_stats *stats = self;
+  void *ptr = dp_allocator_malloc(stats->inner, size);
+  stats->allocations++;
+  stats->bytes_requested += size;
+  if (ptr == NULL) {
+    stats->failures++;
+  } else if (++stats->live > stats->peak_live) {
+    stats->peak_live = stats->live;
+  }
+  return ptr;
+}
+
+static int stats_free(void *self, void *ptr) {
+  dp_stats *stats = self;
+  int result = dp_allocator_free(stats->inner, ptr);
+  if (result == 0) {
+    stats->frees++;
+    stats->live--;
+  }
+  return result;
+}
+
+static bool stats_owns(const void *self, const void *ptr) {
+  const dp_stats *stats = self;
+  return dp_allocator_owns(stats->inner, ptr);
+}
+
+static const dp_allocator_ops stats_ops = {stats_malloc, stats_free, stats_owns};
+
+dp_allocator dp_stats_allocator(dp_stats *stats) {
+  return (dp_allocator){.ops = &stats_ops, .self = stats};
+}
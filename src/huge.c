@@ -0,0 +1,150 @@
+#define _GNU_SOURCE // mremap
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "allocator.h"
+
+/*
+Huge blocks are anonymous mappings of whole pages, the user pointer is the start of the
+mapping, so nothing sits in front of it and dp_free must tell them apart from blocks of the
+buffer by address before reading the offset byte. A block is huge exactly when it is in
+huge_blocks, a dense table searched linearly, small enough that a search costs less than the
+mapping it finds.
+*/
+
+#if DP_HUGE_THRESHOLD
+
+static size_t page_size(void) {
+  static size_t size = 0;
+  if (size == 0)
+    size = (size_t)sysconf(_SC_PAGESIZE);
+  return size;
+}
+
+// Slot of the huge block at ptr, DP_HUGE_SLOTS if there is none.
+static size_t find_huge(const dp_alloc *allocator, const void *ptr) {
+  for (size_t i = 0; i < allocator->huge_count; i++) {
+    if (allocator->huge_blocks[i].ptr == ptr)
+      return i;
+  }
+  return DP_HUGE_SLOTS;
+}
+
+void *dp_huge_malloc(dp_alloc *allocator, size_t size) {
+  size_t page = page_size();
+  if (allocator->huge_count == DP_HUGE_SLOTS) {
+    DP_WARNING(allocator, "Huge block table is full, %zu bytes come from the buffer", size);
+    return NULL;
+  }
+  if (size > SIZE_MAX - page)
+    return NULL;
+
+  size_t length = (size + page - 1) & ~(page - 1);
+  void *ptr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED) {
+    DP_WARNING(allocator, "Mapping a huge block of %zu bytes failed", length);
+    return NULL;
+  }
+  allocator->huge_blocks[allocator->huge_count++] = (dp_huge_block){ptr, length};
+  allocator->huge_bytes += length;
+  DP_INFO(allocator, "Mapped huge block at %p (length=%zu, huge_bytes=%zu)", ptr, length,
+          allocator->huge_bytes);
+  return ptr;
+}
+
+int dp_huge_free(dp_alloc *allocator, void *ptr) {
+  size_t slot = find_huge(allocator, ptr);
+  if (slot == DP_HUGE_SLOTS) {
+    DP_ERROR(allocator, "Deallocating invalid pointer %p", ptr);
+    return 1;
+  }
+  dp_huge_block block = allocator->huge_blocks[slot];
+  allocator->huge_blocks[slot] = allocator->huge_blocks[--allocator->huge_count];
+  allocator->huge_bytes -= block.length;
+  munmap(block.ptr, block.length);
+  DP_INFO(allocator, "Unmapped huge block at %p (length=%zu, huge_bytes=%zu)", ptr, block.length,
+          allocator->huge_bytes);
+  return 0;
+}
+
+size_t dp_huge_size(const dp_alloc *allocator, const void *ptr) {
+  size_t slot = find_huge(allocator, ptr);
+  return slot == DP_HUGE_SLOTS ? 0 : allocator->huge_blocks[slot].length;
+}
+
+// Resizes the huge block in slot to size bytes, the kernel moves its pages if it must.
+static void *huge_resize(dp_alloc *allocator, size_t slot, size_t size) {
+  dp_huge_block *block = &allocator->huge_blocks[slot];
+  size_t page = page_size();
+  if (size > SIZE_MAX - page)
+    return NULL;
+  size_t length = (size + page - 1) & ~(page - 1);
+  if (length == block->length)
+    return block->ptr;
+
+#ifdef MREMAP_MAYMOVE
+  void *ptr = mremap(block->ptr, block->length, length, MREMAP_MAYMOVE);
+  if (ptr == MAP_FAILED)
+    return NULL;
+#else
+  void *ptr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED)
+    return NULL;
+  memcpy(ptr, block->ptr, length < block->length ? length : block->length);
+  munmap(block->ptr, block->length);
+#endif
+  DP_INFO(allocator, "Remapped huge block at %p to %p (length=%zu->%zu)", block->ptr, ptr,
+          block->length, length);
+  allocator->huge_bytes = allocator->huge_bytes - block->length + length;
+  block->ptr = ptr;
+  block->length = length;
+  return ptr;
+}
+
+#endif // DP_HUGE_THRESHOLD
+
+void *dp_realloc(dp_alloc *allocator, void *ptr, size_t size) {
+  if (allocator == NULL)
+    return NULL;
+  if (ptr == NULL)
+    return dp_malloc(allocator, size);
+  if (size == 0) {
+    dp_free(allocator, ptr);
+    return NULL;
+  }
+
+#if DP_HUGE_THRESHOLD
+  size_t slot = find_huge(allocator, ptr);
+  if (slot != DP_HUGE_SLOTS) {
+    // A block shrunk below the threshold moves into the buffer, if it has room.
+    if (size <= DP_HUGE_THRESHOLD) {
+      void *moved = dp_malloc(allocator, size);
+      if (moved != NULL) {
+        memcpy(moved, ptr, size);
+        dp_huge_free(allocator, ptr);
+        return moved;
+      }
+    }
+    return huge_resize(allocator, slot, size);
+  }
+#endif
+
+  size_t usable = dp_usable_size(allocator, ptr);
+  if (usable == 0) {
+    DP_ERROR(allocator, "Reallocating invalid pointer %p", ptr);
+    return NULL;
+  }
+  if (size <= usable)
+    return ptr;
+  void *moved = dp_malloc(allocator, size);
+  if (moved == NULL)
+    return NULL;
+  memcpy(moved, ptr, usable);
+  dp_free(allocator, ptr);
+  return moved;
+}
@@ -0,0 +1,164 @@
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS, madvise
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "pages.h"
+
+static size_t round_up(size_t size, size_t page) { return (size + page - 1) & ~(page - 1); }
+
+static void *map_anonymous(size_t size, int flags) {
+  void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+  return data == MAP_FAILED ? NULL : data;
+}
+
+// Maps size bytes starting on a huge page boundary, over-mapping by a huge page and
+// unmapping what hangs over either side of the aligned range.
+static void *map_aligned(size_t size) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t length = size + DP_HUGE_PAGE_SIZE - page;
+  uint8_t *mapping = map_anonymous(length, 0);
+  if (mapping == NULL)
+    return NULL;
+  uint8_t *data = (uint8_t *)round_up((uintptr_t)mapping, DP_HUGE_PAGE_SIZE);
+  if (data > mapping)
+    munmap(mapping, (size_t)(data - mapping));
+  if (mapping + length > data + size)
+    munmap(data + size, (size_t)(mapping + length - data - size));
+  return data;
+}
+
+bool dp_pages_map(dp_pages *pages, size_t size, dp_page_kind kind) {
+  if (pages == NULL || size == 0 || size > SIZE_MAX - 2 * DP_HUGE_PAGE_SIZE)
+    return false;
+
+#ifdef MAP_HUGETLB
+  if (kind == DP_PAGES_HUGETLB) {
+    size_t length = round_up(size, DP_HUGE_PAGE_SIZE);
+    void *data = map_anonymous(length, MAP_HUGETLB);
+    if (data != NULL) {
+      *pages = (dp_pages){data, length, DP_PAGES_HUGETLB};
+      return true;
+    }
+  }
+#endif
+
+  if (kind == DP_PAGES_SMALL) {
+    size_t length = round_up(size, (size_t)sysconf(_SC_PAGESIZE));
+    void *data = map_anonymous(length, 0);
+    if (data == NULL)
+      return false;
+    *pages = (dp_pages){data, length, DP_PAGES_SMALL};
+    return true;
+  }
+
+  // Stays aligned when the advice fails, the system may still collapse it into huge pages.
+  size_t length = round_up(size, DP_HUGE_PAGE_SIZE);
+  void *data = map_aligned(length);
+  if (data == NULL)
+    return false;
+  *pages = (dp_pages){data, length, DP_PAGES_SMALL};
+#ifdef MADV_HUGEPAGE
+  if (madvise(data, length, MADV_HUGEPAGE) == 0)
+    pages->kind = DP_PAGES_TRANSPARENT;
+#endif
+  return true;
+}
+
+void dp_pages_unmap(dp_pages *pages) {
+  if (pages == NULL || pages->data == NULL)
+    return;
+  munmap(pages->data, pages->size);
+  pages->data = NULL;
+  pages->size = 0;
+}
+
+size_t dp_decommit(void *data, size_t size) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  uintptr_t start = round_up((uintptr_t)data, page);
+  uintptr_t end = ((uintptr_t)data + size) & ~(uintptr_t)(page - 1);
+  if (end <= start)
+    return 0;
+#if DP_TRIM_LAZY && defined(MADV_FREE)
+  int advice = MADV_FREE;
+#else
+  int advice = MADV_DONTNEED;
+#endif
+  return madvise((void *)start, end - start, advice) == 0 ? end - start : 0;
+}
+
+// A slice of a mapping to fault in.
+typedef struct warm_slice {
+  uint8_t *data;
+  size_t size;
+} warm_slice;
+
+static void *fault_in(void *arg) {
+  warm_slice *slice = arg;
+#ifdef MADV_POPULATE_WRITE
+  if (madvise(slice->data, slice->size, MADV_POPULATE_WRITE) == 0)
+    return NULL;
+#endif
+  // Writes, a read would only map the shared zero page.
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  for (size_t offset = 0; offset < slice->size; offset += page) {
+    ((volatile uint8_t *)slice->data)[offset] = 0;
+  }
+  return NULL;
+}
+
+bool dp_pages_warm(dp_pages *pages, dp_warm_up warm_up) {
+  if (pages == NULL || pages->data == NULL)
+    return false;
+
+  // Slices of whole huge pages, so no two threads fault the same one. Threads past the online
+  // CPUs would only wait for one.
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t threads = warm_up.threads > 1 ? warm_up.threads : 1;
+  if (cpus > 0 && threads > (size_t)cpus)
+    threads = (size_t)cpus;
+  if (threads > DP_WARM_MAX_THREADS)
+    threads = DP_WARM_MAX_THREADS;
+  size_t slice_size = round_up((pages->size + threads - 1) / threads, DP_HUGE_PAGE_SIZE);
+  warm_slice slices[DP_WARM_MAX_THREADS];
+  pthread_t workers[DP_WARM_MAX_THREADS];
+  size_t started = 0;
+  for (size_t i = 0; i < threads && i * slice_size < pages->size; i++) {
+    size_t offset = i * slice_size;
+    size_t remaining = pages->size - offset;
+    slices[i] = (warm_slice){(uint8_t *)pages->data + offset,
+                             remaining < slice_size ? remaining : slice_size};
+    // The calling thread takes the first slice, and any a worker couldn't be started for.
+    if (i == 0 || pthread_create(&workers[i], NULL, fault_in, &slices[i]) != 0)
+      fault_in(&slices[i]);
+    else
+      workers[started++] = workers[i];
+  }
+  for (size_t i = 0; i < started; i++) {
+    pthread_join(workers[i], NULL);
+  }
+
+  return !warm_up.lock || mlock(pages->data, pages->size) == 0;
+}
+
+bool dp_init_pages(dp_alloc *allocator, dp_pages *pages, size_t size, dp_page_kind kind,
+                   const dp_warm_up *warm_up IF_DP_LOG(, dp_logger logger)) {
+  if (!dp_pages_map(pages, size, kind))
+    return false;
+  if (!dp_init(allocator, pages->data, pages->size IF_DP_LOG(, logger))) {
+    dp_pages_unmap(pages);
+    return false;
+  }
+  DP_INFO(allocator, "Heap over %zu bytes of %s pages", pages->size,
+          pages->kind == DP_PAGES_HUGETLB       ? "hugetlb"
+          : pages->kind == DP_PAGES_TRANSPARENT ? "transparent huge"
+                                                : "small");
+  if (warm_up != NULL && !dp_pages_warm(pages, *warm_up)) {
+    DP_WARNING(allocator, "Locking the heap's pages failed, they may be paged out");
+  }
+  return true;
+}
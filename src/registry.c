@@ -0,0 +1,199 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "allocator.h"
+
+/*
+Global arena registry: a three level radix tree over page numbers, mapping every page a
+registered arena's buffer touches to that arena.
+
+  address: │ root │ mid │ leaf │ page offset │
+           └──────┴─────┴──────┴─────────────┘
+                                 REGISTRY_PAGE_SHIFT bits
+
+Only an arena's first and last pages can be shared with other arenas, its interior pages
+are covered by its buffer alone. Arenas sharing a page form a chain through
+registry_next[0] (the page is their first page) or registry_next[1] (their last page), so
+lookups are O(1) as long as arenas are not much smaller than a page. Registration is
+linear in the arena's page count. Nodes are allocated on demand and never released.
+
+dp_register and dp_unregister hold registry_lock, so one thread at a time changes the tree
+and the chains. Lookups take no lock: nodes, slots and chain links are published with
+release stores and read with acquire loads, so a lookup sees an arena only after its buffer
+and links. Since nodes are never released, and unregistering leaves the arena's own links
+in place, a lookup walking a chain while it changes never leaves it.
+*/
+
+#if DP_REGISTRY
+
+#if UINTPTR_MAX > 0xFFFFFFFFu
+#define REGISTRY_ADDRESS_BITS 48
+#else
+#define REGISTRY_ADDRESS_BITS 32
+#endif
+
+#define REGISTRY_PAGE_SHIFT 12
+#define REGISTRY_LEAF_BITS 12
+#define REGISTRY_ROOT_BITS ((REGISTRY_ADDRESS_BITS - REGISTRY_PAGE_SHIFT - REGISTRY_LEAF_BITS) / 2)
+#define REGISTRY_MID_BITS                                                                          \
+  (REGISTRY_ADDRESS_BITS - REGISTRY_PAGE_SHIFT - REGISTRY_LEAF_BITS - REGISTRY_ROOT_BITS)
+#define REGISTRY_PAGE_BITS (REGISTRY_ADDRESS_BITS - REGISTRY_PAGE_SHIFT)
+
+#define REGISTRY_LEAF_MASK (((uintptr_t)1 << REGISTRY_LEAF_BITS) - 1)
+#define REGISTRY_MID_MASK (((uintptr_t)1 << REGISTRY_MID_BITS) - 1)
+
+typedef struct registry_leaf {
+  _Atomic(dp_alloc *) pages[1 << REGISTRY_LEAF_BITS];
+} registry_leaf;
+
+typedef struct registry_mid {
+  _Atomic(registry_leaf *) leaves[1 << REGISTRY_MID_BITS];
+} registry_mid;
+
+static _Atomic(registry_mid *) registry_root[1 << REGISTRY_ROOT_BITS];
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline uintptr_t first_page(const dp_alloc *allocator) {
+  return (uintptr_t)allocator->buffer >> REGISTRY_PAGE_SHIFT;
+}
+
+static inline uintptr_t last_page(const dp_alloc *allocator) {
+  return ((uintptr_t)allocator->buffer + allocator->buffer_size - 1) >> REGISTRY_PAGE_SHIFT;
+}
+
+// The arena's chain link on page, NULL on interior pages, which it doesn't share.
+static inline _Atomic(dp_alloc *) *chain_link(dp_alloc *allocator, uintptr_t page) {
+  if (page == first_page(allocator))
+    return &allocator->registry_next[0];
+  if (page == last_page(allocator))
+    return &allocator->registry_next[1];
+  return NULL;
+}
+
+// Head of page's chain, NULL if the nodes don't exist.
+static _Atomic(dp_alloc *) *page_slot(uintptr_t page) {
+  registry_mid *mid = atomic_load_explicit(
+      &registry_root[page >> (REGISTRY_MID_BITS + REGISTRY_LEAF_BITS)], memory_order_acquire);
+  if (mid == NULL)
+    return NULL;
+  registry_leaf *leaf = atomic_load_explicit(
+      &mid->leaves[(page >> REGISTRY_LEAF_BITS) & REGISTRY_MID_MASK], memory_order_acquire);
+  return leaf != NULL ? &leaf->pages[page & REGISTRY_LEAF_MASK] : NULL;
+}
+
+// Creates the nodes on the way to page's slot, false if they can't be allocated. Callers hold
+// registry_lock, the nodes are zeroed before they are published.
+static bool create_nodes(uintptr_t page) {
+  _Atomic(registry_mid *) *root = &registry_root[page >> (REGISTRY_MID_BITS + REGISTRY_LEAF_BITS)];
+  registry_mid *mid = atomic_load_explicit(root, memory_order_relaxed);
+  if (mid == NULL) {
+    if ((mid = calloc(1, sizeof(registry_mid))) == NULL)
+      return false;
+    atomic_store_explicit(root, mid, memory_order_release);
+  }
+  _Atomic(registry_leaf *) *leaves = &mid->leaves[(page >> REGISTRY_LEAF_BITS) & REGISTRY_MID_MASK];
+  if (atomic_load_explicit(leaves, memory_order_relaxed) == NULL) {
+    registry_leaf *leaf = calloc(1, sizeof(registry_leaf));
+    if (leaf == NULL)
+      return false;
+    atomic_store_explicit(leaves, leaf, memory_order_release);
+  }
+  return true;
+}
+
+static bool register_pages(dp_alloc *allocator) {
+  if (dp_owner(allocator->buffer) == allocator)
+    return true; // already registered.
+
+  // Create every node up front, so running out of memory leaves the registry untouched.
+  uintptr_t first = first_page(allocator);
+  uintptr_t last = last_page(allocator);
+  for (uintptr_t page = first; page <= last; page = (page | REGISTRY_LEAF_MASK) + 1) {
+    if (!create_nodes(page))
+      return false;
+  }
+
+  // The arena goes at the head of each chain, its link to the old head is set first.
+  for (uintptr_t page = first; page <= last; page++) {
+    _Atomic(dp_alloc *) *slot = page_slot(page);
+    _Atomic(dp_alloc *) *link = chain_link(allocator, page);
+    if (link != NULL) {
+      atomic_store_explicit(link, atomic_load_explicit(slot, memory_order_relaxed),
+                            memory_order_relaxed);
+    }
+    atomic_store_explicit(slot, allocator, memory_order_release);
+  }
+
+  DP_INFO(allocator, "Registered arena %p (pages %#zx-%#zx)", allocator, (size_t)first,
+          (size_t)last);
+  return true;
+}
+
+bool dp_register(dp_alloc *allocator) {
+  if (allocator == NULL || allocator->buffer == NULL ||
+      last_page(allocator) >> REGISTRY_PAGE_BITS != 0) {
+    return false;
+  }
+  pthread_mutex_lock(&registry_lock);
+  bool registered = register_pages(allocator);
+  pthread_mutex_unlock(&registry_lock);
+  return registered;
+}
+
+void dp_unregister(dp_alloc *allocator) {
+  if (allocator == NULL || allocator->buffer == NULL ||
+      last_page(allocator) >> REGISTRY_PAGE_BITS != 0) {
+    return;
+  }
+
+  pthread_mutex_lock(&registry_lock);
+  for (uintptr_t page = first_page(allocator); page <= last_page(allocator); page++) {
+    _Atomic(dp_alloc *) *link = page_slot(page);
+    dp_alloc *arena = link != NULL ? atomic_load_explicit(link, memory_order_relaxed) : NULL;
+    while (arena != NULL && arena != allocator) {
+      link = chain_link(arena, page);
+      arena = link != NULL ? atomic_load_explicit(link, memory_order_relaxed) : NULL;
+    }
+    if (arena == NULL)
+      continue; // not registered on this page.
+
+    // Lookups already past the link keep following the arena's own, left as they are.
+    _Atomic(dp_alloc *) *next = chain_link(allocator, page);
+    atomic_store_explicit(link, next != NULL ? atomic_load_explicit(next, memory_order_relaxed)
+                                             : NULL,
+                          memory_order_release);
+  }
+  pthread_mutex_unlock(&registry_lock);
+}
+
+dp_alloc *dp_owner(const void *ptr) {
+  uintptr_t address = (uintptr_t)ptr;
+  uintptr_t page = address >> REGISTRY_PAGE_SHIFT;
+  if (page >> REGISTRY_PAGE_BITS != 0)
+    return NULL;
+
+  _Atomic(dp_alloc *) *slot = page_slot(page);
+  dp_alloc *arena = slot != NULL ? atomic_load_explicit(slot, memory_order_acquire) : NULL;
+  while (arena != NULL) {
+    if (address >= (uintptr_t)arena->buffer &&
+        address - (uintptr_t)arena->buffer < arena->buffer_size) {
+      return arena;
+    }
+    _Atomic(dp_alloc *) *link = chain_link(arena, page);
+    arena = link != NULL ? atomic_load_explicit(link, memory_order_acquire) : NULL;
+  }
+  return NULL;
+}
+
+int dp_free_any(void *ptr) {
+  dp_alloc *owner = dp_owner(ptr);
+  if (owner == NULL)
+    return 1; // not in any registered arena, there's no logger to report it to.
+  return dp_free(owner, ptr);
+}
+
+#endif
@@ -0,0 +1,544 @@
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "allocator.h"
+#include "pages.h"
+
+#if DP_OUT_OF_LINE_METADATA
+
+#if DP_FREE_INDEX
+#error "DP_FREE_INDEX indexes inline block headers, it can't be combined with out of line metadata"
+#endif
+#if DP_SIZE_CLASSES
+#error "DP_SIZE_CLASSES caches blocks through their headers, which out of line metadata drops"
+#endif
+
+/*
+Layout of the buffer:
+
+  ┌────────────┬───────────┬──────────────┬───────┬─────────┬─────────┬─────┐
+  │block_starts│free_starts│trimmed_starts│padding│ granule │ granule │ ... │
+  └────────────┴───────────┴──────────────┴───────┴─────────┴─────────┴─────┘
+                                                  ▲
+                                                data
+
+Every block is a run of granules, its first granule's bit is set in block_starts and, while
+the block is free, in free_starts. The bit past the last granule is always set in
+block_starts, so every block has an end. User pointers are the first byte of their block,
+there is nothing between consecutive blocks. A free block whose pages were returned by a
+trim also has its first granule's bit set in trimmed_starts, so it isn't trimmed again.
+
+Each bitmap is DP_SIDE_LEVELS arrays of words, a bit per granule followed by its summaries.
+*/
+
+#define ALL_ONES (~UINT64_C(0))
+
+static const size_t granule = DP_ALIGNMENT ? DP_ALIGNMENT : alignof(max_align_t);
+
+static inline size_t ctz64(uint64_t bits) { return (size_t)__builtin_ctzll(bits); }
+
+static inline size_t last_bit(uint64_t bits) { return 63 - (size_t)__builtin_clzll(bits); }
+
+// Words of every level for a bitmap of bits bits, returns the total.
+static size_t side_words(size_t bits, size_t words[DP_SIDE_LEVELS]) {
+  size_t total = 0;
+  for (size_t level = 0; level < DP_SIDE_LEVELS; level++) {
+    words[level] = (bits + 63) / 64;
+    total += words[level];
+    bits = words[level];
+  }
+  return total;
+}
+
+static inline bool test_bit(const dp_side_bitmap *bitmap, size_t bit) {
+  return (bitmap->levels[0][bit / 64] >> (bit % 64)) & 1;
+}
+
+static void set_bit(dp_side_bitmap *bitmap, size_t bit) {
+  for (size_t level = 0; level < DP_SIDE_LEVELS; level++) {
+    uint64_t *word = &bitmap->levels[level][bit / 64];
+    bool was_empty = *word == 0;
+    *word |= UINT64_C(1) << (bit % 64);
+    if (!was_empty)
+      break; // the summaries above already have the word.
+    bit /= 64;
+  }
+}
+
+static void clear_bit(dp_side_bitmap *bitmap, size_t bit) {
+  for (size_t level = 0; level < DP_SIDE_LEVELS; level++) {
+    uint64_t *word = &bitmap->levels[level][bit / 64];
+    *word &= ~(UINT64_C(1) << (bit % 64));
+    if (*word != 0)
+      break;
+    bit /= 64;
+  }
+}
+
+// First set bit in [from, limit), limit if there is none. Climbs the summaries while the
+// rest of the current word is empty, then descends to the first set bit under the summary.
+static size_t next_set(const dp_side_bitmap *bitmap, size_t from, size_t limit) {
+  size_t pos = from;
+  size_t level = 0;
+  for (;;) {
+    if (pos << (6 * level) >= limit)
+      return limit;
+    size_t word = pos / 64;
+    if (word >= bitmap->words[level])
+      return limit;
+    uint64_t bits = bitmap->levels[level][word] & (ALL_ONES << (pos % 64));
+    if (bits != 0) {
+      pos = word * 64 + ctz64(bits);
+      break;
+    }
+    if (level + 1 == DP_SIDE_LEVELS) {
+      const uint64_t *top = bitmap->levels[level];
+      do {
+        if (++word >= bitmap->words[level])
+          return limit;
+      } while (top[word] == 0);
+      pos = word * 64 + ctz64(top[word]);
+      break;
+    }
+    pos = word + 1;
+    level++;
+  }
+  while (level > 0) {
+    level--;
+    pos = pos * 64 + ctz64(bitmap->levels[level][pos]);
+  }
+  return pos < limit ? pos : limit;
+}
+
+// Last set bit at or before from, the caller guarantees there is one.
+static size_t prev_set(const dp_side_bitmap *bitmap, size_t from) {
+  size_t pos = from;
+  size_t level = 0;
+  for (;;) {
+    size_t word = pos / 64;
+    uint64_t bits = bitmap->levels[level][word] & (ALL_ONES >> (63 - pos % 64));
+    if (bits != 0) {
+      pos = word * 64 + last_bit(bits);
+      break;
+    }
+    if (level + 1 == DP_SIDE_LEVELS) {
+      const uint64_t *top = bitmap->levels[level];
+      do {
+        word--;
+      } while (top[word] == 0);
+      pos = word * 64 + last_bit(top[word]);
+      break;
+    }
+    pos = word - 1;
+    level++;
+  }
+  while (level > 0) {
+    level--;
+    pos = pos * 64 + last_bit(bitmap->levels[level][pos]);
+  }
+  return pos;
+}
+
+// Granules in the block starting at start.
+static inline size_t block_granules(dp_alloc *allocator, size_t start) {
+  return next_set(&allocator->block_starts, start + 1, allocator->granules + 1) - start;
+}
+
+static void place_bitmap(dp_side_bitmap *bitmap, uint64_t *words,
+                         const size_t level_words[DP_SIDE_LEVELS]) {
+  for (size_t level = 0; level < DP_SIDE_LEVELS; level++) {
+    bitmap->levels[level] = words;
+    bitmap->words[level] = level_words[level];
+    words += level_words[level];
+  }
+}
+
+bool dp_init(dp_alloc *allocator, void *buffer, size_t buffer_size IF_DP_LOG(, dp_logger logger)) {
+  if (buffer == NULL || buffer_size < granule) {
+    return false;
+  }
+
+  uintptr_t start = ((uintptr_t)buffer + alignof(uint64_t) - 1) & ~(alignof(uint64_t) - 1);
+  uintptr_t end = (uintptr_t)buffer + buffer_size;
+  if (start >= end)
+    return false;
+
+  // Start from the granule count ignoring padding and summaries and shrink until everything
+  // fits, the bitmaps hold one extra bit for the end of the last block.
+  size_t granules = (size_t)(end - start) * 8 / (granule * 8 + 3);
+  size_t level_words[DP_SIDE_LEVELS];
+  size_t words = 0;
+  uintptr_t data = 0;
+  for (; granules > 0; granules--) {
+    words = side_words(granules + 1, level_words);
+    data = (start + 3 * words * sizeof(uint64_t) + granule - 1) & ~(uintptr_t)(granule - 1);
+    if (data <= end && (end - data) / granule >= granules)
+      break;
+  }
+  if (granules == 0)
+    return false;
+
+  // buffer covers the side table too, so buffer_size - available counts the metadata.
+  allocator->buffer = (uint8_t *)start;
+  allocator->buffer_size = (size_t)(end - start);
+  place_bitmap(&allocator->block_starts, (uint64_t *)start, level_words);
+  place_bitmap(&allocator->free_starts, (uint64_t *)start + words, level_words);
+  place_bitmap(&allocator->trimmed_starts, (uint64_t *)start + 2 * words, level_words);
+  allocator->data = (uint8_t *)data;
+  allocator->granules = granules;
+  allocator->available = granules * granule;
+  allocator->free_list_head = NULL;
+  IF_DP_LOG(allocator->logger = logger;)
+  IF_DP_STATS(allocator->num_iterations = 0;)
+  IF_DP_STATS(allocator->num_free_iterations = 0;)
+
+  // One free block spanning every granule.
+  memset((void *)start, 0, 3 * words * sizeof(uint64_t));
+  set_bit(&allocator->block_starts, 0);
+  set_bit(&allocator->free_starts, 0);
+  set_bit(&allocator->block_starts, granules);
+#if DP_HUGE_THRESHOLD
+  allocator->huge_count = 0;
+  allocator->huge_bytes = 0;
+#endif
+#if DP_WATERMARKS
+  memset(allocator->watermarks, 0, sizeof(allocator->watermarks));
+  for (size_t i = 0; i < DP_WATERMARK_COUNT; i++) {
+    allocator->watermarks[i].fire_at = SIZE_MAX;
+  }
+  allocator->largest_free = allocator->available;
+#endif
+
+  DP_INFO(allocator, "Out of line metadata over %zu granules of %zu bytes", granules, granule);
+  return true;
+}
+
+// Where place_malloc places a block, see dp_malloc_hint.
+typedef enum placement {
+  PLACE_FIT,  // at the start of the free block DP_FIT_POLICY picks.
+  PLACE_LOW,  // at the start of the lowest free block that fits.
+  PLACE_HIGH, // at the end of the highest free block that fits.
+} placement;
+
+static void *place_malloc(dp_alloc *allocator, size_t size, placement place) {
+#if DP_HUGE_THRESHOLD
+  // Falls back to the buffer when the request can't be mapped.
+  if (size > DP_HUGE_THRESHOLD && allocator != NULL) {
+    void *huge = dp_huge_malloc(allocator, size);
+    if (huge != NULL)
+      return huge;
+  }
+#endif
+  if (size == 0 || allocator == NULL || size > allocator->available) {
+    return NULL;
+  }
+
+  size_t count = (size + granule - 1) / granule;
+  size_t best_fit = SIZE_MAX;
+  size_t best_fit_granules = SIZE_MAX;
+  size_t probes = 0;
+  IF_DP_STATS(allocator->num_iterations = 0;)
+
+  // Free blocks in address order, each sized by a scan of block_starts that stops once the
+  // block can no longer beat the best fit so far. Placed blocks take the first fit, or the
+  // last one.
+  size_t limit = allocator->granules + 1;
+  for (size_t start = next_set(&allocator->free_starts, 0, allocator->granules);
+       start < allocator->granules;
+       start = next_set(&allocator->free_starts, start + 1, allocator->granules)) {
+    IF_DP_STATS(allocator->num_iterations++;)
+    size_t bound = place == PLACE_FIT && best_fit_granules < limit - start
+                       ? start + best_fit_granules
+                       : limit;
+    size_t length = next_set(&allocator->block_starts, start + 1, bound) - start;
+    if (length >= count && (place != PLACE_FIT || length < best_fit_granules)) {
+      best_fit = start;
+      best_fit_granules = length;
+      if (place == PLACE_LOW || (place == PLACE_FIT && (length == count ||
+                                                         dp_config_fit_policy == DP_FIT_FIRST)))
+        break; // perfect fit, or the first fit is all we want.
+    }
+    if (place == PLACE_FIT && dp_config_probe_limit != 0 && ++probes >= dp_config_probe_limit &&
+        best_fit != SIZE_MAX)
+      break; // settle for the best fit within the probe limit.
+  }
+
+  if (best_fit == SIZE_MAX)
+    return NULL;
+
+  size_t block = best_fit;
+  size_t remainder = best_fit_granules - count;
+  if (remainder == 0 || remainder * granule < dp_config_split_threshold) {
+    count = best_fit_granules;
+    clear_bit(&allocator->free_starts, best_fit);
+    clear_bit(&allocator->trimmed_starts, best_fit);
+  } else if (place == PLACE_HIGH) {
+    // The free block keeps its start and gives up its end.
+    block = best_fit + remainder;
+    set_bit(&allocator->block_starts, block);
+  } else {
+    set_bit(&allocator->block_starts, best_fit + count);
+    set_bit(&allocator->free_starts, best_fit + count);
+    clear_bit(&allocator->free_starts, best_fit);
+    if (test_bit(&allocator->trimmed_starts, best_fit)) {
+      // What is left of a trimmed block stays trimmed.
+      set_bit(&allocator->trimmed_starts, best_fit + count);
+      clear_bit(&allocator->trimmed_starts, best_fit);
+    }
+  }
+  allocator->available -= count * granule;
+  IF_DP_WATERMARKS(dp_watch_malloc(allocator, best_fit_granules * granule,
+                                   (best_fit_granules - count) * granule);)
+
+  DP_INFO(allocator, "Allocated granules %zu-%zu (available=%zu)", block, block + count - 1,
+          allocator->available);
+  return allocator->data + block * granule;
+}
+
+void *dp_malloc(dp_alloc *allocator, size_t size) {
+  return place_malloc(allocator, size, PLACE_FIT);
+}
+
+void *dp_malloc_hint(dp_alloc *allocator, size_t size, dp_lifetime lifetime) {
+  return place_malloc(allocator, size, lifetime == DP_LIFETIME_LONG ? PLACE_LOW : PLACE_HIGH);
+}
+
+#if DP_TRIM_THRESHOLD
+// Trims the free block spanning granules first-last, whose pages from lo to hi are still
+// committed. Its trimmed neighbours' pages stay decommitted, only the pages they share with
+// lo-hi are decommitted again.
+static void trim_freed(dp_alloc *allocator, size_t first, size_t last, size_t lo, size_t hi) {
+  uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+  uintptr_t begin = (uintptr_t)(allocator->data + first * granule);
+  uintptr_t end = (uintptr_t)(allocator->data + last * granule);
+  uintptr_t from = (uintptr_t)(allocator->data + lo * granule);
+  uintptr_t to = (uintptr_t)(allocator->data + hi * granule);
+  from = from - begin >= page ? from - (page - 1) : begin;
+  to = end - to >= page ? to + (page - 1) : end;
+  size_t released = dp_decommit((void *)from, to - from);
+  set_bit(&allocator->trimmed_starts, first);
+  DP_DEBUG(allocator, "Trimmed %zu bytes of granules %zu-%zu", released, first, last - 1);
+  (void)released;
+}
+#endif
+
+int dp_free(dp_alloc *allocator, void *ptr) {
+  if (ptr == NULL || allocator == NULL) {
+    DP_ERROR(allocator, "Trying to free null pointer, or with null allocator.");
+    return 1;
+  }
+
+  uintptr_t offset = (uintptr_t)ptr - (uintptr_t)allocator->data;
+#if DP_HUGE_THRESHOLD
+  if ((uint8_t *)ptr < allocator->data || offset / granule >= allocator->granules)
+    return dp_huge_free(allocator, ptr);
+#endif
+  if ((uint8_t *)ptr < allocator->data || offset % granule != 0 ||
+      offset / granule >= allocator->granules) {
+    DP_ERROR(allocator, "Deallocating invalid pointer %p", ptr);
+    return 1;
+  }
+
+  size_t start = offset / granule;
+  if (!test_bit(&allocator->block_starts, start)) {
+    DP_ERROR(allocator, "Trying to free %p which is not a valid block", ptr);
+    return 1;
+  }
+  if (test_bit(&allocator->free_starts, start)) {
+    DP_ERROR(allocator, "Double free detected for pointer %p", ptr);
+    return 1;
+  }
+
+  // Both neighbours come straight out of block_starts, dp_free scans no free list. The merged
+  // block spans granules first-last, untrimmed its pages from lo to hi.
+  IF_DP_STATS(allocator->num_free_iterations = 0;)
+  size_t end = start + block_granules(allocator, start);
+  allocator->available += (end - start) * granule;
+  set_bit(&allocator->free_starts, start);
+  size_t first = start, last = end, lo = start, hi = end;
+
+  if (end < allocator->granules && test_bit(&allocator->free_starts, end)) {
+    DP_DEBUG(allocator, "Coalescing granules %zu-%zu with the free block on the right", start,
+             end - 1);
+    last = end + block_granules(allocator, end);
+    if (!test_bit(&allocator->trimmed_starts, end))
+      hi = last;
+    clear_bit(&allocator->block_starts, end);
+    clear_bit(&allocator->free_starts, end);
+    clear_bit(&allocator->trimmed_starts, end);
+  }
+  size_t left = start > 0 ? prev_set(&allocator->block_starts, start - 1) : start;
+  if (left != start && test_bit(&allocator->free_starts, left)) {
+    DP_DEBUG(allocator, "Coalescing granules %zu-%zu with the free block on the left", start,
+             end - 1);
+    first = left;
+    if (!test_bit(&allocator->trimmed_starts, left))
+      lo = left;
+    clear_bit(&allocator->block_starts, start);
+    clear_bit(&allocator->free_starts, start);
+    clear_bit(&allocator->trimmed_starts, left);
+  }
+#if DP_TRIM_THRESHOLD
+  if ((last - first) * granule >= DP_TRIM_THRESHOLD)
+    trim_freed(allocator, first, last, lo, hi);
+#else
+  (void)first;
+  (void)lo;
+  (void)hi;
+#endif
+  IF_DP_WATERMARKS(dp_watch_free(allocator, (last - first) * granule);)
+
+  DP_INFO(allocator, "Freed granules %zu-%zu (available=%zu)", start, end - 1,
+          allocator->available);
+  return 0;
+}
+
+// Every summary bit must match whether the word it covers is empty.
+static bool summaries_intact(const dp_side_bitmap *bitmap) {
+  for (size_t level = 0; level + 1 < DP_SIDE_LEVELS; level++) {
+    const uint64_t *summary = bitmap->levels[level + 1];
+    for (size_t word = 0; word < bitmap->words[level + 1] * 64; word++) {
+      bool set = (summary[word / 64] >> (word % 64)) & 1;
+      if (set != (word < bitmap->words[level] && bitmap->levels[level][word] != 0))
+        return false;
+    }
+  }
+  return true;
+}
+
+int dp_check(dp_alloc *allocator) {
+  if (allocator == NULL)
+    return 1;
+
+  size_t granules = allocator->granules;
+  const dp_side_bitmap *starts = &allocator->block_starts;
+  const dp_side_bitmap *frees = &allocator->free_starts;
+  const dp_side_bitmap *trims = &allocator->trimmed_starts;
+  if (!summaries_intact(starts) || !summaries_intact(frees) || !summaries_intact(trims)) {
+    DP_ERROR(allocator, "Heap check: bitmap summaries are corrupted");
+    return 1;
+  }
+
+  // Free blocks are blocks, and nothing is set past the end of the last block.
+  for (size_t i = 0; i < starts->words[0]; i++) {
+    if ((frees->levels[0][i] & ~starts->levels[0][i]) != 0) {
+      DP_ERROR(allocator, "Heap check: free bit without a block start in word %zu", i);
+      return 1;
+    }
+    if ((trims->levels[0][i] & ~frees->levels[0][i]) != 0) {
+      DP_ERROR(allocator, "Heap check: trimmed bit without a free block in word %zu", i);
+      return 1;
+    }
+  }
+  uint64_t tail = (granules + 1) % 64 ? ALL_ONES << ((granules + 1) % 64) : 0;
+  if (!test_bit(starts, 0) || !test_bit(starts, granules) ||
+      (starts->levels[0][starts->words[0] - 1] & tail) != 0 || test_bit(frees, granules)) {
+    DP_ERROR(allocator, "Heap check: block bitmap bounds are corrupted");
+    return 1;
+  }
+
+  // Walk the blocks in address order, free ones must be coalesced and hold available.
+  size_t free_bytes = 0;
+  bool prev_free = false;
+  for (size_t start = 0; start < granules; start = next_set(starts, start + 1, granules + 1)) {
+    bool is_free = test_bit(frees, start);
+    if (is_free) {
+      if (prev_free) {
+        DP_ERROR(allocator, "Heap check: free block at granule %zu wasn't coalesced", start);
+        return 1;
+      }
+      free_bytes += block_granules(allocator, start) * granule;
+    }
+    prev_free = is_free;
+  }
+  if (free_bytes != allocator->available) {
+    DP_ERROR(allocator, "Heap check: available=%zu but free blocks hold %zu",
+             allocator->available, free_bytes);
+    return 1;
+  }
+  return 0;
+}
+
+// Nothing is cached without headers.
+size_t dp_usable_size(dp_alloc *allocator, const void *ptr) {
+  if (allocator == NULL || ptr == NULL)
+    return 0;
+  uintptr_t offset = (uintptr_t)ptr - (uintptr_t)allocator->data;
+  if ((const uint8_t *)ptr < allocator->data || offset / granule >= allocator->granules) {
+#if DP_HUGE_THRESHOLD
+    return dp_huge_size(allocator, ptr);
+#else
+    return 0;
+#endif
+  }
+  size_t start = offset / granule;
+  if (offset % granule != 0 || !test_bit(&allocator->block_starts, start) ||
+      test_bit(&allocator->free_starts, start))
+    return 0;
+  return block_granules(allocator, start) * granule;
+}
+
+size_t dp_largest_free(dp_alloc *allocator) {
+  size_t largest = 0;
+  if (allocator == NULL)
+    return 0;
+  for (size_t start = next_set(&allocator->free_starts, 0, allocator->granules);
+       start < allocator->granules;
+       start = next_set(&allocator->free_starts, start + 1, allocator->granules)) {
+    size_t size = block_granules(allocator, start) * granule;
+    if (size > largest)
+      largest = size;
+  }
+  return largest;
+}
+
+// Free blocks in address order, those trimmed before are skipped.
+size_t dp_trim(dp_alloc *allocator, size_t keep_bytes) {
+  if (allocator == NULL)
+    return 0;
+  size_t kept = 0;
+  size_t released = 0;
+  for (size_t start = next_set(&allocator->free_starts, 0, allocator->granules);
+       start < allocator->granules;
+       start = next_set(&allocator->free_starts, start + 1, allocator->granules)) {
+    if (test_bit(&allocator->trimmed_starts, start))
+      continue;
+    size_t size = block_granules(allocator, start) * granule;
+    if (size <= keep_bytes - kept) {
+      kept += size;
+    } else {
+      released += dp_decommit(allocator->data + start * granule, size);
+      set_bit(&allocator->trimmed_starts, start);
+    }
+  }
+  DP_INFO(allocator, "Trimmed %zu bytes, kept %zu free bytes committed", released, kept);
+  return released;
+}
+
+size_t dp_flush_cache(dp_alloc *allocator) {
+  (void)allocator;
+  return 0;
+}
+
+#if DP_STATS
+float dp_get_fragmentation(dp_alloc *allocator) {
+  size_t largest = 0;
+  size_t total = 0;
+  for (size_t start = next_set(&allocator->free_starts, 0, allocator->granules);
+       start < allocator->granules;
+       start = next_set(&allocator->free_starts, start + 1, allocator->granules)) {
+    size_t size = block_granules(allocator, start) * granule;
+    total += size;
+    if (size > largest)
+      largest = size;
+  }
+
+  return (total > 0) ? 1.0f - (float)largest / total : 0.0f;
+}
+#endif
+
+#endif // DP_OUT_OF_LINE_METADATA
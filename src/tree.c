@@ -0,0 +1,312 @@
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "tree.h"
+
+/*
+Layout of the buffer:
+
+  ┌──────────────┬──────────────┬─────────────┬───────┬─────────┬─────────┬─────┐
+  │occupied words│run_ends words│segment tree │padding│ granule │ granule │ ... │
+  └──────────────┴──────────────┴─────────────┴───────┴─────────┴─────────┴─────┘
+
+Bits past the last granule are set in occupied, so no free run extends past the end. Every
+node holds the free runs of its span: leaves span the 64 granules of one occupied word,
+inner nodes twice their children's span. Allocation descends from the root towards the
+lowest span whose runs fit, freeing rebuilds the leaves it touched and their ancestors.
+*/
+
+#define ALL_ONES (~UINT64_C(0))
+#define MAX_GRANULES ((size_t)1 << 31) // keeps node spans within uint32_t.
+
+static inline size_t ctz64(uint64_t bits) { return (size_t)__builtin_ctzll(bits); }
+
+static inline bool test_bit(const uint64_t *words, size_t bit) {
+  return (words[bit / 64] >> (bit % 64)) & 1;
+}
+
+static void assign_bits(uint64_t *words, size_t from, size_t count, bool set) {
+  while (count > 0) {
+    size_t shift = from % 64;
+    size_t n = count < 64 - shift ? count : 64 - shift;
+    uint64_t mask = (n == 64 ? ALL_ONES : (UINT64_C(1) << n) - 1) << shift;
+    if (set)
+      words[from / 64] |= mask;
+    else
+      words[from / 64] &= ~mask;
+    from += n;
+    count -= n;
+  }
+}
+
+// First set bit of words in [from, limit), limit if there is none.
+static size_t next_set(const uint64_t *words, size_t from, size_t limit) {
+  size_t word = from / 64;
+  uint64_t bits = words[word] & (ALL_ONES << (from % 64));
+  while (bits == 0) {
+    if (++word * 64 >= limit)
+      return limit;
+    bits = words[word];
+  }
+  size_t found = word * 64 + ctz64(bits);
+  return found < limit ? found : limit;
+}
+
+static dp_tree_node leaf_node(uint64_t occupied) {
+  if (occupied == 0)
+    return (dp_tree_node){64, 64, 64};
+
+  // Every step shortens each run of free bits by one, the longest run lasts the longest.
+  uint32_t longest = 0;
+  for (uint64_t runs = ~occupied; runs != 0; runs &= runs >> 1)
+    longest++;
+  return (dp_tree_node){(uint32_t)ctz64(occupied), (uint32_t)__builtin_clzll(occupied),
+                        longest};
+}
+
+// Parent of two nodes spanning half granules each.
+static dp_tree_node combine(dp_tree_node left, dp_tree_node right, uint32_t half) {
+  dp_tree_node node;
+  node.prefix = left.prefix == half ? half + right.prefix : left.prefix;
+  node.suffix = right.suffix == half ? half + left.suffix : right.suffix;
+  node.max = left.max > right.max ? left.max : right.max;
+  if (left.suffix + right.prefix > node.max)
+    node.max = left.suffix + right.prefix;
+  return node;
+}
+
+// Rebuilds the leaves of words [first, last] and every node above them.
+static void update_words(dp_tree *tree, size_t first, size_t last) {
+  dp_tree_node *nodes = tree->nodes;
+  for (size_t word = first; word <= last; word++) {
+    nodes[tree->leaves + word] = leaf_node(tree->occupied[word]);
+  }
+  size_t low = (tree->leaves + first) / 2;
+  size_t high = (tree->leaves + last) / 2;
+  for (uint32_t half = 64; low > 0; low /= 2, high /= 2, half *= 2) {
+    for (size_t i = low; i <= high; i++) {
+      nodes[i] = combine(nodes[2 * i], nodes[2 * i + 1], half);
+    }
+  }
+}
+
+// Start of the first run of count free bits in a word, which must have one.
+static size_t first_run(uint64_t occupied, size_t count) {
+  // Bit i of starts stays set while granules i to i + have - 1 are all free.
+  uint64_t starts = ~occupied;
+  size_t have = 1;
+  while (have < count) {
+    size_t step = have < count - have ? have : count - have;
+    starts &= starts >> step;
+    have += step;
+  }
+  return ctz64(starts);
+}
+
+static size_t leaves_for(size_t words) {
+  size_t leaves = 1;
+  while (leaves < words)
+    leaves *= 2;
+  return leaves;
+}
+
+// First granule address of a heap of granules granules laid out from start.
+static uintptr_t data_start(uintptr_t start, size_t granules, size_t granule) {
+  size_t align = granule < alignof(max_align_t) ? granule : alignof(max_align_t);
+  size_t words = (granules + 63) / 64;
+  uintptr_t nodes_end = start + 2 * words * sizeof(uint64_t) +
+                        2 * leaves_for(words) * sizeof(dp_tree_node);
+  return (nodes_end + align - 1) & ~(uintptr_t)(align - 1);
+}
+
+bool dp_tree_init(dp_tree *tree, void *buffer, size_t buffer_size,
+                  size_t granule IF_DP_LOG(, dp_logger logger)) {
+  if (tree == NULL || buffer == NULL || granule < 8 || (granule & (granule - 1)) != 0) {
+    return false;
+  }
+
+  uintptr_t start = ((uintptr_t)buffer + alignof(uint64_t) - 1) & ~(alignof(uint64_t) - 1);
+  uintptr_t end = (uintptr_t)buffer + buffer_size;
+  if (start >= end)
+    return false;
+
+  // The side table grows with the heap, binary search for the most granules that fit.
+  size_t low = 0;
+  size_t high = (size_t)(end - start) / granule;
+  if (high > MAX_GRANULES)
+    high = MAX_GRANULES;
+  while (low < high) {
+    size_t mid = low + (high - low + 1) / 2;
+    uintptr_t data = data_start(start, mid, granule);
+    if (data <= end && (end - data) / granule >= mid)
+      low = mid;
+    else
+      high = mid - 1;
+  }
+  size_t granules = low;
+  if (granules == 0)
+    return false;
+
+  size_t words = (granules + 63) / 64;
+  tree->occupied = (uint64_t *)start;
+  tree->run_ends = tree->occupied + words;
+  tree->words = words;
+  tree->nodes = (dp_tree_node *)(tree->run_ends + words);
+  tree->leaves = leaves_for(words);
+  tree->data = (uint8_t *)data_start(start, granules, granule);
+  tree->granule = granule;
+  tree->granules = granules;
+  tree->available = granules;
+  IF_DP_LOG(tree->logger = logger;)
+  IF_DP_STATS(tree->num_iterations = 0;)
+
+  // Leaves past the last word, and nodes spanning only those, stay allocated.
+  memset(tree->occupied, 0, (size_t)((uintptr_t)(tree->nodes + 2 * tree->leaves) - start));
+  assign_bits(tree->occupied, granules, words * 64 - granules, true);
+  update_words(tree, 0, words - 1);
+
+  DP_INFO(tree, "Tree engine over %zu granules of %zu bytes (%zu leaves)", granules, granule,
+          tree->leaves);
+  return true;
+}
+
+void *dp_tree_malloc(dp_tree *tree, size_t size) {
+  if (tree == NULL || size == 0 || size > tree->available * tree->granule)
+    return NULL;
+
+  size_t count = (size + tree->granule - 1) / tree->granule;
+  const dp_tree_node *nodes = tree->nodes;
+  if (count > nodes[1].max)
+    return NULL;
+
+  // Lowest fit first: inside the left half, across the middle, then inside the right half.
+  size_t node = 1;
+  size_t base = 0;
+  size_t span = 64 * tree->leaves;
+  size_t start;
+  IF_DP_STATS(tree->num_iterations = 0;)
+  for (;;) {
+    if (node >= tree->leaves) {
+      start = base + first_run(tree->occupied[node - tree->leaves], count);
+      break;
+    }
+    IF_DP_STATS(tree->num_iterations++;)
+    size_t half = span / 2;
+    size_t left = 2 * node;
+    if (nodes[left].max >= count) {
+      node = left;
+    } else if (nodes[left].suffix + nodes[left + 1].prefix >= count) {
+      start = base + half - nodes[left].suffix;
+      break;
+    } else {
+      node = left + 1;
+      base += half;
+    }
+    span = half;
+  }
+
+  assign_bits(tree->occupied, start, count, true);
+  assign_bits(tree->run_ends, start + count - 1, 1, true);
+  update_words(tree, start / 64, (start + count - 1) / 64);
+  tree->available -= count;
+
+  DP_INFO(tree, "Allocated granules %zu-%zu (available=%zu)", start, start + count - 1,
+          tree->available);
+  return tree->data + start * tree->granule;
+}
+
+int dp_tree_free(dp_tree *tree, void *ptr) {
+  if (ptr == NULL || tree == NULL) {
+    DP_ERROR(tree, "Trying to free null pointer, or with null allocator.");
+    return 1;
+  }
+
+  uintptr_t offset = (uintptr_t)ptr - (uintptr_t)tree->data;
+  if ((uint8_t *)ptr < tree->data || offset % tree->granule != 0 ||
+      offset / tree->granule >= tree->granules) {
+    DP_ERROR(tree, "Deallocating invalid pointer %p", ptr);
+    return 1;
+  }
+
+  size_t start = offset / tree->granule;
+  if (!test_bit(tree->occupied, start)) {
+    DP_ERROR(tree, "Double free detected for pointer %p", ptr);
+    return 1;
+  }
+  // Granule before an allocation is either free or the end of another allocation.
+  if (start > 0 && test_bit(tree->occupied, start - 1) && !test_bit(tree->run_ends, start - 1)) {
+    DP_ERROR(tree, "Trying to free %p which is inside an allocation", ptr);
+    return 1;
+  }
+
+  size_t end = next_set(tree->run_ends, start, tree->granules);
+  if (end == tree->granules) {
+    DP_ERROR(tree, "Allocation at %p has no end, the bitmap is corrupted", ptr);
+    return 1;
+  }
+  size_t count = end - start + 1;
+  assign_bits(tree->occupied, start, count, false);
+  assign_bits(tree->run_ends, end, 1, false);
+  update_words(tree, start / 64, end / 64);
+  tree->available += count;
+
+  DP_INFO(tree, "Freed granules %zu-%zu (available=%zu)", start, end, tree->available);
+  return 0;
+}
+
+size_t dp_tree_largest_free(const dp_tree *tree) {
+  return tree == NULL ? 0 : tree->nodes[1].max * tree->granule;
+}
+
+static bool same_node(dp_tree_node a, dp_tree_node b) {
+  return a.prefix == b.prefix && a.suffix == b.suffix && a.max == b.max;
+}
+
+int dp_tree_check(dp_tree *tree) {
+  if (tree == NULL)
+    return 1;
+
+  size_t free_granules = 0;
+  for (size_t word = 0; word < tree->leaves; word++) {
+    dp_tree_node expected = word < tree->words ? leaf_node(tree->occupied[word])
+                                               : (dp_tree_node){0, 0, 0};
+    if (!same_node(tree->nodes[tree->leaves + word], expected)) {
+      DP_ERROR(tree, "Tree check: leaf of word %zu is stale", word);
+      return 1;
+    }
+    if (word < tree->words) {
+      free_granules += 64 - (size_t)__builtin_popcountll(tree->occupied[word]);
+      if ((tree->run_ends[word] & ~tree->occupied[word]) != 0) {
+        DP_ERROR(tree, "Tree check: allocation end outside an allocation in word %zu", word);
+        return 1;
+      }
+    }
+  }
+
+  size_t span = 64;
+  for (size_t level_start = tree->leaves / 2; level_start > 0; level_start /= 2, span *= 2) {
+    for (size_t i = level_start; i < 2 * level_start; i++) {
+      dp_tree_node expected =
+          combine(tree->nodes[2 * i], tree->nodes[2 * i + 1], (uint32_t)span);
+      if (!same_node(tree->nodes[i], expected)) {
+        DP_ERROR(tree, "Tree check: node %zu is stale", i);
+        return 1;
+      }
+    }
+  }
+
+  size_t tail = tree->words * 64 - tree->granules;
+  if (tail > 0 && (tree->occupied[tree->words - 1] >> (64 - tail)) != (ALL_ONES >> (64 - tail))) {
+    DP_ERROR(tree, "Tree check: granules past the end of the heap are free");
+    return 1;
+  }
+  if (free_granules != tree->available) {
+    DP_ERROR(tree, "Tree check: available=%zu but %zu granules are free", tree->available,
+             free_granules);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,64 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "allocator.h"
+
+/*
+dp_malloc only lowers the watched values and dp_free only raises them, so each compares them
+against one bound per watermark, fire_below and fire_at, and calls dp_watermark_crossed when
+it is passed. Between crossings the compares are all the watermarks cost.
+
+The largest free block isn't known without a walk over the free blocks, so largest_free is
+a lower bound kept in O(1): a free raises it to the block it leaves, carving a block at least
+that large lowers it to the remainder. Only a bound under low needs the exact value, which
+dp_watermark_crossed recounts before firing.
+*/
+
+#if DP_WATERMARKS
+
+static size_t watched(dp_alloc *allocator, dp_watermark watermark) {
+  return watermark == DP_WATERMARK_AVAILABLE ? allocator->available : allocator->largest_free;
+}
+
+static void arm(dp_watermark_state *state, bool pressure) {
+  state->pressure = pressure;
+  state->fire_below = pressure ? 0 : state->low;
+  state->fire_at = pressure ? state->high : SIZE_MAX;
+}
+
+bool dp_set_watermark(dp_alloc *allocator, dp_watermark watermark, size_t low, size_t high,
+                      dp_watermark_callback callback, void *context) {
+  if (allocator == NULL || watermark >= DP_WATERMARK_COUNT || low > high)
+    return false;
+  dp_watermark_state *state = &allocator->watermarks[watermark];
+  state->low = low;
+  state->high = high;
+  state->callback = callback;
+  state->context = context;
+  arm(state, false);
+  if (watermark == DP_WATERMARK_LARGEST)
+    allocator->largest_free = dp_largest_free(allocator);
+  if (watched(allocator, watermark) < low)
+    dp_watermark_crossed(allocator, watermark);
+  return true;
+}
+
+void dp_watermark_crossed(dp_alloc *allocator, dp_watermark watermark) {
+  dp_watermark_state *state = &allocator->watermarks[watermark];
+  bool pressure = !state->pressure;
+  if (pressure && watermark == DP_WATERMARK_LARGEST) {
+    allocator->largest_free = dp_largest_free(allocator);
+    if (allocator->largest_free >= state->low)
+      return; // only the bound dropped.
+  }
+  size_t value = watched(allocator, watermark);
+  arm(state, pressure);
+  DP_INFO(allocator, "%s watermark %s (value=%zu, low=%zu, high=%zu)",
+          watermark == DP_WATERMARK_AVAILABLE ? "Available" : "Largest free block",
+          pressure ? "under pressure" : "relieved", value, state->low, state->high);
+  if (state->callback != NULL)
+    state->callback(allocator, watermark, pressure, value, state->context);
+}
+
+#endif
@@ -1,6 +1,9 @@
 #include <algorithm>
+#include <bit>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
+#include <string>
 #include <vector>
 
 #include "fuzztest/fuzztest.h"
@@ -8,20 +11,21 @@
 
 #include "allocator.h"
 #include "config_macros.h"
+#include "perf_trace.hpp"
 
 namespace {
 
 static constexpr size_t BUFFER_SIZE = 4096;
-static constexpr size_t DEFAULT_ALIGN = alignof(max_align_t);
+static constexpr size_t DEFAULT_ALIGN = DP_ALIGNMENT ? DP_ALIGNMENT : alignof(max_align_t);
 
 inline void noop_log(const char *, ...) {}
 
 class AllocatorFixture {
 public:
-  AllocatorFixture() {
-    buffer_.resize(BUFFER_SIZE, 0);
+  explicit AllocatorFixture(size_t buffer_size = BUFFER_SIZE) {
+    buffer_.resize(buffer_size, 0);
     dp_init(&allocator_, buffer_.data(),
-            BUFFER_SIZE IF_DP_LOG(
+            buffer_size IF_DP_LOG(
                 , {.debug = noop_log, .info = noop_log, .warning = noop_log, .error = noop_log}));
   }
 
@@ -234,4 +238,154 @@ void ZeroSizeAllocation() {
 }
 TEST(AllocatorFuzzTest, ZeroSizeAllocation) { ZeroSizeAllocation(); }
 
+#if DP_STATS
+
+// Performance-directed targets.
+//
+// FuzzTest is coverage guided, so the cost of a sequence is fed back as coverage: every
+// power of two a metric reaches takes its own branch in feed_cost, which makes inputs
+// that push a metric to a new order of magnitude interesting to the fuzzer. Every
+// operation is also checked against its declared bound.
+//
+// When DP_PERF_CORPUS_OUT is set in the environment, each new worst case is written
+// there as a trace (see perf_trace.hpp). Traces worth keeping go to test/perf_corpus,
+// which is replayed by CorpusStaysWithinBounds below and by the corpus benchmarks.
+
+static constexpr size_t PERF_BUFFER_SIZE = 64 * 1024;
+
+enum PerfMetric { MALLOC_PROBES, FREE_SCANS, FRAGMENTATION_AT_FAILURE, NUM_PERF_METRICS };
+const char *const PERF_METRIC_NAMES[NUM_PERF_METRICS] = {"malloc_probes", "free_scans",
+                                                         "fragmentation_at_failure"};
+
+volatile size_t cost_levels[NUM_PERF_METRICS][24];
+
+#define COST_LEVEL(n)                                                                              \
+  case n:                                                                                          \
+    cost_levels[Metric][n] = cost;                                                                 \
+    break;
+
+template <PerfMetric Metric> void feed_cost(size_t cost) {
+  switch (std::bit_width(cost)) {
+    COST_LEVEL(0) COST_LEVEL(1) COST_LEVEL(2) COST_LEVEL(3) COST_LEVEL(4) COST_LEVEL(5)
+    COST_LEVEL(6) COST_LEVEL(7) COST_LEVEL(8) COST_LEVEL(9) COST_LEVEL(10) COST_LEVEL(11)
+    COST_LEVEL(12) COST_LEVEL(13) COST_LEVEL(14) COST_LEVEL(15) COST_LEVEL(16) COST_LEVEL(17)
+    COST_LEVEL(18) COST_LEVEL(19) COST_LEVEL(20) COST_LEVEL(21) COST_LEVEL(22) COST_LEVEL(23)
+  default:
+    break;
+  }
+}
+
+#undef COST_LEVEL
+
+struct PerfCosts {
+  size_t costs[NUM_PERF_METRICS];
+};
+
+size_t free_list_length(dp_alloc *alloc) {
+  size_t length = 0;
+  for (block_header *curr = alloc->free_list_head; curr; curr = curr->next) {
+    length++;
+  }
+  return length;
+}
+
+// Worst cost of every metric over the trace. dp_malloc may probe every free block plus
+// the list head once, dp_free may scan every free block once.
+PerfCosts run_and_check_bounds(const PerfTrace &trace) {
+  AllocatorFixture fixture(PERF_BUFFER_SIZE);
+  dp_alloc *alloc = fixture.get();
+  PerfCosts worst{};
+  size_t list_length = 0;
+  bool failed = false;
+
+  std::vector<void *> live = run_perf_trace(
+      trace,
+      [&](size_t size) {
+        list_length = free_list_length(alloc);
+        return dp_malloc(alloc, size);
+      },
+      [&](void *ptr) {
+        list_length = free_list_length(alloc);
+        EXPECT_EQ(dp_free(alloc, ptr), 0);
+      },
+      [&](const PerfOp &op, void *ptr) {
+        if (op.is_alloc && ptr == nullptr) {
+          if (!failed) {
+            worst.costs[FRAGMENTATION_AT_FAILURE] =
+                static_cast<size_t>(dp_get_fragmentation(alloc) * 100);
+            failed = true;
+          }
+        } else if (op.is_alloc) {
+          EXPECT_LE(alloc->num_iterations, list_length + 1);
+          worst.costs[MALLOC_PROBES] = std::max(worst.costs[MALLOC_PROBES], alloc->num_iterations);
+        } else {
+          EXPECT_LE(alloc->num_free_iterations, list_length);
+          worst.costs[FREE_SCANS] =
+              std::max(worst.costs[FREE_SCANS], alloc->num_free_iterations);
+        }
+      });
+
+  for (void *ptr : live) {
+    EXPECT_EQ(dp_free(alloc, ptr), 0);
+  }
+  return worst;
+}
+
+void save_if_worst(PerfMetric metric, size_t cost, const PerfTrace &trace) {
+  static size_t worst[NUM_PERF_METRICS] = {};
+  const char *dir = std::getenv("DP_PERF_CORPUS_OUT");
+  if (dir == nullptr || cost <= worst[metric])
+    return;
+
+  worst[metric] = cost;
+  std::string name = std::string(PERF_METRIC_NAMES[metric]) + "-" + std::to_string(cost);
+  write_perf_trace(std::filesystem::path(dir) / (name + ".trace"), trace);
+}
+
+template <PerfMetric Metric> void maximize_cost(const std::vector<std::pair<bool, uint16_t>> &ops) {
+  PerfTrace trace;
+  for (const auto &[is_alloc, value] : ops) {
+    trace.push_back({is_alloc, is_alloc ? value % 4096u + 1 : value});
+  }
+
+  PerfCosts worst = run_and_check_bounds(trace);
+  feed_cost<Metric>(worst.costs[Metric]);
+  save_if_worst(Metric, worst.costs[Metric], trace);
+}
+
+auto PerfOpsDomain() {
+  return fuzztest::VectorOf(
+             fuzztest::PairOf(fuzztest::Arbitrary<bool>(), fuzztest::Arbitrary<uint16_t>()))
+      .WithMaxSize(2000);
+}
+
+void MaximizeMallocProbes(const std::vector<std::pair<bool, uint16_t>> &ops) {
+  maximize_cost<MALLOC_PROBES>(ops);
+}
+FUZZ_TEST(AllocatorPerfFuzzTest, MaximizeMallocProbes).WithDomains(PerfOpsDomain());
+
+void MaximizeFreeScans(const std::vector<std::pair<bool, uint16_t>> &ops) {
+  maximize_cost<FREE_SCANS>(ops);
+}
+FUZZ_TEST(AllocatorPerfFuzzTest, MaximizeFreeScans).WithDomains(PerfOpsDomain());
+
+void MaximizeFragmentationAtFailure(const std::vector<std::pair<bool, uint16_t>> &ops) {
+  maximize_cost<FRAGMENTATION_AT_FAILURE>(ops);
+}
+FUZZ_TEST(AllocatorPerfFuzzTest, MaximizeFragmentationAtFailure).WithDomains(PerfOpsDomain());
+
+TEST(AllocatorPerfFuzzTest, CorpusStaysWithinBounds) {
+  auto files = perf_corpus_files(DP_PERF_CORPUS_DIR);
+  ASSERT_FALSE(files.empty()) << "No traces in " << DP_PERF_CORPUS_DIR;
+
+  for (const auto &file : files) {
+    SCOPED_TRACE(file.string());
+    PerfTrace trace;
+    ASSERT_TRUE(read_perf_trace(file, trace));
+    run_and_check_bounds(trace);
+  }
+}
+
+#endif
+
 } // namespace
@@ -30,7 +30,7 @@ TEST_F(DPAllocatorTest, TooLargeAllocation) {
 }
 
 TEST_F(DPAllocatorTest, ExactSizeAllocation) {
-  void *ptr = dp_malloc(&allocator, BUFFER_SIZE - 2 * sizeof(block_header));
+  void *ptr = malloc_largest();
   ASSERT_NE(nullptr, ptr);
   ASSERT_EQ(nullptr, dp_malloc(&allocator, 1)); // Should be full
 }
@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <random>
+
+#include "bitmap.h"
+#include "test_common.hpp"
+
+// Tests for the granule bitmap engine. Every supported SIMD level runs the same suite and
+// must make exactly the same decisions as the scalar reference.
+
+static constexpr size_t GRANULE = 64;
+
+class DPBitmapTest : public ::testing::TestWithParam<dp_simd> {
+protected:
+  static constexpr size_t BUFFER_SIZE = 64 * 1024;
+  alignas(max_align_t) std::array<uint8_t, BUFFER_SIZE> buffer;
+  dp_bitmap bitmap;
+
+  void SetUp() override {
+    if (!dp_simd_supported(GetParam()))
+      GTEST_SKIP() << "SIMD level not supported on this CPU";
+    ASSERT_TRUE(init(bitmap, buffer.data(), BUFFER_SIZE));
+    ASSERT_TRUE(dp_bitmap_set_simd(&bitmap, GetParam()));
+  }
+
+  static bool init(dp_bitmap &target, uint8_t *data, size_t size) {
+    return dp_bitmap_init(&target, data, size,
+                          GRANULE IF_DP_LOG(, {.debug = test_debug,
+                                               .info = test_info,
+                                               .warning = test_warning,
+                                               .error = test_error}));
+  }
+};
+
+TEST_P(DPBitmapTest, LayoutFitsBuffer) {
+  ASSERT_GT(bitmap.granules, 0u);
+  ASSERT_EQ(bitmap.available, bitmap.granules);
+  ASSERT_GE(reinterpret_cast<uint8_t *>(bitmap.occupied), buffer.data());
+  ASSERT_LE(bitmap.data + bitmap.granules * GRANULE, buffer.data() + BUFFER_SIZE);
+  // Bitmaps take 2 bits per granule, the rest of the buffer is data.
+  ASSERT_GE(bitmap.granules, (BUFFER_SIZE - 2 * GRANULE) / (GRANULE + 1));
+}
+
+TEST_P(DPBitmapTest, RejectsBadGranules) {
+  dp_bitmap other;
+  ASSERT_FALSE(dp_bitmap_init(&other, buffer.data(), BUFFER_SIZE, 48 IF_DP_LOG(, bitmap.logger)));
+  ASSERT_FALSE(dp_bitmap_init(&other, buffer.data(), BUFFER_SIZE, 4 IF_DP_LOG(, bitmap.logger)));
+  ASSERT_FALSE(dp_bitmap_init(&other, nullptr, BUFFER_SIZE, 64 IF_DP_LOG(, bitmap.logger)));
+  ASSERT_FALSE(init(other, buffer.data(), 8));
+}
+
+TEST_P(DPBitmapTest, AllocationsAreGranuleAlignedAndDisjoint) {
+  void *a = dp_bitmap_malloc(&bitmap, 1);
+  void *b = dp_bitmap_malloc(&bitmap, GRANULE + 1);
+  void *c = dp_bitmap_malloc(&bitmap, GRANULE);
+  ASSERT_NE(a, nullptr);
+  ASSERT_NE(b, nullptr);
+  ASSERT_NE(c, nullptr);
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(a) % std::min(GRANULE, alignof(max_align_t)), 0u);
+  ASSERT_EQ(static_cast<uint8_t *>(b), static_cast<uint8_t *>(a) + GRANULE);
+  ASSERT_EQ(static_cast<uint8_t *>(c), static_cast<uint8_t *>(b) + 2 * GRANULE);
+  ASSERT_EQ(bitmap.available, bitmap.granules - 4);
+
+  ASSERT_EQ(dp_bitmap_free(&bitmap, b), 0);
+  ASSERT_EQ(dp_bitmap_free(&bitmap, a), 0);
+  ASSERT_EQ(dp_bitmap_free(&bitmap, c), 0);
+  ASSERT_EQ(bitmap.available, bitmap.granules);
+}
+
+TEST_P(DPBitmapTest, FirstFitReusesHoles) {
+  void *ptrs[4];
+  for (void *&ptr : ptrs) {
+    ptr = dp_bitmap_malloc(&bitmap, 2 * GRANULE);
+    ASSERT_NE(ptr, nullptr);
+  }
+  ASSERT_EQ(dp_bitmap_free(&bitmap, ptrs[1]), 0);
+
+  // Too large for the hole, goes after the last allocation.
+  void *large = dp_bitmap_malloc(&bitmap, 3 * GRANULE);
+  ASSERT_EQ(static_cast<uint8_t *>(large), static_cast<uint8_t *>(ptrs[3]) + 2 * GRANULE);
+  // Fits the hole.
+  void *small = dp_bitmap_malloc(&bitmap, GRANULE);
+  ASSERT_EQ(small, ptrs[1]);
+}
+
+TEST_P(DPBitmapTest, RunsCrossWordBoundaries) {
+  // 60 granules, then a run that must span the first and second bitmap words.
+  void *head = dp_bitmap_malloc(&bitmap, 60 * GRANULE);
+  void *run = dp_bitmap_malloc(&bitmap, 100 * GRANULE);
+  ASSERT_NE(head, nullptr);
+  ASSERT_NE(run, nullptr);
+  ASSERT_EQ(static_cast<uint8_t *>(run), static_cast<uint8_t *>(head) + 60 * GRANULE);
+  ASSERT_EQ(dp_bitmap_free(&bitmap, run), 0);
+  ASSERT_EQ(bitmap.available, bitmap.granules - 60);
+}
+
+TEST_P(DPBitmapTest, ExhaustAndRefill) {
+  std::vector<void *> ptrs;
+  while (void *ptr = dp_bitmap_malloc(&bitmap, GRANULE)) {
+    ptrs.push_back(ptr);
+  }
+  ASSERT_EQ(ptrs.size(), bitmap.granules);
+  ASSERT_EQ(bitmap.available, 0u);
+  ASSERT_EQ(dp_bitmap_malloc(&bitmap, 1), nullptr);
+
+  for (void *ptr : ptrs) {
+    ASSERT_EQ(dp_bitmap_free(&bitmap, ptr), 0);
+  }
+  ASSERT_NE(dp_bitmap_malloc(&bitmap, bitmap.granules * GRANULE), nullptr);
+}
+
+TEST_P(DPBitmapTest, InvalidFrees) {
+  auto *ptr = static_cast<uint8_t *>(dp_bitmap_malloc(&bitmap, 3 * GRANULE));
+  ASSERT_NE(ptr, nullptr);
+
+  ASSERT_EQ(dp_bitmap_free(&bitmap, nullptr), 1);
+  ASSERT_EQ(dp_bitmap_free(&bitmap, ptr + 1), 1);
+  ASSERT_EQ(dp_bitmap_free(&bitmap, ptr + GRANULE), 1);   // inside the allocation.
+  ASSERT_EQ(dp_bitmap_free(&bitmap, ptr + 8 * GRANULE), 1); // never allocated.
+  ASSERT_EQ(dp_bitmap_free(&bitmap, buffer.data()), 1);     // the bitmaps.
+  ASSERT_EQ(dp_bitmap_free(&bitmap, ptr), 0);
+  ASSERT_EQ(dp_bitmap_free(&bitmap, ptr), 1); // double free.
+}
+
+TEST_P(DPBitmapTest, MatchesScalarReference) {
+  alignas(max_align_t) std::array<uint8_t, BUFFER_SIZE> reference_buffer;
+  dp_bitmap reference;
+  ASSERT_TRUE(init(reference, reference_buffer.data(), BUFFER_SIZE));
+  ASSERT_TRUE(dp_bitmap_set_simd(&reference, DP_SIMD_SCALAR));
+
+  std::mt19937 rng(1234);
+  std::uniform_int_distribution<size_t> size_dist(1, 24 * GRANULE);
+  std::vector<size_t> live; // offsets from data, identical in both engines.
+  for (size_t i = 0; i < 5000; i++) {
+    if (live.empty() || rng() % 3 != 0) {
+      size_t size = size_dist(rng);
+      auto *ptr = static_cast<uint8_t *>(dp_bitmap_malloc(&bitmap, size));
+      auto *expected = static_cast<uint8_t *>(dp_bitmap_malloc(&reference, size));
+      ASSERT_EQ(ptr == nullptr, expected == nullptr);
+      if (ptr) {
+        ASSERT_EQ(ptr - bitmap.data, expected - reference.data);
+        live.push_back(static_cast<size_t>(ptr - bitmap.data));
+      }
+    } else {
+      size_t idx = rng() % live.size();
+      ASSERT_EQ(dp_bitmap_free(&bitmap, bitmap.data + live[idx]), 0);
+      ASSERT_EQ(dp_bitmap_free(&reference, reference.data + live[idx]), 0);
+      live.erase(live.begin() + static_cast<long>(idx));
+    }
+    ASSERT_EQ(bitmap.available, reference.available);
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(SimdLevels, DPBitmapTest,
+                         ::testing::Values(DP_SIMD_SCALAR, DP_SIMD_SSE2, DP_SIMD_AVX2,
+                                           DP_SIMD_NEON));
+
+TEST(DPSimdTest, BestIsSupported) {
+  ASSERT_TRUE(dp_simd_supported(dp_simd_best()));
+  ASSERT_TRUE(dp_simd_supported(DP_SIMD_SCALAR));
+}
@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "test_common.hpp"
+
+// Asymptotic complexity regression tests.
+//
+// Each test sweeps the number of live or free blocks over several orders of magnitude,
+// records the deterministic DP_STATS probe counters for one operation and fits the
+// order k of cost ~ n^k with a least squares fit in log-log space. The test fails when
+// the fitted order exceeds the bound declared for that operation.
+
+#if DP_STATS
+
+namespace {
+
+// Slack on top of the declared order, absorbs constant terms at the small end of the sweep.
+constexpr double ORDER_TOLERANCE = 0.2;
+
+const std::vector<size_t> SWEEP = {16, 64, 256, 1024, 4096};
+
+inline void noop_log(const char *, ...) {}
+
+double fitted_order(const std::vector<std::pair<size_t, size_t>> &samples) {
+  double mean_x = 0, mean_y = 0;
+  for (auto [n, cost] : samples) {
+    mean_x += std::log((double)n);
+    mean_y += std::log((double)std::max<size_t>(cost, 1));
+  }
+  mean_x /= samples.size();
+  mean_y /= samples.size();
+
+  double cov = 0, var = 0;
+  for (auto [n, cost] : samples) {
+    double dx = std::log((double)n) - mean_x;
+    double dy = std::log((double)std::max<size_t>(cost, 1)) - mean_y;
+    cov += dx * dy;
+    var += dx * dx;
+  }
+  return cov / var;
+}
+
+class ComplexityTest : public ::testing::Test {
+protected:
+  static constexpr size_t BUFFER_SIZE = 4 * 1024 * 1024;
+  static constexpr size_t BLOCK_SIZE = 32;
+  // Requests none of the holes can satisfy, past the size classes so they search the heap.
+  static constexpr size_t SEARCH_SIZE = std::max(BLOCK_SIZE * 4, UNCACHED_SIZE);
+  std::vector<uint8_t> buffer;
+  dp_alloc allocator;
+  std::vector<void *> live;
+
+  void SetUp() override { buffer.resize(BUFFER_SIZE); }
+
+  // Reinitialises the heap with `live_blocks` allocated blocks and `free_blocks` holes
+  // between them that can't coalesce, plus the free tail of the buffer.
+  void age(size_t live_blocks, size_t free_blocks) {
+    ASSERT_LE(free_blocks, live_blocks);
+    ASSERT_TRUE(dp_init(&allocator, buffer.data(),
+                        BUFFER_SIZE IF_DP_LOG(, {.debug = noop_log,
+                                                 .info = noop_log,
+                                                 .warning = noop_log,
+                                                 .error = noop_log})));
+    live.clear();
+
+    std::vector<void *> holes;
+    size_t total = live_blocks + free_blocks;
+    for (size_t i = 0; i < total; i++) {
+      void *ptr = dp_malloc(&allocator, BLOCK_SIZE);
+      ASSERT_NE(ptr, nullptr);
+      if ((i + 1) * free_blocks / total != i * free_blocks / total)
+        holes.push_back(ptr);
+      else
+        live.push_back(ptr);
+    }
+    for (void *ptr : holes) {
+      ASSERT_EQ(dp_free(&allocator, ptr), 0);
+    }
+    dp_flush_cache(&allocator); // the holes are free blocks, not cached ones.
+  }
+
+  // Probes for a request none of the holes can satisfy, so the whole free list is searched.
+  size_t malloc_probes() {
+    void *ptr = dp_malloc(&allocator, SEARCH_SIZE);
+    EXPECT_NE(ptr, nullptr);
+    size_t probes = allocator.num_iterations;
+    live.push_back(ptr);
+    return probes;
+  }
+
+  // Scans for freeing a block taken from the tail, whose only free neighbour is the tail
+  // itself at the end of the free list.
+  size_t free_scans() {
+    void *ptr = dp_malloc(&allocator, SEARCH_SIZE);
+    EXPECT_NE(ptr, nullptr);
+    EXPECT_EQ(dp_free(&allocator, ptr), 0);
+    return allocator.num_free_iterations;
+  }
+};
+
+} // namespace
+
+TEST(ComplexityFitTest, FitRecoversKnownOrders) {
+  std::vector<std::pair<size_t, size_t>> constant, linear, quadratic;
+  for (size_t n : SWEEP) {
+    constant.push_back({n, 7});
+    linear.push_back({n, 3 * n + 5});
+    quadratic.push_back({n, n * n});
+  }
+
+  EXPECT_NEAR(fitted_order(constant), 0.0, 0.01);
+  EXPECT_NEAR(fitted_order(linear), 1.0, 0.05);
+  EXPECT_NEAR(fitted_order(quadratic), 2.0, 0.01);
+}
+
+// dp_malloc is declared O(free blocks).
+TEST_F(ComplexityTest, MallocIsLinearInFreeBlocks) {
+  std::vector<std::pair<size_t, size_t>> samples;
+  for (size_t n : SWEEP) {
+    ASSERT_NO_FATAL_FAILURE(age(n, n));
+    samples.push_back({n, malloc_probes()});
+  }
+
+  double order = fitted_order(samples);
+  test_info("dp_malloc probes ~ free_blocks^%.2f", order);
+  EXPECT_LE(order, 1.0 + ORDER_TOLERANCE);
+}
+
+// dp_malloc is declared O(1) in live blocks.
+TEST_F(ComplexityTest, MallocIsConstantInLiveBlocks) {
+  std::vector<std::pair<size_t, size_t>> samples;
+  for (size_t n : SWEEP) {
+    ASSERT_NO_FATAL_FAILURE(age(n, 16));
+    samples.push_back({n, malloc_probes()});
+  }
+
+  double order = fitted_order(samples);
+  test_info("dp_malloc probes ~ live_blocks^%.2f", order);
+  EXPECT_LE(order, 0.0 + ORDER_TOLERANCE);
+}
+
+// dp_free is declared O(free blocks), coalescing scans the free list for neighbours.
+TEST_F(ComplexityTest, FreeIsLinearInFreeBlocks) {
+  std::vector<std::pair<size_t, size_t>> samples;
+  for (size_t n : SWEEP) {
+    ASSERT_NO_FATAL_FAILURE(age(n, n));
+    samples.push_back({n, free_scans()});
+  }
+
+  double order = fitted_order(samples);
+  test_info("dp_free scans ~ free_blocks^%.2f", order);
+  EXPECT_LE(order, 1.0 + ORDER_TOLERANCE);
+}
+
+// dp_free is declared O(1) in live blocks.
+TEST_F(ComplexityTest, FreeIsConstantInLiveBlocks) {
+  std::vector<std::pair<size_t, size_t>> samples;
+  for (size_t n : SWEEP) {
+    ASSERT_NO_FATAL_FAILURE(age(n, 16));
+    samples.push_back({n, free_scans()});
+  }
+
+  double order = fitted_order(samples);
+  test_info("dp_free scans ~ live_blocks^%.2f", order);
+  EXPECT_LE(order, 0.0 + ORDER_TOLERANCE);
+}
+
+#endif
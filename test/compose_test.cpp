@@ -0,0 +1,262 @@
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "compose.hpp"
+#include "test_common.hpp"
+
+// Tests for the composable allocator layer, the C combinators of compose.h over deadpool's
+// engines and the C++ templates of compose.hpp.
+
+#if DP_LOG
+static dp_logger test_logger() {
+  return {.debug = test_debug, .info = test_info, .warning = test_warning, .error = test_error};
+}
+#endif
+
+class DPComposeTest : public ::testing::Test {
+protected:
+  static constexpr size_t SMALL_SIZE = 16 * 1024;
+  static constexpr size_t LARGE_SIZE = 64 * 1024;
+  alignas(max_align_t) std::array<uint8_t, SMALL_SIZE> small_buffer;
+  alignas(max_align_t) std::array<uint8_t, LARGE_SIZE> large_buffer;
+  dp_bitmap small;
+  dp_alloc large;
+
+  void SetUp() override {
+    ASSERT_TRUE(dp_bitmap_init(&small, small_buffer.data(), SMALL_SIZE,
+                               16 IF_DP_LOG(, test_logger())));
+    ASSERT_TRUE(dp_init(&large, large_buffer.data(), LARGE_SIZE IF_DP_LOG(, test_logger())));
+  }
+
+  void TearDown() override { ASSERT_EQ(dp_check(&large), 0); }
+};
+
+TEST_F(DPComposeTest, AdaptersOwnTheirBuffers) {
+  dp_allocator heap = dp_heap_allocator(&large);
+  dp_allocator bitmap = dp_bitmap_allocator(&small);
+  void *ptr = dp_allocator_malloc(heap, 100);
+  ASSERT_TRUE(dp_allocator_owns(heap, ptr));
+  ASSERT_FALSE(dp_allocator_owns(bitmap, ptr));
+  ASSERT_FALSE(dp_allocator_owns(dp_mmap_allocator(), ptr)); // can't tell.
+  ASSERT_EQ(dp_allocator_free(heap, ptr), 0);
+  ASSERT_EQ(dp_allocator_free(heap, ptr), 1);
+}
+
+TEST_F(DPComposeTest, SegregatorRoutesBySize) {
+  dp_segregator segregator = {64, dp_bitmap_allocator(&small), dp_heap_allocator(&large)};
+  dp_allocator allocator = dp_segregator_allocator(&segregator);
+
+  void *small_ptr = dp_allocator_malloc(allocator, 64);
+  void *large_ptr = dp_allocator_malloc(allocator, 65);
+  ASSERT_TRUE(dp_allocator_owns(segregator.small, small_ptr));
+  ASSERT_TRUE(dp_allocator_owns(segregator.large, large_ptr));
+  ASSERT_TRUE(dp_allocator_owns(allocator, large_ptr));
+  ASSERT_EQ(dp_allocator_free(allocator, small_ptr), 0);
+  ASSERT_EQ(dp_allocator_free(allocator, large_ptr), 0);
+  ASSERT_EQ(small.available, small.granules);
+}
+
+TEST_F(DPComposeTest, FallbackTakesWhatThePrimaryCant) {
+  dp_fallback fallback = {dp_bitmap_allocator(&small), dp_mmap_allocator()};
+  dp_allocator allocator = dp_fallback_allocator(&fallback);
+
+  void *fits = dp_allocator_malloc(allocator, 1024);
+  auto *overflow = static_cast<uint8_t *>(dp_allocator_malloc(allocator, 2 * SMALL_SIZE));
+  ASSERT_TRUE(dp_allocator_owns(fallback.primary, fits));
+  ASSERT_NE(overflow, nullptr);
+  ASSERT_FALSE(dp_allocator_owns(fallback.primary, overflow));
+  overflow[2 * SMALL_SIZE - 1] = 1; // the whole block is mapped.
+  ASSERT_EQ(dp_allocator_malloc(allocator, 0), nullptr);
+  ASSERT_EQ(dp_allocator_free(allocator, overflow), 0);
+  ASSERT_EQ(dp_allocator_free(allocator, fits), 0);
+  ASSERT_EQ(dp_allocator_free(allocator, large_buffer.data() + 40), 1); // not a mapping.
+}
+
+TEST(DPMmapTest, FreesOnlyLiveMappings) {
+  dp_allocator allocator = dp_mmap_allocator();
+  auto *ptr = static_cast<uint8_t *>(dp_allocator_malloc(allocator, 100));
+  ASSERT_NE(ptr, nullptr);
+  size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t offset = reinterpret_cast<uintptr_t>(ptr) & (page - 1);
+
+  // A page of someone else's at the same block offset, with a length in front of it.
+  void *mapping = mmap(nullptr, page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  ASSERT_NE(mapping, MAP_FAILED);
+  std::memset(mapping, 0, page);
+  *static_cast<size_t *>(mapping) = page;
+  uint8_t *foreign = static_cast<uint8_t *>(mapping) + offset;
+  ASSERT_EQ(dp_allocator_free(allocator, foreign), 1);
+  foreign[0] = 1; // still mapped.
+  ASSERT_EQ(munmap(mapping, page), 0);
+
+  ASSERT_EQ(dp_allocator_free(allocator, ptr), 0);
+  ASSERT_EQ(dp_allocator_free(allocator, ptr), 1);
+}
+
+#if DP_HUGE_THRESHOLD
+TEST_F(DPComposeTest, HeapOwnsItsHugeBlocks) {
+  // The heap maps the block outside its buffer, its frees must still go to the heap.
+  dp_fallback fallback = {dp_heap_allocator(&large), dp_mmap_allocator()};
+  dp_allocator allocator = dp_fallback_allocator(&fallback);
+  auto *huge = static_cast<uint8_t *>(dp_allocator_malloc(allocator, DP_HUGE_THRESHOLD + 1));
+  ASSERT_NE(huge, nullptr);
+  ASSERT_EQ(large.huge_count, 1u);
+  ASSERT_TRUE(dp_allocator_owns(fallback.primary, huge));
+  ASSERT_TRUE(dp_allocator_owns(allocator, huge));
+  huge[DP_HUGE_THRESHOLD] = 1;
+  ASSERT_EQ(dp_allocator_free(allocator, huge), 0);
+  ASSERT_EQ(large.huge_count, 0u);
+  ASSERT_FALSE(dp_allocator_owns(fallback.primary, huge));
+}
+#endif
+
+TEST_F(DPComposeTest, BucketizerPicksTheBucketBySize) {
+  dp_tree trees[2];
+  alignas(max_align_t) static std::array<uint8_t, 2 * SMALL_SIZE> buffers;
+  dp_allocator buckets[2];
+  for (size_t i = 0; i < 2; i++) {
+    ASSERT_TRUE(dp_tree_init(&trees[i], buffers.data() + i * SMALL_SIZE, SMALL_SIZE,
+                             64 IF_DP_LOG(, test_logger())));
+    buckets[i] = dp_tree_allocator(&trees[i]);
+  }
+  dp_bucketizer bucketizer = {buckets, 2, 32, 32}; // (32, 64] and (64, 96].
+  dp_allocator allocator = dp_bucketizer_allocator(&bucketizer);
+
+  ASSERT_EQ(dp_allocator_malloc(allocator, 32), nullptr);
+  ASSERT_EQ(dp_allocator_malloc(allocator, 97), nullptr);
+  void *first = dp_allocator_malloc(allocator, 64);
+  void *second = dp_allocator_malloc(allocator, 65);
+  ASSERT_TRUE(dp_allocator_owns(buckets[0], first));
+  ASSERT_TRUE(dp_allocator_owns(buckets[1], second));
+  ASSERT_EQ(dp_allocator_free(allocator, second), 0);
+  ASSERT_EQ(dp_allocator_free(allocator, first), 0);
+  ASSERT_EQ(dp_allocator_free(allocator, large_buffer.data()), 1);
+  ASSERT_EQ(dp_tree_check(&trees[0]), 0);
+  ASSERT_EQ(dp_tree_check(&trees[1]), 0);
+}
+
+TEST_F(DPComposeTest, StatsCountWhatPassesThrough) {
+  dp_stats stats{};
+  stats.inner = dp_bitmap_allocator(&small);
+  dp_allocator allocator = dp_stats_allocator(&stats);
+
+  void *a = dp_allocator_malloc(allocator, 10);
+  void *b = dp_allocator_malloc(allocator, 20);
+  ASSERT_EQ(dp_allocator_malloc(allocator, 2 * SMALL_SIZE), nullptr);
+  ASSERT_EQ(dp_allocator_free(allocator, a), 0);
+  ASSERT_EQ(dp_allocator_free(allocator, a), 1);
+  ASSERT_EQ(dp_allocator_free(allocator, b), 0);
+  ASSERT_EQ(stats.allocations, 3u);
+  ASSERT_EQ(stats.failures, 1u);
+  ASSERT_EQ(stats.bytes_requested, 30 + 2 * SMALL_SIZE);
+  ASSERT_EQ(stats.frees, 2u);
+  ASSERT_EQ(stats.live, 0u);
+  ASSERT_EQ(stats.peak_live, 2u);
+}
+
+TEST(DPPoolTest, HandsOutAndReusesBlocks) {
+  alignas(max_align_t) std::array<uint8_t, 1024> buffer;
+  dp::pool pool;
+  ASSERT_FALSE(pool.init(buffer.data(), 8, 16));
+  ASSERT_TRUE(pool.init(buffer.data(), buffer.size(), 20));
+  ASSERT_EQ(pool.block_size() % alignof(max_align_t), 0u);
+  ASSERT_EQ(pool.allocate(pool.block_size() + 1), nullptr);
+
+  std::vector<void *> blocks;
+  while (void *block = pool.allocate(1)) {
+    blocks.push_back(block);
+  }
+  ASSERT_EQ(blocks.size(), buffer.size() / pool.block_size());
+  ASSERT_FALSE(pool.deallocate(static_cast<uint8_t *>(blocks[1]) + 1));
+  ASSERT_TRUE(pool.deallocate(blocks[1]));
+  ASSERT_EQ(pool.allocate(pool.block_size()), blocks[1]);
+  ASSERT_FALSE(pool.owns(buffer.data() + buffer.size()));
+}
+
+namespace {
+
+using small_pools = dp::bucketizer<dp::pool, 0, 64, 16>;
+using composed = dp::stats<dp::segregator<64, dp::fallback<small_pools, dp::heap<>>,
+                                          dp::fallback<dp::heap<>, dp::mmap_allocator>>>;
+
+} // namespace
+
+class DPComposeTemplateTest : public ::testing::Test {
+protected:
+  static constexpr size_t POOL_SIZE = 1024;
+  static constexpr size_t HEAP_SIZE = 16 * 1024;
+  alignas(max_align_t) std::array<uint8_t, small_pools::count * POOL_SIZE> pool_buffer;
+  alignas(max_align_t) std::array<uint8_t, HEAP_SIZE> overflow_buffer;
+  alignas(max_align_t) std::array<uint8_t, HEAP_SIZE> large_buffer;
+  composed allocator;
+
+  void SetUp() override {
+    auto &small = allocator.inner.small;
+    for (size_t i = 0; i < small_pools::count; i++) {
+      ASSERT_TRUE(small.primary.buckets[i].init(pool_buffer.data() + i * POOL_SIZE, POOL_SIZE,
+                                                small_pools::bucket_size(i)));
+    }
+    ASSERT_TRUE(small.secondary.init(overflow_buffer.data(), HEAP_SIZE));
+    ASSERT_TRUE(allocator.inner.large.primary.init(large_buffer.data(), HEAP_SIZE));
+  }
+
+  void TearDown() override {
+    ASSERT_TRUE(allocator.inner.small.secondary.check());
+    ASSERT_TRUE(allocator.inner.large.primary.check());
+  }
+};
+
+TEST_F(DPComposeTemplateTest, EachSizeLandsInItsPart) {
+  auto &small = allocator.inner.small;
+  void *tiny = allocator.allocate(1);
+  void *medium = allocator.allocate(1000);
+  void *huge = allocator.allocate(2 * HEAP_SIZE);
+  ASSERT_TRUE(small.primary.buckets[0].owns(tiny));
+  ASSERT_TRUE(allocator.inner.large.primary.owns(medium));
+  ASSERT_NE(huge, nullptr);
+  ASSERT_FALSE(allocator.inner.large.primary.owns(huge));
+
+  // A full pool overflows into the small heap.
+  std::vector<void *> blocks;
+  for (size_t i = 0; i <= POOL_SIZE / 64; i++) {
+    blocks.push_back(allocator.allocate(64));
+  }
+  ASSERT_TRUE(small.secondary.owns(blocks.back()));
+
+  for (void *ptr : blocks) {
+    ASSERT_TRUE(allocator.deallocate(ptr));
+  }
+  for (void *ptr : {tiny, medium, huge}) {
+    ASSERT_TRUE(allocator.deallocate(ptr));
+  }
+  ASSERT_EQ(allocator.live, 0u);
+  ASSERT_EQ(allocator.peak_live, blocks.size() + 3);
+  ASSERT_EQ(allocator.failures, 0u);
+}
+
+TEST_F(DPComposeTemplateTest, CrossesIntoTheCLayerAndBack) {
+  dp_allocator view = dp::to_dp_allocator(allocator);
+  void *ptr = dp_allocator_malloc(view, 32);
+  ASSERT_EQ(view.ops->owns, nullptr); // mmap can't tell what it owns, so neither can allocator.
+  ASSERT_TRUE(dp_allocator_owns(dp::to_dp_allocator(allocator.inner.small), ptr));
+  ASSERT_EQ(dp_allocator_free(view, ptr), 0);
+  ASSERT_EQ(dp_allocator_free(view, nullptr), 1);
+  ASSERT_EQ(allocator.frees, 1u);
+
+  // A dp_alloc as the primary of a template composition.
+  alignas(max_align_t) static std::array<uint8_t, HEAP_SIZE> c_buffer;
+  dp_alloc heap;
+  ASSERT_TRUE(dp_init(&heap, c_buffer.data(), HEAP_SIZE IF_DP_LOG(, test_logger())));
+  dp::fallback<dp::vtable_allocator, dp::mmap_allocator> mixed;
+  mixed.primary.target = dp_heap_allocator(&heap);
+  void *inside = mixed.allocate(100);
+  void *outside = mixed.allocate(2 * HEAP_SIZE);
+  ASSERT_TRUE(mixed.primary.owns(inside));
+  // Unless the heap maps it as a huge block, the mmap allocator takes the request.
+  bool mapped_by_heap = DP_HUGE_THRESHOLD != 0 && 2 * HEAP_SIZE > DP_HUGE_THRESHOLD;
+  ASSERT_EQ(mixed.primary.owns(outside), mapped_by_heap);
+  ASSERT_TRUE(mixed.deallocate(outside));
+  ASSERT_TRUE(mixed.deallocate(inside));
+  ASSERT_EQ(dp_check(&heap), 0);
+}
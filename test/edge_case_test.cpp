@@ -64,6 +64,8 @@ TEST_F(DPAllocatorTest, FreePointerOutsideBuffer) {
   ASSERT_EQ(1, result);
 }
 
+// Out of line metadata keeps no header in front of the block to corrupt.
+#if !DP_OUT_OF_LINE_METADATA
 TEST_F(DPAllocatorTest, FreeInvalidBlockWithNonNullNext) {
   void *ptr = dp_malloc(&allocator, 64);
   ASSERT_NE(nullptr, ptr);
@@ -80,6 +82,7 @@ TEST_F(DPAllocatorTest, FreeInvalidBlockWithNonNullNext) {
   ASSERT_EQ(0, dp_free(&allocator, ptr));
   allocated.clear();
 }
+#endif
 
 TEST_F(DPAllocatorTest, DoubleFree) {
   void *ptr = dp_malloc(&allocator, 100);
@@ -96,9 +99,9 @@ TEST_F(DPAllocatorTest, DoubleFree) {
 // dp_get_fragmentation edge cases (lines 278, 292)
 #if DP_STATS
 TEST_F(DPAllocatorTest, FragmentationWithNoFreeBlocks) {
-  void *ptr = dp_malloc(&allocator, BUFFER_SIZE - 2 * sizeof(block_header));
+  void *ptr = malloc_largest();
   ASSERT_NE(nullptr, ptr);
-  ASSERT_EQ(nullptr, allocator.free_list_head);
+  ASSERT_EQ(0u, dp_largest_free(&allocator));
 
   float frag = dp_get_fragmentation(&allocator);
   ASSERT_FLOAT_EQ(0.0f, frag);
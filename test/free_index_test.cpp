@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <random>
+
+#include "test_common.hpp"
+
+// Tests for the free block index (DP_FREE_INDEX), which replaces the free list. They only
+// run in builds with the index enabled, the rest of the suite covers the free list.
+
+#if DP_FREE_INDEX
+class DPFreeIndexTest : public DPHeapFixture<64 * 1024> {};
+
+TEST_F(DPFreeIndexTest, IndexIsReservedPastTheHeap) {
+  ASSERT_EQ(allocator.free_list_head, nullptr);
+  ASSERT_EQ(allocator.index_count, 1u);
+  auto *index = reinterpret_cast<uint8_t *>(allocator.index_sizes);
+  ASSERT_GE(index, allocator.buffer + allocator.buffer_size);
+  ASSERT_LE(reinterpret_cast<uint8_t *>(allocator.index_offsets), buffer.data() + BUFFER_SIZE);
+  ASSERT_EQ(allocator.index_sizes[0], allocator.available);
+  ASSERT_EQ(allocator.index_offsets[0], 0u);
+}
+
+TEST_F(DPFreeIndexTest, SplitAndCoalesceKeepTheIndexInSync) {
+  void *a = dp_malloc(&allocator, 64);
+  void *b = dp_malloc(&allocator, 64);
+  void *c = dp_malloc(&allocator, 64);
+  ASSERT_NE(c, nullptr);
+  ASSERT_EQ(allocator.index_count, 1u); // the tail.
+
+  ASSERT_EQ(dp_free(&allocator, a), 0);
+  ASSERT_EQ(allocator.index_count, 2u);
+  ASSERT_EQ(dp_check(&allocator), 0);
+
+  // Merges into a's entry, then c merges both with the tail.
+  ASSERT_EQ(dp_free(&allocator, b), 0);
+  ASSERT_EQ(allocator.index_count, 2u);
+  ASSERT_EQ(dp_free(&allocator, c), 0);
+  ASSERT_EQ(allocator.index_count, 1u);
+  ASSERT_EQ(allocator.index_sizes[0], allocator.buffer_size - sizeof(block_header));
+}
+
+TEST_F(DPFreeIndexTest, PicksTheBestFit) {
+  if (dp_config_fit_policy != DP_FIT_BEST)
+    GTEST_SKIP() << "first fit takes the first indexed block, in no particular order";
+
+  // Holes of 256, 64 and 128 bytes, each followed by a live block.
+  std::vector<void *> holes;
+  std::vector<void *> live;
+  for (size_t size : {256, 64, 128}) {
+    holes.push_back(dp_malloc(&allocator, size));
+    live.push_back(dp_malloc(&allocator, 16));
+  }
+  for (void *hole : holes) {
+    ASSERT_EQ(dp_free(&allocator, hole), 0);
+  }
+
+  ASSERT_EQ(dp_malloc(&allocator, 100), holes[2]);
+}
+
+TEST_F(DPFreeIndexTest, RandomWorkloadStaysConsistent) {
+  std::mt19937 rng(99);
+  std::uniform_int_distribution<size_t> size_dist(1, 512);
+  std::vector<void *> live;
+  for (size_t i = 0; i < 4000; i++) {
+    if (live.empty() || rng() % 2 == 0) {
+      if (void *ptr = dp_malloc(&allocator, size_dist(rng)))
+        live.push_back(ptr);
+    } else {
+      size_t idx = rng() % live.size();
+      ASSERT_EQ(dp_free(&allocator, live[idx]), 0);
+      live.erase(live.begin() + static_cast<long>(idx));
+    }
+    ASSERT_EQ(dp_check(&allocator), 0) << "after operation " << i;
+  }
+  for (void *ptr : live) {
+    ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  }
+  ASSERT_EQ(allocator.index_count, 1u);
+}
+#endif
@@ -22,8 +22,10 @@ TEST_F(DPAllocatorTest, FragmentationAndCoalescing) {
   ASSERT_NO_FATAL_FAILURE(checked_free(ptr4));
 
   // Should be able to allocate a large block now
-  void *large_ptr;
-  ASSERT_NO_FATAL_FAILURE(checked_alloc(900, &large_ptr));
+  ASSERT_TRUE(fully_coalesced());
+  void *large_ptr = malloc_largest();
+  ASSERT_NE(large_ptr, nullptr);
+  allocated.push_back({large_ptr, 0});
 }
 
 TEST_F(DPAllocatorTest, FragmentedTooLargeAllocationFailure) {
@@ -103,8 +105,10 @@ TEST_F(DPAllocatorTest, BestFitNotHead) {
   ASSERT_NE(p5, nullptr);
   allocated.push_back({p5, 50});
 
-  // Check that p2 is still free and head (size includes alignment padding)
-  ASSERT_GE(allocator.free_list_head->size, 200);
+  // Check that p2 is still free and whole, the best fit for its size
+  void *p6 = dp_malloc(&allocator, 200);
+  ASSERT_EQ(p6, p2);
+  allocated.push_back({p6, 200});
 }
 
 // Non-aligned size tests
@@ -222,23 +226,13 @@ TEST_F(DPAllocatorTest, LeftCoalescing) {
   ASSERT_NO_FATAL_FAILURE(checked_free(p1));
 
   // Count free blocks before freeing p2
-  size_t free_blocks_before = 0;
-  block_header *curr = allocator.free_list_head;
-  while (curr) {
-    free_blocks_before++;
-    curr = curr->next;
-  }
+  size_t free_blocks_before = free_blocks();
 
   // Free p2 (should coalesce left with p1)
   ASSERT_NO_FATAL_FAILURE(checked_free(p2));
 
   // Count free blocks after - should be same or fewer due to coalescing
-  size_t free_blocks_after = 0;
-  curr = allocator.free_list_head;
-  while (curr) {
-    free_blocks_after++;
-    curr = curr->next;
-  }
+  size_t free_blocks_after = free_blocks();
 
   // After coalescing, we should have fewer separate blocks
   ASSERT_LE(free_blocks_after, free_blocks_before);
@@ -258,22 +252,12 @@ TEST_F(DPAllocatorTest, RightCoalescing) {
   // Free p2 first (right block)
   ASSERT_NO_FATAL_FAILURE(checked_free(p2));
 
-  size_t free_blocks_before = 0;
-  block_header *curr = allocator.free_list_head;
-  while (curr) {
-    free_blocks_before++;
-    curr = curr->next;
-  }
+  size_t free_blocks_before = free_blocks();
 
   // Free p1 (should coalesce right with p2)
   ASSERT_NO_FATAL_FAILURE(checked_free(p1));
 
-  size_t free_blocks_after = 0;
-  curr = allocator.free_list_head;
-  while (curr) {
-    free_blocks_after++;
-    curr = curr->next;
-  }
+  size_t free_blocks_after = free_blocks();
 
   ASSERT_LE(free_blocks_after, free_blocks_before);
 
@@ -295,22 +279,12 @@ TEST_F(DPAllocatorTest, BothSidesCoalescing) {
   ASSERT_NO_FATAL_FAILURE(checked_free(p1));
   ASSERT_NO_FATAL_FAILURE(checked_free(p3));
 
-  size_t free_blocks_before = 0;
-  block_header *curr = allocator.free_list_head;
-  while (curr) {
-    free_blocks_before++;
-    curr = curr->next;
-  }
+  size_t free_blocks_before = free_blocks();
 
   // Free middle block - should coalesce with both neighbors
   ASSERT_NO_FATAL_FAILURE(checked_free(p2));
 
-  size_t free_blocks_after = 0;
-  curr = allocator.free_list_head;
-  while (curr) {
-    free_blocks_after++;
-    curr = curr->next;
-  }
+  size_t free_blocks_after = free_blocks();
 
   // Should have coalesced into fewer blocks
   ASSERT_LT(free_blocks_after, free_blocks_before);
@@ -340,15 +314,7 @@ TEST_F(DPAllocatorTest, CoalescingSequenceAlternating) {
   }
 
   // After all frees, should have minimal fragmentation (one large block)
-  size_t free_blocks = 0;
-  block_header *curr = allocator.free_list_head;
-  while (curr) {
-    free_blocks++;
-    curr = curr->next;
-  }
-
-  // All blocks should have coalesced
-  ASSERT_EQ(free_blocks, 1);
+  ASSERT_EQ(free_blocks(), 1);
 
   // Clear tracking since we already freed everything
   allocated.clear();
@@ -382,13 +348,10 @@ TEST_F(DPAllocatorTest, FragmentationMetric) {
   checked_alloc(100, &p3);
 
   // Alloc rest
-  // We want to fill the remaining space.
-  // allocator.available is the size of the free block payload.
-  // We need to account for the header of the new block.
-  // So we can alloc at most available - sizeof(block_header).
-
-  if (allocator.available > sizeof(block_header)) {
-    checked_alloc(allocator.available - sizeof(block_header), &tail);
+  // We want to fill the remaining space, with the largest block that fits in it.
+  tail = malloc_largest();
+  if (tail != nullptr) {
+    allocated.push_back({tail, 0});
   }
 
   // Now buffer is full (or close to).
@@ -401,6 +364,7 @@ TEST_F(DPAllocatorTest, FragmentationMetric) {
   // Frag = 1 - 100/200 = 0.5.
 
 #if DP_STATS
+  dp_flush_cache(&allocator); // the holes are free blocks, not cached ones.
   float fragmentation = dp_get_fragmentation(&allocator);
   ASSERT_NEAR(fragmentation, 0.5f, 0.01f);
   test_info("Fragmentation check: %f\n", fragmentation);
@@ -58,7 +58,7 @@ TEST_F(FuzzTest, RandomAllocFreeSequence) {
     ASSERT_EQ(dp_free(&allocator, alloc.ptr), 0);
   }
 
-  EXPECT_EQ(allocator.free_list_head->next, nullptr);
+  EXPECT_TRUE(fully_coalesced());
 }
 
 TEST_F(FuzzTest, RandomSizeDistributions) {
@@ -74,7 +74,7 @@ TEST_F(FuzzTest, RandomSizeDistributions) {
         ASSERT_EQ(dp_free(&allocator, ptr), 0);
       }
     }
-    EXPECT_EQ(allocator.free_list_head->next, nullptr);
+    EXPECT_TRUE(fully_coalesced());
   };
 
   run_with_dist(1, 8);
@@ -105,7 +105,7 @@ TEST_F(FuzzTest, RandomFreeOrder) {
     ASSERT_EQ(dp_free(&allocator, p), 0);
   }
 
-  EXPECT_EQ(allocator.free_list_head->next, nullptr);
+  EXPECT_TRUE(fully_coalesced());
 }
 
 TEST_F(FuzzTest, AllocateWriteVerifyFree) {
@@ -184,7 +184,7 @@ TEST_F(FuzzTest, BurstAllocBurstFree) {
     }
   }
 
-  EXPECT_EQ(allocator.free_list_head->next, nullptr);
+  EXPECT_TRUE(fully_coalesced());
 }
 
 TEST_F(FuzzTest, PowerOfTwoSizes) {
@@ -298,7 +298,7 @@ TEST_F(FuzzTest, RepeatedSameSizeAlloc) {
     ASSERT_EQ(dp_free(&allocator, p), 0);
   }
 
-  EXPECT_EQ(allocator.free_list_head->next, nullptr);
+  EXPECT_TRUE(fully_coalesced());
 }
 
 TEST_F(FuzzTest, MultipleSeedsConsistency) {
@@ -328,7 +328,7 @@ TEST_F(FuzzTest, MultipleSeedsConsistency) {
       ASSERT_EQ(dp_free(&allocator, p), 0);
     }
 
-    EXPECT_EQ(allocator.free_list_head->next, nullptr) << "Coalescing failed for seed " << s;
+    EXPECT_TRUE(fully_coalesced()) << "Coalescing failed for seed " << s;
   }
 }
 
@@ -355,7 +355,7 @@ TEST_F(FuzzTest, LIFOFreeing) {
     }
   }
 
-  EXPECT_EQ(allocator.free_list_head->next, nullptr);
+  EXPECT_TRUE(fully_coalesced());
 }
 
 TEST_F(FuzzTest, FIFOFreeing) {
@@ -380,7 +380,7 @@ TEST_F(FuzzTest, FIFOFreeing) {
     }
   }
 
-  EXPECT_EQ(allocator.free_list_head->next, nullptr);
+  EXPECT_TRUE(fully_coalesced());
 }
 
 TEST_F(FuzzTest, InterleavedPatterns) {
@@ -441,5 +441,5 @@ TEST_F(FuzzTest, InterleavedPatterns) {
     ASSERT_EQ(dp_free(&allocator, alloc.ptr), 0);
   }
 
-  EXPECT_EQ(allocator.free_list_head->next, nullptr);
+  EXPECT_TRUE(fully_coalesced());
 }
@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <type_traits>
+
+#include "heap.hpp"
+#include "test_common.hpp"
+
+// Behaviour the C library and dp::heap share, run against both. dp::heap keeps its own copy
+// of the allocator so every instance can pick its options at compile time, these tests keep
+// the two copies from drifting apart.
+
+namespace {
+
+// The C library behind dp::heap's interface.
+class c_heap {
+public:
+  static constexpr size_t alignment = DEFAULT_ALIGN;
+  // Requests past DP_HUGE_THRESHOLD are mapped instead of failing.
+  static constexpr bool maps_large = DP_HUGE_THRESHOLD != 0;
+
+  bool init(void *buffer, size_t buffer_size) {
+    return dp_init(&allocator_, buffer,
+                   buffer_size IF_DP_LOG(, {.debug = test_debug,
+                                            .info = test_info,
+                                            .warning = test_warning,
+                                            .error = test_error}));
+  }
+  void *allocate(size_t size) { return dp_malloc(&allocator_, size); }
+  bool deallocate(void *ptr) { return dp_free(&allocator_, ptr) == 0; }
+  size_t flush_cache() { return dp_flush_cache(&allocator_); }
+  bool check() { return dp_check(&allocator_) == 0; }
+  size_t available() const { return allocator_.available; }
+
+private:
+  dp_alloc allocator_;
+};
+
+template <typename Config> class cpp_heap : public dp::heap<Config> {
+public:
+  static constexpr size_t alignment = Config::alignment;
+  static constexpr bool maps_large = false;
+};
+
+struct first_fit_config : dp::default_config {
+  static constexpr dp::fit fit_policy = dp::fit::first;
+  static constexpr bool header_canary = true;
+};
+
+struct cached_config : dp::default_config {
+  static constexpr size_t size_classes = 8;
+  static constexpr size_t class_cache_depth = 4;
+};
+
+struct wide_config : dp::default_config {
+  static constexpr size_t alignment = 64;
+  static constexpr size_t split_threshold = 64;
+  static constexpr size_t probe_limit = 4;
+};
+
+} // namespace
+
+template <typename Heap> class DPHeapContractTest : public ::testing::Test {
+protected:
+  static constexpr size_t BUFFER_SIZE = 64 * 1024;
+  alignas(max_align_t) std::array<uint8_t, BUFFER_SIZE> buffer;
+  Heap heap;
+  size_t initial_available;
+
+  void SetUp() override {
+    ASSERT_TRUE(heap.init(buffer.data(), BUFFER_SIZE));
+    initial_available = heap.available();
+  }
+
+  void TearDown() override { ASSERT_TRUE(heap.check()); }
+
+  // Frees every block, every byte must come back.
+  void free_all(std::vector<void *> &ptrs) {
+    for (void *ptr : ptrs) {
+      ASSERT_TRUE(heap.deallocate(ptr));
+    }
+    ptrs.clear();
+    heap.flush_cache();
+    ASSERT_TRUE(heap.check());
+    ASSERT_EQ(heap.available(), initial_available);
+  }
+};
+
+using Heaps = ::testing::Types<c_heap, cpp_heap<dp::default_config>, cpp_heap<first_fit_config>,
+                               cpp_heap<cached_config>, cpp_heap<wide_config>>;
+TYPED_TEST_SUITE(DPHeapContractTest, Heaps);
+
+TYPED_TEST(DPHeapContractTest, BlocksAreAlignedAndDisjoint) {
+  std::vector<void *> ptrs;
+  std::vector<size_t> sizes;
+  for (size_t round = 0; round < 4; round++) {
+    for (size_t size : {1, 7, 24, 100, 513, 1000, 2048}) {
+      auto *ptr = static_cast<uint8_t *>(this->heap.allocate(size));
+      ASSERT_NE(ptr, nullptr);
+      ASSERT_EQ(reinterpret_cast<uintptr_t>(ptr) % TypeParam::alignment, 0u);
+      std::memset(ptr, static_cast<int>(ptrs.size()), size);
+      ptrs.push_back(ptr);
+      sizes.push_back(size);
+    }
+  }
+  for (size_t i = 0; i < ptrs.size(); i++) {
+    auto *bytes = static_cast<uint8_t *>(ptrs[i]);
+    ASSERT_TRUE(std::all_of(bytes, bytes + sizes[i],
+                            [i](uint8_t byte) { return byte == static_cast<uint8_t>(i); }))
+        << "block " << i << " was overwritten";
+  }
+  this->free_all(ptrs);
+}
+
+TYPED_TEST(DPHeapContractTest, RejectsZeroAndOversizedRequests) {
+  ASSERT_EQ(this->heap.allocate(0), nullptr);
+  if (TypeParam::maps_large)
+    GTEST_SKIP() << "oversized requests are mapped outside the buffer";
+  ASSERT_EQ(this->heap.allocate(TestFixture::BUFFER_SIZE), nullptr);
+  ASSERT_EQ(this->heap.available(), this->initial_available);
+}
+
+TYPED_TEST(DPHeapContractTest, RejectsRequestsThatWrap) {
+  // Adding the padding to these sizes wraps around, they must not pass for small requests.
+  for (size_t size : {SIZE_MAX, SIZE_MAX - 1, SIZE_MAX - TypeParam::alignment + 1}) {
+    ASSERT_EQ(this->heap.allocate(size), nullptr) << size;
+  }
+  ASSERT_EQ(this->heap.available(), this->initial_available);
+}
+
+TYPED_TEST(DPHeapContractTest, RejectsInvalidFrees) {
+  void *ptr = this->heap.allocate(64);
+  ASSERT_NE(ptr, nullptr);
+  ASSERT_FALSE(this->heap.deallocate(nullptr));
+  alignas(max_align_t) uint8_t elsewhere[256]{};
+  ASSERT_FALSE(this->heap.deallocate(elsewhere + 128));
+  ASSERT_TRUE(this->heap.deallocate(ptr));
+  ASSERT_FALSE(this->heap.deallocate(ptr)); // double free, cached or not.
+}
+
+TYPED_TEST(DPHeapContractTest, ExhaustAndRefill) {
+  std::vector<void *> ptrs;
+  while (void *ptr = this->heap.allocate(48)) {
+    ptrs.push_back(ptr);
+  }
+  ASSERT_GT(ptrs.size(), 100u);
+  this->free_all(ptrs);
+  // Every block coalesced back into one.
+  void *large = this->heap.allocate(TestFixture::BUFFER_SIZE / 2);
+  ASSERT_NE(large, nullptr);
+  ASSERT_TRUE(this->heap.deallocate(large));
+}
+
+TYPED_TEST(DPHeapContractTest, CoalescesBothNeighbours) {
+  if constexpr (TypeParam::maps_large) {
+    SKIP_PAST_HUGE_THRESHOLD(3 * 1000);
+  }
+  void *left = this->heap.allocate(1000);
+  void *middle = this->heap.allocate(1000);
+  void *right = this->heap.allocate(1000);
+  void *guard = this->heap.allocate(16);
+  ASSERT_NE(guard, nullptr);
+  ASSERT_TRUE(this->heap.deallocate(left));
+  ASSERT_TRUE(this->heap.deallocate(right));
+  ASSERT_TRUE(this->heap.deallocate(middle));
+  ASSERT_TRUE(this->heap.check());
+
+  // The merged hole is smaller than the tail and first in the free list, every fit policy
+  // picks it.
+  void *merged = this->heap.allocate(3 * 1000);
+  ASSERT_EQ(merged, left);
+  ASSERT_TRUE(this->heap.deallocate(merged));
+  ASSERT_TRUE(this->heap.deallocate(guard));
+}
+
+TYPED_TEST(DPHeapContractTest, RandomChurnKeepsEveryBlockIntact) {
+  std::mt19937 rng(11);
+  std::uniform_int_distribution<size_t> size_dist(1, 2048);
+  struct live_block {
+    uint8_t *ptr;
+    size_t size;
+    uint8_t fill;
+  };
+  std::vector<live_block> live;
+  for (size_t i = 0; i < 4000; i++) {
+    if (live.empty() || (rng() % 3 != 0 && live.size() < 48)) {
+      size_t size = size_dist(rng);
+      auto *ptr = static_cast<uint8_t *>(this->heap.allocate(size));
+      if (ptr == nullptr)
+        continue; // fragmented, a later free makes room.
+      auto fill = static_cast<uint8_t>(i);
+      std::memset(ptr, fill, size);
+      live.push_back({ptr, size, fill});
+    } else {
+      size_t idx = rng() % live.size();
+      live_block block = live[idx];
+      ASSERT_TRUE(std::all_of(block.ptr, block.ptr + block.size,
+                              [&](uint8_t byte) { return byte == block.fill; }))
+          << "block freed at operation " << i << " was overwritten";
+      ASSERT_TRUE(this->heap.deallocate(block.ptr));
+      live.erase(live.begin() + static_cast<long>(idx));
+    }
+    if (i % 256 == 0) {
+      ASSERT_TRUE(this->heap.check()) << "after operation " << i;
+    }
+  }
+  std::vector<void *> ptrs;
+  for (live_block &block : live) {
+    ptrs.push_back(block.ptr);
+  }
+  this->free_all(ptrs);
+}
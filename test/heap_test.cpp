@@ -0,0 +1,231 @@
+#include <random>
+#include <string>
+
+#include "heap.hpp"
+#include "test_common.hpp"
+
+// Tests for the compile time specialised C++ heap (dp::heap). A heap configured like the
+// C library must place every block where dp_malloc does.
+
+namespace {
+
+struct c_config : dp::default_config {
+  static constexpr size_t alignment = DEFAULT_ALIGN;
+  static constexpr dp::fit fit_policy =
+      dp_config_fit_policy == DP_FIT_BEST ? dp::fit::best : dp::fit::first;
+  static constexpr size_t split_threshold = dp_config_split_threshold;
+  static constexpr size_t probe_limit = dp_config_probe_limit;
+  static constexpr size_t size_classes = DP_SIZE_CLASSES;
+  static constexpr size_t class_cache_depth = dp_config_class_cache_depth;
+  static constexpr bool header_canary = DP_HEADER_CANARY;
+};
+
+struct first_fit_config : dp::default_config {
+  static constexpr dp::fit fit_policy = dp::fit::first;
+};
+
+struct cached_config : dp::default_config {
+  static constexpr size_t size_classes = 8;
+  static constexpr size_t class_cache_depth = 4;
+  static constexpr bool header_canary = true;
+  static constexpr bool stats = true;
+};
+
+struct counting_logger {
+  static inline size_t infos = 0;
+  static inline size_t errors = 0;
+  static void debug(const char *, ...) {}
+  static void info(const char *, ...) { infos++; }
+  static void warning(const char *, ...) {}
+  static void error(const char *, ...) { errors++; }
+};
+
+struct logged_config : dp::default_config {
+  using logger = counting_logger;
+};
+
+struct point {
+  int x;
+  int y;
+  point(int x, int y) : x(x), y(y) {}
+};
+
+} // namespace
+
+template <typename Config> class DPHeapTest : public ::testing::Test {
+protected:
+  static constexpr size_t BUFFER_SIZE = 64 * 1024;
+  alignas(max_align_t) std::array<uint8_t, BUFFER_SIZE> buffer;
+  dp::heap<Config> heap;
+
+  void SetUp() override { ASSERT_TRUE(heap.init(buffer.data(), BUFFER_SIZE)); }
+
+  void TearDown() override {
+    ASSERT_TRUE(heap.check());
+    heap.flush_cache();
+    ASSERT_TRUE(heap.check());
+  }
+};
+
+using Configs = ::testing::Types<dp::default_config, first_fit_config, cached_config, c_config>;
+TYPED_TEST_SUITE(DPHeapTest, Configs);
+
+TYPED_TEST(DPHeapTest, AllocatesAlignedBlocksAndReclaimsThem) {
+  size_t initial = this->heap.available();
+  std::vector<void *> ptrs;
+  for (size_t size : {1, 24, 100, 513, 4000}) {
+    void *ptr = this->heap.allocate(size);
+    ASSERT_NE(ptr, nullptr);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(ptr) % TypeParam::alignment, 0u);
+    ptrs.push_back(ptr);
+  }
+  ASSERT_EQ(this->heap.allocate(0), nullptr);
+  ASSERT_TRUE(this->heap.check());
+  for (void *ptr : ptrs) {
+    ASSERT_TRUE(this->heap.deallocate(ptr));
+  }
+  this->heap.flush_cache();
+  ASSERT_EQ(this->heap.available(), initial);
+}
+
+TYPED_TEST(DPHeapTest, RejectsInvalidFrees) {
+  auto *ptr = static_cast<uint8_t *>(this->heap.allocate(64));
+  ASSERT_FALSE(this->heap.deallocate(nullptr));
+  alignas(max_align_t) uint8_t elsewhere[64]{};
+  ASSERT_FALSE(this->heap.deallocate(elsewhere + 32));
+  ASSERT_TRUE(this->heap.deallocate(ptr));
+  ASSERT_FALSE(this->heap.deallocate(ptr)); // double free, cached or not.
+}
+
+TYPED_TEST(DPHeapTest, MakeConstructsAndDestroyReleases) {
+  point *p = this->heap.template make<point>(3, 4);
+  ASSERT_NE(p, nullptr);
+  ASSERT_EQ(p->x, 3);
+  ASSERT_EQ(p->y, 4);
+  auto *text = this->heap.template make<std::string>(100, 'x');
+  ASSERT_EQ(text->size(), 100u);
+  this->heap.destroy(text);
+  this->heap.destroy(p);
+}
+
+TYPED_TEST(DPHeapTest, ExhaustAndRefill) {
+  std::vector<void *> ptrs;
+  while (void *ptr = this->heap.allocate(48)) {
+    ptrs.push_back(ptr);
+  }
+  ASSERT_GT(ptrs.size(), 100u);
+  for (void *ptr : ptrs) {
+    ASSERT_TRUE(this->heap.deallocate(ptr));
+  }
+  // Needs the cached blocks back in the heap.
+  ASSERT_NE(this->heap.allocate(TestFixture::BUFFER_SIZE / 2), nullptr);
+}
+
+TEST(DPHeapFitTest, FollowsTheFitPolicy) {
+  alignas(max_align_t) std::array<uint8_t, 4096> best_buffer;
+  alignas(max_align_t) std::array<uint8_t, 4096> first_buffer;
+  dp::heap<> best;
+  dp::heap<first_fit_config> first;
+  ASSERT_TRUE(best.init(best_buffer.data(), best_buffer.size()));
+  ASSERT_TRUE(first.init(first_buffer.data(), first_buffer.size()));
+
+  auto holes = [](auto &heap) {
+    // Holes of 256 and 64 bytes, the 64 byte one first in the free list.
+    void *large = heap.allocate(256);
+    void *guard = heap.allocate(16);
+    void *small = heap.allocate(64);
+    void *tail = heap.allocate(16);
+    EXPECT_NE(tail, nullptr);
+    heap.deallocate(large);
+    heap.deallocate(small);
+    (void)guard;
+    return std::pair{large, small};
+  };
+  auto [best_large, best_small] = holes(best);
+  auto [first_large, first_small] = holes(first);
+  ASSERT_EQ(best.allocate(32), best_small);
+  ASSERT_EQ(first.allocate(200), first_large);
+}
+
+TEST(DPHeapCacheTest, CompileTimeClassesShareTheRuntimeCache) {
+  alignas(max_align_t) std::array<uint8_t, 4096> buffer;
+  dp::heap<cached_config> heap;
+  ASSERT_TRUE(heap.init(buffer.data(), buffer.size()));
+
+  point *p = heap.make<point>(1, 2);
+  heap.destroy(p);
+  ASSERT_EQ(heap.cached_blocks(), 1u);
+  ASSERT_EQ(heap.stats().num_free_iterations, 0u); // cached, no coalescing walk.
+  ASSERT_EQ(heap.allocate(sizeof(point)), static_cast<void *>(p));
+  ASSERT_EQ(heap.stats().num_iterations, 0u);
+  ASSERT_TRUE(heap.deallocate(p));
+  ASSERT_EQ(heap.allocate<sizeof(point)>(), static_cast<void *>(p));
+  ASSERT_TRUE(heap.check());
+}
+
+TEST(DPHeapCacheTest, CanaryCatchesCorruptedHeaders) {
+  alignas(max_align_t) std::array<uint8_t, 4096> buffer;
+  dp::heap<cached_config> heap;
+  ASSERT_TRUE(heap.init(buffer.data(), buffer.size()));
+
+  auto *ptr = static_cast<uint8_t *>(heap.allocate(1024));
+  // The size field sits right after the next pointer at the start of the header.
+  auto *size = reinterpret_cast<size_t *>(buffer.data() + sizeof(void *));
+  *size += 16;
+  ASSERT_FALSE(heap.check());
+  ASSERT_FALSE(heap.deallocate(ptr));
+  *size -= 16;
+  ASSERT_TRUE(heap.deallocate(ptr));
+}
+
+TEST(DPHeapLogTest, CallsTheConfiguredLogger) {
+  alignas(max_align_t) std::array<uint8_t, 4096> buffer;
+  dp::heap<logged_config> heap;
+  ASSERT_TRUE(heap.init(buffer.data(), buffer.size()));
+
+  counting_logger::infos = counting_logger::errors = 0;
+  void *ptr = heap.allocate(100);
+  ASSERT_TRUE(heap.deallocate(ptr));
+  ASSERT_FALSE(heap.deallocate(ptr));
+  ASSERT_EQ(counting_logger::infos, 2u);
+  ASSERT_EQ(counting_logger::errors, 1u);
+}
+
+// The free index and out of line metadata place blocks their own way.
+#if !DP_FREE_INDEX && !DP_OUT_OF_LINE_METADATA
+TEST(DPHeapCompatTest, PlacesBlocksLikeTheCLibrary) {
+  constexpr size_t SIZE = 256 * 1024;
+  alignas(max_align_t) static std::array<uint8_t, SIZE> heap_buffer;
+  alignas(max_align_t) static std::array<uint8_t, SIZE> c_buffer;
+  dp::heap<c_config> heap;
+  dp_alloc allocator;
+  ASSERT_TRUE(heap.init(heap_buffer.data(), SIZE));
+  ASSERT_TRUE(dp_init(&allocator, c_buffer.data(),
+                      SIZE IF_DP_LOG(, {.debug = test_debug,
+                                        .info = test_info,
+                                        .warning = test_warning,
+                                        .error = test_error})));
+
+  std::mt19937 rng(7);
+  std::uniform_int_distribution<size_t> size_dist(1, 2048);
+  std::vector<size_t> live; // offsets from the start of the buffers.
+  for (size_t i = 0; i < 5000; i++) {
+    if (live.empty() || (rng() % 3 != 0 && live.size() < 64)) {
+      size_t size = size_dist(rng);
+      auto *ptr = static_cast<uint8_t *>(heap.allocate(size));
+      auto *expected = static_cast<uint8_t *>(dp_malloc(&allocator, size));
+      ASSERT_NE(ptr, nullptr);
+      ASSERT_NE(expected, nullptr);
+      ASSERT_EQ(ptr - heap.buffer(), expected - allocator.buffer) << "after operation " << i;
+      live.push_back(static_cast<size_t>(ptr - heap.buffer()));
+    } else {
+      size_t idx = rng() % live.size();
+      ASSERT_TRUE(heap.deallocate(heap.buffer() + live[idx]));
+      ASSERT_EQ(dp_free(&allocator, allocator.buffer + live[idx]), 0);
+      live.erase(live.begin() + static_cast<long>(idx));
+    }
+    ASSERT_EQ(heap.available(), allocator.available);
+  }
+  ASSERT_TRUE(heap.check());
+}
+#endif
@@ -0,0 +1,164 @@
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "test_common.hpp"
+
+// Tests for dp_realloc and the huge allocation bypass (DP_HUGE_THRESHOLD). The bypass tests
+// only run in builds with it enabled.
+
+class DPHugeTest : public DPHeapFixture<1024 * 1024> {
+protected:
+  void TearDown() override {
+    DPHeapFixture::TearDown();
+    dp_flush_cache(&allocator);
+    ASSERT_EQ(allocator.available, initial_available);
+  }
+
+  static void fill(void *ptr, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      static_cast<uint8_t *>(ptr)[i] = static_cast<uint8_t>(i * 31);
+    }
+  }
+
+  static bool filled(const void *ptr, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      if (static_cast<const uint8_t *>(ptr)[i] != static_cast<uint8_t>(i * 31))
+        return false;
+    }
+    return true;
+  }
+};
+
+TEST_F(DPHugeTest, ReallocKeepsTheContents) {
+  void *ptr = dp_realloc(&allocator, nullptr, 100);
+  ASSERT_NE(ptr, nullptr);
+  ASSERT_GE(dp_usable_size(&allocator, ptr), 100u);
+  fill(ptr, 100);
+
+  // Shrinking, or growing within the block, keeps it in place.
+  ASSERT_EQ(dp_realloc(&allocator, ptr, 10), ptr);
+  ASSERT_EQ(dp_realloc(&allocator, ptr, dp_usable_size(&allocator, ptr)), ptr);
+
+  void *grown = dp_realloc(&allocator, ptr, 4000);
+  ASSERT_NE(grown, nullptr);
+  ASSERT_TRUE(filled(grown, 100));
+  ASSERT_EQ(dp_usable_size(&allocator, ptr), 0u); // freed, or cached by DP_SIZE_CLASSES.
+  ASSERT_EQ(dp_realloc(&allocator, grown, 0), nullptr);
+}
+
+TEST_F(DPHugeTest, ReallocRejectsInvalidPointers) {
+  void *ptr = dp_malloc(&allocator, 64);
+  ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  ASSERT_EQ(dp_usable_size(&allocator, ptr), 0u);
+  ASSERT_EQ(dp_realloc(&allocator, ptr, 128), nullptr);
+  ASSERT_EQ(dp_usable_size(&allocator, nullptr), 0u);
+}
+
+#if DP_HUGE_THRESHOLD
+static constexpr size_t HUGE_SIZE = DP_HUGE_THRESHOLD + 1;
+
+TEST_F(DPHugeTest, HugeBlocksBypassTheBuffer) {
+  auto *ptr = static_cast<uint8_t *>(dp_malloc(&allocator, HUGE_SIZE));
+  ASSERT_NE(ptr, nullptr);
+  ASSERT_EQ(allocator.available, initial_available);
+  ASSERT_EQ(allocator.huge_count, 1u);
+  ASSERT_GE(allocator.huge_bytes, HUGE_SIZE);
+  ASSERT_EQ(dp_usable_size(&allocator, ptr), allocator.huge_bytes);
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(ptr) % DEFAULT_ALIGN, 0u);
+  fill(ptr, HUGE_SIZE);
+
+  ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  ASSERT_EQ(allocator.huge_count, 0u);
+  ASSERT_EQ(allocator.huge_bytes, 0u);
+  ASSERT_EQ(dp_free(&allocator, ptr), 1);
+  alignas(max_align_t) uint8_t elsewhere[64];
+  ASSERT_EQ(dp_free(&allocator, elsewhere + 16), 1);
+}
+
+TEST_F(DPHugeTest, ReallocRemapsHugeBlocks) {
+  void *ptr = dp_malloc(&allocator, HUGE_SIZE);
+  fill(ptr, HUGE_SIZE);
+  void *grown = dp_realloc(&allocator, ptr, 4 * HUGE_SIZE);
+  ASSERT_NE(grown, nullptr);
+  ASSERT_TRUE(filled(grown, HUGE_SIZE));
+  ASSERT_EQ(allocator.huge_count, 1u);
+  ASSERT_GE(allocator.huge_bytes, 4 * HUGE_SIZE);
+  ASSERT_EQ(allocator.available, initial_available);
+
+  // Below the threshold it moves into the buffer.
+  void *shrunk = dp_realloc(&allocator, grown, 100);
+  ASSERT_GT(static_cast<uint8_t *>(shrunk), allocator.buffer);
+  ASSERT_LT(static_cast<uint8_t *>(shrunk), allocator.buffer + allocator.buffer_size);
+  ASSERT_TRUE(filled(shrunk, 100));
+  ASSERT_EQ(allocator.huge_count, 0u);
+
+  // And out of it past the threshold.
+  void *regrown = dp_realloc(&allocator, shrunk, HUGE_SIZE);
+  ASSERT_EQ(allocator.huge_count, 1u);
+  ASSERT_TRUE(filled(regrown, 100));
+  ASSERT_EQ(dp_free(&allocator, regrown), 0);
+}
+
+TEST_F(DPHugeTest, FullTableFallsBackToTheBuffer) {
+  if (HUGE_SIZE * 2 > initial_available)
+    GTEST_SKIP() << "the buffer can't hold a huge block";
+  std::vector<void *> ptrs;
+  for (size_t i = 0; i < DP_HUGE_SLOTS; i++) {
+    ptrs.push_back(dp_malloc(&allocator, HUGE_SIZE));
+  }
+  ASSERT_EQ(allocator.huge_count, static_cast<size_t>(DP_HUGE_SLOTS));
+  auto *overflow = static_cast<uint8_t *>(dp_malloc(&allocator, HUGE_SIZE));
+  ASSERT_GT(overflow, allocator.buffer);
+  ASSERT_LT(overflow, allocator.buffer + allocator.buffer_size);
+  ASSERT_EQ(dp_free(&allocator, overflow), 0);
+  for (void *ptr : ptrs) {
+    ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  }
+  ASSERT_EQ(allocator.huge_bytes, 0u);
+}
+
+// The kernel may place a huge block's mapping right after a mapped buffer, its user pointer
+// is then buffer + buffer_size and the byte in front of it is the buffer's last.
+TEST(DPHugeMappingTest, HugeBlockRightAfterTheBuffer) {
+  size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t heap_size = 16 * page;
+  size_t huge_length = align_up(HUGE_SIZE, page);
+  void *region = mmap(nullptr, heap_size + huge_length, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  ASSERT_NE(region, MAP_FAILED);
+  std::memset(region, 0xFF, heap_size); // the last byte, read as an offset, points far off.
+  dp_alloc allocator;
+  ASSERT_TRUE(dp_init(&allocator, region,
+                      heap_size IF_DP_LOG(, {.debug = test_debug,
+                                             .info = test_info,
+                                             .warning = test_warning,
+                                             .error = test_error})));
+  uint8_t *end = allocator.buffer + allocator.buffer_size;
+  if (reinterpret_cast<uintptr_t>(end) % page != 0) {
+    munmap(region, heap_size + huge_length);
+    GTEST_SKIP() << "the buffer doesn't end on a page";
+  }
+
+  // Move a huge block's mapping to the end of the buffer.
+  void *ptr = dp_malloc(&allocator, HUGE_SIZE);
+  ASSERT_NE(ptr, nullptr);
+  ASSERT_EQ(allocator.huge_count, 1u);
+  ASSERT_EQ(mremap(ptr, huge_length, huge_length, MREMAP_MAYMOVE | MREMAP_FIXED, end), end);
+  allocator.huge_blocks[0].ptr = end;
+
+  ASSERT_EQ(dp_usable_size(&allocator, end), huge_length);
+  ASSERT_EQ(dp_free(&allocator, end), 0);
+  ASSERT_EQ(allocator.huge_count, 0u);
+  ASSERT_EQ(dp_check(&allocator), 0);
+  munmap(region, heap_size);
+}
+#else
+TEST_F(DPHugeTest, FailedReallocLeavesTheBlock) {
+  void *ptr = dp_malloc(&allocator, 64);
+  fill(ptr, 64);
+  ASSERT_EQ(dp_realloc(&allocator, ptr, 2 * BUFFER_SIZE), nullptr);
+  ASSERT_TRUE(filled(ptr, 64));
+  ASSERT_EQ(dp_free(&allocator, ptr), 0);
+}
+#endif
@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <vector>
+
+#include "test_common.hpp"
+
+// Tests for dp_malloc_hint.
+
+class DPLifetimeTest : public DPHeapFixture<32 * LAYOUT_BLOCK> {
+protected:
+  static constexpr size_t BLOCK_SIZE = LAYOUT_BLOCK;
+
+  uintptr_t address(void *ptr) { return reinterpret_cast<uintptr_t>(ptr); }
+
+  // Allocates the rest of the heap in blocks of at most BLOCK_SIZE.
+  std::vector<void *> fill() {
+    std::vector<void *> blocks;
+    while (void *ptr = dp_malloc(&allocator, BLOCK_SIZE)) {
+      blocks.push_back(ptr);
+    }
+    size_t rest = dp_largest_free(&allocator);
+    if (rest > 2 * DEFAULT_ALIGN) {
+      blocks.push_back(dp_malloc(&allocator, rest - 2 * DEFAULT_ALIGN));
+      EXPECT_NE(blocks.back(), nullptr);
+    }
+    return blocks;
+  }
+};
+
+TEST_F(DPLifetimeTest, SeparatesLifetimes) {
+  uintptr_t middle = address(buffer.data()) + BUFFER_SIZE / 2;
+  std::vector<void *> long_blocks;
+  std::vector<void *> short_blocks;
+  for (int i = 0; i < 4; i++) {
+    long_blocks.push_back(dp_malloc_hint(&allocator, BLOCK_SIZE, DP_LIFETIME_LONG));
+    short_blocks.push_back(dp_malloc_hint(&allocator, BLOCK_SIZE, DP_LIFETIME_SHORT));
+    ASSERT_NE(long_blocks.back(), nullptr);
+    ASSERT_NE(short_blocks.back(), nullptr);
+  }
+  // Long lived blocks grow up from the start of the buffer, short lived ones down from its end.
+  for (size_t i = 0; i < long_blocks.size(); i++) {
+    ASSERT_LT(address(long_blocks[i]), middle);
+    ASSERT_GT(address(short_blocks[i]), middle);
+    ASSERT_LE(address(short_blocks[i]) + BLOCK_SIZE, address(buffer.data()) + BUFFER_SIZE);
+    if (i > 0) {
+      ASSERT_GT(address(long_blocks[i]), address(long_blocks[i - 1]));
+      ASSERT_LT(address(short_blocks[i]), address(short_blocks[i - 1]));
+    }
+  }
+  ASSERT_EQ(dp_check(&allocator), 0);
+
+  // Freeing the short lived blocks leaves one free block behind the long lived ones.
+  for (void *ptr : short_blocks) {
+    std::fill_n(static_cast<uint8_t *>(ptr), BLOCK_SIZE, 0xAB);
+    ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  }
+  dp_flush_cache(&allocator);
+  ASSERT_EQ(dp_largest_free(&allocator), allocator.available);
+
+  for (void *ptr : long_blocks) {
+    ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  }
+  dp_flush_cache(&allocator);
+  ASSERT_EQ(dp_largest_free(&allocator), allocator.available);
+}
+
+TEST_F(DPLifetimeTest, ShortLivedBlocksTakeTheHighestHole) {
+  // Holes of two blocks low and high in the buffer, between live separators.
+  std::vector<void *> low = malloc_pieces(&allocator, 2 * BLOCK_SIZE, BLOCK_SIZE);
+  void *low_separator = dp_malloc(&allocator, BLOCK_SIZE);
+  std::vector<void *> filler = malloc_pieces(&allocator, BUFFER_SIZE / 2, BLOCK_SIZE);
+  std::vector<void *> high = malloc_pieces(&allocator, 2 * BLOCK_SIZE, BLOCK_SIZE);
+  void *high_separator = dp_malloc(&allocator, BLOCK_SIZE);
+  ASSERT_NE(high_separator, nullptr);
+  std::vector<void *> tail = fill();
+  for (void *ptr : low) {
+    ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  }
+  for (void *ptr : high) {
+    ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  }
+
+  // The short lived block goes to the end of the high hole, the long lived one to the start
+  // of the low hole.
+  void *short_block = dp_malloc_hint(&allocator, BLOCK_SIZE / 2, DP_LIFETIME_SHORT);
+  void *long_block = dp_malloc_hint(&allocator, BLOCK_SIZE / 2, DP_LIFETIME_LONG);
+  ASSERT_GT(address(short_block), address(high.front()));
+  ASSERT_LT(address(short_block), address(high_separator));
+  ASSERT_EQ(long_block, low.front());
+  ASSERT_EQ(dp_check(&allocator), 0);
+
+  for (void *ptr : {short_block, long_block, low_separator, high_separator}) {
+    ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  }
+  for (void *ptr : filler) {
+    ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  }
+  for (void *ptr : tail) {
+    ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  }
+  dp_flush_cache(&allocator);
+  ASSERT_EQ(dp_largest_free(&allocator), allocator.available);
+}
+
+TEST_F(DPLifetimeTest, FillsWhatDpMallocWould) {
+  // A block too large to leave a free remainder takes its whole free block, either way. The
+  // free block is a hole in an otherwise full heap.
+  std::vector<void *> blocks = fill();
+  ASSERT_GE(blocks.size(), 3u);
+  ASSERT_EQ(dp_free(&allocator, blocks[1]), 0);
+  blocks.erase(blocks.begin() + 1);
+  size_t size = dp_largest_free(&allocator) - 2 * DEFAULT_ALIGN;
+  for (dp_lifetime lifetime : {DP_LIFETIME_SHORT, DP_LIFETIME_LONG}) {
+    void *ptr = dp_malloc_hint(&allocator, size, lifetime);
+    ASSERT_NE(ptr, nullptr);
+    ASSERT_EQ(dp_malloc_hint(&allocator, BLOCK_SIZE, lifetime), nullptr);
+    ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  }
+  ASSERT_EQ(dp_malloc_hint(&allocator, in_buffer_size(BUFFER_SIZE), DP_LIFETIME_LONG), nullptr);
+  ASSERT_EQ(dp_malloc_hint(nullptr, BLOCK_SIZE, DP_LIFETIME_LONG), nullptr);
+  for (void *ptr : blocks) {
+    ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  }
+}
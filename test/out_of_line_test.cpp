@@ -0,0 +1,140 @@
+#include <cstring>
+#include <random>
+
+#include "test_common.hpp"
+
+// Tests for out of line metadata (DP_OUT_OF_LINE_METADATA), which replaces block headers
+// with bitmaps at the front of the buffer. They only run in builds with the mode enabled,
+// the rest of the suite covers inline headers.
+
+#if DP_OUT_OF_LINE_METADATA
+class DPOutOfLineTest : public DPHeapFixture<1024 * 1024> {};
+
+TEST_F(DPOutOfLineTest, SideTableIsAtTheFront) {
+  ASSERT_EQ(allocator.free_list_head, nullptr);
+  auto *block_starts = reinterpret_cast<uint8_t *>(allocator.block_starts.levels[0]);
+  auto *free_starts = reinterpret_cast<uint8_t *>(allocator.free_starts.levels[0]);
+  ASSERT_EQ(block_starts, buffer.data());
+  ASSERT_GT(free_starts, block_starts);
+  ASSERT_GE(allocator.data, free_starts);
+  ASSERT_LE(allocator.data + allocator.granules * DEFAULT_ALIGN, buffer.data() + BUFFER_SIZE);
+  ASSERT_EQ(allocator.available, allocator.granules * DEFAULT_ALIGN);
+  // Two bits per granule, the data keeps all but a few percent of the buffer.
+  ASSERT_GE(allocator.available, BUFFER_SIZE - BUFFER_SIZE / 16);
+}
+
+TEST_F(DPOutOfLineTest, PowerOfTwoBlocksArePackedBackToBack) {
+  constexpr size_t SIZE = 64;
+  std::vector<void *> ptrs;
+  while (void *ptr = dp_malloc(&allocator, SIZE)) {
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(ptr) % DEFAULT_ALIGN, 0u);
+    if (!ptrs.empty()) {
+      ASSERT_EQ(static_cast<uint8_t *>(ptr), static_cast<uint8_t *>(ptrs.back()) + SIZE);
+    }
+    ptrs.push_back(ptr);
+  }
+  ASSERT_EQ(ptrs.size(), allocator.granules * DEFAULT_ALIGN / SIZE);
+  ASSERT_LT(allocator.available, SIZE);
+
+  for (void *ptr : ptrs) {
+    ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  }
+  ASSERT_EQ(allocator.available, allocator.granules * DEFAULT_ALIGN);
+}
+
+TEST_F(DPOutOfLineTest, OverflowDoesNotReachMetadata) {
+  auto *a = static_cast<uint8_t *>(dp_malloc(&allocator, 64));
+  auto *b = static_cast<uint8_t *>(dp_malloc(&allocator, 64));
+  ASSERT_EQ(b, a + 64);
+
+  // Running off the end of a only clobbers b's data, both blocks stay intact.
+  std::memset(a, 0xFF, 96);
+  ASSERT_EQ(dp_check(&allocator), 0);
+  ASSERT_EQ(dp_free(&allocator, a), 0);
+  ASSERT_EQ(dp_free(&allocator, b), 0);
+}
+
+TEST_F(DPOutOfLineTest, CoalescesBothNeighbours) {
+  void *a = dp_malloc(&allocator, 100);
+  void *b = dp_malloc(&allocator, 200);
+  void *c = dp_malloc(&allocator, 300);
+  void *d = dp_malloc(&allocator, 16);
+  ASSERT_NE(d, nullptr);
+
+  ASSERT_EQ(dp_free(&allocator, a), 0);
+  ASSERT_EQ(dp_free(&allocator, c), 0);
+  ASSERT_EQ(dp_check(&allocator), 0);
+  ASSERT_EQ(dp_free(&allocator, b), 0);
+
+  // a, b and c merged back into a single block.
+  ASSERT_EQ(dp_malloc(&allocator, align_up(100, DEFAULT_ALIGN) + align_up(200, DEFAULT_ALIGN) +
+                                      align_up(300, DEFAULT_ALIGN)),
+            a);
+}
+
+TEST_F(DPOutOfLineTest, FindsBlocksAcrossSummaryWords) {
+  // Spans more than 64 level 0 words, so both neighbours of the last block are only found
+  // through the summaries.
+  size_t span = 100 * 64 * DEFAULT_ALIGN;
+  ASSERT_LT(2 * span, allocator.available);
+  void *first = dp_malloc(&allocator, span);
+  void *second = dp_malloc(&allocator, span);
+  void *last = dp_malloc(&allocator, DEFAULT_ALIGN);
+  ASSERT_NE(last, nullptr);
+
+  ASSERT_EQ(dp_free(&allocator, second), 0);
+  ASSERT_EQ(dp_free(&allocator, last), 0);
+  ASSERT_EQ(dp_free(&allocator, first), 0);
+  ASSERT_EQ(allocator.available, allocator.granules * DEFAULT_ALIGN);
+  ASSERT_EQ(dp_malloc(&allocator, allocator.available), first);
+}
+
+TEST_F(DPOutOfLineTest, FollowsTheFitPolicy) {
+  // Holes of 256, 64 and 128 bytes, each followed by a live block.
+  std::vector<void *> holes;
+  std::vector<void *> live;
+  for (size_t size : {256, 64, 128}) {
+    holes.push_back(dp_malloc(&allocator, size));
+    live.push_back(dp_malloc(&allocator, 16));
+  }
+  for (void *hole : holes) {
+    ASSERT_EQ(dp_free(&allocator, hole), 0);
+  }
+
+  void *expected = dp_config_fit_policy == DP_FIT_BEST ? holes[2] : holes[0];
+  ASSERT_EQ(dp_malloc(&allocator, 100), expected);
+}
+
+TEST_F(DPOutOfLineTest, InvalidFrees) {
+  auto *ptr = static_cast<uint8_t *>(dp_malloc(&allocator, 3 * DEFAULT_ALIGN));
+  ASSERT_NE(ptr, nullptr);
+
+  ASSERT_EQ(dp_free(&allocator, nullptr), 1);
+  ASSERT_EQ(dp_free(&allocator, ptr + 1), 1);
+  ASSERT_EQ(dp_free(&allocator, ptr + DEFAULT_ALIGN), 1); // inside the allocation.
+  ASSERT_EQ(dp_free(&allocator, buffer.data()), 1);       // the side table.
+  ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  ASSERT_EQ(dp_free(&allocator, ptr), 1); // double free.
+}
+
+TEST_F(DPOutOfLineTest, RandomWorkloadStaysConsistent) {
+  std::mt19937 rng(99);
+  std::uniform_int_distribution<size_t> size_dist(1, 512);
+  std::vector<void *> live;
+  for (size_t i = 0; i < 4000; i++) {
+    if (live.empty() || rng() % 2 == 0) {
+      if (void *ptr = dp_malloc(&allocator, size_dist(rng)))
+        live.push_back(ptr);
+    } else {
+      size_t idx = rng() % live.size();
+      ASSERT_EQ(dp_free(&allocator, live[idx]), 0);
+      live.erase(live.begin() + static_cast<long>(idx));
+    }
+    ASSERT_EQ(dp_check(&allocator), 0) << "after operation " << i;
+  }
+  for (void *ptr : live) {
+    ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  }
+  ASSERT_EQ(allocator.available, allocator.granules * DEFAULT_ALIGN);
+}
+#endif
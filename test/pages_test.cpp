@@ -0,0 +1,93 @@
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+#include "pages.h"
+#include "test_common.hpp"
+
+// Tests for the page backed buffer provider. Which kinds the system can give depends on its
+// hugetlbfs pool and transparent huge page settings, so the tests only hold each mapping to
+// what it reports.
+
+class DPPagesTest : public ::testing::TestWithParam<dp_page_kind> {};
+
+TEST_P(DPPagesTest, MapsNoLargerThanAsked) {
+  constexpr size_t SIZE = 3 * 1024 * 1024 + 100;
+  dp_pages pages;
+  ASSERT_TRUE(dp_pages_map(&pages, SIZE, GetParam()));
+  ASSERT_GE(pages.kind, GetParam()); // kinds run from largest to smallest.
+  ASSERT_GE(pages.size, SIZE);
+  if (pages.kind != DP_PAGES_SMALL) {
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(pages.data) % DP_HUGE_PAGE_SIZE, 0u);
+    ASSERT_EQ(pages.size % DP_HUGE_PAGE_SIZE, 0u);
+  }
+  auto *bytes = static_cast<uint8_t *>(pages.data);
+  bytes[0] = 1;
+  bytes[pages.size - 1] = 1;
+  dp_pages_unmap(&pages);
+  ASSERT_EQ(pages.data, nullptr);
+  dp_pages_unmap(&pages); // already unmapped.
+}
+
+TEST_P(DPPagesTest, HostsAHeap) {
+  dp_alloc allocator;
+  dp_pages pages;
+  ASSERT_TRUE(dp_init_pages(&allocator, &pages, 4 * 1024 * 1024, GetParam(),
+                            nullptr IF_DP_LOG(, {.debug = test_debug,
+                                                 .info = test_info,
+                                                 .warning = test_warning,
+                                                 .error = test_error})));
+  ASSERT_EQ(allocator.buffer, pages.data);
+  void *ptr = dp_malloc(&allocator, 1024 * 1024);
+  ASSERT_NE(ptr, nullptr);
+  ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  ASSERT_EQ(dp_check(&allocator), 0);
+  dp_pages_unmap(&pages);
+}
+
+TEST_P(DPPagesTest, WarmsUpEveryPage) {
+  constexpr size_t SIZE = 6 * 1024 * 1024;
+  dp_pages pages;
+  ASSERT_TRUE(dp_pages_map(&pages, SIZE, GetParam()));
+  // Thread counts past the CPUs and DP_WARM_MAX_THREADS are clamped.
+  for (size_t threads : {size_t{0}, size_t{1}, size_t{3}, size_t{64}, SIZE_MAX}) {
+    ASSERT_TRUE(dp_pages_warm(&pages, {.threads = threads, .lock = false}));
+  }
+  // Resident after the warm up, a fault would leave mincore reporting the page missing.
+  size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  std::vector<unsigned char> resident(pages.size / page);
+  ASSERT_EQ(mincore(pages.data, pages.size, resident.data()), 0);
+  for (unsigned char flags : resident) {
+    ASSERT_TRUE(flags & 1);
+  }
+  dp_pages_unmap(&pages);
+}
+
+TEST_P(DPPagesTest, HostsAWarmHeap) {
+  dp_alloc allocator;
+  dp_pages pages;
+  // The lock is within RLIMIT_MEMLOCK's usual 8MiB, a failed lock still leaves a heap.
+  dp_warm_up warm_up = {.threads = 2, .lock = true};
+  ASSERT_TRUE(dp_init_pages(&allocator, &pages, 2 * 1024 * 1024, GetParam(),
+                            &warm_up IF_DP_LOG(, {.debug = test_debug,
+                                                  .info = test_info,
+                                                  .warning = test_warning,
+                                                  .error = test_error})));
+  void *ptr = dp_malloc(&allocator, 1024 * 1024);
+  ASSERT_NE(ptr, nullptr);
+  ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  ASSERT_EQ(dp_check(&allocator), 0);
+  dp_pages_unmap(&pages);
+}
+
+INSTANTIATE_TEST_SUITE_P(Kinds, DPPagesTest,
+                         ::testing::Values(DP_PAGES_HUGETLB, DP_PAGES_TRANSPARENT, DP_PAGES_SMALL));
+
+TEST(DPPagesArgsTest, RejectsEmptyMappings) {
+  dp_pages pages;
+  ASSERT_FALSE(dp_pages_map(&pages, 0, DP_PAGES_SMALL));
+  ASSERT_FALSE(dp_pages_map(nullptr, 4096, DP_PAGES_SMALL));
+  ASSERT_FALSE(dp_pages_warm(nullptr, {.threads = 1, .lock = false}));
+  pages.data = nullptr;
+  ASSERT_FALSE(dp_pages_warm(&pages, {.threads = 1, .lock = false}));
+}
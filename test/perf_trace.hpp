@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Allocation traces for the performance regression corpus (test/perf_corpus).
+//
+// A trace is a text file with one operation per line:
+//   a <size>   allocate size bytes, the result is appended to the live list.
+//   f <index>  free live[index % live.size()] and remove it from the live list.
+// Failed allocations are not added to the live list and frees with no live blocks
+// are ignored, so any sequence of operations is a valid trace.
+
+struct PerfOp {
+  bool is_alloc;
+  size_t value;
+};
+
+using PerfTrace = std::vector<PerfOp>;
+
+inline bool read_perf_trace(const std::filesystem::path &path, PerfTrace &trace) {
+  std::ifstream in(path);
+  if (!in)
+    return false;
+
+  trace.clear();
+  char kind;
+  size_t value;
+  while (in >> kind >> value) {
+    if (kind != 'a' && kind != 'f')
+      return false;
+    trace.push_back({kind == 'a', value});
+  }
+  return in.eof();
+}
+
+inline bool write_perf_trace(const std::filesystem::path &path, const PerfTrace &trace) {
+  std::ofstream out(path);
+  for (const PerfOp &op : trace) {
+    out << (op.is_alloc ? 'a' : 'f') << ' ' << op.value << '\n';
+  }
+  return static_cast<bool>(out);
+}
+
+// Sorted *.trace files in dir, empty if the directory doesn't exist.
+inline std::vector<std::filesystem::path> perf_corpus_files(const std::filesystem::path &dir) {
+  std::vector<std::filesystem::path> files;
+  std::error_code error;
+  for (const auto &entry : std::filesystem::directory_iterator(dir, error)) {
+    if (entry.path().extension() == ".trace")
+      files.push_back(entry.path());
+  }
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+// Runs the trace through alloc(size) -> void * and free(void *), calling
+// after_op(op, ptr) after every operation that reached the allocator, with the returned
+// (possibly null) or freed pointer. Returns the blocks still live.
+template <typename Alloc, typename Free, typename AfterOp>
+std::vector<void *> run_perf_trace(const PerfTrace &trace, Alloc &&alloc, Free &&free,
+                                   AfterOp &&after_op) {
+  std::vector<void *> live;
+  for (const PerfOp &op : trace) {
+    if (op.is_alloc) {
+      void *ptr = alloc(op.value);
+      if (ptr)
+        live.push_back(ptr);
+      after_op(op, ptr);
+    } else if (!live.empty()) {
+      size_t idx = op.value % live.size();
+      void *ptr = live[idx];
+      free(ptr);
+      live.erase(live.begin() + static_cast<long>(idx));
+      after_op(op, ptr);
+    }
+  }
+  return live;
+}
@@ -0,0 +1,156 @@
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "test_common.hpp"
+
+// Tests for the global arena registry: dp_register, dp_unregister, dp_owner, dp_free_any. They
+// only run in builds with it enabled (DP_REGISTRY).
+
+#if DP_REGISTRY
+
+class DPRegistryTest : public ::testing::Test {
+protected:
+  static constexpr size_t ARENA_COUNT = 3;
+  // Smaller than a page, so neighbouring arenas share pages.
+  static constexpr size_t SMALL_ARENA_SIZE = 1000;
+  static constexpr size_t LARGE_ARENA_SIZE = 1 << 20;
+
+  std::unique_ptr<uint8_t[]> small_buffer =
+      std::make_unique<uint8_t[]>(SMALL_ARENA_SIZE * ARENA_COUNT);
+  std::unique_ptr<uint8_t[]> large_buffer = std::make_unique<uint8_t[]>(LARGE_ARENA_SIZE);
+  dp_alloc small[ARENA_COUNT];
+  dp_alloc large;
+
+  void SetUp() override {
+    for (size_t i = 0; i < ARENA_COUNT; i++) {
+      init(small[i], small_buffer.get() + i * SMALL_ARENA_SIZE, SMALL_ARENA_SIZE);
+    }
+    init(large, large_buffer.get(), LARGE_ARENA_SIZE);
+  }
+
+  void TearDown() override {
+    for (dp_alloc &arena : small) {
+      dp_unregister(&arena);
+    }
+    dp_unregister(&large);
+  }
+
+  static void init(dp_alloc &arena, uint8_t *buffer, size_t size) {
+    ASSERT_TRUE(dp_init(&arena, buffer,
+                        size IF_DP_LOG(, {.debug = test_debug,
+                                          .info = test_info,
+                                          .warning = test_warning,
+                                          .error = test_error})));
+  }
+};
+
+TEST_F(DPRegistryTest, UnregisteredPointerHasNoOwner) {
+  void *ptr = dp_malloc(&large, 64);
+  ASSERT_NE(ptr, nullptr);
+  ASSERT_EQ(dp_owner(ptr), nullptr);
+  ASSERT_EQ(dp_free_any(ptr), 1);
+  ASSERT_EQ(dp_free(&large, ptr), 0);
+}
+
+TEST_F(DPRegistryTest, OwnerOfEveryArena) {
+  for (dp_alloc &arena : small) {
+    ASSERT_TRUE(dp_register(&arena));
+  }
+  ASSERT_TRUE(dp_register(&large));
+
+  for (dp_alloc &arena : small) {
+    void *ptr = dp_malloc(&arena, 32);
+    ASSERT_NE(ptr, nullptr);
+    ASSERT_EQ(dp_owner(ptr), &arena);
+    ASSERT_EQ(dp_owner(arena.buffer), &arena);
+    ASSERT_EQ(dp_owner(arena.buffer + arena.buffer_size - 1), &arena);
+    ASSERT_EQ(dp_free_any(ptr), 0);
+  }
+
+  // Pointers deep inside the large arena, on pages it doesn't share. Blocks past
+  // DP_HUGE_THRESHOLD would be mapped outside it.
+  size_t deep = LARGE_ARENA_SIZE / 2;
+  if (DP_HUGE_THRESHOLD != 0 && DP_HUGE_THRESHOLD < deep)
+    deep = DP_HUGE_THRESHOLD;
+  void *first = dp_malloc(&large, deep);
+  void *second = dp_malloc(&large, 64);
+  ASSERT_NE(first, nullptr);
+  ASSERT_NE(second, nullptr);
+  ASSERT_EQ(dp_owner(second), &large);
+  ASSERT_EQ(dp_free_any(second), 0);
+  ASSERT_EQ(dp_free_any(first), 0);
+  ASSERT_EQ(dp_check(&large), 0);
+}
+
+TEST_F(DPRegistryTest, RegisterTwice) {
+  ASSERT_TRUE(dp_register(&small[0]));
+  ASSERT_TRUE(dp_register(&small[0]));
+  ASSERT_TRUE(dp_register(&small[1]));
+  ASSERT_EQ(dp_owner(small[0].buffer), &small[0]);
+  ASSERT_EQ(dp_owner(small[1].buffer), &small[1]);
+}
+
+TEST_F(DPRegistryTest, UnregisterKeepsNeighbours) {
+  for (dp_alloc &arena : small) {
+    ASSERT_TRUE(dp_register(&arena));
+  }
+
+  dp_unregister(&small[1]);
+  ASSERT_EQ(dp_owner(small[1].buffer), nullptr);
+  ASSERT_EQ(dp_owner(small[0].buffer), &small[0]);
+  ASSERT_EQ(dp_owner(small[0].buffer + small[0].buffer_size - 1), &small[0]);
+  ASSERT_EQ(dp_owner(small[2].buffer), &small[2]);
+
+  dp_unregister(&small[0]);
+  ASSERT_EQ(dp_owner(small[0].buffer), nullptr);
+  ASSERT_EQ(dp_owner(small[2].buffer), &small[2]);
+
+  // Unregistering an arena that isn't registered is a no-op.
+  dp_unregister(&small[0]);
+  ASSERT_EQ(dp_owner(small[2].buffer), &small[2]);
+}
+
+TEST_F(DPRegistryTest, NullArguments) {
+  ASSERT_FALSE(dp_register(nullptr));
+  dp_unregister(nullptr);
+  ASSERT_EQ(dp_owner(nullptr), nullptr);
+  ASSERT_EQ(dp_free_any(nullptr), 1);
+}
+
+// Lookups run lock-free alongside registration, arenas that stay registered are always found
+// even while a neighbour on their pages comes and goes.
+TEST_F(DPRegistryTest, LookupsDuringRegistration) {
+  ASSERT_TRUE(dp_register(&small[0]));
+  ASSERT_TRUE(dp_register(&small[2]));
+
+  std::atomic<bool> done = false;
+  std::vector<std::thread> readers;
+  std::atomic<size_t> misses = 0;
+  for (int i = 0; i < 3; i++) {
+    readers.emplace_back([&] {
+      while (!done.load()) {
+        if (dp_owner(small[0].buffer + small[0].buffer_size - 1) != &small[0])
+          misses++;
+        if (dp_owner(small[2].buffer) != &small[2])
+          misses++;
+        dp_alloc *middle = dp_owner(small[1].buffer);
+        if (middle != nullptr && middle != &small[1])
+          misses++;
+      }
+    });
+  }
+
+  for (int i = 0; i < 10000; i++) {
+    ASSERT_TRUE(dp_register(&small[1]));
+    dp_unregister(&small[1]);
+  }
+  done = true;
+  for (std::thread &reader : readers) {
+    reader.join();
+  }
+  ASSERT_EQ(misses, 0);
+  ASSERT_EQ(dp_owner(small[1].buffer), nullptr);
+}
+#endif
@@ -0,0 +1,134 @@
+#include <cstring>
+
+#include "allocator_inline.h"
+#include "test_common.hpp"
+
+// Tests for the size class cache (DP_SIZE_CLASSES) and the inline fast path. The cache tests
+// only run in builds with the cache enabled, without it the inline functions must behave
+// exactly like dp_malloc and dp_free.
+
+class DPSizeClassTest : public DPHeapFixture<64 * 1024> {
+protected:
+  void TearDown() override {
+    DPHeapFixture::TearDown();
+    dp_flush_cache(&allocator);
+    ASSERT_EQ(dp_check(&allocator), 0);
+  }
+};
+
+TEST_F(DPSizeClassTest, InlinePathMatchesOutOfLine) {
+  std::vector<void *> ptrs;
+  for (size_t size : {1, 16, 48, 100, 1000, 5000}) {
+    auto *ptr = static_cast<uint8_t *>(dp_malloc_inline(&allocator, size));
+    ASSERT_NE(ptr, nullptr);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(ptr) % DEFAULT_ALIGN, 0u);
+    ptrs.push_back(ptr);
+  }
+  ASSERT_EQ(dp_malloc_inline(&allocator, 0), nullptr);
+
+  // Either side frees what the other allocated.
+  for (size_t i = 0; i < ptrs.size(); i++) {
+    ASSERT_EQ(i % 2 ? dp_free_inline(&allocator, ptrs[i]) : dp_free(&allocator, ptrs[i]), 0);
+  }
+  ASSERT_EQ(dp_free(&allocator, nullptr), 1);
+  size_t flushed = dp_flush_cache(&allocator);
+  ASSERT_LE(flushed, DP_SIZE_CLASSES ? ptrs.size() : 0u);
+  ASSERT_EQ(allocator.available, initial_available);
+}
+
+#if DP_SIZE_CLASSES
+TEST_F(DPSizeClassTest, FreedBlocksAreReusedWithinTheirClass) {
+  void *ptr = dp_malloc(&allocator, 3 * DEFAULT_ALIGN);
+  size_t available = allocator.available;
+  ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  ASSERT_EQ(allocator.available, available); // still allocated while cached.
+  ASSERT_EQ(allocator.class_count[2], 1u);
+
+  // Any request of the class gets it back, smaller classes don't.
+  ASSERT_NE(dp_malloc(&allocator, 2 * DEFAULT_ALIGN), ptr);
+  ASSERT_EQ(dp_malloc(&allocator, 2 * DEFAULT_ALIGN + 1), ptr);
+  ASSERT_EQ(allocator.class_count[2], 0u);
+  ASSERT_EQ(allocator.class_cache[2], DP_CACHE_END);
+}
+
+TEST_F(DPSizeClassTest, InlineFreeFeedsTheCache) {
+  void *ptr = dp_malloc_inline(&allocator, DEFAULT_ALIGN);
+  ASSERT_EQ(dp_free_inline(&allocator, ptr), 0);
+  ASSERT_EQ(allocator.class_count[0], 1u);
+  ASSERT_EQ(dp_malloc_inline(&allocator, 1), ptr);
+  ASSERT_EQ(dp_free_inline(&allocator, ptr), 0);
+}
+
+TEST_F(DPSizeClassTest, DoubleFreeOfACachedBlockFails) {
+  void *ptr = dp_malloc(&allocator, DEFAULT_ALIGN);
+  ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  ASSERT_EQ(dp_free(&allocator, ptr), 1);
+  ASSERT_EQ(dp_free_inline(&allocator, ptr), 1);
+  ASSERT_EQ(allocator.class_count[0], 1u);
+}
+
+TEST_F(DPSizeClassTest, LargeBlocksBypassTheCache) {
+  void *ptr = dp_malloc(&allocator, DP_SIZE_CLASSES * DEFAULT_ALIGN + 1);
+  ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  ASSERT_EQ(allocator.available, initial_available);
+  ASSERT_EQ(dp_flush_cache(&allocator), 0u);
+}
+
+TEST_F(DPSizeClassTest, DepthBoundsEachClass) {
+  std::vector<void *> ptrs;
+  for (size_t i = 0; i <= dp_config_class_cache_depth; i++) {
+    ptrs.push_back(dp_malloc(&allocator, DEFAULT_ALIGN));
+    ASSERT_NE(ptrs.back(), nullptr);
+  }
+  for (void *ptr : ptrs) {
+    ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  }
+  ASSERT_EQ(allocator.class_count[0], dp_config_class_cache_depth);
+  ASSERT_EQ(dp_flush_cache(&allocator), dp_config_class_cache_depth);
+  ASSERT_EQ(allocator.available, initial_available);
+}
+
+TEST_F(DPSizeClassTest, ExhaustionFlushesTheCache) {
+  std::vector<void *> ptrs;
+  while (void *ptr = dp_malloc(&allocator, 2 * DEFAULT_ALIGN)) {
+    ptrs.push_back(ptr);
+  }
+  for (void *ptr : ptrs) {
+    ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  }
+  ASSERT_GT(allocator.class_count[1], 0u);
+  ASSERT_LT(allocator.available, initial_available);
+
+  // Only fits once the cached blocks are back in the heap and coalesced.
+  ASSERT_NE(dp_malloc(&allocator, initial_available - DEFAULT_ALIGN), nullptr);
+  ASSERT_EQ(allocator.class_count[1], 0u);
+}
+
+TEST_F(DPSizeClassTest, CheckCatchesACorruptedCache) {
+  void *ptr = dp_malloc(&allocator, DEFAULT_ALIGN);
+  ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  allocator.class_count[0]++;
+  ASSERT_EQ(dp_check(&allocator), 1);
+  allocator.class_count[0]--;
+}
+
+TEST_F(DPSizeClassTest, PushRejectsPointersPastTheBuffer) {
+  // One live block fills the heap, the bytes in front of the buffer's end are its user bytes.
+  auto *last = static_cast<uint8_t *>(
+      dp_malloc(&allocator, dp_largest_free(&allocator) - 2 * DEFAULT_ALIGN));
+  ASSERT_NE(last, nullptr);
+  uint8_t *end = allocator.buffer + allocator.buffer_size;
+  ASSERT_GE(last + dp_usable_size(&allocator, last), end);
+
+  // They look like the header and offset byte of a cacheable block whose user pointer is the
+  // end of the buffer, a huge block mapped right after the buffer would start there.
+  block_header fake = {};
+  fake.size = DEFAULT_ALIGN + DP_CLASS_USER_OFFSET - sizeof(block_header);
+  std::memcpy(end - DP_CLASS_USER_OFFSET, &fake, sizeof(fake));
+  end[-1] = static_cast<uint8_t>(DP_CLASS_USER_OFFSET - sizeof(block_header));
+  // The test builds validate every free out of line, so the push is called directly.
+  ASSERT_FALSE(dp_class_push(&allocator, end));
+  ASSERT_EQ(allocator.cached_blocks, 0u);
+  ASSERT_EQ(dp_free(&allocator, last), 0);
+}
+#endif
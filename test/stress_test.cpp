@@ -76,8 +76,7 @@ TEST_F(DPAllocatorTest, DeterministicRandomAllocFreeStress) {
     ASSERT_EQ(dp_free(&allocator, p), 0);
   }
 
-  ASSERT_NE(allocator.free_list_head, nullptr);
-  EXPECT_EQ(allocator.free_list_head->next, nullptr) << "All blocks should coalesce after cleanup";
+  EXPECT_TRUE(fully_coalesced()) << "All blocks should coalesce after cleanup";
 }
 
 // Explicit fragmentation and coalescing under near-full memory pressure
@@ -97,6 +96,7 @@ TEST_F(DPAllocatorTest, FragmentationAndCoalescingUnderPressure) {
   for (size_t i = 0; i < ptrs.size(); i += 2) {
     ASSERT_EQ(dp_free(&allocator, ptrs[i]), 0) << "Free (even index) failed";
   }
+  dp_flush_cache(&allocator); // the holes are free blocks, not cached ones.
 
 #if DP_STATS
   float frag_fragmented = dp_get_fragmentation(&allocator);
@@ -107,9 +107,7 @@ TEST_F(DPAllocatorTest, FragmentationAndCoalescingUnderPressure) {
     ASSERT_EQ(dp_free(&allocator, ptrs[i]), 0) << "Free (odd index) failed";
   }
 
-  ASSERT_NE(allocator.free_list_head, nullptr);
-  EXPECT_TRUE(allocator.free_list_head->is_free);
-  EXPECT_EQ(allocator.free_list_head->next, nullptr) << "Expected a single coalesced free block";
+  EXPECT_TRUE(fully_coalesced()) << "Expected a single coalesced free block";
 
 #if DP_STATS
   float frag_final = dp_get_fragmentation(&allocator);
@@ -146,9 +144,7 @@ TEST_F(DPAllocatorTest, LargeAndSmallInterleavedUnderPressure) {
     ASSERT_EQ(dp_free(&allocator, smalls[i]), 0);
   }
 
-  ASSERT_NE(allocator.free_list_head, nullptr);
-  EXPECT_EQ(allocator.free_list_head->next, nullptr)
-      << "All blocks should coalesce after full cleanup";
+  EXPECT_TRUE(fully_coalesced()) << "All blocks should coalesce after full cleanup";
 
 #if DP_STATS
   float frag = dp_get_fragmentation(&allocator);
@@ -156,7 +152,9 @@ TEST_F(DPAllocatorTest, LargeAndSmallInterleavedUnderPressure) {
 #endif
 }
 
-// Best-fit traversal complexity under fragmentation
+// Best-fit traversal complexity under fragmentation, the probes walk the free list and the
+// size class caches serve the request without one.
+#if !DP_FREE_INDEX && !DP_OUT_OF_LINE_METADATA
 TEST_F(DPAllocatorTest, Complexity) {
   const int N = 20;
   std::vector<void *> ptrs;
@@ -183,11 +181,12 @@ TEST_F(DPAllocatorTest, Complexity) {
   ASSERT_NE(p, nullptr);
   allocated.push_back({p, 9});
 
-#if DP_STATS
+#if DP_STATS && !DP_SIZE_CLASSES
   test_info("Complexity check: N=%d, iterations=%zu\n", N / 2, allocator.num_iterations);
   ASSERT_GE(allocator.num_iterations, N / 2);
 #endif
 }
+#endif
 
 // Rapid fill and drain cycles
 TEST_F(DPAllocatorTest, RapidFillDrainCycles) {
@@ -209,9 +208,8 @@ TEST_F(DPAllocatorTest, RapidFillDrainCycles) {
       ASSERT_EQ(dp_free(&allocator, p), 0) << "Free failed in cycle " << cycle;
     }
 
-    ASSERT_NE(allocator.free_list_head, nullptr);
-    EXPECT_EQ(allocator.free_list_head->next, nullptr)
-        << "Free list should have single block after drain in cycle " << cycle;
+    EXPECT_TRUE(fully_coalesced())
+        << "Heap should be a single free block after drain in cycle " << cycle;
   }
 }
 
@@ -233,8 +231,7 @@ TEST_F(DPAllocatorTest, ReverseOrderFreePattern) {
     ASSERT_EQ(dp_free(&allocator, *it), 0);
   }
 
-  ASSERT_NE(allocator.free_list_head, nullptr);
-  EXPECT_EQ(allocator.free_list_head->next, nullptr) << "All blocks should coalesce into one";
+  EXPECT_TRUE(fully_coalesced()) << "All blocks should coalesce into one";
 
 #if DP_STATS
   float frag = dp_get_fragmentation(&allocator);
@@ -269,8 +266,7 @@ TEST_F(DPAllocatorTest, MixedSizeStress) {
     ASSERT_EQ(dp_free(&allocator, p), 0);
   }
 
-  ASSERT_NE(allocator.free_list_head, nullptr);
-  EXPECT_EQ(allocator.free_list_head->next, nullptr);
+  EXPECT_TRUE(fully_coalesced());
 }
 
 // Boundary allocation sizes
@@ -284,6 +280,5 @@ TEST_F(DPAllocatorTest, BoundaryAllocationSizes) {
     }
   }
 
-  EXPECT_EQ(allocator.free_list_head->next, nullptr)
-      << "Should be single free block after all boundary tests";
+  EXPECT_TRUE(fully_coalesced()) << "Should be single free block after all boundary tests";
 }
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <bit>
 #include <cstdarg>
 #include <cstddef>
 #include <cstdint>
@@ -11,12 +13,44 @@
 #include "allocator.h"
 #include "config_macros.h"
 
-static constexpr size_t DEFAULT_ALIGN = alignof(max_align_t);
+static constexpr size_t DEFAULT_ALIGN = DP_ALIGNMENT ? DP_ALIGNMENT : alignof(max_align_t);
 
-static inline size_t align_up(size_t value, size_t alignment) {
+static constexpr size_t align_up(size_t value, size_t alignment) {
   return (value + (alignment - 1)) & ~(alignment - 1);
 }
 
+// Smallest request past every size class, freeing it returns the block to the heap.
+static constexpr size_t UNCACHED_SIZE = DP_SIZE_CLASSES * DEFAULT_ALIGN + 1;
+
+// Skips the running test if requests of size bytes are mapped outside the buffer, see
+// DP_HUGE_THRESHOLD.
+#define SKIP_PAST_HUGE_THRESHOLD(size)                                                             \
+  if (DP_HUGE_THRESHOLD != 0 && (size) > DP_HUGE_THRESHOLD)                                        \
+  GTEST_SKIP() << "requests of " << (size) << " bytes bypass the buffer"
+
+// size, or the largest request the buffer serves if that is smaller, larger requests are mapped
+// outside it (DP_HUGE_THRESHOLD).
+static constexpr size_t in_buffer_size(size_t size) {
+  return DP_HUGE_THRESHOLD != 0 && size > DP_HUGE_THRESHOLD ? DP_HUGE_THRESHOLD : size;
+}
+
+// Block size for tests that lay out the heap by hand: past the size classes, even halved, so
+// frees go back to the heap, and served from the buffer. Larger regions are adjacent blocks.
+static constexpr size_t LAYOUT_BLOCK =
+    in_buffer_size(std::max<size_t>(4 * 1024, 2 * align_up(UNCACHED_SIZE, 1024)));
+
+// Allocates blocks of piece bytes until they cover size bytes, adjacent when carved from the
+// same free block. Tests lay out regions past DP_HUGE_THRESHOLD with them, freeing every piece
+// leaves a single free block.
+inline std::vector<void *> malloc_pieces(dp_alloc *allocator, size_t size, size_t piece) {
+  std::vector<void *> pieces;
+  for (size_t covered = 0; covered < size; covered += piece) {
+    pieces.push_back(dp_malloc(allocator, piece));
+    EXPECT_NE(pieces.back(), nullptr);
+  }
+  return pieces;
+}
+
 inline void test_debug(const char *fmt, ...) {
   printf("DEBUG: ");
   va_list args;
@@ -104,6 +138,40 @@ protected:
     }
   }
 
+  // Free blocks in the heap, once the blocks cached by DP_SIZE_CLASSES are flushed.
+  size_t free_blocks() {
+    dp_flush_cache(&allocator);
+    size_t count = 0;
+#if DP_FREE_INDEX
+    count = allocator.index_count;
+#elif DP_OUT_OF_LINE_METADATA
+    for (size_t i = 0; i < allocator.free_starts.words[0]; i++) {
+      count += std::popcount(allocator.free_starts.levels[0][i]);
+    }
+#else
+    for (block_header *block = allocator.free_list_head; block != nullptr; block = block->next) {
+      count++;
+    }
+#endif
+    return count;
+  }
+
+  // Whether every free byte is back in a single free block, once the blocks cached by
+  // DP_SIZE_CLASSES are flushed.
+  bool fully_coalesced() {
+    return free_blocks() == 1 && dp_check(&allocator) == 0 &&
+           dp_largest_free(&allocator) == allocator.available;
+  }
+
+  // Allocates the largest block the heap has room for, whatever its metadata costs.
+  void *malloc_largest() {
+    void *ptr = nullptr;
+    for (size_t size = allocator.available; ptr == nullptr && size > 0; size--) {
+      ptr = dp_malloc(&allocator, size);
+    }
+    return ptr;
+  }
+
   void checked_free(void *ptr) {
     auto erased = std::erase_if(allocated, [&](auto allocation) { return allocation.ptr == ptr; });
     ASSERT_GT(erased, 0);
@@ -121,5 +189,27 @@ protected:
       ASSERT_EQ(dp_free(&allocator, allocation.ptr), 0);
     }
     allocated.clear();
+    ASSERT_EQ(dp_check(&allocator), 0);
+  }
+};
+
+// An allocator over a buffer of its own, checked after every test. The feature tests derive
+// from it, sizing the buffer for what they allocate.
+template <size_t BufferSize> class DPHeapFixture : public ::testing::Test {
+protected:
+  static constexpr size_t BUFFER_SIZE = BufferSize;
+  alignas(max_align_t) std::array<uint8_t, BUFFER_SIZE> buffer;
+  dp_alloc allocator;
+  size_t initial_available;
+
+  void SetUp() override {
+    ASSERT_TRUE(dp_init(&allocator, buffer.data(),
+                        BUFFER_SIZE IF_DP_LOG(, {.debug = test_debug,
+                                                 .info = test_info,
+                                                 .warning = test_warning,
+                                                 .error = test_error})));
+    initial_available = allocator.available;
   }
+
+  void TearDown() override { ASSERT_EQ(dp_check(&allocator), 0); }
 };
@@ -0,0 +1,151 @@
+#include <random>
+
+#include "bitmap.h"
+#include "test_common.hpp"
+#include "tree.h"
+
+// Tests for the segment tree first fit engine. Its placements must match the bitmap
+// engine's, which finds the same lowest fitting run with a linear scan.
+
+static constexpr size_t GRANULE = 64;
+
+class DPTreeTest : public ::testing::Test {
+protected:
+  static constexpr size_t BUFFER_SIZE = 256 * 1024;
+  alignas(max_align_t) std::array<uint8_t, BUFFER_SIZE> buffer;
+  dp_tree tree;
+
+  void SetUp() override { ASSERT_TRUE(init(tree, buffer.data(), BUFFER_SIZE)); }
+
+  void TearDown() override { ASSERT_EQ(dp_tree_check(&tree), 0); }
+
+  static bool init(dp_tree &target, uint8_t *data, size_t size) {
+    return dp_tree_init(&target, data, size,
+                        GRANULE IF_DP_LOG(, {.debug = test_debug,
+                                             .info = test_info,
+                                             .warning = test_warning,
+                                             .error = test_error}));
+  }
+};
+
+TEST_F(DPTreeTest, LayoutFitsBuffer) {
+  ASSERT_GT(tree.granules, 0u);
+  ASSERT_EQ(tree.available, tree.granules);
+  ASSERT_GE(tree.leaves, tree.words);
+  ASSERT_EQ(tree.leaves & (tree.leaves - 1), 0u);
+  ASSERT_GE(reinterpret_cast<uint8_t *>(tree.occupied), buffer.data());
+  ASSERT_GE(tree.data, reinterpret_cast<uint8_t *>(tree.nodes + 2 * tree.leaves));
+  ASSERT_LE(tree.data + tree.granules * GRANULE, buffer.data() + BUFFER_SIZE);
+  ASSERT_EQ(dp_tree_largest_free(&tree), tree.granules * GRANULE);
+}
+
+TEST_F(DPTreeTest, RejectsBadGranules) {
+  dp_tree other;
+  ASSERT_FALSE(dp_tree_init(&other, buffer.data(), BUFFER_SIZE, 48 IF_DP_LOG(, tree.logger)));
+  ASSERT_FALSE(dp_tree_init(&other, buffer.data(), BUFFER_SIZE, 4 IF_DP_LOG(, tree.logger)));
+  ASSERT_FALSE(dp_tree_init(&other, nullptr, BUFFER_SIZE, 64 IF_DP_LOG(, tree.logger)));
+  ASSERT_FALSE(init(other, buffer.data(), 8));
+}
+
+TEST_F(DPTreeTest, PicksTheLowestFitNotTheBest) {
+  // Holes of 4, 1 and 2 granules, each followed by a live block.
+  std::vector<void *> holes;
+  std::vector<void *> live;
+  for (size_t granules : {4, 1, 2}) {
+    holes.push_back(dp_tree_malloc(&tree, granules * GRANULE));
+    live.push_back(dp_tree_malloc(&tree, GRANULE));
+  }
+  for (void *hole : holes) {
+    ASSERT_EQ(dp_tree_free(&tree, hole), 0);
+  }
+
+  ASSERT_EQ(dp_tree_malloc(&tree, 2 * GRANULE), holes[0]);
+  ASSERT_EQ(dp_tree_malloc(&tree, GRANULE), static_cast<uint8_t *>(holes[0]) + 2 * GRANULE);
+  ASSERT_EQ(dp_tree_malloc(&tree, 2 * GRANULE), holes[2]);
+}
+
+TEST_F(DPTreeTest, RunsCrossLeavesAndSubtrees) {
+  // 60 granules, then a run spanning 3 leaves, freed and merged with the 60 in front.
+  void *head = dp_tree_malloc(&tree, 60 * GRANULE);
+  void *run = dp_tree_malloc(&tree, 130 * GRANULE);
+  void *tail = dp_tree_malloc(&tree, GRANULE);
+  ASSERT_EQ(static_cast<uint8_t *>(run), static_cast<uint8_t *>(head) + 60 * GRANULE);
+  ASSERT_EQ(dp_tree_check(&tree), 0);
+
+  ASSERT_EQ(dp_tree_free(&tree, head), 0);
+  ASSERT_EQ(dp_tree_free(&tree, run), 0);
+  ASSERT_EQ(dp_tree_malloc(&tree, 190 * GRANULE), head);
+  ASSERT_EQ(dp_tree_free(&tree, tail), 0);
+}
+
+TEST_F(DPTreeTest, LargestFreeTracksTheLongestRun) {
+  void *a = dp_tree_malloc(&tree, 10 * GRANULE);
+  void *b = dp_tree_malloc(&tree, tree.available * GRANULE - 10 * GRANULE);
+  void *c = dp_tree_malloc(&tree, 10 * GRANULE);
+  ASSERT_NE(c, nullptr);
+  ASSERT_EQ(dp_tree_largest_free(&tree), 0u);
+
+  ASSERT_EQ(dp_tree_free(&tree, a), 0);
+  ASSERT_EQ(dp_tree_largest_free(&tree), 10 * GRANULE);
+  ASSERT_EQ(dp_tree_malloc(&tree, 11 * GRANULE), nullptr);
+  ASSERT_EQ(dp_tree_free(&tree, b), 0);
+  ASSERT_EQ(dp_tree_largest_free(&tree), tree.available * GRANULE);
+}
+
+TEST_F(DPTreeTest, ExhaustAndRefill) {
+  std::vector<void *> ptrs;
+  while (void *ptr = dp_tree_malloc(&tree, GRANULE)) {
+    ptrs.push_back(ptr);
+  }
+  ASSERT_EQ(ptrs.size(), tree.granules);
+  ASSERT_EQ(tree.available, 0u);
+
+  for (void *ptr : ptrs) {
+    ASSERT_EQ(dp_tree_free(&tree, ptr), 0);
+  }
+  ASSERT_NE(dp_tree_malloc(&tree, tree.granules * GRANULE), nullptr);
+}
+
+TEST_F(DPTreeTest, InvalidFrees) {
+  auto *ptr = static_cast<uint8_t *>(dp_tree_malloc(&tree, 3 * GRANULE));
+  ASSERT_NE(ptr, nullptr);
+
+  ASSERT_EQ(dp_tree_free(&tree, nullptr), 1);
+  ASSERT_EQ(dp_tree_free(&tree, ptr + 1), 1);
+  ASSERT_EQ(dp_tree_free(&tree, ptr + GRANULE), 1);     // inside the allocation.
+  ASSERT_EQ(dp_tree_free(&tree, ptr + 8 * GRANULE), 1); // never allocated.
+  ASSERT_EQ(dp_tree_free(&tree, buffer.data()), 1);     // the side table.
+  ASSERT_EQ(dp_tree_free(&tree, ptr), 0);
+  ASSERT_EQ(dp_tree_free(&tree, ptr), 1); // double free.
+}
+
+TEST_F(DPTreeTest, MatchesBitmapFirstFit) {
+  alignas(max_align_t) std::array<uint8_t, BUFFER_SIZE> reference_buffer;
+  dp_bitmap reference;
+  ASSERT_TRUE(dp_bitmap_init(&reference, reference_buffer.data(), BUFFER_SIZE,
+                             GRANULE IF_DP_LOG(, tree.logger)));
+
+  // The heaps differ in size, live blocks are capped to a quarter of the smaller one so
+  // both engines always find their fit in the part they share.
+  size_t live_limit = std::min(tree.granules, reference.granules) / 4;
+  std::mt19937 rng(1234);
+  std::uniform_int_distribution<size_t> size_dist(1, 64 * GRANULE);
+  std::vector<size_t> live; // granule offsets, identical in both engines.
+  for (size_t i = 0; i < 5000; i++) {
+    if (live.empty() || (rng() % 3 != 0 && tree.granules - tree.available < live_limit)) {
+      size_t size = size_dist(rng);
+      auto *ptr = static_cast<uint8_t *>(dp_tree_malloc(&tree, size));
+      auto *expected = static_cast<uint8_t *>(dp_bitmap_malloc(&reference, size));
+      ASSERT_NE(ptr, nullptr);
+      ASSERT_NE(expected, nullptr);
+      ASSERT_EQ(ptr - tree.data, expected - reference.data) << "after operation " << i;
+      live.push_back(static_cast<size_t>(ptr - tree.data));
+    } else {
+      size_t idx = rng() % live.size();
+      ASSERT_EQ(dp_tree_free(&tree, tree.data + live[idx]), 0);
+      ASSERT_EQ(dp_bitmap_free(&reference, reference.data + live[idx]), 0);
+      live.erase(live.begin() + static_cast<long>(idx));
+    }
+    ASSERT_EQ(dp_tree_check(&tree), 0) << "after operation " << i;
+  }
+}
@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "pages.h"
+#include "test_common.hpp"
+
+// Tests for dp_trim and DP_TRIM_THRESHOLD. The heap lives on its own pages so residency
+// can be read with mincore, lazily trimmed pages (DP_TRIM_LAZY) stay resident until the
+// system reclaims them so those builds don't check it. Blocks span dozens of pages, builds
+// that map requests that large outside the buffer (DP_HUGE_THRESHOLD) lay them out as adjacent
+// pieces of at most DP_HUGE_THRESHOLD bytes.
+
+class DPTrimTest : public ::testing::Test {
+protected:
+  static constexpr size_t HEAP_SIZE = 4 * 1024 * 1024;
+  static constexpr size_t BLOCK_SIZE = 256 * 1024;
+  static constexpr size_t PIECE_SIZE = in_buffer_size(BLOCK_SIZE);
+  dp_alloc allocator;
+  dp_pages pages;
+  size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+  void SetUp() override {
+    ASSERT_TRUE(dp_init_pages(&allocator, &pages, HEAP_SIZE, DP_PAGES_SMALL,
+                              nullptr IF_DP_LOG(, {.debug = test_debug,
+                                                   .info = test_info,
+                                                   .warning = test_warning,
+                                                   .error = test_error})));
+  }
+
+  void TearDown() override { dp_pages_unmap(&pages); }
+
+  // Resident pages among those holding size bytes at data.
+  size_t resident_pages(const void *data, size_t size) {
+    uintptr_t start = reinterpret_cast<uintptr_t>(data) & ~(page - 1);
+    size_t length = reinterpret_cast<uintptr_t>(data) + size - start;
+    std::vector<unsigned char> flags((length + page - 1) / page);
+    EXPECT_EQ(mincore(reinterpret_cast<void *>(start), length, flags.data()), 0);
+    size_t resident = 0;
+    for (unsigned char flag : flags) {
+      resident += flag & 1;
+    }
+    return resident;
+  }
+
+  // Allocates blocks between live separators and frees the blocks, leaving count free blocks
+  // of about BLOCK_SIZE that can't coalesce.
+  std::vector<void *> free_between_separators(size_t count) {
+    std::vector<void *> blocks;
+    std::vector<void *> separators;
+    std::vector<void *> pieces;
+    for (size_t i = 0; i < count; i++) {
+      std::vector<void *> block = malloc_pieces(&allocator, BLOCK_SIZE, PIECE_SIZE);
+      separators.push_back(dp_malloc(&allocator, 64));
+      EXPECT_NE(separators.back(), nullptr);
+      for (void *piece : block) {
+        std::memset(piece, 0xAB, PIECE_SIZE);
+      }
+      blocks.push_back(block.front());
+      pieces.insert(pieces.end(), block.begin(), block.end());
+    }
+    for (void *piece : pieces) {
+      EXPECT_EQ(dp_free(&allocator, piece), 0);
+    }
+    return blocks;
+  }
+};
+
+TEST_F(DPTrimTest, ReturnsFreePages) {
+  std::vector<void *> blocks = free_between_separators(4);
+  size_t released = dp_trim(&allocator, 0);
+  // Every free block gives back all but the pages its edges share with live blocks.
+  ASSERT_GE(released, 4 * (BLOCK_SIZE - 2 * page));
+  ASSERT_LE(released, allocator.available);
+  ASSERT_EQ(dp_check(&allocator), 0);
+#if !DP_TRIM_LAZY
+  for (void *block : blocks) {
+    ASSERT_LE(resident_pages(block, BLOCK_SIZE), 2u);
+  }
+#endif
+
+  // Trimmed blocks are reused like any other, their pages fault back in zeroed.
+  for (size_t i = 0; i < blocks.size(); i++) {
+    for (void *piece : malloc_pieces(&allocator, BLOCK_SIZE, PIECE_SIZE)) {
+      auto *bytes = static_cast<uint8_t *>(piece);
+      ASSERT_NE(bytes, nullptr);
+      std::memset(bytes, static_cast<int>(i), PIECE_SIZE);
+      ASSERT_EQ(bytes[PIECE_SIZE / 2], static_cast<uint8_t>(i));
+    }
+  }
+  ASSERT_EQ(dp_check(&allocator), 0);
+}
+
+TEST_F(DPTrimTest, KeepsRequestedBytesCommitted) {
+  free_between_separators(4);
+  // The tail of the heap is free too, keeping every free byte trims nothing.
+  ASSERT_EQ(dp_trim(&allocator, allocator.available), 0u);
+  size_t released = dp_trim(&allocator, 2 * BLOCK_SIZE + page);
+  ASSERT_GT(released, 0u);
+  ASSERT_LE(released, allocator.available - 2 * BLOCK_SIZE);
+  ASSERT_EQ(dp_check(&allocator), 0);
+}
+
+TEST_F(DPTrimTest, SkipsTrimmedBlocks) {
+  free_between_separators(4);
+  ASSERT_GT(dp_trim(&allocator, 0), 0u);
+  ASSERT_EQ(dp_trim(&allocator, 0), 0u);
+
+  // A block carved out of a trimmed one leaves the rest trimmed, a free that merges into a
+  // trimmed block makes it committed again.
+  size_t size = std::min(BLOCK_SIZE / 2, PIECE_SIZE);
+  void *ptr = dp_malloc(&allocator, size);
+  ASSERT_NE(ptr, nullptr);
+  ASSERT_EQ(dp_trim(&allocator, 0), 0u);
+  std::memset(ptr, 1, size);
+  ASSERT_EQ(dp_free(&allocator, ptr), 0);
+#if !DP_TRIM_THRESHOLD
+  ASSERT_GT(dp_trim(&allocator, 0), 0u);
+#endif
+  ASSERT_EQ(dp_check(&allocator), 0);
+}
+
+#if DP_TRIM_THRESHOLD
+TEST_F(DPTrimTest, TrimsLargeFreesAutomatically) {
+  size_t size = DP_TRIM_THRESHOLD + 4 * page;
+  size_t piece_size = in_buffer_size(size);
+  std::vector<void *> pieces = malloc_pieces(&allocator, size, piece_size);
+  void *separator = dp_malloc(&allocator, 64);
+  ASSERT_NE(separator, nullptr);
+  for (void *piece : pieces) {
+    std::memset(piece, 1, piece_size);
+  }
+  for (void *piece : pieces) {
+    ASSERT_EQ(dp_free(&allocator, piece), 0);
+  }
+#if !DP_TRIM_LAZY
+  ASSERT_LE(resident_pages(pieces.front(), size), 2u);
+#endif
+  ASSERT_EQ(dp_check(&allocator), 0);
+}
+
+TEST_F(DPTrimTest, FreesNextToTrimmedBlocksStayTrimmed) {
+  ASSERT_GT(dp_trim(&allocator, 0), 0u);
+  std::vector<void *> pieces = malloc_pieces(&allocator, BLOCK_SIZE, PIECE_SIZE);
+  void *separator = dp_malloc(&allocator, 64);
+  ASSERT_NE(separator, nullptr);
+  for (void *piece : pieces) {
+    std::memset(piece, 1, PIECE_SIZE);
+  }
+  std::memset(separator, 1, 64);
+
+  // Each free merges into free blocks that are already trimmed, the merged block is trimmed
+  // by the free and left alone by dp_trim.
+  for (void *piece : pieces) {
+    ASSERT_EQ(dp_free(&allocator, piece), 0);
+  }
+  ASSERT_EQ(dp_trim(&allocator, 0), 0u);
+  ASSERT_EQ(dp_free(&allocator, separator), 0);
+  ASSERT_EQ(dp_trim(&allocator, 0), 0u);
+#if !DP_TRIM_LAZY
+  ASSERT_LE(resident_pages(pieces.front(), BLOCK_SIZE), 2u);
+#endif
+  ASSERT_EQ(dp_check(&allocator), 0);
+}
+
+TEST_F(DPTrimTest, FreesNextToTrimmedBlocksDecommitOnlyTheirPages) {
+  size_t size = in_buffer_size(4 * page);
+  auto *ptr = static_cast<uint8_t *>(dp_malloc(&allocator, size));
+  ASSERT_NE(ptr, nullptr);
+  std::memset(ptr, 1, size);
+  ASSERT_GT(dp_trim(&allocator, 0), 0u);
+
+  // A page touched inside the trimmed block on the right is committed again, decommitting the
+  // whole merged block would drop it.
+  uint8_t *touched = ptr + size + BLOCK_SIZE;
+  *touched = 0x5A;
+  ASSERT_EQ(dp_free(&allocator, ptr), 0);
+#if !DP_TRIM_LAZY
+  ASSERT_EQ(*touched, 0x5A);
+  ASSERT_EQ(resident_pages(touched, 1), 1u);
+  // Only the page holding the merged block's header stays.
+  ASSERT_LE(resident_pages(ptr, size), 1u);
+#endif
+  ASSERT_EQ(dp_check(&allocator), 0);
+}
+#endif
+
+TEST(DPTrimArgsTest, RejectsNullAllocator) { ASSERT_EQ(dp_trim(nullptr, 0), 0u); }
@@ -0,0 +1,126 @@
+#include "test_common.hpp"
+
+// Tests for the heap validation tiers: header canaries checked by dp_free, the amortized
+// slice checked by every call and the full dp_check audit. Tests that corrupt a header or the
+// free list only run against the engines that keep them.
+
+#if !DP_OUT_OF_LINE_METADATA
+static block_header *header_of(void *ptr) {
+  uint8_t offset = *(static_cast<uint8_t *>(ptr) - 1);
+  return reinterpret_cast<block_header *>(static_cast<uint8_t *>(ptr) - offset -
+                                          sizeof(block_header));
+}
+#endif
+
+TEST_F(DPAllocatorTest, CheckPassesOnFreshHeap) { ASSERT_EQ(dp_check(&allocator), 0); }
+
+TEST_F(DPAllocatorTest, CheckPassesAfterMixedOperations) {
+  void *ptrs[6];
+  for (size_t i = 0; i < 6; i++) {
+    checked_alloc(16 + i * 8, &ptrs[i]);
+    ASSERT_EQ(dp_check(&allocator), 0);
+  }
+  checked_free(ptrs[1]);
+  checked_free(ptrs[3]);
+  ASSERT_EQ(dp_check(&allocator), 0);
+  checked_free(ptrs[2]); // coalesces with both neighbours.
+  ASSERT_EQ(dp_check(&allocator), 0);
+}
+
+TEST_F(DPAllocatorTest, CheckNullAllocator) { ASSERT_EQ(dp_check(nullptr), 1); }
+
+#if !DP_OUT_OF_LINE_METADATA
+TEST_F(DPAllocatorTest, CheckDetectsCorruptedSize) {
+  void *a, *b;
+  checked_alloc(32, &a);
+  checked_alloc(32, &b);
+
+  block_header *header = header_of(a);
+  header->size += DEFAULT_ALIGN;
+  ASSERT_EQ(dp_check(&allocator), 1);
+  header->size -= DEFAULT_ALIGN;
+  ASSERT_EQ(dp_check(&allocator), 0);
+}
+#endif
+
+TEST_F(DPAllocatorTest, CheckDetectsAvailableMismatch) {
+  checked_alloc(32);
+
+  allocator.available += 1;
+  ASSERT_EQ(dp_check(&allocator), 1);
+  allocator.available -= 1;
+  ASSERT_EQ(dp_check(&allocator), 0);
+}
+
+#if !DP_FREE_INDEX && !DP_OUT_OF_LINE_METADATA
+TEST_F(DPAllocatorTest, CheckDetectsFreeListCycle) {
+  void *a, *b, *c;
+  checked_alloc(32, &a);
+  checked_alloc(32, &b);
+  checked_alloc(32, &c);
+  checked_free(a);
+
+  // The free list is now a followed by the tail of the buffer.
+  block_header *last = allocator.free_list_head;
+  while (last->next != NULL)
+    last = last->next;
+  last->next = allocator.free_list_head;
+  ASSERT_EQ(dp_check(&allocator), 1);
+  last->next = NULL;
+  ASSERT_EQ(dp_check(&allocator), 0);
+}
+
+TEST_F(DPAllocatorTest, CheckDetectsUnlistedFreeBlock) {
+  void *a, *b;
+  checked_alloc(32, &a);
+  checked_alloc(32, &b);
+  checked_free(a);
+
+  block_header *head = allocator.free_list_head;
+  allocator.free_list_head = head->next;
+  ASSERT_EQ(dp_check(&allocator), 1);
+  allocator.free_list_head = head;
+  ASSERT_EQ(dp_check(&allocator), 0);
+}
+#endif
+
+#if DP_HEADER_CANARY && !DP_OUT_OF_LINE_METADATA
+TEST_F(DPAllocatorTest, FreeRejectsCorruptedHeader) {
+  void *a;
+  checked_alloc(32, &a);
+
+  block_header *header = header_of(a);
+  header->size ^= DEFAULT_ALIGN;
+  ASSERT_EQ(dp_free(&allocator, a), 1);
+  ASSERT_EQ(dp_check(&allocator), 1);
+  header->size ^= DEFAULT_ALIGN;
+  ASSERT_EQ(dp_check(&allocator), 0);
+}
+#endif
+
+#if DP_HEADER_CANARY && DP_CHECK_SLICE && !DP_OUT_OF_LINE_METADATA
+TEST_F(DPAllocatorTest, SliceDetectsCorruptionWithinAFewCalls) {
+  void *a, *b, *c;
+  checked_alloc(32, &a);
+  checked_alloc(32, &b);
+  checked_alloc(32, &c);
+
+  // Every block is visited within blocks / DP_CHECK_SLICE calls.
+  block_header *header = header_of(b);
+  header->canary ^= 1;
+  std::vector<void *> extra;
+  void *ptr = nullptr;
+  for (size_t i = 0; i < 8; i++) {
+    ptr = dp_malloc(&allocator, 8);
+    if (ptr == nullptr)
+      break;
+    extra.push_back(ptr);
+  }
+  ASSERT_EQ(ptr, nullptr);
+  header->canary ^= 1;
+
+  for (void *extra_ptr : extra) {
+    ASSERT_EQ(dp_free(&allocator, extra_ptr), 0);
+  }
+}
+#endif
@@ -0,0 +1,181 @@
+#include <vector>
+
+#include "test_common.hpp"
+
+// Tests for dp_largest_free and the memory pressure watermarks (DP_WATERMARKS). The
+// watermark tests only run in builds with them enabled.
+
+class DPWatermarkTest : public DPHeapFixture<16 * LAYOUT_BLOCK> {
+protected:
+  static constexpr size_t BLOCK_SIZE = LAYOUT_BLOCK;
+};
+
+TEST_F(DPWatermarkTest, LargestFreeFindsTheLargestBlock) {
+  ASSERT_EQ(dp_largest_free(&allocator), allocator.available);
+  void *small = dp_malloc(&allocator, BLOCK_SIZE);
+  void *separator = dp_malloc(&allocator, 64);
+  std::vector<void *> large = malloc_pieces(&allocator, 4 * BLOCK_SIZE, BLOCK_SIZE);
+  ASSERT_NE(small, nullptr);
+  ASSERT_NE(separator, nullptr);
+  size_t tail = dp_largest_free(&allocator);
+  ASSERT_EQ(tail, allocator.available);
+
+  ASSERT_EQ(dp_free(&allocator, small), 0);
+  ASSERT_EQ(dp_largest_free(&allocator), tail);
+  ASSERT_GT(allocator.available, tail);
+  // The large block merges with the tail, the small one stays apart.
+  for (void *ptr : large) {
+    ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  }
+  ASSERT_GE(dp_largest_free(&allocator), tail + 4 * BLOCK_SIZE);
+  ASSERT_LT(dp_largest_free(&allocator), allocator.available);
+  ASSERT_EQ(dp_free(&allocator, separator), 0);
+  dp_flush_cache(&allocator); // the separator is small enough for a size class.
+  ASSERT_EQ(dp_largest_free(&allocator), allocator.available);
+  ASSERT_EQ(dp_largest_free(nullptr), 0u);
+}
+
+#if DP_WATERMARKS
+struct WatermarkEvent {
+  dp_watermark watermark;
+  bool pressure;
+  size_t value;
+};
+
+static void record(dp_alloc *, dp_watermark watermark, bool pressure, size_t value,
+                   void *context) {
+  static_cast<std::vector<WatermarkEvent> *>(context)->push_back({watermark, pressure, value});
+}
+
+TEST_F(DPWatermarkTest, AvailableFiresOncePerCrossing) {
+  std::vector<WatermarkEvent> events;
+  size_t low = allocator.available / 2;
+  size_t high = allocator.available * 3 / 4;
+  ASSERT_TRUE(dp_set_watermark(&allocator, DP_WATERMARK_AVAILABLE, low, high, record, &events));
+  ASSERT_TRUE(events.empty());
+
+  // Falling through low fires once, falling further doesn't fire again.
+  std::vector<void *> blocks;
+  while (void *ptr = dp_malloc(&allocator, BLOCK_SIZE)) {
+    blocks.push_back(ptr);
+    ASSERT_EQ(events.size(), allocator.available < low ? 1u : 0u);
+  }
+  ASSERT_EQ(events.size(), 1u);
+  ASSERT_EQ(events[0].watermark, DP_WATERMARK_AVAILABLE);
+  ASSERT_TRUE(events[0].pressure);
+  ASSERT_LT(events[0].value, low);
+
+  // Climbing back past low isn't enough, relief waits for high.
+  bool relieved = false;
+  for (void *ptr : blocks) {
+    ASSERT_EQ(dp_free(&allocator, ptr), 0);
+    relieved = relieved || allocator.available >= high;
+    ASSERT_EQ(events.size(), relieved ? 2u : 1u);
+  }
+  ASSERT_FALSE(events[1].pressure);
+  ASSERT_GE(events[1].value, high);
+}
+
+TEST_F(DPWatermarkTest, LargestFiresOnlyWhenTheLargestBlockDrops) {
+  std::vector<WatermarkEvent> events;
+  // The buffer in blocks, the first five free as a hole in front of a live separator and the
+  // rest free as the tail.
+  std::vector<void *> blocks;
+  while (void *ptr = dp_malloc(&allocator, BLOCK_SIZE)) {
+    blocks.push_back(ptr);
+  }
+  ASSERT_GE(blocks.size(), 14u);
+  void *separator = blocks[5];
+  for (void *ptr : blocks) {
+    if (ptr != separator) {
+      ASSERT_EQ(dp_free(&allocator, ptr), 0);
+    }
+  }
+  ASSERT_TRUE(dp_set_watermark(&allocator, DP_WATERMARK_LARGEST, 4 * BLOCK_SIZE,
+                               8 * BLOCK_SIZE, record, &events));
+
+  // Carving the tail under low leaves the hole, the largest block is still above low. Short
+  // lived blocks come out of the tail, the highest free block.
+  std::vector<void *> tail;
+  for (size_t i = 8; i < blocks.size(); i++) {
+    tail.push_back(dp_malloc_hint(&allocator, BLOCK_SIZE, DP_LIFETIME_SHORT));
+    ASSERT_NE(tail.back(), nullptr);
+  }
+  ASSERT_TRUE(events.empty());
+  ASSERT_EQ(allocator.largest_free, dp_largest_free(&allocator));
+
+  // Carving the hole too leaves nothing above low, long lived blocks come out of the hole.
+  std::vector<void *> carved;
+  for (int i = 0; i < 2; i++) {
+    carved.push_back(dp_malloc_hint(&allocator, BLOCK_SIZE, DP_LIFETIME_LONG));
+    ASSERT_NE(carved.back(), nullptr);
+  }
+  ASSERT_EQ(events.size(), 1u);
+  ASSERT_EQ(events[0].watermark, DP_WATERMARK_LARGEST);
+  ASSERT_TRUE(events[0].pressure);
+  ASSERT_EQ(events[0].value, dp_largest_free(&allocator));
+
+  // Freeing the tail makes it the largest again.
+  for (void *ptr : tail) {
+    ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  }
+  ASSERT_EQ(events.size(), 2u);
+  ASSERT_FALSE(events[1].pressure);
+  ASSERT_GE(events[1].value, 8 * BLOCK_SIZE);
+  for (void *ptr : carved) {
+    ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  }
+  ASSERT_EQ(dp_free(&allocator, separator), 0);
+  ASSERT_EQ(events.size(), 2u);
+}
+
+TEST_F(DPWatermarkTest, FiresRightAwayWhenAlreadyBelow) {
+  std::vector<WatermarkEvent> events;
+  ASSERT_FALSE(dp_set_watermark(&allocator, DP_WATERMARK_AVAILABLE, 2, 1, record, &events));
+  ASSERT_FALSE(dp_set_watermark(nullptr, DP_WATERMARK_AVAILABLE, 1, 2, record, &events));
+  ASSERT_TRUE(dp_set_watermark(&allocator, DP_WATERMARK_AVAILABLE, BUFFER_SIZE, BUFFER_SIZE,
+                               record, &events));
+  ASSERT_EQ(events.size(), 1u);
+  ASSERT_TRUE(events[0].pressure);
+
+  // Zero watermarks stop watching.
+  ASSERT_TRUE(dp_set_watermark(&allocator, DP_WATERMARK_AVAILABLE, 0, 0, record, &events));
+  void *ptr = dp_malloc(&allocator, BLOCK_SIZE);
+  ASSERT_NE(ptr, nullptr);
+  ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  ASSERT_EQ(events.size(), 1u);
+}
+
+// Sheds the reserve blocks under pressure, the allocator can be used from the callback.
+struct Reserve {
+  std::vector<void *> blocks;
+  size_t sheds;
+};
+
+static void shed(dp_alloc *allocator, dp_watermark, bool pressure, size_t, void *context) {
+  auto *reserve = static_cast<Reserve *>(context);
+  if (pressure && !reserve->blocks.empty()) {
+    for (void *block : reserve->blocks) {
+      dp_free(allocator, block);
+    }
+    reserve->blocks.clear();
+    reserve->sheds++;
+  }
+}
+
+TEST_F(DPWatermarkTest, CallbacksMayFreeBlocks) {
+  Reserve reserve = {malloc_pieces(&allocator, 4 * BLOCK_SIZE, BLOCK_SIZE), 0};
+  ASSERT_TRUE(dp_set_watermark(&allocator, DP_WATERMARK_AVAILABLE, 2 * BLOCK_SIZE,
+                               6 * BLOCK_SIZE, shed, &reserve));
+  std::vector<void *> blocks;
+  while (void *ptr = dp_malloc(&allocator, BLOCK_SIZE)) {
+    blocks.push_back(ptr);
+  }
+  ASSERT_EQ(reserve.sheds, 1u);
+  ASSERT_EQ(dp_check(&allocator), 0);
+  for (void *ptr : blocks) {
+    ASSERT_EQ(dp_free(&allocator, ptr), 0);
+  }
+  ASSERT_EQ(dp_largest_free(&allocator), allocator.available);
+}
+#endif